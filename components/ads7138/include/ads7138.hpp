@@ -9,6 +9,102 @@
 
 #include "logger.hpp"
 
+namespace espp {
+/// @brief Possible channel numbers
+/// @details The ADS7138 has 8 channels, see data sheet Table 1 (p. 4)
+/// @note The channel numbers are 0-indexed.
+/// @note The channel may be configured as digital input, digital output, or
+///       analog input.
+/// @note Declared outside Ads7138 (use Ads7138::Channel) so that its
+///       formatter is visible to the class's log calls.
+enum class Ads7138Channel : uint8_t {
+  CH0 = 0, ///< Channel 0
+  CH1 = 1, ///< Channel 1
+  CH2 = 2, ///< Channel 2
+  CH3 = 3, ///< Channel 3
+  CH4 = 4, ///< Channel 4
+  CH5 = 5, ///< Channel 5
+  CH6 = 6, ///< Channel 6
+  CH7 = 7, ///< Channel 7
+};
+
+/// \brief Enum for the data format that can be read from the ADC
+/// @note Declared outside Ads7138 (use Ads7138::DataFormat) for the same
+///       reason as Ads7138Channel.
+enum class Ads7138DataFormat : uint8_t {
+  RAW = 0,      ///< Raw data format, 12 bit ADC data
+  AVERAGED = 1, ///< Averaged data format, 16 bit ADC data
+};
+} // namespace espp
+
+#include "format.hpp"
+
+// for allowing easy serialization/printing of the
+// espp::Ads7138Channel enum
+template <> struct fmt::formatter<espp::Ads7138Channel> {
+  template <typename ParseContext> constexpr auto parse(ParseContext &ctx) { return ctx.begin(); }
+
+  template <typename FormatContext>
+  auto format(espp::Ads7138Channel const &ch, FormatContext &ctx) {
+    switch (ch) {
+    case espp::Ads7138Channel::CH0:
+      return format_to(ctx.out(), "CH0");
+    case espp::Ads7138Channel::CH1:
+      return format_to(ctx.out(), "CH1");
+    case espp::Ads7138Channel::CH2:
+      return format_to(ctx.out(), "CH2");
+    case espp::Ads7138Channel::CH3:
+      return format_to(ctx.out(), "CH3");
+    case espp::Ads7138Channel::CH4:
+      return format_to(ctx.out(), "CH4");
+    case espp::Ads7138Channel::CH5:
+      return format_to(ctx.out(), "CH5");
+    case espp::Ads7138Channel::CH6:
+      return format_to(ctx.out(), "CH6");
+    case espp::Ads7138Channel::CH7:
+      return format_to(ctx.out(), "CH7");
+    default:
+      return format_to(ctx.out(), "UNKNOWN");
+    }
+  }
+};
+
+// for allowing easy serialization/printing of a
+// std::vector<espp::Ads7138Channel> object
+template <> struct fmt::formatter<std::vector<espp::Ads7138Channel>> {
+  template <typename ParseContext> constexpr auto parse(ParseContext &ctx) { return ctx.begin(); }
+
+  template <typename FormatContext>
+  auto format(std::vector<espp::Ads7138Channel> const &channels, FormatContext &ctx) {
+    std::string result = "{";
+    for (auto const &ch : channels) {
+      result += fmt::format("{}, ", ch);
+    }
+    if (result.size() > 1)
+      result.resize(result.size() - 2); // remove trailing ", "
+    result += "}";
+    return format_to(ctx.out(), "{}", result);
+  }
+};
+
+// for allowing easy serialization/printing of the
+// espp::Ads7138DataFormat enum
+template <> struct fmt::formatter<espp::Ads7138DataFormat> {
+  template <typename ParseContext> constexpr auto parse(ParseContext &ctx) { return ctx.begin(); }
+
+  template <typename FormatContext>
+  auto format(espp::Ads7138DataFormat const &format, FormatContext &ctx) {
+    switch (format) {
+    case espp::Ads7138DataFormat::RAW:
+      return format_to(ctx.out(), "RAW");
+    case espp::Ads7138DataFormat::AVERAGED:
+      return format_to(ctx.out(), "AVERAGED");
+    default:
+      return format_to(ctx.out(), "UNKNOWN");
+    }
+  }
+};
+
 namespace espp {
 /**
  * @brief Class for reading values from the ADS7138 family of ADC chips.
@@ -58,21 +154,8 @@ public:
     OSR_128 = 7 ///< 128x oversampling
   };
 
-  /// @brief Possible channel numbers
-  /// @details The ADS7138 has 8 channels, see data sheet Table 1 (p. 4)
-  /// @note The channel numbers are 0-indexed.
-  /// @note The channel may be configured as digital input, digital output, or
-  ///       analog input.
-  enum class Channel : uint8_t {
-    CH0 = 0, ///< Channel 0
-    CH1 = 1, ///< Channel 1
-    CH2 = 2, ///< Channel 2
-    CH3 = 3, ///< Channel 3
-    CH4 = 4, ///< Channel 4
-    CH5 = 5, ///< Channel 5
-    CH6 = 6, ///< Channel 6
-    CH7 = 7, ///< Channel 7
-  };
+  typedef Ads7138Channel Channel;       ///< Possible channel numbers
+  typedef Ads7138DataFormat DataFormat; ///< Data format that can be read from the ADC
 
   /// @brief Possible modes for analog input conversion
   ///
@@ -121,12 +204,6 @@ public:
     PUSH_PULL = 1,  ///< Push-pull output mode
   };
 
-  /// \brief Enum for the data format that can be read from the ADC
-  enum class DataFormat : uint8_t {
-    RAW = 0,      ///< Raw data format, 12 bit ADC data
-    AVERAGED = 1, ///< Averaged data format, 16 bit ADC data
-  };
-
   /// \brief Enum for the different configurations of bits that can be
   ///        appended to the data when reading from the ADC
   enum class Append : uint8_t {
@@ -293,7 +370,8 @@ public:
     std::lock_guard<std::recursive_mutex> lock(mutex_);
     // if it's a digital output channel, we can't set thresholds
     if (!is_analog_input(channel)) {
-      logger_.error("Channel {} is configured as a digital output, cannot set alert", channel);
+      logger_.error("Channel {} is configured as a digital output, cannot set alert",
+                    channel);
       return;
     }
     // alert flags for this channel assert the ALERT pin
@@ -313,7 +391,9 @@ public:
     std::lock_guard<std::recursive_mutex> lock(mutex_);
     // if it's not a digital input channel we can't set a digital alert
     if (!is_digital_input(channel)) {
-      logger_.error("Channel {} is not configured as a digital input, cannot set alert", channel);
+      logger_.error(
+          "Channel {} is not configured as a digital input, cannot set alert",
+          channel);
       return;
     }
     // alert flags for this channel assert the ALERT pin
@@ -801,8 +881,8 @@ protected:
   }
 
   void set_pin_configuration() {
-    logger_.info("Setting digital mode for outputs {} and inputs {}", digital_outputs_,
-                 digital_inputs_);
+    logger_.info("Setting digital mode for outputs {} and inputs {}",
+                 digital_outputs_, digital_inputs_);
     uint8_t data = 0;
     for (auto channel : digital_inputs_) {
       data |= 1 << static_cast<uint8_t>(channel);
@@ -1221,8 +1301,8 @@ protected:
       logger_.error("Invalid event count: {}, valid values: 0-15", event_count);
       return;
     }
-    logger_.info("Configuring event for channel {} with low threshold {} mV, high threshold {} mV, "
-                 "and event count {}",
+    logger_.info("Configuring event for channel {} with low threshold {} mV, "
+                 "high threshold {} mV, and event count {}",
                  ch, low_threshold_mv, high_threshold_mv, event_count);
     int channel = static_cast<int>(ch);
     // convert the thresholds to raw values
@@ -1331,8 +1411,6 @@ protected:
 };
 } // namespace espp
 
-#include "format.hpp"
-
 // for allowing easy serialization/printing of the
 // espp::Ads7138::OverSamplingRatio enum
 template <> struct fmt::formatter<espp::Ads7138::OversamplingRatio> {
@@ -1383,24 +1461,6 @@ template <> struct fmt::formatter<espp::Ads7138::Mode> {
   }
 };
 
-// for allowing easy serialization/printing of the
-// espp::Ads7138::DataFormat enum
-template <> struct fmt::formatter<espp::Ads7138::DataFormat> {
-  template <typename ParseContext> constexpr auto parse(ParseContext &ctx) { return ctx.begin(); }
-
-  template <typename FormatContext>
-  auto format(espp::Ads7138::DataFormat const &format, FormatContext &ctx) {
-    switch (format) {
-    case espp::Ads7138::DataFormat::RAW:
-      return format_to(ctx.out(), "RAW");
-    case espp::Ads7138::DataFormat::AVERAGED:
-      return format_to(ctx.out(), "AVERAGED");
-    default:
-      return format_to(ctx.out(), "UNKNOWN");
-    }
-  }
-};
-
 // for allowing easy serialization/printing of the
 // espp::Ads7138::Append enum
 template <> struct fmt::formatter<espp::Ads7138::Append> {
@@ -1421,50 +1481,3 @@ template <> struct fmt::formatter<espp::Ads7138::Append> {
   }
 };
 
-// for allowing easy serialization/printing of the
-// espp::Ads7138::Channel enum
-template <> struct fmt::formatter<espp::Ads7138::Channel> {
-  template <typename ParseContext> constexpr auto parse(ParseContext &ctx) { return ctx.begin(); }
-
-  template <typename FormatContext>
-  auto format(espp::Ads7138::Channel const &ch, FormatContext &ctx) {
-    switch (ch) {
-    case espp::Ads7138::Channel::CH0:
-      return format_to(ctx.out(), "CH0");
-    case espp::Ads7138::Channel::CH1:
-      return format_to(ctx.out(), "CH1");
-    case espp::Ads7138::Channel::CH2:
-      return format_to(ctx.out(), "CH2");
-    case espp::Ads7138::Channel::CH3:
-      return format_to(ctx.out(), "CH3");
-    case espp::Ads7138::Channel::CH4:
-      return format_to(ctx.out(), "CH4");
-    case espp::Ads7138::Channel::CH5:
-      return format_to(ctx.out(), "CH5");
-    case espp::Ads7138::Channel::CH6:
-      return format_to(ctx.out(), "CH6");
-    case espp::Ads7138::Channel::CH7:
-      return format_to(ctx.out(), "CH7");
-    default:
-      return format_to(ctx.out(), "UNKNOWN");
-    }
-  }
-};
-
-// for allowing easy serialization/printing of a
-// std::vector<espp::Ads7138::Channel> object
-template <> struct fmt::formatter<std::vector<espp::Ads7138::Channel>> {
-  template <typename ParseContext> constexpr auto parse(ParseContext &ctx) { return ctx.begin(); }
-
-  template <typename FormatContext>
-  auto format(std::vector<espp::Ads7138::Channel> const &channels, FormatContext &ctx) {
-    std::string result = "{";
-    for (auto const &ch : channels) {
-      result += fmt::format("{}, ", ch);
-    }
-    if (result.size() > 1)
-      result.resize(result.size() - 2); // remove trailing ", "
-    result += "}";
-    return format_to(ctx.out(), "{}", result);
-  }
-};
@@ -1,13 +1,35 @@
+#include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 #include <thread>
 #include <vector>
 
+#include <esp_heap_caps.h>
+
 #include "event_manager.hpp"
 #include "logger.hpp"
 #include "serialization.hpp"
 
 using namespace std::chrono_literals;
 
+// count the heap allocations made by the process so that the benchmark below
+// can report allocations per event
+static std::atomic<size_t> num_allocations{0};
+
+void *operator new(size_t size) {
+  num_allocations++;
+  void *ptr = std::malloc(size);
+  if (!ptr) {
+    std::abort();
+  }
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
 extern "C" void app_main(void) {
   espp::Logger logger({.tag = "main", .level = espp::Logger::Verbosity::INFO});
   logger.info("Starting event manager example!");
@@ -146,6 +168,188 @@ extern "C" void app_main(void) {
   em.remove_subscriber(event1, "task 2");
   //! [event manager example]
 
+  logger.info("Starting event manager typed example!");
+  //! [event manager typed example]
+  {
+    // for in-process communication, events can be passed as objects instead
+    // of bytes. Declaring the topic with its type (normally in a header shared
+    // by the publishers and subscribers) lets the compiler check that they all
+    // agree on the type, and the events are moved through the queue without
+    // being serialized.
+    static const espp::EventManager::TypedTopic<BatteryState> battery_topic{"battery/typed"};
+    auto &em = espp::EventManager::get();
+    em.add_subscriber(battery_topic, "typed subscriber", [](const BatteryState &bs) {
+      fmt::print("Typed subscriber got battery state: {:.2f} V, {:.2f} %\n", bs.voltage,
+                 bs.state_of_charge);
+    });
+    BatteryState bs;
+    for (int i = 0; i < 3; i++) {
+      bs.voltage -= 0.1f;
+      bs.state_of_charge -= 5.0f;
+      em.publish(battery_topic, bs);
+    }
+    // NOTE: this would not compile, since battery_topic carries BatteryState:
+    //   em.publish(battery_topic, std::string("not a battery state"));
+    std::this_thread::sleep_for(100ms);
+    em.remove_subscriber(battery_topic.name, "typed subscriber");
+  }
+  //! [event manager typed example]
+
+  logger.info("Starting event manager bounded queue example!");
+  //! [event manager bounded queue example]
+  {
+    auto &em = espp::EventManager::get();
+    const std::string topic = "sensor/slow";
+    // keep at most 4 events queued for this topic, dropping the oldest ones
+    // if the subscriber can't keep up
+    em.configure_topic(topic, {.queue_capacity = 4,
+                               .overflow_policy = espp::EventManager::OverflowPolicy::DROP_OLDEST});
+    em.add_subscriber(topic, "slow subscriber", [](const std::vector<uint8_t> &data) {
+      // simulate a slow subscriber
+      std::this_thread::sleep_for(10ms);
+    });
+    std::vector<uint8_t> data(16);
+    for (int i = 0; i < 100; i++) {
+      em.publish(topic, data);
+      std::this_thread::sleep_for(1ms);
+    }
+    // let the subscriber drain the queue
+    std::this_thread::sleep_for(100ms);
+    auto stats = em.get_topic_stats(topic);
+    fmt::print("Topic '{}': enqueued {}, dropped {}, high water mark {}, max callback latency "
+               "{:.3f} ms\n",
+               topic, stats.enqueued, stats.dropped, stats.high_water_mark,
+               stats.max_callback_latency.count() * 1e3f);
+    em.remove_subscriber(topic, "slow subscriber");
+  }
+  //! [event manager bounded queue example]
+
+  logger.info("Starting event manager benchmark!");
+  //! [event manager benchmark]
+  {
+    static constexpr size_t num_events = 100000;
+    static constexpr size_t event_size = 64;
+    std::vector<uint8_t> event(event_size, 0xA5);
+
+    // run the benchmark on a topic, returning {events/s, allocations/event}
+    auto run_benchmark = [&](const std::string &topic, bool use_view_subscriber,
+                             bool use_topic_handle) {
+      std::atomic<size_t> num_received{0};
+      auto &em = espp::EventManager::get();
+      if (use_view_subscriber) {
+        em.add_view_subscriber(topic, "benchmark",
+                               [&](std::span<const uint8_t> data) { num_received++; });
+      } else {
+        em.add_subscriber(topic, "benchmark",
+                          [&](const std::vector<uint8_t> &data) { num_received++; });
+      }
+      // publishing through a topic handle skips the topic string lookup
+      auto handle = em.get_topic_handle(topic);
+      auto publish = [&]() {
+        return use_topic_handle ? em.publish(handle, event)
+                                : em.publish(topic, std::span<const uint8_t>(event));
+      };
+      auto start = std::chrono::high_resolution_clock::now();
+      size_t start_allocations = num_allocations;
+      for (size_t i = 0; i < num_events; i++) {
+        // if the topic's buffer ring is full, wait for the subscriber to
+        // catch up
+        while (!publish()) {
+          std::this_thread::yield();
+        }
+      }
+      while (num_received < num_events) {
+        std::this_thread::yield();
+      }
+      size_t allocations = num_allocations - start_allocations;
+      auto end = std::chrono::high_resolution_clock::now();
+      em.remove_subscriber(topic, "benchmark");
+      float elapsed = std::chrono::duration<float>(end - start).count();
+      return std::make_pair(num_events / elapsed, (float)allocations / num_events);
+    };
+
+    // default topic: each event is copied into a newly allocated vector
+    auto [copy_rate, copy_allocs] = run_benchmark("benchmark/copy", false, false);
+    // pooled topic: each event is copied into a preallocated buffer and
+    // subscribers receive a view of it
+    espp::EventManager::get().configure_topic(
+        "benchmark/pooled", {.buffer_count = 32, .buffer_size_bytes = event_size});
+    auto [pool_rate, pool_allocs] = run_benchmark("benchmark/pooled", true, false);
+    // pooled topic, published through its TopicHandle
+    auto [handle_rate, handle_allocs] = run_benchmark("benchmark/pooled", true, true);
+
+    fmt::print("Published {} events of {} bytes:\n"
+               "  copy:   {:10.0f} events/s, {:.3f} allocations/event\n"
+               "  pooled: {:10.0f} events/s, {:.3f} allocations/event\n"
+               "  handle: {:10.0f} events/s, {:.3f} allocations/event\n",
+               num_events, event_size, copy_rate, copy_allocs, pool_rate, pool_allocs,
+               handle_rate, handle_allocs);
+  }
+  //! [event manager benchmark]
+
+  logger.info("Starting event manager dispatch benchmark!");
+  //! [event manager dispatch benchmark]
+  {
+    static constexpr size_t num_topics = 40;
+    static constexpr size_t num_rounds = 200;
+    auto &em = espp::EventManager::get();
+
+    // publish the current time on each topic and measure how long it takes
+    // for the subscriber callbacks to be called, as well as how much memory
+    // the subscribers use
+    auto run_benchmark = [&](const espp::EventManager::DispatchConfig &config) {
+      em.set_dispatch_config(config);
+      std::atomic<size_t> num_received{0};
+      std::atomic<uint64_t> total_latency_ns{0};
+      std::atomic<uint64_t> max_latency_ns{0};
+      auto callback = [&](std::span<const uint8_t> data) {
+        auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        int64_t published;
+        memcpy(&published, data.data(), sizeof(published));
+        uint64_t latency = now - published;
+        total_latency_ns += latency;
+        uint64_t prev_max = max_latency_ns;
+        while (latency > prev_max && !max_latency_ns.compare_exchange_weak(prev_max, latency)) {
+        }
+        num_received++;
+      };
+      size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+      for (size_t i = 0; i < num_topics; i++) {
+        em.add_view_subscriber(fmt::format("dispatch/{}", i), "benchmark", callback);
+      }
+      size_t free_after = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+      for (size_t round = 0; round < num_rounds; round++) {
+        for (size_t i = 0; i < num_topics; i++) {
+          auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+          std::vector<uint8_t> data(sizeof(now));
+          memcpy(data.data(), &now, sizeof(now));
+          em.publish(fmt::format("dispatch/{}", i), data);
+        }
+        std::this_thread::sleep_for(1ms);
+      }
+      while (num_received < num_topics * num_rounds) {
+        std::this_thread::sleep_for(1ms);
+      }
+      for (size_t i = 0; i < num_topics; i++) {
+        em.remove_subscriber(fmt::format("dispatch/{}", i), "benchmark");
+      }
+      fmt::print("  {:<14}: avg latency {:8.1f} us, max latency {:8.1f} us, memory used {} B\n",
+                 config.mode == espp::EventManager::DispatchMode::WORKER_POOL ? "worker pool"
+                                                                               : "task per topic",
+                 total_latency_ns / 1e3f / num_received, max_latency_ns / 1e3f,
+                 free_before - free_after);
+    };
+
+    fmt::print("Dispatching {} rounds of events on {} topics:\n", num_rounds, num_topics);
+    run_benchmark({.mode = espp::EventManager::DispatchMode::TASK_PER_TOPIC});
+    run_benchmark({.mode = espp::EventManager::DispatchMode::WORKER_POOL,
+                   .num_workers = 2,
+                   .stack_size_bytes = 8 * 1024});
+    // go back to the default dispatch mode
+    em.set_dispatch_config({.mode = espp::EventManager::DispatchMode::TASK_PER_TOPIC});
+  }
+  //! [event manager dispatch benchmark]
+
   logger.info("Event manager example complete!");
 
   while (true) {
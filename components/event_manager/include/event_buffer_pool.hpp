@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace espp {
+/**
+ * @brief Fixed-slot ring of preallocated event buffers. All storage for the
+ *        ring is allocated once at construction, so pushing and popping
+ *        events performs no heap allocation. Popped events are returned as
+ *        reference-counted Handle objects which keep their slot from being
+ *        overwritten until every copy of the handle has been destroyed.
+ *
+ * @note push() / pop() are not internally synchronized - the caller (e.g. the
+ *       EventManager) must serialize access to them. Handles may be copied
+ *       and destroyed from any thread.
+ */
+class EventBufferPool {
+public:
+  /**
+   * @brief Reference-counted view of a single buffer within the pool.
+   */
+  class Handle {
+  public:
+    Handle() = default;
+
+    Handle(const Handle &other) : pool_(other.pool_), slot_(other.slot_) { acquire(); }
+
+    Handle(Handle &&other) noexcept : pool_(other.pool_), slot_(other.slot_) {
+      other.pool_ = nullptr;
+    }
+
+    Handle &operator=(const Handle &other) {
+      if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        slot_ = other.slot_;
+        acquire();
+      }
+      return *this;
+    }
+
+    Handle &operator=(Handle &&other) noexcept {
+      if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        slot_ = other.slot_;
+        other.pool_ = nullptr;
+      }
+      return *this;
+    }
+
+    ~Handle() { release(); }
+
+    /**
+     * @brief Whether or not this handle refers to a buffer.
+     */
+    explicit operator bool() const { return pool_ != nullptr; }
+
+    /**
+     * @brief Pointer to the data held by the buffer.
+     * @return Pointer to the first byte of the buffer, or nullptr if the
+     *         handle is empty.
+     */
+    const uint8_t *data() const { return pool_ ? pool_->slot_data(slot_) : nullptr; }
+
+    /**
+     * @brief Number of valid bytes in the buffer.
+     * @return Number of bytes that were published into the buffer.
+     */
+    size_t size() const { return pool_ ? pool_->slots_[slot_].size : 0; }
+
+    /**
+     * @brief View of the valid bytes in the buffer.
+     * @return std::span over the published bytes.
+     */
+    std::span<const uint8_t> span() const { return {data(), size()}; }
+
+  protected:
+    friend class EventBufferPool;
+
+    Handle(EventBufferPool *pool, size_t slot) : pool_(pool), slot_(slot) { acquire(); }
+
+    void acquire() {
+      if (pool_)
+        pool_->slots_[slot_].refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() {
+      if (pool_)
+        pool_->slots_[slot_].refs.fetch_sub(1, std::memory_order_release);
+      pool_ = nullptr;
+    }
+
+    EventBufferPool *pool_{nullptr};
+    size_t slot_{0};
+  };
+
+  /**
+   * @brief Construct the pool, allocating all of its storage.
+   * @param num_buffers Number of buffers (slots) in the ring.
+   * @param buffer_size Maximum number of bytes each buffer can hold.
+   */
+  EventBufferPool(size_t num_buffers, size_t buffer_size)
+      : num_buffers_(num_buffers), buffer_size_(buffer_size),
+        storage_(std::make_unique<uint8_t[]>(num_buffers * buffer_size)),
+        slots_(std::make_unique<Slot[]>(num_buffers)) {}
+
+  EventBufferPool(const EventBufferPool &) = delete;
+  EventBufferPool &operator=(const EventBufferPool &) = delete;
+
+  /**
+   * @brief Copy \p data into the next free buffer at the back of the ring.
+   * @param data Data to copy into the pool.
+   * @return True if the data was stored, false if it was larger than the
+   *         buffer size or the ring has no free buffer (all slots are either
+   *         queued or still referenced by a Handle).
+   */
+  bool push(std::span<const uint8_t> data) {
+    if (data.size() > buffer_size_ || count_ == num_buffers_) {
+      return false;
+    }
+    auto &slot = slots_[head_];
+    if (slot.refs.load(std::memory_order_acquire) != 0) {
+      // a subscriber still holds a handle to this buffer
+      return false;
+    }
+    std::memcpy(slot_data(head_), data.data(), data.size());
+    slot.size = data.size();
+    head_ = (head_ + 1) % num_buffers_;
+    count_++;
+    return true;
+  }
+
+  /**
+   * @brief Remove the oldest buffer from the front of the ring.
+   * @return Handle to the oldest buffer, or an empty Handle if the ring is
+   *         empty. The buffer will not be reused until the returned handle
+   *         (and any copies of it) have been destroyed.
+   */
+  Handle pop() {
+    if (count_ == 0) {
+      return {};
+    }
+    Handle handle(this, tail_);
+    tail_ = (tail_ + 1) % num_buffers_;
+    count_--;
+    return handle;
+  }
+
+  /**
+   * @brief Remove all queued buffers from the ring.
+   */
+  void clear() {
+    // NOTE: the next push still goes to head_, since the buffers before it
+    // may be referenced by handles that were popped earlier
+    tail_ = head_;
+    count_ = 0;
+  }
+
+  /**
+   * @brief Whether the next push() will fail because there is no free buffer.
+   * @return True if all buffers are queued, or if the next buffer in the ring
+   *         is still referenced by a Handle.
+   */
+  bool full() const { return count_ == num_buffers_ || next_in_use(); }
+
+  /**
+   * @brief Whether the buffer the next push() would use is still referenced
+   *        by a Handle. Popping queued buffers does not free it.
+   * @return True if the next buffer in the ring is referenced by a Handle.
+   */
+  bool next_in_use() const { return slots_[head_].refs.load(std::memory_order_acquire) != 0; }
+
+  /**
+   * @brief Number of buffers currently queued in the ring.
+   */
+  size_t size() const { return count_; }
+
+  /**
+   * @brief Whether the ring has no queued buffers.
+   */
+  bool empty() const { return count_ == 0; }
+
+  /**
+   * @brief Total number of buffers in the ring.
+   */
+  size_t capacity() const { return num_buffers_; }
+
+  /**
+   * @brief Maximum number of bytes each buffer can hold.
+   */
+  size_t buffer_size() const { return buffer_size_; }
+
+protected:
+  struct Slot {
+    std::atomic<uint32_t> refs{0};
+    size_t size{0};
+  };
+
+  uint8_t *slot_data(size_t slot) const { return storage_.get() + slot * buffer_size_; }
+
+  size_t num_buffers_;
+  size_t buffer_size_;
+  std::unique_ptr<uint8_t[]> storage_;
+  std::unique_ptr<Slot[]> slots_;
+  size_t head_{0};
+  size_t tail_{0};
+  size_t count_{0};
+};
+} // namespace espp
@@ -1,14 +1,19 @@
 #pragma once
 
+#include <chrono>
 #include <deque>
 #include <mutex>
+#include <span>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
+#include "event_buffer_pool.hpp"
 #include "event_map.hpp"
 #include "logger.hpp"
 #include "task.hpp"
+#include "typed_event_queue.hpp"
 
 namespace espp {
 /**
@@ -31,6 +36,23 @@ namespace espp {
  *       and then deserialize your data from string in the subscriber
  *       callbacks.
  *
+ * @note By default each topic runs its own subscriber Task. With many topics,
+ *       set_dispatch_config() can be used to instead dispatch all topics from
+ *       a small, shared pool of worker tasks. Events within a topic are still
+ *       delivered in order and never concurrently, but different topics may
+ *       be dispatched in parallel.
+ *
+ * @note For in-process communication, a topic can instead be declared as a
+ *       TypedTopic<T>. Objects of type T are then moved through the topic's
+ *       queue without any serialization, and the compiler checks that
+ *       publishers and subscribers of the TypedTopic agree on T.
+ *
+ * @note For high-rate topics, configure_topic() can be used to give a topic a
+ *       preallocated ring of event buffers. Publishing on such a topic copies
+ *       the data into the next free buffer (no heap allocation) and
+ *       subscribers registered with add_view_subscriber() receive a
+ *       std::span view of that buffer instead of a copy.
+ *
  * \section event_manager_ex1 Event Manager Example
  * \snippet event_manager_example.cpp event manager example
  */
@@ -43,6 +65,101 @@ public:
    */
   typedef std::function<void(const std::vector<uint8_t> &)> event_callback_fn;
 
+  /**
+   * @brief Function definition for function prototypes to be called when
+   *        subscription/event data is available, receiving a view of the
+   *        data rather than a copy.
+   * @param std::span<const uint8_t> View of the data associated with the
+   *        event. Only valid for the duration of the callback.
+   */
+  typedef std::function<void(std::span<const uint8_t>)> event_view_callback_fn;
+
+  /**
+   * @brief How subscriber callbacks are run, see set_dispatch_config().
+   */
+  enum class DispatchMode {
+    TASK_PER_TOPIC, /**< Each topic has its own subscriber Task (default). */
+    WORKER_POOL,    /**< All topics are dispatched from a shared pool of worker tasks. */
+  };
+
+  /**
+   * @brief Configuration for how subscriber callbacks are dispatched.
+   */
+  struct DispatchConfig {
+    DispatchMode mode{DispatchMode::TASK_PER_TOPIC}; /**< Dispatch mode to use. */
+    size_t num_workers{2}; /**< Number of worker tasks, used if mode is WORKER_POOL. */
+    size_t stack_size_bytes{8 * 1024}; /**< Stack size of each worker task, used if mode is
+                                          WORKER_POOL. */
+  };
+
+  /**
+   * @brief Handle to an interned topic, see get_topic_handle(). Publishing
+   *        through a handle avoids hashing the topic string and taking the
+   *        EventManager's global lock.
+   */
+  struct TopicHandle {
+    uint32_t id{UINT32_MAX}; /**< Dense id of the topic. */
+
+    /**
+     * @brief Whether the handle refers to a topic.
+     */
+    bool valid() const { return id != UINT32_MAX; }
+  };
+
+  /**
+   * @brief Topic whose events are objects of type \p T, rather than bytes.
+   * @details Declare the topic once (e.g. in a header shared by the
+   *          publishers and subscribers) and use it with the typed
+   *          add_subscriber() and publish() overloads, so that using the
+   *          wrong event type is a compile-time error.
+   * @tparam T Type of the events on the topic. Must be move constructible.
+   */
+  template <typename T> struct TypedTopic {
+    std::string name; /**< Name of the topic. */
+  };
+
+  /**
+   * @brief What to do when publishing on a topic whose queue is full.
+   */
+  enum class OverflowPolicy {
+    DROP_NEWEST, /**< Drop the event being published (publish returns false). */
+    DROP_OLDEST, /**< Drop the oldest queued event to make room for the new one. */
+    BLOCK,       /**< Block the publisher until there is room or the block_timeout expires. */
+    COALESCE_LATEST, /**< Replace any queued events with the new one, so subscribers only
+                        ever see the latest event. */
+  };
+
+  /**
+   * @brief Per-topic configuration, see configure_topic().
+   */
+  struct TopicConfig {
+    size_t buffer_count{0}; /**< Number of preallocated event buffers in the topic's ring. If 0,
+                               the topic uses the default (allocating) queue. */
+    size_t buffer_size_bytes{0}; /**< Maximum size of an event published on the topic when
+                                    buffer_count > 0. */
+    size_t queue_capacity{0}; /**< Maximum number of queued events. If 0, the queue is unbounded.
+                                 @note Topics with buffer_count > 0 are always bounded by
+                                 buffer_count. */
+    OverflowPolicy overflow_policy{
+        OverflowPolicy::DROP_NEWEST}; /**< What to do when the topic's queue is full. */
+    std::chrono::duration<float> block_timeout{
+        0}; /**< Maximum time to block the publisher for, used if overflow_policy is BLOCK. */
+  };
+
+  /**
+   * @brief Counters for a topic, see get_topic_stats().
+   */
+  struct TopicStats {
+    size_t enqueued{0};        /**< Number of events that were queued. */
+    size_t dropped{0};         /**< Number of events that were dropped (or coalesced). */
+    size_t rejected_in_use{0}; /**< Number of events on a pooled topic that were rejected
+                                    because the buffer they needed was still being
+                                    delivered to a subscriber. */
+    size_t high_water_mark{0}; /**< Largest number of events that have been queued at once. */
+    std::chrono::duration<float> max_callback_latency{
+        0}; /**< Longest time taken to run the topic's callbacks for a single event. */
+  };
+
   /**
    * @brief Get the singleton instance of the EventManager.
    * @return A reference to the EventManager singleton.
@@ -82,6 +199,78 @@ public:
   bool add_subscriber(const std::string &topic, const std::string &component,
                       const event_callback_fn &callback, const size_t stack_size_bytes = 8 * 1024);
 
+  /**
+   * @brief Register a subscriber for \p component on \p topic which will
+   *        receive a view of the published data instead of a copy.
+   * @param topic Topic name for the data being subscribed to.
+   * @param component Name of the component publishing data.
+   * @param callback The event_view_callback_fn to be called when receicing
+   *        data on \p topic.
+   * @param stack_size_bytes The stack size in bytes to use for the subscriber
+   * @note The stack size is only used if a subscriber is not already registered
+   *       for that topic. If a subscriber is already registered for that topic,
+   *       the stack size is ignored.
+   * @return True if the subscriber was added, false if it was already
+   *         registered for that component.
+   */
+  bool add_view_subscriber(const std::string &topic, const std::string &component,
+                           const event_view_callback_fn &callback,
+                           const size_t stack_size_bytes = 8 * 1024);
+
+  /**
+   * @brief Register a subscriber for \p component on the typed \p topic.
+   * @param topic TypedTopic for the events being subscribed to.
+   * @param component Name of the component subscribing to events.
+   * @param callback Function to be called with each event published on
+   *        \p topic. The event is only valid for the duration of the
+   *        callback.
+   * @param stack_size_bytes The stack size in bytes to use for the subscriber
+   * @note The stack size is only used if a subscriber is not already registered
+   *       for that topic. If a subscriber is already registered for that topic,
+   *       the stack size is ignored.
+   * @return True if the subscriber was added, false if it was already
+   *         registered for that component or the topic is already in use with
+   *         a different event type.
+   */
+  template <typename T>
+  bool add_subscriber(const TypedTopic<T> &topic, const std::string &component,
+                      const std::type_identity_t<std::function<void(const T &)>> &callback,
+                      const size_t stack_size_bytes = 8 * 1024) {
+    logger_.info("Adding typed subscriber '{}' to topic '{}'", component, topic.name);
+    if (!set_topic_type(topic.name, detail::type_id<T>(), &detail::TypedEventQueue<T>::make)) {
+      return false;
+    }
+    return add_subscriber_callback(
+        topic.name,
+        {.component = component,
+         .typed_callback =
+             [callback](const void *event) { callback(*static_cast<const T *>(event)); }},
+        stack_size_bytes);
+  }
+
+  /**
+   * @brief Configure \p topic, e.g. to use a preallocated ring of event
+   *        buffers so that publishing does not allocate.
+   * @param topic Topic to configure.
+   * @param config TopicConfig to use for the topic.
+   * @note The configuration is applied when the first subscriber for \p topic
+   *       is added, so this must be called before any subscribers are
+   *       registered on \p topic.
+   * @return True if the configuration was stored, false if \p topic already
+   *         has subscribers or the configuration is invalid.
+   */
+  bool configure_topic(const std::string &topic, const TopicConfig &config);
+
+  /**
+   * @brief Get the handle for \p topic, interning it if it has not been seen
+   *        before.
+   * @param topic Topic name to get the handle for.
+   * @note Handles remain valid for the lifetime of the EventManager, even if
+   *       the topic's subscribers are removed and added again.
+   * @return TopicHandle which can be used to publish on \p topic.
+   */
+  TopicHandle get_topic_handle(const std::string &topic);
+
   /**
    * @brief Publish \p data on \p topic.
    * @param topic Topic to publish data on.
@@ -92,6 +281,70 @@ public:
    */
   bool publish(const std::string &topic, const std::vector<uint8_t> &data);
 
+  /**
+   * @brief Publish \p data on \p topic.
+   * @param topic Topic to publish data on.
+   * @param data View of the data to publish.
+   * @note If \p topic was configured with a buffer ring, the data is copied
+   *       into the next free buffer without allocating. If the ring is full
+   *       or \p data is larger than the configured buffer size, the event is
+   *       dropped and false is returned.
+   * @return True if \p data was successfully published to \p topic, false
+   *         otherwise. Publish will not occur (and will return false) if
+   *         there are no subscribers for this topic.
+   */
+  bool publish(const std::string &topic, std::span<const uint8_t> data);
+
+  /**
+   * @brief Publish \p data on the topic referred to by \p topic.
+   * @details The topic is found through a lock-free lookup, so the only lock
+   *          taken is the topic's own queue lock. This allows publishing on
+   *          different topics from multiple cores without contention.
+   * @param topic Handle to the topic to publish data on, from
+   *        get_topic_handle().
+   * @param data View of the data to publish.
+   * @return True if \p data was successfully published, false otherwise.
+   *         Publish will not occur (and will return false) if \p topic is
+   *         invalid or there are no subscribers for the topic.
+   */
+  bool publish(TopicHandle topic, std::span<const uint8_t> data);
+
+  /**
+   * @brief Publish \p event on the typed \p topic.
+   * @details The event is moved into the topic's queue and passed to the
+   *          subscribers by reference, without any serialization.
+   * @param topic TypedTopic to publish the event on.
+   * @param event Event to publish.
+   * @return True if \p event was successfully published to \p topic, false
+   *         otherwise. Publish will not occur (and will return false) if
+   *         there are no subscribers for this topic.
+   */
+  template <typename T> bool publish(const TypedTopic<T> &topic, std::type_identity_t<T> event) {
+    logger_.debug("Publishing on topic '{}'", topic.name);
+    SubscriberData *sub_data = find_subscriber_data(topic.name);
+    if (sub_data == nullptr) {
+      return false;
+    }
+    std::unique_lock<std::mutex> lk(sub_data->m);
+    if (!sub_data->active) {
+      // no subscribers
+      return false;
+    }
+    if (sub_data->type_id != detail::type_id<T>()) {
+      logger_.error("Cannot publish on topic '{}', event type does not match", topic.name);
+      return false;
+    }
+    if (!make_room(*sub_data, lk)) {
+      logger_.debug("Dropping event on topic '{}', queue is full", topic.name);
+      sub_data->stats.dropped++;
+      return false;
+    }
+    static_cast<detail::TypedEventQueue<T> *>(sub_data->typed.get())
+        ->deq.push_back(std::move(event));
+    on_enqueued(*sub_data, lk);
+    return true;
+  }
+
   /**
    * @brief Remove \p component's publisher for \p topic.
    * @param topic The topic that \p component was publishing on.
@@ -110,6 +363,25 @@ public:
    */
   bool remove_subscriber(const std::string &topic, const std::string &component);
 
+  /**
+   * @brief Get the counters for \p topic.
+   * @param topic Topic to get the counters for.
+   * @return TopicStats for \p topic. If the topic is unknown, all counters are
+   *         zero.
+   */
+  TopicStats get_topic_stats(const std::string &topic);
+
+  /**
+   * @brief Configure how subscriber callbacks are dispatched.
+   * @param config DispatchConfig to use.
+   * @note This must be called before any subscribers are registered. In
+   *       DispatchMode::WORKER_POOL the stack size passed to add_subscriber()
+   *       is ignored, since no per-topic task is created.
+   * @return True if the configuration was applied, false if there are
+   *         already subscribers registered or the configuration is invalid.
+   */
+  bool set_dispatch_config(const DispatchConfig &config);
+
   /**
    * @brief Set the logger verbosity for the EventManager.
    * @param level new Logger::Verbosity level to use.
@@ -119,26 +391,137 @@ public:
 protected:
   EventManager() : logger_({.tag = "Event Manager", .level = Logger::Verbosity::WARN}) {}
 
+  ~EventManager() { stop_workers(); }
+
+  // maximum number of events a worker will dispatch for one topic before
+  // letting other topics run
+  static constexpr size_t MAX_EVENTS_PER_DISPATCH = 8;
+
   struct SubscriberData {
+    std::string topic;
+    uint32_t id{UINT32_MAX};
     std::mutex m;
     std::condition_variable cv;
+    std::condition_variable space_cv; // for publishers blocked on a full queue
     std::deque<std::vector<uint8_t>> deq;
+    std::unique_ptr<EventBufferPool> pool;
+    std::vector<uint8_t> scratch;
+    const void *type_id{nullptr}; // event type of a typed topic
+    std::unique_ptr<detail::TypedEventQueueBase> typed;
+    TopicConfig config;
+    TopicStats stats;
+    size_t num_blocked{0}; // number of publishers waiting on space_cv
+    bool active{false};    // whether the topic has subscribers
+    bool scheduled{false}; // in the run queue or being dispatched by a worker
+
+    bool has_data() const { return size() > 0; }
+
+    size_t size() const {
+      if (typed) {
+        return typed->size();
+      }
+      return pool ? pool->size() : deq.size();
+    }
+
+    bool full() const {
+      if (pool) {
+        return pool->full();
+      }
+      return config.queue_capacity > 0 && size() >= config.queue_capacity;
+    }
+
+    bool next_buffer_in_use() const { return pool && pool->next_in_use(); }
+
+    void pop_front() {
+      if (typed) {
+        typed->pop_front();
+      } else if (pool) {
+        pool->pop();
+      } else {
+        deq.pop_front();
+      }
+    }
+
+    void clear() {
+      deq.clear();
+      if (pool) {
+        pool->clear();
+      }
+      if (typed) {
+        typed->clear();
+      }
+    }
   };
 
+  struct SubscriberCallback {
+    std::string component;
+    event_callback_fn callback;
+    event_view_callback_fn view_callback;
+    std::function<void(const void *)> typed_callback;
+  };
+
+  bool add_subscriber_callback(const std::string &topic, SubscriberCallback &&callback,
+                               size_t stack_size_bytes);
+
+  SubscriberData &get_subscriber_data(const std::string &topic);
+
+  SubscriberData *find_subscriber_data(const std::string &topic);
+
+  bool set_topic_type(const std::string &topic, const void *type_id,
+                      std::unique_ptr<detail::TypedEventQueueBase> (*make_queue)());
+
+  bool publish(SubscriberData &sub_data, std::span<const uint8_t> data);
+
+  bool enqueue(SubscriberData &sub_data, std::span<const uint8_t> data,
+               std::unique_lock<std::mutex> &lk);
+
+  bool make_room(SubscriberData &sub_data, std::unique_lock<std::mutex> &lk);
+
+  void on_enqueued(SubscriberData &sub_data, std::unique_lock<std::mutex> &lk);
+
   bool subscriber_task_fn(const std::string &topic, std::mutex &m, std::condition_variable &cv);
 
+  bool worker_task_fn(std::mutex &m, std::condition_variable &cv);
+
+  void schedule(SubscriberData &sub_data);
+
+  void dispatch(SubscriberData &sub_data, size_t max_events);
+
+  void stop_workers();
+
   std::recursive_mutex events_mutex_;
   detail::EventMap events_;
 
   std::recursive_mutex callbacks_mutex_;
-  std::unordered_map<std::string, std::vector<std::pair<std::string, event_callback_fn>>>
-      subscriber_callbacks_;
+  std::unordered_map<std::string, std::vector<SubscriberCallback>> subscriber_callbacks_;
 
   std::recursive_mutex tasks_mutex_;
   std::unordered_map<std::string, std::unique_ptr<Task>> subscriber_tasks_;
 
   std::recursive_mutex data_mutex_;
   std::unordered_map<std::string, SubscriberData> subscriber_data_;
+  std::unordered_map<std::string, TopicConfig> topic_configs_;
+
+  // topic id -> subscriber data, readable without locking. When the table
+  // fills up a copy with twice the capacity is published; old versions are
+  // kept so readers never see freed memory (topics are never removed, so
+  // this is bounded to twice the size of the final table).
+  struct TopicTable {
+    explicit TopicTable(size_t capacity)
+        : capacity(capacity), entries(std::make_unique<std::atomic<SubscriberData *>[]>(capacity)) {}
+    size_t capacity;
+    std::unique_ptr<std::atomic<SubscriberData *>[]> entries;
+  };
+  uint32_t num_topics_{0};
+  std::atomic<TopicTable *> topic_table_{nullptr};
+  std::vector<std::unique_ptr<TopicTable>> topic_table_versions_;
+
+  std::atomic<DispatchMode> dispatch_mode_{DispatchMode::TASK_PER_TOPIC};
+  std::mutex dispatch_mutex_;
+  std::condition_variable dispatch_cv_;
+  std::deque<SubscriberData *> run_queue_;
+  bool workers_running_{false};
+  std::vector<std::unique_ptr<Task>> workers_;
 
   Logger logger_;
 };
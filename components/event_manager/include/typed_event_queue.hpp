@@ -0,0 +1,68 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <optional>
+
+namespace espp {
+namespace detail {
+/**
+ * @brief Get a unique id for type \p T, without requiring RTTI.
+ * @return Pointer which is unique to type \p T.
+ */
+template <typename T> const void *type_id() {
+  static const char id{0};
+  return &id;
+}
+
+/**
+ * @brief Type-erased interface to a queue of events of a single type, used by
+ *        the EventManager for typed topics.
+ * @note Not internally synchronized, the EventManager protects the queue with
+ *       the topic's mutex. The front() / release_front() slot is only ever
+ *       accessed by the (single) context dispatching the topic.
+ */
+struct TypedEventQueueBase {
+  virtual ~TypedEventQueueBase() = default;
+  virtual size_t size() const = 0;
+  virtual void pop_front() = 0;
+  virtual void clear() = 0;
+  /**
+   * @brief Move the oldest event out of the queue and into the dispatch slot.
+   * @return Pointer to the event in the dispatch slot, or nullptr if the
+   *         queue was empty.
+   */
+  virtual const void *take_front() = 0;
+  /**
+   * @brief Destroy the event in the dispatch slot.
+   */
+  virtual void release_front() = 0;
+};
+
+template <typename T> struct TypedEventQueue : public TypedEventQueueBase {
+  size_t size() const override { return deq.size(); }
+
+  void pop_front() override { deq.pop_front(); }
+
+  void clear() override { deq.clear(); }
+
+  const void *take_front() override {
+    if (deq.empty()) {
+      return nullptr;
+    }
+    front.emplace(std::move(deq.front()));
+    deq.pop_front();
+    return &front.value();
+  }
+
+  void release_front() override { front.reset(); }
+
+  static std::unique_ptr<TypedEventQueueBase> make() {
+    return std::make_unique<TypedEventQueue<T>>();
+  }
+
+  std::deque<T> deq;
+  std::optional<T> front;
+};
+} // namespace detail
+} // namespace espp
@@ -21,6 +21,34 @@ bool EventManager::add_subscriber(const std::string &topic, const std::string &c
                                   const event_callback_fn &callback,
                                   const size_t stack_size_bytes) {
   logger_.info("Adding subscriber '{}' to topic '{}'", component, topic);
+  return add_subscriber_callback(topic, {.component = component, .callback = callback},
+                                 stack_size_bytes);
+}
+
+bool EventManager::add_view_subscriber(const std::string &topic, const std::string &component,
+                                       const event_view_callback_fn &callback,
+                                       const size_t stack_size_bytes) {
+  logger_.info("Adding view subscriber '{}' to topic '{}'", component, topic);
+  return add_subscriber_callback(topic, {.component = component, .view_callback = callback},
+                                 stack_size_bytes);
+}
+
+bool EventManager::add_subscriber_callback(const std::string &topic,
+                                           SubscriberCallback &&subscriber,
+                                           size_t stack_size_bytes) {
+  const auto &component = subscriber.component;
+  {
+    // make sure the subscriber and the topic agree on whether the topic is
+    // typed or not (typed subscribers have already set the topic's type)
+    std::lock_guard<std::recursive_mutex> lk(data_mutex_);
+    auto &sub_data = get_subscriber_data(topic);
+    std::lock_guard<std::mutex> data_lk(sub_data.m);
+    if ((sub_data.typed != nullptr) != (subscriber.typed_callback != nullptr)) {
+      logger_.error("Cannot add subscriber '{}' to topic '{}', event type does not match",
+                    component, topic);
+      return false;
+    }
+  }
   {
     std::lock_guard<std::recursive_mutex> lk(events_mutex_);
     // add to `events_`
@@ -37,22 +65,39 @@ bool EventManager::add_subscriber(const std::string &topic, const std::string &c
   {
     std::lock_guard<std::recursive_mutex> lk(callbacks_mutex_);
     auto &callbacks = subscriber_callbacks_[topic];
-    auto is_component = [&component](std::pair<std::string, event_callback_fn> &e) {
-      return std::get<0>(e) == component;
+    auto is_component = [&component](const SubscriberCallback &e) {
+      return e.component == component;
     };
     auto elem = std::find_if(std::begin(callbacks), std::end(callbacks), is_component);
     if (elem != std::end(callbacks)) {
       // callback for this component is already registered, so return false
       return false;
     }
-    callbacks.emplace_back(component, callback);
+    callbacks.push_back(std::move(subscriber));
+  }
+  // activate the topic's `subscriber_data_` if this is its first subscriber
+  {
+    std::lock_guard<std::recursive_mutex> data_lk(data_mutex_);
+    auto &sub_data = get_subscriber_data(topic);
+    std::lock_guard<std::mutex> lk(sub_data.m);
+    if (!sub_data.active) {
+      sub_data.config = topic_configs_.contains(topic) ? topic_configs_[topic] : TopicConfig{};
+      sub_data.pool.reset();
+      if (!sub_data.typed && sub_data.config.buffer_count > 0) {
+        sub_data.pool = std::make_unique<EventBufferPool>(sub_data.config.buffer_count,
+                                                          sub_data.config.buffer_size_bytes);
+      }
+      sub_data.active = true;
+    }
+  }
+  if (dispatch_mode_ == DispatchMode::WORKER_POOL) {
+    // the topic will be dispatched by the worker pool
+    return true;
   }
   // if not in `subscriber_tasks_`
   {
     std::lock_guard<std::recursive_mutex> lk(tasks_mutex_);
     if (!subscriber_tasks_.contains(topic)) {
-      // add to `subscriber_data_`
-      subscriber_data_[topic]; // insert default constructed data
       // create new task (using bound subscriber_task_fn) and add to
       // `subscriber_tasks_`
       using namespace std::placeholders;
@@ -67,31 +112,226 @@ bool EventManager::add_subscriber(const std::string &topic, const std::string &c
   return true;
 }
 
+bool EventManager::configure_topic(const std::string &topic, const TopicConfig &config) {
+  logger_.info("Configuring topic '{}' with {} buffers of {} bytes", topic, config.buffer_count,
+               config.buffer_size_bytes);
+  if (config.buffer_count > 0 && config.buffer_size_bytes == 0) {
+    logger_.error("Cannot configure topic '{}' with zero-sized buffers", topic);
+    return false;
+  }
+  std::lock_guard<std::recursive_mutex> lk(data_mutex_);
+  if (subscriber_data_.contains(topic)) {
+    auto &sub_data = subscriber_data_[topic];
+    std::lock_guard<std::mutex> data_lk(sub_data.m);
+    if (sub_data.active) {
+      logger_.error("Cannot configure topic '{}', it already has subscribers", topic);
+      return false;
+    }
+  }
+  topic_configs_[topic] = config;
+  return true;
+}
+
+EventManager::TopicHandle EventManager::get_topic_handle(const std::string &topic) {
+  std::lock_guard<std::recursive_mutex> lk(data_mutex_);
+  return {get_subscriber_data(topic).id};
+}
+
+EventManager::SubscriberData *EventManager::find_subscriber_data(const std::string &topic) {
+  std::lock_guard<std::recursive_mutex> lk(data_mutex_);
+  if (!subscriber_data_.contains(topic)) {
+    return nullptr;
+  }
+  return &subscriber_data_[topic];
+}
+
+bool EventManager::set_topic_type(const std::string &topic, const void *type_id,
+                                  std::unique_ptr<detail::TypedEventQueueBase> (*make_queue)()) {
+  std::lock_guard<std::recursive_mutex> lk(data_mutex_);
+  auto &sub_data = get_subscriber_data(topic);
+  std::lock_guard<std::mutex> data_lk(sub_data.m);
+  if (sub_data.type_id == type_id) {
+    return true;
+  }
+  if (sub_data.type_id != nullptr) {
+    logger_.error("Cannot use topic '{}', it is already used with a different event type", topic);
+    return false;
+  }
+  if (sub_data.active) {
+    logger_.error("Cannot use topic '{}' as a typed topic, it already has subscribers", topic);
+    return false;
+  }
+  sub_data.type_id = type_id;
+  sub_data.typed = make_queue();
+  return true;
+}
+
+EventManager::SubscriberData &EventManager::get_subscriber_data(const std::string &topic) {
+  // NOTE: data_mutex_ must be locked by the caller
+  if (subscriber_data_.contains(topic)) {
+    return subscriber_data_[topic];
+  }
+  // intern the topic: insert default constructed data, which is never
+  // removed, and give it the next dense id
+  auto &sub_data = subscriber_data_[topic];
+  sub_data.topic = topic;
+  sub_data.id = num_topics_++;
+  auto *table = topic_table_.load(std::memory_order_relaxed);
+  if (table == nullptr || sub_data.id >= table->capacity) {
+    // publish a new table with twice the capacity. Old tables are kept alive
+    // since lock-free readers may still be using them.
+    size_t capacity = table == nullptr ? 16 : table->capacity * 2;
+    auto new_table = std::make_unique<TopicTable>(capacity);
+    for (size_t i = 0; table != nullptr && i < table->capacity; i++) {
+      new_table->entries[i].store(table->entries[i].load(std::memory_order_relaxed),
+                                  std::memory_order_relaxed);
+    }
+    table = new_table.get();
+    topic_table_versions_.push_back(std::move(new_table));
+    topic_table_.store(table, std::memory_order_release);
+  }
+  table->entries[sub_data.id].store(&sub_data, std::memory_order_release);
+  return sub_data;
+}
+
 bool EventManager::publish(const std::string &topic, const std::vector<uint8_t> &data) {
-  logger_.info("Publishing on topic '{}'", topic);
+  return publish(topic, std::span<const uint8_t>(data));
+}
+
+bool EventManager::publish(const std::string &topic, std::span<const uint8_t> data) {
+  logger_.debug("Publishing on topic '{}'", topic);
   // find topic in `subscriber_data_`, push_back into the queue there and notify
   // the cv.
-  // get the data queue
-  SubscriberData *sub_data;
-  {
-    std::lock_guard<std::recursive_mutex> lk(data_mutex_);
-    // find sub_data in `subscriber_data_`
-    if (!subscriber_data_.contains(topic)) {
-      return false;
-    }
-    sub_data = &subscriber_data_[topic];
+  SubscriberData *sub_data = find_subscriber_data(topic);
+  if (sub_data == nullptr) {
+    return false;
   }
-  {
-    // lock the data queue
-    std::unique_lock<std::mutex> lk(sub_data->m);
-    // push the data into the queue
-    sub_data->deq.push_back(data);
-    // notify the task that there is new data in the queue
-    sub_data->cv.notify_all();
+  return publish(*sub_data, data);
+}
+
+bool EventManager::publish(TopicHandle topic, std::span<const uint8_t> data) {
+  // lock-free lookup of the topic in the current version of the topic table
+  const auto *table = topic_table_.load(std::memory_order_acquire);
+  if (table == nullptr || topic.id >= table->capacity) {
+    return false;
+  }
+  auto *sub_data = table->entries[topic.id].load(std::memory_order_acquire);
+  if (sub_data == nullptr) {
+    return false;
+  }
+  return publish(*sub_data, data);
+}
+
+bool EventManager::publish(SubscriberData &sub_data, std::span<const uint8_t> data) {
+  // lock the data queue
+  std::unique_lock<std::mutex> lk(sub_data.m);
+  if (!sub_data.active) {
+    // no subscribers
+    return false;
+  }
+  if (sub_data.typed) {
+    logger_.error("Cannot publish bytes on typed topic '{}'", sub_data.topic);
+    return false;
+  }
+  if (sub_data.next_buffer_in_use() &&
+      sub_data.config.overflow_policy != OverflowPolicy::BLOCK) {
+    // the buffer the event needs is still held by the subscriber it is being
+    // delivered to, so dropping or coalescing the queued events would not make
+    // room for it: reject only the new event and leave the queue alone
+    logger_.debug("Rejecting event on topic '{}', its buffer is in use", sub_data.topic);
+    sub_data.stats.rejected_in_use++;
+    return false;
+  }
+  if (!enqueue(sub_data, data, lk)) {
+    logger_.debug("Dropping event on topic '{}', queue is full", sub_data.topic);
+    sub_data.stats.dropped++;
+    return false;
+  }
+  on_enqueued(sub_data, lk);
+  return true;
+}
+
+void EventManager::on_enqueued(SubscriberData &sub_data, std::unique_lock<std::mutex> &lk) {
+  // NOTE: lk must hold sub_data.m
+  const size_t size = sub_data.size();
+  sub_data.stats.enqueued++;
+  sub_data.stats.high_water_mark = std::max(sub_data.stats.high_water_mark, size);
+  // notify the task / worker pool that there is new data in the queue
+  if (dispatch_mode_ == DispatchMode::WORKER_POOL) {
+    schedule(sub_data);
+  } else if (size == 1) {
+    // the subscriber task only waits when the queue is empty, so only wake it
+    // then. Notify without holding the lock so that it doesn't wake up just
+    // to block on the lock.
+    lk.unlock();
+    sub_data.cv.notify_all();
+  }
+}
+
+bool EventManager::enqueue(SubscriberData &sub_data, std::span<const uint8_t> data,
+                           std::unique_lock<std::mutex> &lk) {
+  // NOTE: lk must hold sub_data.m
+  if (sub_data.config.overflow_policy == OverflowPolicy::COALESCE_LATEST && !sub_data.pool &&
+      !sub_data.deq.empty()) {
+    // overwrite the latest queued event in place to reuse its memory
+    sub_data.stats.dropped += sub_data.deq.size();
+    auto latest = std::move(sub_data.deq.back());
+    sub_data.deq.clear();
+    latest.assign(data.begin(), data.end());
+    sub_data.deq.push_back(std::move(latest));
+    return true;
+  }
+  if (!make_room(sub_data, lk)) {
+    return false;
+  }
+  if (sub_data.pool) {
+    // copy the data into the topic's preallocated ring. NOTE: this can fail
+    // if the data is too large for the buffers.
+    return sub_data.pool->push(data);
   }
+  // push the data into the queue
+  sub_data.deq.emplace_back(data.begin(), data.end());
   return true;
 }
 
+bool EventManager::make_room(SubscriberData &sub_data, std::unique_lock<std::mutex> &lk) {
+  // NOTE: lk must hold sub_data.m
+  const auto &config = sub_data.config;
+  if (config.overflow_policy == OverflowPolicy::COALESCE_LATEST) {
+    // replace any queued events with the new one
+    sub_data.stats.dropped += sub_data.size();
+    sub_data.clear();
+    return !sub_data.full();
+  }
+  if (!sub_data.full()) {
+    return true;
+  }
+  switch (config.overflow_policy) {
+  case OverflowPolicy::DROP_OLDEST:
+    sub_data.pop_front();
+    sub_data.stats.dropped++;
+    return !sub_data.full();
+  case OverflowPolicy::BLOCK:
+    sub_data.num_blocked++;
+    sub_data.space_cv.wait_for(lk, config.block_timeout, [&sub_data]() {
+      return !sub_data.active || !sub_data.full();
+    });
+    sub_data.num_blocked--;
+    return sub_data.active && !sub_data.full();
+  default:
+    return false;
+  }
+}
+
+EventManager::TopicStats EventManager::get_topic_stats(const std::string &topic) {
+  SubscriberData *sub_data = find_subscriber_data(topic);
+  if (sub_data == nullptr) {
+    return {};
+  }
+  std::lock_guard<std::mutex> lk(sub_data->m);
+  return sub_data->stats;
+}
+
 bool EventManager::remove_publisher(const std::string &topic, const std::string &component) {
   logger_.info("Removing publisher '{}' on topic '{}'", component, topic);
   // remove from `events_`
@@ -140,8 +380,8 @@ bool EventManager::remove_subscriber(const std::string &topic, const std::string
     std::lock_guard<std::recursive_mutex> lk(callbacks_mutex_);
     auto callbacks = subscriber_callbacks_[topic];
 
-    auto is_component = [&component](std::pair<std::string, event_callback_fn> &e) {
-      return std::get<0>(e) == component;
+    auto is_component = [&component](const SubscriberCallback &e) {
+      return e.component == component;
     };
     auto elem = std::find_if(std::begin(callbacks), std::end(callbacks), is_component);
     if (elem != std::end(callbacks)) {
@@ -154,28 +394,82 @@ bool EventManager::remove_subscriber(const std::string &topic, const std::string
   }
   // if this was the last subscriber
   if (was_last_subscriber) {
-    logger_.info("It was the last subscriber for '{}', cleaning up tasks", topic);
-    // notify the data (so the subscriber task function can stop waiting on the data cv)
+    logger_.info("It was the last subscriber for '{}', cleaning up", topic);
+    // deactivate the topic and drop any pending data. NOTE: the topic's data
+    // is never removed, since TopicHandle publishers may be using it.
+    SubscriberData *sub_data;
     {
       std::lock_guard<std::recursive_mutex> lk(data_mutex_);
-      subscriber_data_[topic].cv.notify_all();
+      sub_data = &subscriber_data_[topic];
     }
     {
+      std::lock_guard<std::mutex> lk(sub_data->m);
+      sub_data->active = false;
+      sub_data->clear();
+      // notify the data (so the subscriber task function can stop waiting on
+      // the data cv) and any blocked publishers
+      sub_data->cv.notify_all();
+      sub_data->space_cv.notify_all();
+    }
+    if (dispatch_mode_ == DispatchMode::WORKER_POOL) {
+      // wait for the worker pool to be done with the topic
+      std::unique_lock<std::mutex> lk(sub_data->m);
+      sub_data->cv.wait(lk, [sub_data]() { return !sub_data->scheduled; });
+    } else {
       std::lock_guard<std::recursive_mutex> lk(tasks_mutex_);
       // stop the task
       subscriber_tasks_[topic]->stop();
       // remove from `subscriber_tasks_`
       subscriber_tasks_.erase(topic);
     }
-    {
-      std::lock_guard<std::recursive_mutex> lk(data_mutex_);
-      // remove from `subscriber_data_`
-      subscriber_data_.erase(topic);
+  }
+  return true;
+}
+
+bool EventManager::set_dispatch_config(const DispatchConfig &config) {
+  logger_.info("Setting dispatch mode to {} with {} workers", (int)config.mode,
+               config.num_workers);
+  if (config.mode == DispatchMode::WORKER_POOL && config.num_workers == 0) {
+    logger_.error("Cannot use a worker pool with zero workers");
+    return false;
+  }
+  {
+    std::lock_guard<std::recursive_mutex> lk(data_mutex_);
+    for (auto &[topic, sub_data] : subscriber_data_) {
+      std::lock_guard<std::mutex> data_lk(sub_data.m);
+      if (sub_data.active) {
+        logger_.error("Cannot change dispatch mode, there are already subscribers");
+        return false;
+      }
+    }
+  }
+  stop_workers();
+  dispatch_mode_ = config.mode;
+  if (config.mode == DispatchMode::WORKER_POOL) {
+    workers_running_ = true;
+    using namespace std::placeholders;
+    for (size_t i = 0; i < config.num_workers; i++) {
+      auto worker = Task::make_unique(
+          {.name = fmt::format("event worker {}", i),
+           .callback = std::bind(&EventManager::worker_task_fn, this, _1, _2),
+           .stack_size_bytes{config.stack_size_bytes}});
+      worker->start();
+      workers_.push_back(std::move(worker));
     }
   }
   return true;
 }
 
+void EventManager::stop_workers() {
+  {
+    std::lock_guard<std::mutex> lk(dispatch_mutex_);
+    workers_running_ = false;
+    dispatch_cv_.notify_all();
+  }
+  // destroying the tasks will stop them
+  workers_.clear();
+}
+
 bool EventManager::subscriber_task_fn(const std::string &topic, std::mutex &m,
                                       std::condition_variable &cv) {
   // get the data queue
@@ -192,38 +486,122 @@ bool EventManager::subscriber_task_fn(const std::string &topic, std::mutex &m,
   // get the data
   logger_.debug("Waiting on data for topic '{}'", topic);
   {
-    // wait on sub_data's mutex/cv
+    // wait on sub_data's mutex/cv, unless data was published while we were
+    // running the callbacks (in which case the notify was missed)
     std::unique_lock<std::mutex> lk(sub_data->m);
-    sub_data->cv.wait(lk);
-    if (sub_data->deq.empty()) {
-      // stop the task, we were notified, but there was no data available.
-      return true;
+    if (!sub_data->has_data()) {
+      sub_data->cv.wait(lk);
+      if (!sub_data->has_data()) {
+        // stop the task, we were notified, but there was no data available.
+        return true;
+      }
     }
   }
   // we were woken up - that means there must be >= 1 element in the queue,
   // so let's loop until we get all the data
-  while (true) {
+  dispatch(*sub_data, 0);
+  // we don't want to stop the task...
+  return false;
+}
+
+bool EventManager::worker_task_fn(std::mutex &m, std::condition_variable &cv) {
+  SubscriberData *sub_data;
+  {
+    std::unique_lock<std::mutex> lk(dispatch_mutex_);
+    dispatch_cv_.wait(lk, [this]() { return !workers_running_ || !run_queue_.empty(); });
+    if (!workers_running_) {
+      // stop the task, the worker pool is being shut down
+      return true;
+    }
+    sub_data = run_queue_.front();
+    run_queue_.pop_front();
+  }
+  // this worker now owns the topic (it is `scheduled` so no other worker will
+  // pick it up), so dispatch a batch of its events
+  dispatch(*sub_data, MAX_EVENTS_PER_DISPATCH);
+  {
+    std::unique_lock<std::mutex> lk(sub_data->m);
+    if (sub_data->has_data()) {
+      // more data is available, so put the topic at the back of the run
+      // queue to let other topics run in between
+      std::lock_guard<std::mutex> dispatch_lk(dispatch_mutex_);
+      run_queue_.push_back(sub_data);
+      dispatch_cv_.notify_one();
+    } else {
+      sub_data->scheduled = false;
+      // let remove_subscriber know that the topic is no longer in use
+      sub_data->cv.notify_all();
+    }
+  }
+  // we don't want to stop the task...
+  return false;
+}
+
+void EventManager::schedule(SubscriberData &sub_data) {
+  // NOTE: sub_data.m must be locked by the caller
+  if (sub_data.scheduled) {
+    // already queued or being dispatched by a worker, which will pick up the
+    // new data
+    return;
+  }
+  sub_data.scheduled = true;
+  std::lock_guard<std::mutex> lk(dispatch_mutex_);
+  run_queue_.push_back(&sub_data);
+  dispatch_cv_.notify_one();
+}
+
+void EventManager::dispatch(SubscriberData &sub_data, size_t max_events) {
+  const auto &topic = sub_data.topic;
+  size_t num_events = 0;
+  while (max_events == 0 || num_events < max_events) {
     logger_.debug("Getting data for topic '{}'", topic);
     std::vector<uint8_t> data;
+    // handle to the pooled buffer (if the topic has a pool), which keeps the
+    // buffer from being overwritten while the callbacks are running
+    EventBufferPool::Handle handle;
+    std::span<const uint8_t> view;
+    // object being dispatched (if the topic is typed)
+    const void *event = nullptr;
     {
-      std::unique_lock<std::mutex> lk(sub_data->m);
-      if (sub_data->deq.empty()) {
-        // we've gotten all the data, so break out of the loop
-        break;
+      std::unique_lock<std::mutex> lk(sub_data.m);
+      if (sub_data.typed) {
+        event = sub_data.typed->take_front();
+        if (event == nullptr) {
+          // we've gotten all the data, so break out of the loop
+          break;
+        }
+      } else if (sub_data.pool) {
+        handle = sub_data.pool->pop();
+        if (!handle) {
+          // we've gotten all the data, so break out of the loop
+          break;
+        }
+        view = handle.span();
+      } else {
+        if (sub_data.deq.empty()) {
+          // we've gotten all the data, so break out of the loop
+          break;
+        }
+        // move the data out of sub_data's deque front
+        data = std::move(sub_data.deq.front());
+        // and pop the front data off
+        sub_data.deq.pop_front();
+        view = data;
+      }
+      if (sub_data.num_blocked > 0) {
+        // let a blocked publisher know there is room in the queue
+        sub_data.space_cv.notify_one();
       }
-      // set data to sub_data's deque front
-      data = sub_data->deq.front();
-      // and pop the front data off
-      sub_data->deq.pop_front();
     }
+    num_events++;
     // get all the callbacks
     logger_.debug("Finding callbacks for topic '{}'", topic);
-    std::vector<std::pair<std::string, event_callback_fn>> *callbacks;
+    std::vector<SubscriberCallback> *callbacks;
     {
       std::lock_guard<std::recursive_mutex> lk(callbacks_mutex_);
       if (!subscriber_callbacks_.contains(topic)) {
-        // stop the task, we don't have any callbacks anymore.
-        return true;
+        // we don't have any callbacks anymore.
+        continue;
       }
       // copy here so that we don't hold this lock the whole time we're calling
       // callbacks
@@ -231,11 +609,39 @@ bool EventManager::subscriber_task_fn(const std::string &topic, std::mutex &m,
     }
     // call all the callbacks
     logger_.debug("Calling {} callbacks for topic '{}'", callbacks->size(), topic);
-    for (auto [comp, callback] : *callbacks) {
-      logger_.debug("Callback for '{}'", comp);
-      callback(data);
+    bool scratch_valid = false;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &subscriber : *callbacks) {
+      logger_.debug("Callback for '{}'", subscriber.component);
+      if (subscriber.typed_callback) {
+        subscriber.typed_callback(event);
+      } else if (subscriber.view_callback) {
+        subscriber.view_callback(view);
+      } else if (!handle) {
+        subscriber.callback(data);
+      } else {
+        // vector subscriber on a pooled topic: copy into the topic's scratch
+        // vector, which reuses its capacity across events
+        if (!scratch_valid) {
+          sub_data.scratch.assign(view.begin(), view.end());
+          scratch_valid = true;
+        }
+        subscriber.callback(sub_data.scratch);
+      }
+    }
+    std::chrono::duration<float> latency = std::chrono::steady_clock::now() - start;
+    // release the pooled buffer / typed event (if any) so it can be reused
+    handle = {};
+    if (event != nullptr) {
+      sub_data.typed->release_front();
+    }
+    {
+      std::lock_guard<std::mutex> lk(sub_data.m);
+      sub_data.stats.max_callback_latency = std::max(sub_data.stats.max_callback_latency, latency);
+      if (sub_data.pool && sub_data.num_blocked > 0) {
+        // the released buffer may be the one a blocked publisher is waiting on
+        sub_data.space_cv.notify_one();
+      }
     }
   }
-  // we don't want to stop the task...
-  return false;
 }
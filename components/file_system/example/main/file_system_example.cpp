@@ -118,6 +118,24 @@ extern "C" void app_main(void) {
     std::string root_listing = fs.list_directory(root, config);
     logger.info("Recursive directory listing for {}:\n{}", root.string(), root_listing);
 
+    // list the files an entry at a time, without building the whole listing
+    config.recursive = false;
+    size_t num_entries = 0;
+    fs.list_directory(sandbox, config, [&](std::string_view entry) {
+      logger.info("Entry {}: {}", num_entries++, entry);
+      return true;
+    });
+
+    // cache the listing, which is only regenerated when it may have changed
+    config.use_cache = true;
+    directory_listing = fs.list_directory(sandbox, config);
+    // writing to a file doesn't change its directory's modification time, so
+    // notify the file system to invalidate the cached listing
+    std::ofstream(file2, std::ios::app) << "more data\n";
+    fs.notify_write(file2);
+    directory_listing = fs.list_directory(sandbox, config);
+    logger.info("Cached directory listing for {}:\n{}", sandbox, directory_listing);
+
     // cleanup
     auto items = {file, file2, sandbox};
     for (auto &item : items) {
@@ -1,13 +1,20 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cstdio>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <dirent.h>
 #include <sys/stat.h>
@@ -37,6 +44,9 @@ namespace espp {
 /// on the file system. It also provides a method to get a human readable string
 /// for a byte size.
 ///
+/// Directory listings can be generated an entry at a time, and can be cached:
+/// see list_directory() and notify_write().
+///
 /// \section fs_ex1 File System Info Example
 /// \snippet file_system_example.cpp file_system info example
 /// \section fs_ex2 File System POSIX / NEWLIB Example
@@ -57,16 +67,29 @@ public:
   /// This struct is used to configure the output of the list_directory() method.
   /// It contains boolean values for each of the fields to include in the output.
   struct ListConfig {
-    bool type = true;            ///< The type of the file (directory, file, etc.)
-    bool permissions = true;     ///< The permissions of the file
-    bool number_of_links = true; ///< The number of links to the file
-    bool owner = true;           ///< The owner of the file
-    bool group = true;           ///< The group of the file
-    bool size = true;            ///< The size of the file
-    bool date_time = true;       ///< The date and time of the file
-    bool recursive = false;      ///< Whether to list the contents of subdirectories
+    bool type = true;                ///< The type of the file (directory, file, etc.)
+    bool permissions = true;         ///< The permissions of the file
+    bool number_of_links = true;     ///< The number of links to the file
+    bool owner = true;               ///< The owner of the file
+    bool group = true;               ///< The group of the file
+    bool size = true;                ///< The size of the file
+    bool human_readable_size = true; ///< Whether the size is human readable (see
+                                     ///< human_readable()) or in bytes, as FTP clients expect
+    bool date_time = true;           ///< The date and time of the file
+    bool recursive = false;          ///< Whether to list the contents of subdirectories
+    bool use_cache = false;          ///< Whether the listing may come from / be stored in the
+                                     ///< listing cache, see notify_write()
+
+    bool operator==(const ListConfig &) const = default;
   };
 
+  /// @brief Function called with each entry of a directory listing
+  /// @param entry The formatted entry, including its line ending
+  /// @return True to continue listing, false to stop
+  typedef std::function<bool(std::string_view entry)> list_entry_fn;
+
+  static constexpr size_t MAX_CACHED_LISTINGS = 4; ///< Max number of listings in the cache
+
   FileSystem(const FileSystem &) = delete;
   FileSystem &operator=(const FileSystem &) = delete;
   FileSystem(FileSystem &&) = delete;
@@ -143,6 +166,7 @@ public:
   /// - owner: The owner of the file
   /// - group: The group of the file
   /// - size: The size of the file
+  /// - human_readable_size: Whether the size is human readable or in bytes
   /// - date_time: The date and time of the file
   /// - recursive: Whether to list the contents of subdirectories
   /// @param path The path to the directory
@@ -166,6 +190,7 @@ public:
   /// - owner: The owner of the file
   /// - group: The group of the file
   /// - size: The size of the file
+  /// - human_readable_size: Whether the size is human readable or in bytes
   /// - date_time: The date and time of the file
   /// - recursive: Whether to list the contents of subdirectories
   /// @param path The path to the directory
@@ -175,85 +200,109 @@ public:
   std::string list_directory(const std::string &path, const ListConfig &config,
                              const std::string &prefix = "") {
     std::string result;
-    DIR *dir = opendir(path.c_str());
-    if (dir == nullptr) {
-      return result;
+    list_directory(path, config, make_appender(result), prefix);
+    return result;
+  }
+
+  /// @brief List the contents of a directory, an entry at a time
+  /// @details
+  /// This method lists the contents of a directory like the other
+  /// list_directory() methods, but instead of building the whole listing it
+  /// calls \p on_entry with each entry as soon as it is formatted, e.g. to
+  /// send it over a network connection. Large directories can be listed
+  /// without holding the listing in memory, and the first entries are
+  /// available right away. Each entry takes a single stat() of the file.
+  ///
+  /// If \p config uses the cache, a cached listing which is still up to date
+  /// (see notify_write()) is passed to \p on_entry from the cache, an entry at
+  /// a time. Otherwise the complete listing is added to the cache as it is
+  /// generated.
+  /// @param path The path to the directory
+  /// @param config The config for the output
+  /// @param on_entry The function called with each entry
+  /// @param prefix The prefix to use for the output
+  /// @return False if \p on_entry stopped the listing, true otherwise
+  bool list_directory(const std::string &path, const ListConfig &config,
+                      const list_entry_fn &on_entry, const std::string &prefix = "") {
+    if (!config.use_cache) {
+      return list_entries(path, config, on_entry, prefix);
     }
-    struct dirent *entry;
-    namespace fs = std::filesystem;
-    while ((entry = readdir(dir)) != nullptr) {
-      // skip the current and parent directories
-      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-        continue;
-      }
-      // use the config to determine output
-      std::error_code ec;
-      auto file_path = fs::path{path} / entry->d_name;
-      auto file_status = fs::status(file_path, ec);
-      if (ec) {
-        logger_.warn("Failed to get status for file: {}", file_path.string());
-      }
-      if (config.type) {
-        if (fs::is_directory(file_status)) {
-          result += "d";
-        } else if (fs::is_regular_file(file_status)) {
-          result += "-";
-        } else {
-          result += "?";
-        }
-      }
-      if (config.permissions) {
-        auto perms = file_status.permissions();
-        result += (perms & fs::perms::owner_read) != fs::perms::none ? "r" : "-";
-        result += (perms & fs::perms::owner_write) != fs::perms::none ? "w" : "-";
-        result += (perms & fs::perms::owner_exec) != fs::perms::none ? "x" : "-";
-        result += (perms & fs::perms::group_read) != fs::perms::none ? "r" : "-";
-        result += (perms & fs::perms::group_write) != fs::perms::none ? "w" : "-";
-        result += (perms & fs::perms::group_exec) != fs::perms::none ? "x" : "-";
-        result += (perms & fs::perms::others_read) != fs::perms::none ? "r" : "-";
-        result += (perms & fs::perms::others_write) != fs::perms::none ? "w" : "-";
-        result += (perms & fs::perms::others_exec) != fs::perms::none ? "x" : "-";
-        result += " ";
-      }
-      if (config.number_of_links) {
-        result += "1 ";
-      }
-      if (config.owner) {
-        result += "owner ";
+    // a listing which is cached for the directory's current modification
+    // time, and was not invalidated since, is still up to date
+    auto key = normalize(path);
+    time_t modification_time = get_modification_time(key);
+    std::shared_ptr<const std::string> cached_listing;
+    uint32_t generation;
+    {
+      std::lock_guard<std::mutex> lock(listing_cache_mutex_);
+      auto cached = std::find_if(listing_cache_.begin(), listing_cache_.end(), [&](auto &entry) {
+        return entry.path == key && entry.config == config && entry.prefix == prefix;
+      });
+      if (cached != listing_cache_.end() && cached->modification_time == modification_time) {
+        // keep the most recently used listings at the front
+        std::rotate(listing_cache_.begin(), cached, cached + 1);
+        cached_listing = listing_cache_.front().listing;
+      } else if (cached != listing_cache_.end()) {
+        listing_cache_.erase(cached);
       }
-      if (config.group) {
-        result += "group ";
-      }
-      if (config.size) {
-        if (fs::is_regular_file(file_status)) {
-          result += fmt::format("{:>8} ", human_readable(fs::file_size(file_path, ec)));
-        } else {
-          result += fmt::format("{:>8} ", "");
-        }
-      }
-      if (config.date_time) {
-        auto ftime = fs::last_write_time(file_path, ec);
-        if (ec) {
-          result += "Jan 01 00:00 ";
-        } else {
-          // NOTE: std::chrono::system_clock::to_time_t is not implemented in ESP-IDF
-          // auto cftime = std::chrono::system_clock::to_time_t(ftime);
-          auto cftime = to_time_t(ftime);
-          std::tm tm = *std::localtime(&cftime);
-          char buffer[80];
-          std::strftime(buffer, sizeof(buffer), "%b %d %H:%M", &tm);
-          result += fmt::format("{:>12} ", buffer);
-        }
-      }
-      result += prefix;
-      result += entry->d_name;
-      result += "\r\n";
-      if (config.recursive && fs::is_directory(file_status)) {
-        result += list_directory(file_path, config, std::string{entry->d_name} + "/");
+      generation = listing_cache_generation_;
+    }
+    if (cached_listing) {
+      return replay_listing(*cached_listing, on_entry);
+    }
+    std::string listing;
+    bool complete = list_entries(
+        path, config,
+        [&](std::string_view entry) {
+          listing += entry;
+          return on_entry(entry);
+        },
+        prefix);
+    if (!complete) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(listing_cache_mutex_);
+    // don't cache the listing if anything was written while it was generated
+    if (generation == listing_cache_generation_) {
+      if (listing_cache_.size() >= MAX_CACHED_LISTINGS) {
+        listing_cache_.pop_back();
       }
+      listing_cache_.insert(listing_cache_.begin(),
+                            {key, config, prefix, modification_time,
+                             std::make_shared<const std::string>(std::move(listing))});
     }
-    closedir(dir);
-    return result;
+    return true;
+  }
+
+  /// @brief Notify the file system that a file or directory was written
+  /// @details
+  /// Listings which use the cache (ListConfig::use_cache) are only
+  /// regenerated when the directory's modification time changes or when
+  /// they are invalidated by this method. Not every file system updates the
+  /// modification time of a directory when its entries change (or changes
+  /// it more often than once a second), and none update it when a file's
+  /// size changes, so this must be called after creating, writing, renaming
+  /// (with both paths) or removing a file or directory which may be in a
+  /// cached listing.
+  /// @note espp::FtpServer calls this method with each path its clients
+  ///       change.
+  /// @param path The path of the file or directory which was written
+  void notify_write(const std::filesystem::path &path) {
+    auto changed = normalize(path.string());
+    auto parent = normalize(std::filesystem::path{changed}.parent_path().string());
+    std::lock_guard<std::mutex> lock(listing_cache_mutex_);
+    listing_cache_generation_++;
+    std::erase_if(listing_cache_, [&](auto &entry) {
+      return entry.path == parent || entry.path == changed ||
+             (entry.config.recursive && is_within(changed, entry.path));
+    });
+  }
+
+  /// @brief Remove all listings from the listing cache
+  void clear_listing_cache() {
+    std::lock_guard<std::mutex> lock(listing_cache_mutex_);
+    listing_cache_generation_++;
+    listing_cache_.clear();
   }
 
   /// Function to convert a time_point to a time_t.
@@ -273,6 +322,170 @@ public:
   }
 
 protected:
+  /// @brief A directory listing in the listing cache
+  struct CachedListing {
+    std::string path;                           ///< The normalized path of the directory
+    ListConfig config;                          ///< The config of the listing
+    std::string prefix;                         ///< The prefix of the listing
+    time_t modification_time;                   ///< The mtime of the directory when listed
+    std::shared_ptr<const std::string> listing; ///< The listing
+  };
+
+  /// @brief List the contents of a directory, an entry at a time, without
+  ///        using the listing cache
+  /// @param path The path to the directory
+  /// @param config The config for the output
+  /// @param on_entry The function called with each entry
+  /// @param prefix The prefix to use for the output
+  /// @return False if \p on_entry stopped the listing, true otherwise
+  bool list_entries(const std::string &path, const ListConfig &config,
+                    const list_entry_fn &on_entry, const std::string &prefix) {
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr) {
+      return true;
+    }
+    std::string file_path;
+    std::string entry;
+    bool keep_listing = true;
+    struct dirent *dir_entry;
+    while (keep_listing && (dir_entry = readdir(dir)) != nullptr) {
+      // skip the current and parent directories
+      if (strcmp(dir_entry->d_name, ".") == 0 || strcmp(dir_entry->d_name, "..") == 0) {
+        continue;
+      }
+      file_path.assign(path).append("/").append(dir_entry->d_name);
+      bool is_directory = format_entry(file_path, dir_entry->d_name, config, prefix, entry);
+      keep_listing = on_entry(entry);
+      if (keep_listing && config.recursive && is_directory) {
+        keep_listing = list_entries(file_path, config, on_entry,
+                                    std::string{dir_entry->d_name} + "/");
+      }
+    }
+    closedir(dir);
+    return keep_listing;
+  }
+
+  /// @brief Pass each entry of a cached listing to \p on_entry
+  /// @param listing The listing, made of entries which each end with "\r\n"
+  /// @param on_entry The function called with each entry
+  /// @return False if \p on_entry stopped the listing, true otherwise
+  static bool replay_listing(std::string_view listing, const list_entry_fn &on_entry) {
+    while (!listing.empty()) {
+      auto end = listing.find("\r\n");
+      size_t size = end == std::string_view::npos ? listing.size() : end + 2;
+      if (!on_entry(listing.substr(0, size))) {
+        return false;
+      }
+      listing.remove_prefix(size);
+    }
+    return true;
+  }
+
+  /// @brief Make a function which appends each entry of a listing to a string
+  /// @param result The string to append the entries to
+  /// @return The function
+  static list_entry_fn make_appender(std::string &result) {
+    return [&result](std::string_view entry) {
+      result += entry;
+      return true;
+    };
+  }
+
+  /// @brief Normalize a path, so that the listing cache can compare paths
+  /// @param path The path
+  /// @return The path, lexically normalized and without a trailing separator
+  static std::string normalize(const std::string &path) {
+    auto normalized = std::filesystem::path{path}.lexically_normal().string();
+    if (normalized.size() > 1 && normalized.back() == '/') {
+      normalized.pop_back();
+    }
+    return normalized;
+  }
+
+  /// @brief Check whether a path is inside a directory
+  /// @param path The normalized path
+  /// @param directory The normalized path of the directory
+  /// @return True if \p path is (possibly indirectly) inside \p directory
+  static bool is_within(const std::string &path, const std::string &directory) {
+    std::filesystem::path dir{directory};
+    std::filesystem::path file{path};
+    auto [dir_end, file_it] = std::mismatch(dir.begin(), dir.end(), file.begin(), file.end());
+    return dir_end == dir.end() && file_it != file.end();
+  }
+
+  /// @brief Get the modification time of a file or directory
+  /// @param path The path of the file or directory
+  /// @return The modification time, or 0 if it could not be stat'ed
+  static time_t get_modification_time(const std::string &path) {
+    struct stat file_status;
+    return ::stat(path.c_str(), &file_status) == 0 ? file_status.st_mtime : 0;
+  }
+
+  /// @brief Format the listing entry of a file
+  /// @param file_path The path of the file
+  /// @param name The name of the file
+  /// @param config The config for the output
+  /// @param prefix The prefix to use for the output
+  /// @param entry Set to the entry, including its line ending
+  /// @return True if the file is a directory, false otherwise
+  bool format_entry(const std::string &file_path, std::string_view name, const ListConfig &config,
+                    const std::string &prefix, std::string &entry) {
+    struct stat file_status;
+    bool have_status = ::stat(file_path.c_str(), &file_status) == 0;
+    if (!have_status) {
+      logger_.warn("Failed to get status for file: {}", file_path);
+      file_status = {};
+    }
+    bool is_directory = S_ISDIR(file_status.st_mode);
+    bool is_regular_file = S_ISREG(file_status.st_mode);
+    entry.clear();
+    auto out = std::back_inserter(entry);
+    if (config.type) {
+      entry += is_directory ? "d" : is_regular_file ? "-" : "?";
+    }
+    if (config.permissions) {
+      static constexpr std::array<mode_t, 9> permission_bits = {
+          S_IRUSR, S_IWUSR, S_IXUSR, S_IRGRP, S_IWGRP, S_IXGRP, S_IROTH, S_IWOTH, S_IXOTH};
+      for (size_t i = 0; i < permission_bits.size(); i++) {
+        entry += (file_status.st_mode & permission_bits[i]) ? "rwx"[i % 3] : '-';
+      }
+      entry += " ";
+    }
+    if (config.number_of_links) {
+      entry += "1 ";
+    }
+    if (config.owner) {
+      entry += "owner ";
+    }
+    if (config.group) {
+      entry += "group ";
+    }
+    if (config.size) {
+      if (!config.human_readable_size) {
+        fmt::format_to(out, "{:>8} ", is_regular_file ? file_status.st_size : 0);
+      } else if (is_regular_file) {
+        fmt::format_to(out, "{:>8} ", human_readable(file_status.st_size));
+      } else {
+        fmt::format_to(out, "{:>8} ", "");
+      }
+    }
+    if (config.date_time) {
+      if (!have_status) {
+        entry += "Jan 01 00:00 ";
+      } else {
+        std::tm tm;
+        localtime_r(&file_status.st_mtime, &tm);
+        char buffer[80];
+        std::strftime(buffer, sizeof(buffer), "%b %d %H:%M", &tm);
+        fmt::format_to(out, "{:>12} ", buffer);
+      }
+    }
+    entry += prefix;
+    entry += name;
+    entry += "\r\n";
+    return is_directory;
+  }
+
   /// @brief Constructor
   /// @details
   /// The constructor is private to ensure that the class is a singleton.
@@ -322,6 +535,10 @@ protected:
     }
   }
 
+  std::mutex listing_cache_mutex_;
+  std::vector<CachedListing> listing_cache_;  ///< Most recently used first
+  uint32_t listing_cache_generation_{0}; ///< Incremented whenever the cache is invalidated
+
   Logger logger_;
 };
 } // namespace espp
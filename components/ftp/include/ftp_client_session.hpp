@@ -1,8 +1,8 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <filesystem>
-#include <fstream>
 #include <functional>
 #include <iostream>
 #include <map>
@@ -10,6 +10,10 @@
 #include <string>
 #include <vector>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "file_system.hpp"
 #include "logger.hpp"
 #include "task.hpp"
 #include "tcp_socket.hpp"
@@ -30,18 +34,43 @@ template <typename TP> std::time_t to_time_t(TP tp) {
 }
 
 namespace espp {
+/// Configuration of the file uploads (STOR) of an FtpClientSession.
+/// \note This must be outside the FtpClientSession class because of the gcc
+///       bug described for detail::TcpTransmitConfig.
+struct FtpUploadConfig {
+  size_t block_size{4096}; ///< Size of each upload buffer. The file is written a whole
+                           ///< block at a time, so this should be a multiple of the file
+                           ///< system's block size (4096 B for LittleFS on flash).
+  size_t num_buffers{2}; ///< Number of upload buffers. With two or more, the next block is
+                         ///< received while the previous one is written.
+  size_t writer_stack_size_bytes{4096}; ///< Stack size of the task which writes the blocks.
+};
+
 /// Class representing a client that is connected to the FTP server. This
 /// class is used by the FtpServer class to handle the client's requests.
 class FtpClientSession {
 public:
+  /// \brief Function called after the session created, wrote, renamed or
+  ///     removed a file or directory (and invalidated FileSystem's cached
+  ///     listings which include it), e.g. to update other caches of the files.
+  /// \param path The path of the file or directory which was written.
+  typedef std::function<void(const std::filesystem::path &path)> write_callback_fn;
+
   explicit FtpClientSession(int id, std::string_view local_address,
                             std::unique_ptr<TcpSocket> socket,
-                            const std::filesystem::path &root_path)
+                            const std::filesystem::path &root_path,
+                            const FtpUploadConfig &upload_config = {},
+                            const write_callback_fn &on_write = nullptr)
       : id_(id), local_ip_address_(local_address), current_directory_(root_path),
-        socket_(std::move(socket)), passive_socket_({.log_level = Logger::Verbosity::WARN}),
+        upload_config_(upload_config), on_write_(on_write), socket_(std::move(socket)),
+        passive_socket_({.log_level = Logger::Verbosity::WARN}),
         logger_(
             {.tag = "FtpClientSession " + std::to_string(id), .level = Logger::Verbosity::WARN}) {
     logger_.debug("Client session {} created", id_);
+    // responses are written with TcpSocket::write, which (unlike transmit)
+    // doesn't set the receive timeout, so set it here so that the task can
+    // be stopped while it waits for requests
+    socket_->set_receive_timeout(std::chrono::milliseconds(500));
     send_welcome_message();
     using namespace std::placeholders;
     task_ = std::make_unique<Task>(Task::Config{
@@ -135,64 +164,110 @@ protected:
 
     logger_.info("Received request of size {}", request_data.size());
 
-    std::string_view request((const char *)request_data.data(), request_data.size());
-    if (!handle_request(request)) {
-      logger_.error("Failed to handle request");
-      return false;
+    // handle every complete request (the client may send several at once),
+    // and keep any incomplete one until the rest of it is received
+    request_buffer_.append((const char *)request_data.data(), request_data.size());
+    size_t offset = 0;
+    size_t request_end;
+    while ((request_end = request_buffer_.find("\r\n", offset)) != std::string::npos) {
+      std::string_view request(request_buffer_.data() + offset, request_end + 2 - offset);
+      offset = request_end + 2;
+      if (!handle_request(request)) {
+        logger_.error("Failed to handle request");
+      }
+      if (!socket_->is_connected()) {
+        // the client quit
+        return false;
+      }
+    }
+    request_buffer_.erase(0, offset);
+    if (request_buffer_.size() > max_request_size) {
+      logger_.warn("Discarding {} B of incomplete request", request_buffer_.size());
+      request_buffer_.clear();
     }
 
+    // send the responses to all of the requests together
+    socket_->flush();
+
     // don't want to stop the task
     return false;
   }
 
   /// \brief Send a response to the client.
   /// \details This function sends a response to the client. This function
-  ///     uses the control socket and not the data socket.
+  ///     uses the control socket and not the data socket. The response is
+  ///     buffered by the socket, and sent with the responses to any other
+  ///     requests received at the same time when the socket is flushed.
   /// \param status_code The status code of the response.
   /// \param message The message of the response.
   /// \param multiline Whether or not the response is multiline.
   /// \return True if the response was sent successfully, false otherwise.
   bool send_response(int status_code, std::string_view message, bool multiline = false) {
-    std::string response =
-        std::to_string(status_code) + (multiline ? "-" : " ") + std::string{message} + "\r\n";
-    detail::TcpTransmitConfig config{}; // default config, no wait for response.
-    if (!socket_->transmit(response, config)) {
+    auto code = std::to_string(status_code);
+    if (!socket_->write(code) || !socket_->write(multiline ? "-" : " ") ||
+        !socket_->write(message) || !socket_->write("\r\n")) {
       logger_.error("Failed to send response");
       return false;
     }
     return true;
   }
 
-  /// \brief Receive data from the client.
-  /// \details This function receives data from the client and stores it in
-  ///     the given buffer. This function uses the data socket and not the
-  ///     control socket, and handles both active and passive mode.
-  /// \param buffer The buffer to store the data in.
-  /// \param size The size of the buffer.
-  /// \return The number of bytes received.
-  std::optional<std::vector<uint8_t>> receive_data() {
+  /// \brief Send a response to the client, along with any other buffered
+  ///     responses, right away.
+  /// \details This is used before a transfer on the data connection, which
+  ///     the client may wait for the response to start.
+  /// \param status_code The status code of the response.
+  /// \param message The message of the response.
+  /// \return True if the response was sent successfully, false otherwise.
+  bool send_response_now(int status_code, std::string_view message) {
+    if (!send_response(status_code, message) || !socket_->flush()) {
+      logger_.error("Failed to send response");
+      return false;
+    }
+    return true;
+  }
+
+  /// \brief Open the data connection.
+  /// \details In passive mode this accepts the client's connection to the
+  ///     passive socket, and in active mode it connects to the client.
+  /// \return True if the data connection was opened, false otherwise.
+  bool open_data_connection() {
     if (is_passive_data_connection_) {
       if (!passive_socket_.is_valid()) {
         logger_.error("Passive socket is invalid");
-        return {};
+        return false;
       }
       // accept the connection
       data_socket_ = passive_socket_.accept();
       if (!data_socket_) {
         logger_.error("Failed to accept data connection");
-        return {};
+        return false;
       }
       if (!data_socket_->is_valid()) {
         logger_.error("Failed to accept data connection");
-        return {};
+        return false;
       }
     } else {
       // connect to the client
       if (!data_socket_->connect({.ip_address = data_ip_address_, .port = data_port_})) {
         logger_.error("Failed to connect to client");
-        return {};
+        return false;
       }
     }
+    return true;
+  }
+
+  /// \brief Receive data from the client.
+  /// \details This function receives data from the client and stores it in
+  ///     the given buffer. This function uses the data socket and not the
+  ///     control socket, and handles both active and passive mode.
+  /// \param buffer The buffer to store the data in.
+  /// \param size The size of the buffer.
+  /// \return The number of bytes received.
+  std::optional<std::vector<uint8_t>> receive_data() {
+    if (!open_data_connection()) {
+      return {};
+    }
     // receive the data
     std::vector<uint8_t> data;
     while (true) {
@@ -215,27 +290,8 @@ protected:
   /// \param data The data to send.
   /// \return True if the data was sent successfully, false otherwise.
   bool send_data(std::string_view data) {
-    if (is_passive_data_connection_) {
-      if (!passive_socket_.is_valid()) {
-        logger_.error("Passive socket is invalid");
-        return false;
-      }
-      // accept the connection
-      data_socket_ = passive_socket_.accept();
-      if (!data_socket_) {
-        logger_.error("Failed to accept data connection");
-        return false;
-      }
-      if (!data_socket_->is_valid()) {
-        logger_.error("Failed to accept data connection");
-        return false;
-      }
-    } else {
-      // connect to the client
-      if (!data_socket_->connect({.ip_address = data_ip_address_, .port = data_port_})) {
-        logger_.error("Failed to connect to client");
-        return false;
-      }
+    if (!open_data_connection()) {
+      return false;
     }
     // send the data
     detail::TcpTransmitConfig config{};
@@ -253,60 +309,164 @@ protected:
   /// \note This function has to be used instaed of receive_data() because
   ///     receive_data() needs the whole data in memory, which is not possible
   ///     for large files.
+  /// \note The data is received and written to the file at the same time,
+  ///     see receive_blocks().
   /// \param file_path The path to the file to store the data in.
   /// \return True if the file was received successfully, false otherwise.
   bool receive_file(std::filesystem::path &file_path) {
-    if (is_passive_data_connection_) {
-      if (!passive_socket_.is_valid()) {
-        logger_.error("Passive socket is invalid");
-        return false;
-      }
-      // accept the connection
-      data_socket_ = passive_socket_.accept();
-      if (!data_socket_) {
-        logger_.error("Failed to accept data connection");
-        return false;
-      }
-      if (!data_socket_->is_valid()) {
-        logger_.error("Failed to accept data connection");
-        return false;
-      }
-    } else {
-      // connect to the client
-      if (!data_socket_->connect({.ip_address = data_ip_address_, .port = data_port_})) {
-        logger_.error("Failed to connect to client");
-        return false;
-      }
+    if (!open_data_connection()) {
+      return false;
     }
     // open the file
-    std::ofstream file(file_path, std::ios::binary);
-    if (!file.is_open()) {
+    int file = ::open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (file < 0) {
       logger_.error("Failed to open file");
       return false;
     }
 
     auto start = std::chrono::high_resolution_clock::now();
     size_t total_size = 0;
-    // receive the data
-    while (true) {
-      std::vector<uint8_t> buffer(1024);
-      std::size_t received = data_socket_->receive(buffer.data(), buffer.size());
-      if (received <= 0) {
-        break;
-      }
-      total_size += received;
-      // write it to the filen
-      logger_.debug("Writing {} bytes", received);
-      file.write(reinterpret_cast<char *>(buffer.data()), received);
+    bool success = receive_blocks(file, total_size);
+    if (::close(file) < 0) {
+      logger_.error("Failed to close file");
+      success = false;
     }
     auto end = std::chrono::high_resolution_clock::now();
     float elapsed = std::chrono::duration<float>(end - start).count();
     logger_.info("Received {} bytes in {:.2f} seconds ({:.2f} bytes/s)", total_size, elapsed,
                  total_size / elapsed);
-    file.close();
-    file.flush();
     data_socket_->close();
     data_socket_.reset();
+    return success;
+  }
+
+  /// \brief Receive the data from the data connection and write it to a file.
+  /// \details The data is received into the upload buffers (see
+  ///     FtpUploadConfig), each of which is filled with a whole block before
+  ///     it is handed to a writer task. The writer task writes the blocks to
+  ///     the file in order, while the next blocks are received, so that the
+  ///     network and the file system are used at the same time.
+  /// \param file The file to write to, opened for writing.
+  /// \param total_size Set to the number of bytes which were received.
+  /// \return True if all of the data was received and written, false
+  ///     otherwise.
+  bool receive_blocks(int file, size_t &total_size) {
+    size_t block_size = std::max<size_t>(upload_config_.block_size, 1);
+    size_t num_buffers = std::max<size_t>(upload_config_.num_buffers, 1);
+    std::vector<std::unique_ptr<uint8_t[]>> buffers(num_buffers);
+    std::vector<size_t> sizes(num_buffers, 0);
+    for (auto &buffer : buffers) {
+      buffer.reset(new uint8_t[block_size]);
+    }
+
+    // shared with the writer task
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t num_filled = 0; // buffers which were received but not yet written
+    bool done_receiving = false;
+    bool done_writing = false;
+    bool write_failed = false;
+
+    size_t write_index = 0;
+    Task writer({
+        .name = "FtpClientSession writer",
+        .callback = [&](auto &, auto &) -> bool {
+          std::unique_lock<std::mutex> lk(mutex);
+          cv.wait(lk, [&] { return num_filled > 0 || done_receiving; });
+          if (num_filled == 0) {
+            done_writing = true;
+            cv.notify_all();
+            return true;
+          }
+          bool skip = write_failed;
+          lk.unlock();
+          // after a failed write, the remaining blocks are discarded
+          bool written = skip || write_all(file, buffers[write_index].get(), sizes[write_index]);
+          if (!written) {
+            logger_.error("Failed to write file: {} - '{}'", errno, strerror(errno));
+          }
+          write_index = (write_index + 1) % num_buffers;
+          lk.lock();
+          write_failed = write_failed || !written;
+          num_filled--;
+          cv.notify_all();
+          return false;
+        },
+        .stack_size_bytes = upload_config_.writer_stack_size_bytes,
+        .log_level = Logger::Verbosity::WARN,
+    });
+    if (!writer.start()) {
+      logger_.error("Failed to start the writer task");
+      return false;
+    }
+
+    bool receive_failed = false;
+    size_t fill_index = 0;
+    bool end_of_data = false;
+    while (!end_of_data) {
+      {
+        // wait for a free buffer
+        std::unique_lock<std::mutex> lk(mutex);
+        cv.wait(lk, [&] { return num_filled < num_buffers || write_failed; });
+        if (write_failed) {
+          break;
+        }
+      }
+      // fill it with a whole block, unless the data ends first
+      uint8_t *buffer = buffers[fill_index].get();
+      size_t size = 0;
+      while (size < block_size) {
+        size_t received = data_socket_->receive(buffer + size, block_size - size);
+        if (received == 0 || received > block_size - size) {
+          // the client closed the connection at the end of the file, or the
+          // receive failed
+          receive_failed = received != 0;
+          end_of_data = true;
+          break;
+        }
+        size += received;
+      }
+      if (size == 0) {
+        continue;
+      }
+      total_size += size;
+      std::lock_guard<std::mutex> lk(mutex);
+      sizes[fill_index] = size;
+      num_filled++;
+      cv.notify_all();
+      fill_index = (fill_index + 1) % num_buffers;
+    }
+
+    // wait for the writer task to write the rest of the blocks
+    {
+      std::unique_lock<std::mutex> lk(mutex);
+      done_receiving = true;
+      cv.notify_all();
+      cv.wait(lk, [&] { return done_writing; });
+    }
+    if (receive_failed) {
+      logger_.error("Failed to receive file");
+    }
+    return !receive_failed && !write_failed;
+  }
+
+  /// \brief Write all of the data to a file.
+  /// \param file The file to write to.
+  /// \param data The data to write.
+  /// \param size The number of bytes to write.
+  /// \return True if all of the data was written, false otherwise.
+  static bool write_all(int file, const uint8_t *data, size_t size) {
+    while (size > 0) {
+      ssize_t written = ::write(file, data, size);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        return false;
+      }
+      data += written;
+      size -= written;
+    }
     return true;
   }
 
@@ -317,63 +477,40 @@ protected:
   /// \note This function has to be used instaed of send_data() because
   ///     send_data() needs the whole data in memory, which is not possible
   ///     for large files.
+  /// \note The file is sent with TcpSocket::transmit_file, i.e. with
+  ///     sendfile() where it is supported, and read in chunks otherwise.
   /// \param file_path The path to the file to send.
   /// \return True if the file was sent successfully, false otherwise.
   bool send_file(std::filesystem::path &file_path) {
-    if (is_passive_data_connection_) {
-      if (!passive_socket_.is_valid()) {
-        logger_.error("Passive socket is invalid");
-        return false;
-      }
-      // accept the connection
-      data_socket_ = passive_socket_.accept();
-      if (!data_socket_) {
-        logger_.error("Failed to accept data connection");
-        return false;
-      }
-      if (!data_socket_->is_valid()) {
-        logger_.error("Failed to accept data connection");
-        return false;
-      }
-    } else {
-      // connect to the client
-      if (!data_socket_->connect({.ip_address = data_ip_address_, .port = data_port_})) {
-        logger_.error("Failed to connect to client");
-        return false;
-      }
+    if (!open_data_connection()) {
+      return false;
     }
 
-    detail::TcpTransmitConfig config{};
     // open the file
-    std::ifstream file(file_path, std::ios::in | std::ios::binary);
-    if (!file.is_open()) {
+    int file = ::open(file_path.c_str(), O_RDONLY);
+    if (file < 0) {
       logger_.error("Failed to open file");
       return false;
     }
     // get the file size
-    file.seekg(0, std::ios::end);
-    std::size_t file_size = file.tellg();
+    struct stat file_status;
+    if (fstat(file, &file_status) < 0) {
+      logger_.error("Failed to get file size");
+      ::close(file);
+      return false;
+    }
+    std::size_t file_size = file_status.st_size;
     logger_.debug("File size: {}", file_size);
-    file.seekg(0, std::ios::beg);
-    // send the file
+    // send the file, with sendfile() where it is supported so that the data
+    // is not copied through this task
     auto start = std::chrono::high_resolution_clock::now();
-    size_t total_size = 0;
-    static constexpr std::size_t buffer_size = 1024;
-    std::unique_ptr<char[]> buffer(new char[buffer_size]);
-    while (true) {
-      file.read(buffer.get(), buffer_size);
-      std::size_t bytes_read = file.gcount();
-      if (bytes_read <= 0) {
-        break;
-      }
-      std::string_view data(buffer.get(), bytes_read);
-      if (!data_socket_->transmit(data, config)) {
-        logger_.error("Failed to send file");
-        return false;
-      }
-      total_size += bytes_read;
+    bool success = data_socket_->transmit_file(file, 0, file_size);
+    ::close(file);
+    if (!success) {
+      logger_.error("Failed to send file");
+      return false;
     }
-    file.close();
+    size_t total_size = file_size;
     auto end = std::chrono::high_resolution_clock::now();
     float elapsed = std::chrono::duration<float>(end - start).count();
     logger_.info("Sent {} bytes in {:.2f} seconds ({:.2f} bytes/s)", total_size, elapsed,
@@ -497,7 +634,7 @@ protected:
   /// \brief Send a welcome message to the client.
   /// \details This function sends a welcome message to the client.
   /// \return True if the welcome message was sent successfully, false
-  bool send_welcome_message() { return send_response(220, "Welcome to espp FTP server"); }
+  bool send_welcome_message() { return send_response_now(220, "Welcome to espp FTP server"); }
 
   /// \brief Handle the USER command.
   /// The USER command is used to specify the user name (USER is a
@@ -766,16 +903,12 @@ protected:
   /// @return True if the command was handled successfully, false otherwise
   bool handle_list(std::string_view arguments) {
     logger_.info("Handling list: {}", arguments);
-    if (!send_response(150, "File status okay; about to open data connection.")) {
+    if (!send_response_now(150, "File status okay; about to open data connection.")) {
       logger_.error("Failed to send response");
       return false;
     }
 
-    // get the directory listing
-    std::string directory_listing = list_directory(current_directory_);
-
-    logger_.debug("Directory listing:\n{}", directory_listing);
-    if (!send_data(directory_listing)) {
+    if (!send_directory_listing(current_directory_)) {
       logger_.error("Failed to send directory listing");
       return send_response(426, "Connection closed; transfer aborted.");
     }
@@ -833,7 +966,7 @@ protected:
     if (!std::filesystem::is_regular_file(full_path)) {
       return send_response(550, "Not a regular file.");
     }
-    if (!send_response(150, "File status okay; about to open data connection.")) {
+    if (!send_response_now(150, "File status okay; about to open data connection.")) {
       logger_.error("Failed to send response");
       return false;
     }
@@ -860,12 +993,15 @@ protected:
     std::string_view path = arguments.substr(0, path_end);
     std::filesystem::path full_path = current_directory_ / std::filesystem::path{path};
     // NOTE: we don't check if the file exists, because we want to overwrite it
-    if (!send_response(150, "File status okay; about to open data connection.")) {
+    if (!send_response_now(150, "File status okay; about to open data connection.")) {
       logger_.error("Failed to send response");
       return false;
     }
     // receive the file over the data connection
-    if (!receive_file(full_path)) {
+    bool received = receive_file(full_path);
+    // the file may have been (partly) written even if the transfer failed
+    notify_write(full_path);
+    if (!received) {
       logger_.error("Failed to receive file");
       return send_response(426, "Connection closed; transfer aborted.");
     }
@@ -882,7 +1018,7 @@ protected:
   /// @return True if the command was handled successfully, false otherwise
   bool handle_quit(std::string_view arguments) {
     logger_.info("Handling quit: {}", arguments);
-    bool success = send_response(221, "Service closing control connection.");
+    bool success = send_response_now(221, "Service closing control connection.");
     // close the control connection
     socket_->close();
     return success;
@@ -914,6 +1050,7 @@ protected:
       logger_.error("Failed to delete file: {}", strerror(errno));
       return send_response(550, "Failed to delete file.");
     }
+    notify_write(full_path);
     return send_response(250, "Requested file action okay, completed.");
   }
 
@@ -943,6 +1080,7 @@ protected:
       logger_.error("Failed to delete directory: {}", strerror(errno));
       return send_response(550, "Failed to delete directory.");
     }
+    notify_write(full_path);
     return send_response(250, "Requested file action okay, completed.");
   }
 
@@ -963,6 +1101,7 @@ protected:
       return send_response(550, "File already exists.");
     }
     std::filesystem::create_directory(full_path);
+    notify_write(full_path);
     std::string message = full_path.string() + " created.";
     return send_response(257, message);
   }
@@ -1012,10 +1151,22 @@ protected:
       logger_.error("Failed to rename file: {}", ec.message());
       return send_response(550, "Failed to rename file.");
     }
+    notify_write(rename_from_);
+    notify_write(full_path);
     rename_from_.clear();
     return send_response(250, "Rename successful.");
   }
 
+  /// @brief Invalidate the cached listings which include \p path, and call
+  ///     the write callback, if any, with it
+  /// @param path The path of the file or directory which was written
+  void notify_write(const std::filesystem::path &path) {
+    FileSystem::get().notify_write(path);
+    if (on_write_) {
+      on_write_(path);
+    }
+  }
+
   /// @brief Handle the NOOP command
   /// The NOOP command does nothing.
   /// @param arguments The arguments of the command
@@ -1033,93 +1184,30 @@ protected:
     return send_response(500, "Syntax error, command unrecognized.");
   }
 
-  /// @brief List the contents of a directory
-  /// @param path The path to list
-  /// @return A string containing the contents of the directory
-  std::string list_directory(const std::filesystem::path &path) {
-    return list_directory(path.string());
-  }
-
-  /// @brief List the contents of a directory
-  /// @param path The path to list
-  /// @return A string containing the contents of the directory
-  std::string list_directory(const std::string &path) {
-    std::string result;
-    DIR *dir = opendir(path.c_str());
-    if (dir == nullptr) {
-      return result;
-    }
-    struct dirent *entry;
-    namespace fs = std::filesystem;
-    while ((entry = readdir(dir)) != nullptr) {
-      // skip the current and parent directories
-      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-        continue;
-      }
-      // use the config to determine output
-      std::error_code ec;
-      auto file_path = fs::path{path} / entry->d_name;
-      auto file_status = fs::status(file_path, ec);
-      if (ec) {
-        logger_.warn("Failed to get status for file: {}", file_path.string());
-        continue;
-      }
-
-      // type
-      if (fs::is_directory(file_status)) {
-        result += "d";
-      } else if (fs::is_regular_file(file_status)) {
-        result += "-";
-      } else {
-        result += "?";
-      }
-
-      // permissions
-      auto perms = file_status.permissions();
-      result += (perms & fs::perms::owner_read) != fs::perms::none ? "r" : "-";
-      result += (perms & fs::perms::owner_write) != fs::perms::none ? "w" : "-";
-      result += (perms & fs::perms::owner_exec) != fs::perms::none ? "x" : "-";
-      result += (perms & fs::perms::group_read) != fs::perms::none ? "r" : "-";
-      result += (perms & fs::perms::group_write) != fs::perms::none ? "w" : "-";
-      result += (perms & fs::perms::group_exec) != fs::perms::none ? "x" : "-";
-      result += (perms & fs::perms::others_read) != fs::perms::none ? "r" : "-";
-      result += (perms & fs::perms::others_write) != fs::perms::none ? "w" : "-";
-      result += (perms & fs::perms::others_exec) != fs::perms::none ? "x" : "-";
-      result += " ";
-
-      // number of links
-      result += "1 ";
-
-      // owner and group
-      result += "owner ";
-      result += "group ";
-
-      // size
-      if (fs::is_regular_file(file_status)) {
-        result += fmt::format("{:>8} ", fs::file_size(file_path, ec));
-      } else {
-        result += fmt::format("{:>7}0 ", "");
-      }
-
-      // date
-      auto ftime = fs::last_write_time(file_path, ec);
-      if (ec) {
-        result += "Jan 01 00:00 ";
-      } else {
-        // NOTE: std::chrono::system_clock::to_time_t is not implemented in ESP-IDF
-        // auto cftime = std::chrono::system_clock::to_time_t(ftime);
-        auto cftime = to_time_t(ftime);
-        std::tm tm = *std::localtime(&cftime);
-        char buffer[80];
-        std::strftime(buffer, sizeof(buffer), "%b %d %H:%M", &tm);
-        result += fmt::format("{:>12} ", buffer);
-      }
-
-      result += entry->d_name;
-      result += "\r\n";
+  /// @brief Send the listing of a directory over the data connection
+  /// @details The listing is generated (or, if it is cached and still up to
+  ///     date, read from FileSystem's listing cache) an entry at a time, and
+  ///     each entry is written to the data connection right away
+  ///     (TcpSocket::write sends them whenever its buffer is full), so the
+  ///     client receives the first entries while the rest of the directory is
+  ///     read.
+  /// @param path The path of the directory to list
+  /// @return True if the listing was sent successfully, false otherwise
+  bool send_directory_listing(const std::filesystem::path &path) {
+    if (!open_data_connection()) {
+      return false;
     }
-    closedir(dir);
-    return result;
+    // NOTE: FTP clients parse the size column, so it is listed in bytes
+    static constexpr FileSystem::ListConfig list_config{.human_readable_size = false,
+                                                        .use_cache = true};
+    bool success = FileSystem::get().list_directory(
+        path.string(), list_config,
+        [this](std::string_view entry) { return data_socket_->write(entry); });
+    success = success && data_socket_->flush();
+    // close the data socket
+    data_socket_->close();
+    data_socket_.reset();
+    return success;
   }
 
 private:
@@ -1134,7 +1222,11 @@ private:
 
   std::filesystem::path rename_from_;
 
+  FtpUploadConfig upload_config_;
+  write_callback_fn on_write_;
+
   std::unique_ptr<TcpSocket> socket_;
+  std::string request_buffer_;
 
   std::unique_ptr<TcpSocket> data_socket_;
   bool is_passive_data_connection_{false};
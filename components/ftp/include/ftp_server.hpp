@@ -26,9 +26,17 @@ public:
   /// \param ip_address The IP address to listen on.
   /// \param port The port to listen on.
   /// \param root The root directory of the FTP server.
-  FtpServer(std::string_view ip_address, uint16_t port, const std::filesystem::path &root)
+  /// \param upload_config The configuration of the clients' file uploads.
+  /// \param on_write Function called with each file or directory the clients
+  ///     create, write, rename or remove, e.g. to update other caches of the
+  ///     files. Optional. FileSystem's cached directory listings are
+  ///     invalidated by the server itself.
+  FtpServer(std::string_view ip_address, uint16_t port, const std::filesystem::path &root,
+            const FtpUploadConfig &upload_config = {},
+            const FtpClientSession::write_callback_fn &on_write = nullptr)
       : ip_address_(ip_address), port_(port), server_({.log_level = Logger::Verbosity::WARN}),
-        root_(root), logger_({.tag = "FtpServer", .level = Logger::Verbosity::WARN}) {}
+        root_(root), upload_config_(upload_config), on_write_(on_write),
+        logger_({.tag = "FtpServer", .level = Logger::Verbosity::WARN}) {}
 
   /// \brief Destroy the FTP server.
   ~FtpServer() { stop(); }
@@ -102,8 +110,8 @@ protected:
     logger_.info("Accepted connection from {}, id {}", client_ptr->get_remote_info(), client_id);
 
     // create a new client session
-    auto client_session_ptr =
-        std::make_unique<FtpClientSession>(client_id, ip_address_, std::move(client_ptr), root_);
+    auto client_session_ptr = std::make_unique<FtpClientSession>(
+        client_id, ip_address_, std::move(client_ptr), root_, upload_config_, on_write_);
 
     // add the client session to the map of clients
     std::lock_guard<std::mutex> lk(clients_mutex_);
@@ -136,6 +144,8 @@ protected:
   std::unique_ptr<Task> accept_task_;
 
   std::filesystem::path root_;
+  FtpUploadConfig upload_config_;
+  FtpClientSession::write_callback_fn on_write_;
 
   std::mutex clients_mutex_;
   std::unordered_map<int, std::unique_ptr<FtpClientSession>> clients_;
@@ -1,6 +1,8 @@
 #include <chrono>
 #include <functional>
+#include <memory>
 #include <thread>
+#include <vector>
 
 #include "logger.hpp"
 
@@ -31,6 +33,71 @@ extern "C" void app_main(void) {
     }
     //! [Logger example]
   }
+  {
+    //! [AsyncLogger example]
+    // start the async backend, which formats and prints queued logs from its
+    // own thread
+    espp::Logger::start_async({.queue_size = 256, .drain_period = 5ms});
+    auto sync_logger =
+        espp::Logger({.tag = "Sync Logger", .level = espp::Logger::Verbosity::INFO});
+    auto async_logger = espp::Logger(
+        {.tag = "Async Logger", .level = espp::Logger::Verbosity::INFO, .async = true});
+    // measure the time each log call takes at the call site
+    auto measure_ns_per_call = [](espp::Logger &logger, size_t num_calls) {
+      auto start = std::chrono::high_resolution_clock::now();
+      for (size_t i = 0; i < num_calls; i++) {
+        logger.info("iteration {} of {}: value = {:.3f}", i, num_calls, i * 0.5f);
+      }
+      auto end = std::chrono::high_resolution_clock::now();
+      return std::chrono::duration<float, std::nano>(end - start).count() / num_calls;
+    };
+    static constexpr size_t num_calls = 100;
+    float sync_ns = measure_ns_per_call(sync_logger, num_calls);
+    float async_ns = measure_ns_per_call(async_logger, num_calls);
+    // let the backend drain the queue before printing the results
+    std::this_thread::sleep_for(500ms);
+    fmt::print("Sync logger:  {:.0f} ns / call\n", sync_ns);
+    fmt::print("Async logger: {:.0f} ns / call, {} logs dropped\n", async_ns,
+               espp::Logger::get_async_dropped_count());
+    espp::Logger::stop_async();
+    //! [AsyncLogger example]
+  }
+  {
+    //! [BinaryLogSink example]
+    // binary records are written to this ring buffer; they could just as well
+    // be appended to a file (espp::FileSystem) or sent over the network
+    // (espp::UdpSocket), and then decoded on the host with
+    // components/logger/python/decode_binary_log.py
+    static constexpr size_t ring_size = 4096;
+    std::vector<uint8_t> ring(ring_size);
+    size_t ring_head = 0;
+    size_t binary_bytes = 0;
+    auto binary_sink = std::make_shared<espp::BinaryLogSink>(espp::BinaryLogSink::Config{
+        .write =
+            [&](std::span<const uint8_t> data) {
+              for (auto byte : data) {
+                ring[ring_head] = byte;
+                ring_head = (ring_head + 1) % ring_size;
+              }
+              binary_bytes += data.size();
+            },
+    });
+    auto binary_logger = espp::Logger({.tag = "Binary Logger",
+                                       .level = espp::Logger::Verbosity::INFO,
+                                       .binary_sink = binary_sink});
+    size_t text_bytes = 0;
+    static constexpr size_t num_logs = 100;
+    for (size_t i = 0; i < num_logs; i++) {
+      float value = i * 0.5f;
+      binary_logger.info("iteration {} of {}: value = {:.3f}", i, num_logs, value);
+      // size of the text log which would have been printed instead
+      text_bytes += fmt::formatted_size("[{}/I]:iteration {} of {}: value = {:.3f}\n",
+                                        "Binary Logger", i, num_logs, value);
+    }
+    fmt::print("{} logs: {} bytes as text, {} bytes as binary records ({:.1f}x smaller)\n",
+               num_logs, text_bytes, binary_bytes, (float)text_bytes / binary_bytes);
+    //! [BinaryLogSink example]
+  }
   {
     //! [MultiLogger example]
     // create loggers
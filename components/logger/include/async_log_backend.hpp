@@ -0,0 +1,388 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#if defined(ESP_PLATFORM)
+#include <esp_pthread.h>
+#endif
+
+#include "format.hpp"
+#include "log_args.hpp"
+
+namespace espp {
+namespace detail {
+/**
+ * @brief Append-only registry of logger tags, so that log records can refer
+ *        to a tag by a small id instead of copying (or pointing to) the tag
+ *        string. Tags are never removed, so ids remain valid for the lifetime
+ *        of the program.
+ */
+class LogTagRegistry {
+public:
+  static constexpr size_t MAX_TAGS = 128;           ///< Maximum number of distinct tags.
+  static constexpr uint16_t INVALID_ID = UINT16_MAX; ///< Id returned when the registry is full.
+
+  /**
+   * @brief Get the registry singleton.
+   */
+  static LogTagRegistry &get() {
+    static LogTagRegistry INSTANCE;
+    return INSTANCE;
+  }
+
+  /**
+   * @brief Get the id for \p tag, adding it to the registry if needed.
+   * @param tag Tag to intern.
+   * @return Id of the tag, or INVALID_ID if the registry is full.
+   */
+  uint16_t intern(std::string_view tag) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    size_t count = count_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < count; i++) {
+      if (*tags_[i].load(std::memory_order_relaxed) == tag) {
+        return static_cast<uint16_t>(i);
+      }
+    }
+    if (count == MAX_TAGS) {
+      return INVALID_ID;
+    }
+    storage_[count] = std::make_unique<std::string>(tag);
+    tags_[count].store(storage_[count].get(), std::memory_order_release);
+    count_.store(count + 1, std::memory_order_release);
+    return static_cast<uint16_t>(count);
+  }
+
+  /**
+   * @brief Get the tag for \p id, without locking.
+   * @param id Id returned by intern().
+   * @return The tag, or an empty string_view if \p id is not valid.
+   */
+  std::string_view lookup(uint16_t id) const {
+    if (id >= MAX_TAGS) {
+      return {};
+    }
+    const auto *tag = tags_[id].load(std::memory_order_acquire);
+    return tag ? std::string_view(*tag) : std::string_view{};
+  }
+
+protected:
+  std::mutex mutex_;
+  std::atomic<size_t> count_{0};
+  std::array<std::atomic<const std::string *>, MAX_TAGS> tags_{};
+  std::array<std::unique_ptr<std::string>, MAX_TAGS> storage_;
+};
+
+/**
+ * @brief Compact log record as stored in the async log queue: the format
+ *        string (which must be a literal) is referenced (not copied) and the
+ *        arguments are packed with a LogArgWriter. A formatted message which
+ *        does not fit in the arguments is allocated and owned by the record.
+ */
+struct LogRecord {
+  static constexpr size_t MAX_ARGS_SIZE = 96; ///< Space for packed arguments.
+
+  const char *fmt{nullptr}; ///< Format string, nullptr if args holds the formatted message.
+  uint16_t fmt_size{0};     ///< Length of the format string.
+  char *message{nullptr};   ///< Formatted message which did not fit in args (owned), or nullptr.
+  size_t message_size{0};   ///< Length of the message.
+  uint16_t tag_id{0};       ///< Id of the logger's tag in the LogTagRegistry.
+  uint8_t level{0};         ///< Logger::Verbosity of the record.
+  uint8_t args_size{0};     ///< Number of bytes of packed arguments.
+  std::array<uint8_t, MAX_ARGS_SIZE> args; ///< Packed arguments.
+};
+
+/**
+ * @brief Bounded, lock-free multi-producer queue of LogRecords (Vyukov's
+ *        bounded MPMC queue, used with a single consumer). Producers never
+ *        block; if the queue is full the record is rejected.
+ */
+class LogRecordQueue {
+public:
+  /**
+   * @brief Construct the queue.
+   * @param capacity Number of records, rounded up to a power of two.
+   */
+  explicit LogRecordQueue(size_t capacity) {
+    capacity_ = 1;
+    while (capacity_ < capacity) {
+      capacity_ <<= 1;
+    }
+    cells_ = std::make_unique<Cell[]>(capacity_);
+    for (size_t i = 0; i < capacity_; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief Fill the next free record with \p fill and publish it.
+   * @param fill Callable which fills in the LogRecord it is passed.
+   * @return True if the record was queued, false if the queue was full.
+   */
+  template <typename F> bool push(F &&fill) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+      cell = &cells_[pos & (capacity_ - 1)];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // full
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    fill(cell->record);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Pop the oldest record. Must only be called from one consumer.
+   * @param record LogRecord to copy the oldest record into.
+   * @return True if a record was popped, false if the queue was empty.
+   */
+  bool pop(LogRecord &record) {
+    Cell *cell = &cells_[dequeue_pos_ & (capacity_ - 1)];
+    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    if (sequence != dequeue_pos_ + 1) {
+      return false;
+    }
+    record = cell->record;
+    cell->sequence.store(dequeue_pos_ + capacity_, std::memory_order_release);
+    dequeue_pos_++;
+    return true;
+  }
+
+protected:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    LogRecord record;
+  };
+
+  size_t capacity_;
+  std::unique_ptr<Cell[]> cells_;
+  std::atomic<size_t> enqueue_pos_{0};
+  size_t dequeue_pos_{0};
+};
+
+/**
+ * @brief Background log backend. Log calls pack a LogRecord into a lock-free
+ *        queue and return; a drain thread formats the records and writes them
+ *        to the console, so the caller never waits on I/O.
+ */
+class AsyncLogBackend {
+public:
+  /**
+   * @brief Configuration for the async log backend.
+   */
+  struct Config {
+    size_t queue_size{64}; /**< Number of records in the queue (rounded up to a power of two).
+                              @note Only used the first time the backend is started. */
+    std::chrono::duration<float> drain_period{
+        0.01f}; /**< How long the drain thread sleeps when the queue is empty. */
+    size_t stack_size_bytes{6 * 1024}; /**< Stack size of the drain thread (ESP only). */
+  };
+
+  /**
+   * @brief Get the backend singleton.
+   */
+  static AsyncLogBackend &get() {
+    static AsyncLogBackend INSTANCE;
+    return INSTANCE;
+  }
+
+  ~AsyncLogBackend() { stop(); }
+
+  /**
+   * @brief Start the drain thread.
+   * @param config Configuration for the backend.
+   */
+  void start(const Config &config) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (running_) {
+      return;
+    }
+    if (!queue_) {
+      // NOTE: the queue is never reallocated, since producers may still be
+      // using it after the backend is stopped
+      queue_ = std::make_unique<LogRecordQueue>(config.queue_size);
+    }
+    drain_period_ = config.drain_period;
+#if defined(ESP_PLATFORM)
+    auto thread_config = esp_pthread_get_default_config();
+    thread_config.thread_name = "async log";
+    thread_config.stack_size = config.stack_size_bytes;
+    esp_pthread_set_cfg(&thread_config);
+#endif
+    running_ = true;
+    thread_ = std::thread(&AsyncLogBackend::drain_thread_fn, this);
+  }
+
+  /**
+   * @brief Stop the drain thread, after writing out all queued records.
+   */
+  void stop() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    running_ = false;
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  /**
+   * @brief Whether the drain thread is running.
+   */
+  bool is_running() const { return running_; }
+
+  /**
+   * @brief Number of records which were dropped because the queue was full.
+   */
+  size_t get_dropped_count() const { return dropped_; }
+
+  /**
+   * @brief Queue a log record.
+   * @param tag_id Id of the logger's tag in the LogTagRegistry.
+   * @param level Verbosity level of the record.
+   * @param fmt Format string.
+   * @param fmt_is_literal Whether \p fmt is a string literal, which is
+   *        referenced by the record. Any other format string may not outlive
+   *        the call, so the message is formatted here instead.
+   * @param args Arguments to format. Arithmetic and string arguments are
+   *        packed into the record; if any argument is of another type (or the
+   *        arguments don't fit), the message is formatted here instead. A
+   *        formatted message which does not fit in the record is copied to
+   *        the heap, so that it is still printed in order with the other
+   *        records.
+   * @return True if the record was queued (or dropped and counted because the
+   *         queue was full), false if the backend is not running and the
+   *         caller has to print the message itself.
+   */
+  template <typename... Args>
+  bool log(uint16_t tag_id, uint8_t level, std::string_view fmt, bool fmt_is_literal,
+           const Args &...args) {
+    if (!running_) {
+      return false;
+    }
+    std::array<uint8_t, LogRecord::MAX_ARGS_SIZE> args_data;
+    LogArgWriter writer(args_data);
+    std::unique_ptr<char[]> message;
+    size_t message_size = 0;
+    bool packed = false;
+    if constexpr ((is_packable_log_arg_v<Args> && ...)) {
+      packed = fmt_is_literal && (writer.write(args) && ...);
+    }
+    if (!packed) {
+      // we can't pack (all of) the arguments or keep the format string, so
+      // format here instead
+      fmt::memory_buffer buffer;
+      fmt::vformat_to(std::back_inserter(buffer), fmt, fmt::make_format_args(args...));
+      writer = LogArgWriter(args_data);
+      if (!writer.write_string(std::string_view(buffer.data(), buffer.size()))) {
+        // too long for a record; rather than truncating it (or printing it
+        // before the records which are still queued), queue a copy of it
+        message = std::make_unique<char[]>(buffer.size());
+        std::memcpy(message.get(), buffer.data(), buffer.size());
+        message_size = buffer.size();
+        writer = LogArgWriter(args_data);
+      }
+    }
+    bool queued = queue_->push([&](LogRecord &record) {
+      record.tag_id = tag_id;
+      record.level = level;
+      record.fmt = packed ? fmt.data() : nullptr;
+      record.fmt_size = packed ? static_cast<uint16_t>(fmt.size()) : 0;
+      record.message_size = message_size;
+      record.message = message.release();
+      std::memcpy(record.args.data(), args_data.data(), writer.size());
+      record.args_size = static_cast<uint8_t>(writer.size());
+    });
+    if (!queued) {
+      dropped_++;
+    }
+    return true;
+  }
+
+protected:
+  AsyncLogBackend() = default;
+
+  void drain_thread_fn() {
+    while (running_) {
+      if (!drain()) {
+        std::this_thread::sleep_for(drain_period_);
+      }
+    }
+    // write out anything that was queued before we were stopped
+    drain();
+  }
+
+  bool drain() {
+    bool drained_any = false;
+    LogRecord record;
+    while (queue_->pop(record)) {
+      drained_any = true;
+      write(record);
+    }
+    size_t dropped = dropped_;
+    if (dropped != reported_dropped_) {
+      fmt::print(fg(fmt::terminal_color::yellow), "[async log/W]:{} log records dropped\n",
+                 dropped - reported_dropped_);
+      reported_dropped_ = dropped;
+    }
+    return drained_any;
+  }
+
+  void write(const LogRecord &record) {
+    // NOTE: level order matches Logger::Verbosity
+    static constexpr char level_chars[] = {'D', 'I', 'W', 'E'};
+    // the record owns its message, if any
+    std::unique_ptr<char[]> message(record.message);
+    if (record.level >= sizeof(level_chars)) {
+      return;
+    }
+    fmt::memory_buffer buffer;
+    if (!message) {
+      std::span<const uint8_t> args(record.args.data(), record.args_size);
+      fmt::dynamic_format_arg_store<fmt::format_context> store;
+      if (!unpack_log_args(args, store)) {
+        return;
+      }
+      std::string_view fmt = record.fmt ? std::string_view(record.fmt, record.fmt_size) : "{}";
+      try {
+        fmt::vformat_to(std::back_inserter(buffer), fmt, store);
+      } catch (...) {
+        return;
+      }
+    }
+    auto tag = LogTagRegistry::get().lookup(record.tag_id);
+    auto msg = message ? std::string_view(message.get(), record.message_size)
+                       : std::string_view(buffer.data(), buffer.size());
+    auto style = record.level == 0   ? fg(fmt::color::gray)
+                 : record.level == 1 ? fg(fmt::terminal_color::green)
+                 : record.level == 2 ? fg(fmt::terminal_color::yellow)
+                                     : fg(fmt::terminal_color::red);
+    fmt::print(style, "[{}/{}]:{}\n", tag, level_chars[record.level], msg);
+  }
+
+  std::mutex mutex_;
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+  std::chrono::duration<float> drain_period_{0.01f};
+  std::unique_ptr<LogRecordQueue> queue_;
+  std::atomic<size_t> dropped_{0};
+  size_t reported_dropped_{0};
+};
+} // namespace detail
+} // namespace espp
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "async_log_backend.hpp"
+#include "format.hpp"
+#include "log_args.hpp"
+
+namespace espp {
+/**
+ * @brief Log sink which writes compact binary records instead of formatted
+ *        text. Each log is written as its level, the id of its tag, a
+ *        timestamp, the id of its format string and its packed (binary)
+ *        arguments. The tag and format strings themselves are only written
+ *        once, in dictionary records, the first time they are used. A host-side
+ *        decoder (logger/python/decode_binary_log.py) rebuilds the text.
+ *
+ *        The sink does not do any I/O itself; the records are passed to a
+ *        write callback, which can e.g. copy them into a ring buffer, append
+ *        them to a file (see espp::FileSystem) or send them over the network
+ *        (see espp::UdpSocket).
+ *
+ *        Every record is framed as:
+ *        - uint8_t header: record type (see RecordType) in bits 0-1, log level
+ *          (LOG records only) in bits 2-4
+ *        - varint payload length
+ *        - payload
+ *
+ *        with the payloads (varints are unsigned LEB128):
+ *        - RecordType::TAG: varint tag id, tag string
+ *        - RecordType::FORMAT: varint format id, format string
+ *        - RecordType::LOG: varint tag id, varint timestamp (microseconds since
+ *          the previous LOG record, or since the sink was created), varint
+ *          format id, packed arguments (see detail::LogArgWriter)
+ *
+ * \section binary_log_sink_ex1 Binary Log Sink Example
+ * \snippet logger_example.cpp BinaryLogSink example
+ */
+class BinaryLogSink {
+public:
+  /**
+   * @brief Function called with each encoded record.
+   * @param data The bytes of the record.
+   */
+  typedef std::function<void(std::span<const uint8_t> data)> write_fn;
+
+  /**
+   * @brief Type of a binary log record.
+   */
+  enum class RecordType : uint8_t {
+    TAG = 0,    /**< Dictionary record mapping a tag id to the tag. */
+    FORMAT = 1, /**< Dictionary record mapping a format id to the format string. */
+    LOG = 2,    /**< Log record. */
+  };
+
+  /**
+   * @brief Configuration for the binary log sink.
+   */
+  struct Config {
+    write_fn write;           /**< Function called with each encoded record. */
+    size_t max_formats{256}; /**< Maximum number of format strings in the dictionary. Once it
+                                is full, logs with a new format string are formatted and
+                                written with the format "{}". */
+  };
+
+  /**
+   * @brief Construct the binary log sink.
+   * @param config Configuration for the sink.
+   */
+  explicit BinaryLogSink(const Config &config)
+      : write_(config.write), max_formats_(std::max<size_t>(config.max_formats, 1)),
+        last_timestamp_(std::chrono::steady_clock::now()) {
+    // the format of formatted messages always has a dictionary entry
+    formats_.emplace(PLAIN_TEXT_FORMAT, Format{.id = 0});
+  }
+
+  /**
+   * @brief Forget which tags and format strings have been written, so that
+   *        their dictionary records are written again before their next use.
+   *        Useful e.g. when a new reader connects to the log stream.
+   */
+  void clear_dictionary() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    known_tags_.clear();
+    for (auto &[fmt, format] : formats_) {
+      format.written = false;
+    }
+  }
+
+  /**
+   * @brief Encode a log and pass it (preceded by any dictionary records it
+   *        needs) to the write callback.
+   * @param tag_id Id of the logger's tag in the detail::LogTagRegistry.
+   * @param level Verbosity level of the log.
+   * @param fmt Format string.
+   * @param fmt_is_literal Whether \p fmt is a string literal. Only literal
+   *        format strings are added to the dictionary (up to
+   *        Config::max_formats of them), since run-time format strings could
+   *        grow it without limit.
+   * @param args Arguments to format. Arithmetic and string arguments are
+   *        packed into the record; if any argument is of another type (or the
+   *        arguments don't fit, or the format string is not in the
+   *        dictionary), the message is formatted here and written as a single
+   *        string argument of the format "{}".
+   * @note Records are never truncated: a message which is too long for the
+   *       record buffer is written in a larger record, which is allocated.
+   */
+  template <typename... Args>
+  void write(uint16_t tag_id, uint8_t level, std::string_view fmt, bool fmt_is_literal,
+             const Args &...args) {
+    if (!write_) {
+      return;
+    }
+    Format *format = fmt_is_literal ? find_format(fmt) : nullptr;
+    std::array<uint8_t, MAX_RECORD_SIZE> fixed_record;
+    std::vector<uint8_t> long_record;
+    std::span<uint8_t> record = fixed_record;
+    auto args_data = record.subspan(MAX_HEADERS_SIZE);
+    detail::LogArgWriter writer(args_data);
+    bool packed = false;
+    if constexpr ((detail::is_packable_log_arg_v<Args> && ...)) {
+      packed = format && (writer.write(args) && ...);
+    }
+    if (!packed) {
+      // we can't pack (all of) the arguments or refer to the format string,
+      // so format here instead
+      fmt::memory_buffer buffer;
+      fmt::vformat_to(std::back_inserter(buffer), fmt, fmt::make_format_args(args...));
+      auto msg = std::string_view(buffer.data(), buffer.size());
+      writer = detail::LogArgWriter(args_data);
+      if (!writer.write_string(msg)) {
+        // too long for the record buffer, so write it in a larger record
+        long_record.resize(MAX_HEADERS_SIZE + MAX_STRING_ARG_HEADER_SIZE + msg.size());
+        record = long_record;
+        args_data = record.subspan(MAX_HEADERS_SIZE);
+        writer = detail::LogArgWriter(args_data);
+        if (!writer.write_string(msg)) {
+          // longer than a string argument can be (64 KiB)
+          return;
+        }
+      }
+      fmt = PLAIN_TEXT_FORMAT;
+      format = find_format(fmt);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (known_tags_.insert(tag_id).second) {
+      write_dictionary(RecordType::TAG, tag_id, detail::LogTagRegistry::get().lookup(tag_id));
+    }
+    if (!format->written) {
+      write_dictionary(RecordType::FORMAT, format->id, fmt);
+      format->written = true;
+    }
+    auto now = std::chrono::steady_clock::now();
+    auto timestamp = std::chrono::duration_cast<std::chrono::microseconds>(now - last_timestamp_);
+    last_timestamp_ = now;
+
+    // encode the log header just before the packed arguments
+    std::array<uint8_t, MAX_LOG_HEADER_SIZE> header;
+    size_t header_size = 0;
+    header_size += detail::write_varint(std::span(header).subspan(header_size), tag_id);
+    header_size += detail::write_varint(std::span(header).subspan(header_size), timestamp.count());
+    header_size += detail::write_varint(std::span(header).subspan(header_size), format->id);
+    size_t payload_offset = args_data.data() - record.data() - header_size;
+    std::memcpy(&record[payload_offset], header.data(), header_size);
+    size_t record_offset = write_record_header(record, payload_offset, RecordType::LOG, level,
+                                               header_size + writer.size());
+    write_(std::span<const uint8_t>(&record[record_offset],
+                                    args_data.data() + writer.size() - &record[record_offset]));
+  }
+
+protected:
+  static constexpr size_t MAX_VARINT_SIZE = 10;
+  static constexpr size_t MAX_RECORD_HEADER_SIZE = 1 + MAX_VARINT_SIZE; // header + payload length
+  static constexpr size_t MAX_LOG_HEADER_SIZE = 3 * MAX_VARINT_SIZE; // tag + timestamp + format
+  static constexpr size_t MAX_HEADERS_SIZE = MAX_RECORD_HEADER_SIZE + MAX_LOG_HEADER_SIZE;
+  static constexpr size_t MAX_ARGS_SIZE = 128;
+  static constexpr size_t MAX_RECORD_SIZE = MAX_HEADERS_SIZE + MAX_ARGS_SIZE;
+  static constexpr size_t MAX_STRING_ARG_HEADER_SIZE = 1 + sizeof(uint16_t); // type + length
+  static constexpr std::string_view PLAIN_TEXT_FORMAT = "{}"; ///< Format of formatted messages
+
+  struct Format {
+    size_t id;
+    bool written{false};
+  };
+
+  struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view str) const { return std::hash<std::string_view>{}(str); }
+  };
+
+  /// Get the dictionary entry of \p fmt, adding it if the dictionary is not
+  /// full, or nullptr if it is full
+  /// @note Entries are never removed, so the pointer stays valid.
+  Format *find_format(std::string_view fmt) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = formats_.find(fmt);
+    if (it == formats_.end()) {
+      if (formats_.size() >= max_formats_) {
+        return nullptr;
+      }
+      it = formats_.emplace(std::string(fmt), Format{.id = formats_.size()}).first;
+    }
+    return &it->second;
+  }
+
+  /// Write the record header so that it ends at \p end, returning its offset
+  static size_t write_record_header(std::span<uint8_t> data, size_t end, RecordType type,
+                                    uint8_t level, size_t payload_size) {
+    std::array<uint8_t, MAX_RECORD_HEADER_SIZE> header;
+    header[0] = static_cast<uint8_t>(type) | static_cast<uint8_t>(level << 2);
+    size_t size = 1 + detail::write_varint(std::span(header).subspan(1), payload_size);
+    std::memcpy(&data[end - size], header.data(), size);
+    return end - size;
+  }
+
+  void write_dictionary(RecordType type, size_t id, std::string_view str) {
+    // dictionary records are only written once per string, so they are
+    // allocated to hold the whole string
+    std::vector<uint8_t> record(MAX_RECORD_HEADER_SIZE + MAX_VARINT_SIZE);
+    size_t offset = MAX_RECORD_HEADER_SIZE;
+    offset += detail::write_varint(std::span(record).subspan(offset), id);
+    record.resize(offset);
+    record.insert(record.end(), str.begin(), str.end());
+    size_t end = record.size();
+    size_t start = write_record_header(record, MAX_RECORD_HEADER_SIZE, type, 0,
+                                       end - MAX_RECORD_HEADER_SIZE);
+    write_(std::span<const uint8_t>(&record[start], end - start));
+  }
+
+  write_fn write_;
+  size_t max_formats_;
+  std::mutex mutex_;
+  std::chrono::steady_clock::time_point last_timestamp_;
+  std::unordered_set<uint16_t> known_tags_;
+  std::unordered_map<std::string, Format, StringHash, std::equal_to<>> formats_;
+};
+} // namespace espp
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "format.hpp"
+#include <fmt/args.h>
+
+namespace espp {
+namespace detail {
+/**
+ * @brief Type tag stored in front of each packed log argument.
+ */
+enum class LogArgType : uint8_t {
+  BOOL,   /**< bool, 1 byte. */
+  CHAR,   /**< char, 1 byte. */
+  INT32,  /**< Signed integer of <= 32 bits, zigzag varint. */
+  UINT32, /**< Unsigned integer of <= 32 bits, varint. */
+  INT64,  /**< Signed 64 bit integer, zigzag varint. */
+  UINT64, /**< Unsigned 64 bit integer, varint. */
+  FLOAT,  /**< float, 4 bytes. */
+  DOUBLE, /**< double, 8 bytes. */
+  STRING, /**< String, 2 byte length followed by that many bytes (not null terminated). */
+};
+
+/**
+ * @brief Write \p value as an unsigned LEB128 varint (7 bits per byte, least
+ *        significant first).
+ * @param data Buffer to write into.
+ * @param value Value to write.
+ * @return Number of bytes written, or 0 if \p data was too small.
+ */
+inline size_t write_varint(std::span<uint8_t> data, uint64_t value) {
+  size_t size = 0;
+  do {
+    if (size == data.size()) {
+      return 0;
+    }
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    data[size++] = byte | (value ? 0x80 : 0);
+  } while (value);
+  return size;
+}
+
+/**
+ * @brief Read an unsigned LEB128 varint written by write_varint().
+ * @param data Buffer to read from.
+ * @param value Value that was read.
+ * @return Number of bytes read, or 0 if \p data does not hold a whole varint.
+ */
+inline size_t read_varint(std::span<const uint8_t> data, uint64_t &value) {
+  value = 0;
+  for (size_t i = 0; i < data.size() && i < 10; i++) {
+    value |= static_cast<uint64_t>(data[i] & 0x7f) << (7 * i);
+    if (!(data[i] & 0x80)) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Zigzag-encode \p value, so that small negative values are encoded
+ *        as small varints.
+ */
+inline uint64_t zigzag_encode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+/**
+ * @brief Decode a value encoded with zigzag_encode().
+ */
+inline int64_t zigzag_decode(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+/**
+ * @brief Whether a log argument of type \p T can be packed into a log record
+ *        (as opposed to having to be formatted by the caller).
+ */
+template <typename T>
+constexpr bool is_packable_log_arg_v =
+    std::is_arithmetic_v<std::remove_cvref_t<T>> ||
+    std::is_same_v<std::decay_t<T>, const char *> || std::is_same_v<std::decay_t<T>, char *> ||
+    std::is_same_v<std::remove_cvref_t<T>, std::string> ||
+    std::is_same_v<std::remove_cvref_t<T>, std::string_view>;
+
+/**
+ * @brief Packs log arguments (with their type tags) into a fixed-size buffer.
+ *        Integers are stored as varints, other values in native
+ *        (little-endian) byte order. An argument which does not fit is not
+ *        written, so a record never holds a truncated string.
+ */
+class LogArgWriter {
+public:
+  /**
+   * @brief Construct a writer into \p data.
+   * @param data Buffer to write the packed arguments into.
+   */
+  explicit LogArgWriter(std::span<uint8_t> data) : data_(data) {}
+
+  /**
+   * @brief Pack \p arg.
+   * @param arg Argument to pack, must satisfy is_packable_log_arg_v.
+   * @return True if the argument was packed, false if there was not enough
+   *         space left.
+   */
+  template <typename T> bool write(const T &arg) {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (std::is_same_v<U, bool>) {
+      return write_value(LogArgType::BOOL, arg);
+    } else if constexpr (std::is_same_v<U, char>) {
+      return write_value(LogArgType::CHAR, arg);
+    } else if constexpr (std::is_floating_point_v<U>) {
+      if constexpr (sizeof(U) <= sizeof(float)) {
+        return write_value(LogArgType::FLOAT, static_cast<float>(arg));
+      } else {
+        return write_value(LogArgType::DOUBLE, static_cast<double>(arg));
+      }
+    } else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+      auto type = sizeof(U) <= sizeof(int32_t) ? LogArgType::INT32 : LogArgType::INT64;
+      return write_integer(type, zigzag_encode(arg));
+    } else if constexpr (std::is_integral_v<U>) {
+      auto type = sizeof(U) <= sizeof(uint32_t) ? LogArgType::UINT32 : LogArgType::UINT64;
+      return write_integer(type, arg);
+    } else if constexpr (std::is_pointer_v<U>) {
+      return write_string(arg ? std::string_view(arg) : std::string_view("(null)"));
+    } else {
+      return write_string(std::string_view(arg));
+    }
+  }
+
+  /**
+   * @brief Pack a string argument.
+   * @param str String to pack.
+   * @return True if the string was packed, false if there was not enough
+   *         space left for all of it.
+   */
+  bool write_string(std::string_view str) {
+    if (str.size() > UINT16_MAX || remaining() < 1 + sizeof(uint16_t) + str.size()) {
+      return false;
+    }
+    uint16_t size16 = static_cast<uint16_t>(str.size());
+    data_[offset_++] = static_cast<uint8_t>(LogArgType::STRING);
+    std::memcpy(&data_[offset_], &size16, sizeof(size16));
+    offset_ += sizeof(size16);
+    std::memcpy(&data_[offset_], str.data(), size16);
+    offset_ += size16;
+    return true;
+  }
+
+  /**
+   * @brief Number of bytes written so far.
+   */
+  size_t size() const { return offset_; }
+
+protected:
+  template <typename V> bool write_value(LogArgType type, V value) {
+    if (remaining() < 1 + sizeof(V)) {
+      return false;
+    }
+    data_[offset_++] = static_cast<uint8_t>(type);
+    std::memcpy(&data_[offset_], &value, sizeof(V));
+    offset_ += sizeof(V);
+    return true;
+  }
+
+  bool write_integer(LogArgType type, uint64_t value) {
+    if (remaining() < 2) {
+      return false;
+    }
+    size_t size = write_varint(data_.subspan(offset_ + 1), value);
+    if (size == 0) {
+      return false;
+    }
+    data_[offset_] = static_cast<uint8_t>(type);
+    offset_ += 1 + size;
+    return true;
+  }
+
+  size_t remaining() const { return data_.size() - offset_; }
+
+  std::span<uint8_t> data_;
+  size_t offset_{0};
+};
+
+/**
+ * @brief Unpack arguments packed by a LogArgWriter into \p store, so they can
+ *        be formatted with fmt::vformat.
+ * @param data Packed arguments.
+ * @param store Argument store to push the unpacked arguments into. String
+ *        arguments refer to \p data, so it must outlive the formatting.
+ * @return True if all arguments were unpacked, false if \p data is malformed.
+ */
+inline bool unpack_log_args(std::span<const uint8_t> data,
+                            fmt::dynamic_format_arg_store<fmt::format_context> &store) {
+  size_t offset = 0;
+  auto read = [&](auto &value) {
+    if (offset + sizeof(value) > data.size()) {
+      return false;
+    }
+    std::memcpy(&value, &data[offset], sizeof(value));
+    offset += sizeof(value);
+    return true;
+  };
+  auto push = [&](auto value) {
+    if (!read(value)) {
+      return false;
+    }
+    store.push_back(value);
+    return true;
+  };
+  auto push_integer = [&](auto value, bool is_signed) {
+    uint64_t raw;
+    size_t size = read_varint(data.subspan(offset), raw);
+    if (size == 0) {
+      return false;
+    }
+    offset += size;
+    store.push_back(static_cast<decltype(value)>(is_signed ? zigzag_decode(raw) : raw));
+    return true;
+  };
+  while (offset < data.size()) {
+    auto type = static_cast<LogArgType>(data[offset++]);
+    bool ok = false;
+    switch (type) {
+    case LogArgType::BOOL:
+      ok = push(bool{});
+      break;
+    case LogArgType::CHAR:
+      ok = push(char{});
+      break;
+    case LogArgType::INT32:
+      ok = push_integer(int32_t{}, true);
+      break;
+    case LogArgType::UINT32:
+      ok = push_integer(uint32_t{}, false);
+      break;
+    case LogArgType::INT64:
+      ok = push_integer(int64_t{}, true);
+      break;
+    case LogArgType::UINT64:
+      ok = push_integer(uint64_t{}, false);
+      break;
+    case LogArgType::FLOAT:
+      ok = push(float{});
+      break;
+    case LogArgType::DOUBLE:
+      ok = push(double{});
+      break;
+    case LogArgType::STRING: {
+      uint16_t size;
+      if (read(size) && offset + size <= data.size()) {
+        store.push_back(
+            std::string_view(reinterpret_cast<const char *>(&data[offset]), size));
+        offset += size;
+        ok = true;
+      }
+      break;
+    }
+    default:
+      break;
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace detail
+} // namespace espp
@@ -2,11 +2,48 @@
 
 #include <atomic>
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <source_location>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 
 #include "format.hpp"
 
+#if defined(CONFIG_ESPP_LOGGER_MIN_LEVEL) && !defined(ESPP_LOGGER_MIN_LEVEL)
+#define ESPP_LOGGER_MIN_LEVEL CONFIG_ESPP_LOGGER_MIN_LEVEL
+#endif
+
+#if !defined(ESPP_LOGGER_MIN_LEVEL)
+/**
+ * Minimum Logger::Verbosity (as an integer, 0 = DEBUG ... 4 = NONE) that is
+ * compiled in. Log calls below this level do not format or print anything,
+ * regardless of the logger's run-time verbosity; use the ESPP_LOG_* macros to
+ * also skip evaluating their arguments. Set with CONFIG_ESPP_LOGGER_MIN_LEVEL
+ * (menuconfig) or by defining ESPP_LOGGER_MIN_LEVEL.
+ */
+#define ESPP_LOGGER_MIN_LEVEL 0
+#endif
+
+#if defined(CONFIG_ESPP_LOGGER_ASYNC) && !defined(ESPP_LOGGER_ASYNC)
+#define ESPP_LOGGER_ASYNC CONFIG_ESPP_LOGGER_ASYNC
+#endif
+
+#if !defined(ESPP_LOGGER_ASYNC)
+/**
+ * Whether the async backend and the binary sink are available (non-zero) or
+ * compiled out (0), in which case the logger does not depend on <thread>. Set
+ * with CONFIG_ESPP_LOGGER_ASYNC (menuconfig) or by defining ESPP_LOGGER_ASYNC.
+ */
+#define ESPP_LOGGER_ASYNC 0
+#endif
+
+#if ESPP_LOGGER_ASYNC
+#include "async_log_backend.hpp"
+#include "binary_log_sink.hpp"
+#endif
+
 namespace espp {
 
 /**
@@ -19,6 +56,8 @@ namespace espp {
  * \snippet logger_example.cpp Logger example
  * \section logger_ex2 Threaded Logging and Verbosity Example
  * \snippet logger_example.cpp MultiLogger example
+ * \section logger_ex3 Async Logging Example
+ * \snippet logger_example.cpp AsyncLogger example
  */
 class Logger {
 public:
@@ -33,6 +72,14 @@ public:
     NONE,  /**< No verbosity - logger will not print anything. */
   };
 
+  /**
+   * Minimum verbosity compiled into the program, see ESPP_LOGGER_MIN_LEVEL.
+   * @note Calls below this level do nothing, but (like any function call)
+   *       their arguments are still evaluated. Use the ESPP_LOG_* macros where
+   *       the arguments are expensive to compute.
+   */
+  static constexpr Verbosity MIN_VERBOSITY = static_cast<Verbosity>(ESPP_LOGGER_MIN_LEVEL);
+
   /**
    * @brief Configuration struct for the logger.
    */
@@ -40,8 +87,88 @@ public:
     std::string_view tag; /**< The TAG that will be prepended to all logs. */
     std::chrono::duration<float> rate_limit{
         0}; /**< The rate limit for the logger. Optional, if <= 0 no rate limit. @note Only calls
-               that have _rate_limited suffixed will be rate limited. */
+               that have _rate_limited suffixed will be rate limited, and each call site is
+               rate limited independently. */
+    size_t rate_limit_burst{1}; /**< Number of logs a rate limited call site may print in a burst
+                                   before being limited to one log per rate_limit. */
     Verbosity level = Verbosity::WARN; /**< The verbosity level for the logger. */
+#if ESPP_LOGGER_ASYNC
+    bool async{false}; /**< Whether logs should be queued for the async backend (if it is
+                          running, see start_async()) instead of printed by the caller.
+                          @note Literal format strings are referenced, not copied; logs
+                          with a fmt::runtime() format string (or arguments which can't
+                          be packed) are formatted by the caller and only printed by the
+                          backend. Messages too long for a queue record are copied to
+                          the heap. Either way, all of a logger's queued logs are printed
+                          in the order they were logged. */
+    std::shared_ptr<BinaryLogSink> binary_sink{
+        nullptr}; /**< Optional sink to write binary log records to instead of printing text.
+                     May be shared between loggers. */
+#endif
+  };
+
+#if ESPP_LOGGER_ASYNC
+  /**
+   * @brief Configuration for the async backend, shared by all async loggers.
+   */
+  typedef detail::AsyncLogBackend::Config AsyncConfig;
+#endif
+
+  /**
+   * @brief Format string for the log methods, which also records whether it
+   *        is a literal. Implicitly constructed from the format string, which
+   *        is checked at compile time like fmt::format_string.
+   */
+  template <typename... Args> struct FormatString {
+    /**
+     * @brief Construct from a compile-time format string.
+     * @param s Format string.
+     */
+    template <typename S,
+              typename = std::enable_if_t<std::is_convertible_v<const S &, fmt::string_view>>>
+    consteval FormatString(const S &s) : fmt_str(s) {}
+
+    /**
+     * @brief Construct from a run-time format string (see fmt::runtime()).
+     *        Async loggers format such logs before queueing them, since the
+     *        format string may not outlive the call.
+     * @param s Format string.
+     */
+    FormatString(decltype(fmt::runtime(std::string_view{})) s) : fmt_str(s), is_literal(false) {}
+
+    fmt::format_string<Args...> fmt_str; ///< The format string.
+    bool is_literal{true};               ///< Whether the format string is a literal.
+  };
+
+  /**
+   * @brief Format string for the *_rate_limited methods, which also captures
+   *        the source location of the call so that each call site can be rate
+   *        limited independently. Implicitly constructed from the format
+   *        string, which is checked at compile time like fmt::format_string.
+   */
+  template <typename... Args> struct RateLimitedFormatString {
+    /**
+     * @brief Construct from a compile-time format string.
+     * @param s Format string.
+     * @param location Source location of the log call.
+     */
+    template <typename S,
+              typename = std::enable_if_t<std::is_convertible_v<const S &, fmt::string_view>>>
+    consteval RateLimitedFormatString(
+        const S &s, std::source_location location = std::source_location::current())
+        : fmt_str(s), location(location) {}
+
+    /**
+     * @brief Construct from a run-time format string (see fmt::runtime()).
+     * @param s Format string.
+     * @param location Source location of the log call.
+     */
+    RateLimitedFormatString(decltype(fmt::runtime(std::string_view{})) s,
+                            std::source_location location = std::source_location::current())
+        : fmt_str(s), location(location) {}
+
+    FormatString<Args...> fmt_str; ///< The format string.
+    std::source_location location; ///< Source location of the log call.
   };
 
   /**
@@ -50,7 +177,58 @@ public:
    * @param config configuration for the logger.
    */
   Logger(const Config &config)
-      : tag_(config.tag), rate_limit_(config.rate_limit), level_(config.level) {}
+      : tag_(config.tag), rate_limit_(config.rate_limit),
+        rate_limit_burst_(std::max<size_t>(config.rate_limit_burst, 1)), level_(config.level) {
+#if ESPP_LOGGER_ASYNC
+    async_ = config.async;
+    binary_sink_ = config.binary_sink;
+    has_binary_sink_ = config.binary_sink != nullptr;
+#endif
+  }
+
+#if ESPP_LOGGER_ASYNC
+  /**
+   * @brief Start the async backend's drain thread. Until it is started (and
+   *        after it is stopped), async loggers print synchronously.
+   * @param config Configuration for the async backend.
+   */
+  static void start_async(const AsyncConfig &config) {
+    detail::AsyncLogBackend::get().start(config);
+  }
+
+  /**
+   * @brief Stop the async backend's drain thread, after printing all queued
+   *        logs.
+   */
+  static void stop_async() { detail::AsyncLogBackend::get().stop(); }
+
+  /**
+   * @brief Get the number of logs the async backend has dropped because its
+   *        queue was full.
+   * @return Total number of dropped logs.
+   */
+  static size_t get_async_dropped_count() {
+    return detail::AsyncLogBackend::get().get_dropped_count();
+  }
+
+  /**
+   * @brief Change whether the logger queues its logs for the async backend.
+   * @param async True to queue logs for the async backend, false to print
+   *        them synchronously.
+   */
+  void set_async(bool async) { async_ = async; }
+
+  /**
+   * @brief Change the binary sink the logger writes its logs to.
+   * @param sink Sink to write binary log records to instead of printing
+   *        text, or nullptr to print text.
+   */
+  void set_binary_sink(std::shared_ptr<BinaryLogSink> sink) {
+    std::lock_guard<std::mutex> lock(tag_mutex_);
+    binary_sink_ = sink;
+    has_binary_sink_ = sink != nullptr;
+  }
+#endif
 
   /**
    * @brief Change the verbosity for the logger. \sa Logger::Verbosity
@@ -65,6 +243,9 @@ public:
   void set_tag(const std::string_view tag) {
     std::lock_guard<std::mutex> lock(tag_mutex_);
     tag_ = tag;
+#if ESPP_LOGGER_ASYNC
+    tag_id_ = -1;
+#endif
   }
 
   /**
@@ -81,141 +262,300 @@ public:
 
   /**
    * @brief Print log in GRAY if level is Verbosity::DEBUG or greater.
-   * @param rt_fmt_str format string
+   * @param fmt_str format string, checked against the arguments at compile
+   *        time. Use fmt::runtime() to pass a format string which is only
+   *        known at run-time (async loggers then format the log before
+   *        queueing it, so the format string only has to outlive the call).
    * @param args optional arguments passed to be formatted.
    */
-  template <typename... Args> void debug(std::string_view rt_fmt_str, Args &&...args) {
-    if (level_ > Verbosity::DEBUG)
-      return;
-    auto msg = format(rt_fmt_str, std::forward<Args>(args)...);
-    std::lock_guard<std::mutex> lock(tag_mutex_);
-    fmt::print(fg(fmt::color::gray), "[{}/D]:{}\n", tag_, msg);
+  template <typename... Args>
+  void debug(FormatString<std::type_identity_t<Args>...> fmt_str, Args &&...args) {
+    if constexpr (MIN_VERBOSITY <= Verbosity::DEBUG) {
+      if (level_ > Verbosity::DEBUG)
+        return;
+#if ESPP_LOGGER_ASYNC
+      if (log_binary(Verbosity::DEBUG, fmt_str.fmt_str, fmt_str.is_literal, args...))
+        return;
+      if (log_async(Verbosity::DEBUG, fmt_str.fmt_str, fmt_str.is_literal, args...))
+        return;
+#endif
+      auto msg = fmt::format(fmt_str.fmt_str, std::forward<Args>(args)...);
+      std::lock_guard<std::mutex> lock(tag_mutex_);
+      fmt::print(fg(fmt::color::gray), "[{}/D]:{}\n", tag_, msg);
+    }
   }
 
   /**
-   * @brief Print log in GREEN if level is Verbosity::INFO or greater
-   * @param rt_fmt_str format string
+   * @brief Print log in GREEN if level is Verbosity::INFO or greater.
+   * @param fmt_str format string, checked against the arguments at compile
+   *        time. Use fmt::runtime() to pass a format string which is only
+   *        known at run-time (async loggers then format the log before
+   *        queueing it, so the format string only has to outlive the call).
    * @param args optional arguments passed to be formatted.
    */
-  template <typename... Args> void info(std::string_view rt_fmt_str, Args &&...args) {
-    if (level_ > Verbosity::INFO)
-      return;
-    auto msg = format(rt_fmt_str, std::forward<Args>(args)...);
-    std::lock_guard<std::mutex> lock(tag_mutex_);
-    fmt::print(fg(fmt::terminal_color::green), "[{}/I]:{}\n", tag_, msg);
+  template <typename... Args>
+  void info(FormatString<std::type_identity_t<Args>...> fmt_str, Args &&...args) {
+    if constexpr (MIN_VERBOSITY <= Verbosity::INFO) {
+      if (level_ > Verbosity::INFO)
+        return;
+#if ESPP_LOGGER_ASYNC
+      if (log_binary(Verbosity::INFO, fmt_str.fmt_str, fmt_str.is_literal, args...))
+        return;
+      if (log_async(Verbosity::INFO, fmt_str.fmt_str, fmt_str.is_literal, args...))
+        return;
+#endif
+      auto msg = fmt::format(fmt_str.fmt_str, std::forward<Args>(args)...);
+      std::lock_guard<std::mutex> lock(tag_mutex_);
+      fmt::print(fg(fmt::terminal_color::green), "[{}/I]:{}\n", tag_, msg);
+    }
   }
 
   /**
-   * @brief Print log in YELLOW if level is Verbosity::WARN or greater
-   * @param rt_fmt_str format string
+   * @brief Print log in YELLOW if level is Verbosity::WARN or greater.
+   * @param fmt_str format string, checked against the arguments at compile
+   *        time. Use fmt::runtime() to pass a format string which is only
+   *        known at run-time (async loggers then format the log before
+   *        queueing it, so the format string only has to outlive the call).
    * @param args optional arguments passed to be formatted.
    */
-  template <typename... Args> void warn(std::string_view rt_fmt_str, Args &&...args) {
-    if (level_ > Verbosity::WARN)
-      return;
-    auto msg = format(rt_fmt_str, std::forward<Args>(args)...);
-    std::lock_guard<std::mutex> lock(tag_mutex_);
-    fmt::print(fg(fmt::terminal_color::yellow), "[{}/W]:{}\n", tag_, msg);
+  template <typename... Args>
+  void warn(FormatString<std::type_identity_t<Args>...> fmt_str, Args &&...args) {
+    if constexpr (MIN_VERBOSITY <= Verbosity::WARN) {
+      if (level_ > Verbosity::WARN)
+        return;
+#if ESPP_LOGGER_ASYNC
+      if (log_binary(Verbosity::WARN, fmt_str.fmt_str, fmt_str.is_literal, args...))
+        return;
+      if (log_async(Verbosity::WARN, fmt_str.fmt_str, fmt_str.is_literal, args...))
+        return;
+#endif
+      auto msg = fmt::format(fmt_str.fmt_str, std::forward<Args>(args)...);
+      std::lock_guard<std::mutex> lock(tag_mutex_);
+      fmt::print(fg(fmt::terminal_color::yellow), "[{}/W]:{}\n", tag_, msg);
+    }
   }
 
   /**
-   * @brief Print log in RED if level is Verbosity::ERROR or greater
-   * @param rt_fmt_str format string
+   * @brief Print log in RED if level is Verbosity::ERROR or greater.
+   * @param fmt_str format string, checked against the arguments at compile
+   *        time. Use fmt::runtime() to pass a format string which is only
+   *        known at run-time (async loggers then format the log before
+   *        queueing it, so the format string only has to outlive the call).
    * @param args optional arguments passed to be formatted.
    */
-  template <typename... Args> void error(std::string_view rt_fmt_str, Args &&...args) {
-    if (level_ > Verbosity::ERROR)
-      return;
-    auto msg = format(rt_fmt_str, std::forward<Args>(args)...);
-    std::lock_guard<std::mutex> lock(tag_mutex_);
-    fmt::print(fg(fmt::terminal_color::red), "[{}/E]:{}\n", tag_, msg);
+  template <typename... Args>
+  void error(FormatString<std::type_identity_t<Args>...> fmt_str, Args &&...args) {
+    if constexpr (MIN_VERBOSITY <= Verbosity::ERROR) {
+      if (level_ > Verbosity::ERROR)
+        return;
+#if ESPP_LOGGER_ASYNC
+      if (log_binary(Verbosity::ERROR, fmt_str.fmt_str, fmt_str.is_literal, args...))
+        return;
+      if (log_async(Verbosity::ERROR, fmt_str.fmt_str, fmt_str.is_literal, args...))
+        return;
+#endif
+      auto msg = fmt::format(fmt_str.fmt_str, std::forward<Args>(args)...);
+      std::lock_guard<std::mutex> lock(tag_mutex_);
+      fmt::print(fg(fmt::terminal_color::red), "[{}/E]:{}\n", tag_, msg);
+    }
   }
 
   /**
    * @brief Print log in GRAY if level is Verbosity::DEBUG or greater.
-   *        This function is rate limited by the rate specified in the
-   *        constructor.
-   * @param rt_fmt_str format string
+   *        This function is rate limited (per call site) by the rate
+   *        specified in the constructor. When a call site which was limited
+   *        logs again, the number of logs it suppressed is printed first.
+   * @param fmt_str format string, checked against the arguments at compile
+   *        time. Use fmt::runtime() to pass a format string which is only
+   *        known at run-time (async loggers then format the log before
+   *        queueing it, so the format string only has to outlive the call).
    * @param args optional arguments passed to be formatted.
    */
-  template <typename... Args> void debug_rate_limited(std::string_view rt_fmt_str, Args &&...args) {
-    if (level_ > Verbosity::DEBUG)
-      return;
-    if (rate_limit_ > std::chrono::duration<float>::zero()) {
-      auto now = std::chrono::high_resolution_clock::now();
-      if (now - last_print_ < rate_limit_)
+  template <typename... Args>
+  void debug_rate_limited(RateLimitedFormatString<std::type_identity_t<Args>...> fmt_str,
+                          Args &&...args) {
+    if constexpr (MIN_VERBOSITY <= Verbosity::DEBUG) {
+      if (level_ > Verbosity::DEBUG)
+        return;
+      size_t num_suppressed = 0;
+      if (!rate_limit(fmt_str.location, num_suppressed))
         return;
-      last_print_ = now;
+      if (num_suppressed > 0)
+        debug("Suppressed {} logs from {}:{}", num_suppressed, fmt_str.location.file_name(),
+              fmt_str.location.line());
+      debug(fmt_str.fmt_str, std::forward<Args>(args)...);
     }
-    auto msg = format(rt_fmt_str, std::forward<Args>(args)...);
-    std::lock_guard<std::mutex> lock(tag_mutex_);
-    fmt::print(fg(fmt::color::gray), "[{}/D]:{}\n", tag_, msg);
   }
 
   /**
-   * @brief Print log in GREEN if level is Verbosity::INFO or greater
-   *        This function is rate limited by the rate specified in the
-   *        constructor.
-   * @param rt_fmt_str format string
+   * @brief Print log in GREEN if level is Verbosity::INFO or greater.
+   *        This function is rate limited (per call site) by the rate
+   *        specified in the constructor. When a call site which was limited
+   *        logs again, the number of logs it suppressed is printed first.
+   * @param fmt_str format string, checked against the arguments at compile
+   *        time. Use fmt::runtime() to pass a format string which is only
+   *        known at run-time (async loggers then format the log before
+   *        queueing it, so the format string only has to outlive the call).
    * @param args optional arguments passed to be formatted.
    */
-  template <typename... Args> void info_rate_limited(std::string_view rt_fmt_str, Args &&...args) {
-    if (level_ > Verbosity::INFO)
-      return;
-    if (rate_limit_ > std::chrono::duration<float>::zero()) {
-      auto now = std::chrono::high_resolution_clock::now();
-      if (now - last_print_ < rate_limit_)
+  template <typename... Args>
+  void info_rate_limited(RateLimitedFormatString<std::type_identity_t<Args>...> fmt_str,
+                         Args &&...args) {
+    if constexpr (MIN_VERBOSITY <= Verbosity::INFO) {
+      if (level_ > Verbosity::INFO)
         return;
-      last_print_ = now;
+      size_t num_suppressed = 0;
+      if (!rate_limit(fmt_str.location, num_suppressed))
+        return;
+      if (num_suppressed > 0)
+        info("Suppressed {} logs from {}:{}", num_suppressed, fmt_str.location.file_name(),
+             fmt_str.location.line());
+      info(fmt_str.fmt_str, std::forward<Args>(args)...);
     }
-    auto msg = format(rt_fmt_str, std::forward<Args>(args)...);
-    std::lock_guard<std::mutex> lock(tag_mutex_);
-    fmt::print(fg(fmt::terminal_color::green), "[{}/I]:{}\n", tag_, msg);
   }
 
   /**
-   * @brief Print log in YELLOW if level is Verbosity::WARN or greater
-   *        This function is rate limited by the rate specified in the
-   *        constructor.
-   * @param rt_fmt_str format string
+   * @brief Print log in YELLOW if level is Verbosity::WARN or greater.
+   *        This function is rate limited (per call site) by the rate
+   *        specified in the constructor. When a call site which was limited
+   *        logs again, the number of logs it suppressed is printed first.
+   * @param fmt_str format string, checked against the arguments at compile
+   *        time. Use fmt::runtime() to pass a format string which is only
+   *        known at run-time (async loggers then format the log before
+   *        queueing it, so the format string only has to outlive the call).
    * @param args optional arguments passed to be formatted.
    */
-  template <typename... Args> void warn_rate_limited(std::string_view rt_fmt_str, Args &&...args) {
-    if (level_ > Verbosity::WARN)
-      return;
-    if (rate_limit_ > std::chrono::duration<float>::zero()) {
-      auto now = std::chrono::high_resolution_clock::now();
-      if (now - last_print_ < rate_limit_)
+  template <typename... Args>
+  void warn_rate_limited(RateLimitedFormatString<std::type_identity_t<Args>...> fmt_str,
+                         Args &&...args) {
+    if constexpr (MIN_VERBOSITY <= Verbosity::WARN) {
+      if (level_ > Verbosity::WARN)
+        return;
+      size_t num_suppressed = 0;
+      if (!rate_limit(fmt_str.location, num_suppressed))
         return;
-      last_print_ = now;
+      if (num_suppressed > 0)
+        warn("Suppressed {} logs from {}:{}", num_suppressed, fmt_str.location.file_name(),
+             fmt_str.location.line());
+      warn(fmt_str.fmt_str, std::forward<Args>(args)...);
     }
-    auto msg = format(rt_fmt_str, std::forward<Args>(args)...);
-    std::lock_guard<std::mutex> lock(tag_mutex_);
-    fmt::print(fg(fmt::terminal_color::yellow), "[{}/W]:{}\n", tag_, msg);
   }
 
   /**
-   * @brief Print log in RED if level is Verbosity::ERROR or greater
-   *        This function is rate limited by the rate specified in the
-   *        constructor.
-   * @param rt_fmt_str format string
+   * @brief Print log in RED if level is Verbosity::ERROR or greater.
+   *        This function is rate limited (per call site) by the rate
+   *        specified in the constructor. When a call site which was limited
+   *        logs again, the number of logs it suppressed is printed first.
+   * @param fmt_str format string, checked against the arguments at compile
+   *        time. Use fmt::runtime() to pass a format string which is only
+   *        known at run-time (async loggers then format the log before
+   *        queueing it, so the format string only has to outlive the call).
    * @param args optional arguments passed to be formatted.
    */
-  template <typename... Args> void error_rate_limited(std::string_view rt_fmt_str, Args &&...args) {
-    if (level_ > Verbosity::ERROR)
-      return;
-    if (rate_limit_ > std::chrono::duration<float>::zero()) {
-      auto now = std::chrono::high_resolution_clock::now();
-      if (now - last_print_ < rate_limit_)
+  template <typename... Args>
+  void error_rate_limited(RateLimitedFormatString<std::type_identity_t<Args>...> fmt_str,
+                          Args &&...args) {
+    if constexpr (MIN_VERBOSITY <= Verbosity::ERROR) {
+      if (level_ > Verbosity::ERROR)
         return;
-      last_print_ = now;
+      size_t num_suppressed = 0;
+      if (!rate_limit(fmt_str.location, num_suppressed))
+        return;
+      if (num_suppressed > 0)
+        error("Suppressed {} logs from {}:{}", num_suppressed, fmt_str.location.file_name(),
+              fmt_str.location.line());
+      error(fmt_str.fmt_str, std::forward<Args>(args)...);
     }
-    auto msg = format(rt_fmt_str, std::forward<Args>(args)...);
-    std::lock_guard<std::mutex> lock(tag_mutex_);
-    fmt::print(fg(fmt::terminal_color::red), "[{}/E]:{}\n", tag_, msg);
   }
 
 protected:
+  struct CallSite {
+    std::string_view file;
+    uint_least32_t line;
+    uint_least32_t column;
+    bool operator==(const CallSite &other) const = default;
+  };
+
+  struct CallSiteHash {
+    size_t operator()(const CallSite &site) const {
+      return std::hash<std::string_view>{}(site.file) ^ (site.line << 8) ^ site.column;
+    }
+  };
+
+  struct TokenBucket {
+    float tokens;
+    std::chrono::high_resolution_clock::time_point last_refill;
+    size_t num_suppressed{0};
+  };
+
+  bool rate_limit(const std::source_location &location, size_t &num_suppressed) {
+    if (rate_limit_ <= std::chrono::duration<float>::zero())
+      return true;
+    auto now = std::chrono::high_resolution_clock::now();
+    std::lock_guard<std::mutex> lock(rate_limit_mutex_);
+    CallSite site{location.file_name(), location.line(), location.column()};
+    auto [it, inserted] = token_buckets_.try_emplace(
+        site, TokenBucket{.tokens = static_cast<float>(rate_limit_burst_), .last_refill = now});
+    auto &bucket = it->second;
+    // refill one token per rate_limit_ since the last refill
+    float refill = std::chrono::duration<float>(now - bucket.last_refill) / rate_limit_;
+    bucket.tokens = std::min(bucket.tokens + refill, static_cast<float>(rate_limit_burst_));
+    bucket.last_refill = now;
+    if (bucket.tokens < 1.0f) {
+      bucket.num_suppressed++;
+      return false;
+    }
+    bucket.tokens -= 1.0f;
+    num_suppressed = bucket.num_suppressed;
+    bucket.num_suppressed = 0;
+    return true;
+  }
+
+#if ESPP_LOGGER_ASYNC
+  uint16_t get_tag_id() {
+    int32_t tag_id = tag_id_;
+    if (tag_id < 0) {
+      std::lock_guard<std::mutex> lock(tag_mutex_);
+      tag_id = detail::LogTagRegistry::get().intern(tag_);
+      tag_id_ = tag_id;
+    }
+    return static_cast<uint16_t>(tag_id);
+  }
+
+  template <typename... Args>
+  bool log_binary(Verbosity level, fmt::string_view fmt_str, bool fmt_is_literal,
+                  const Args &...args) {
+    if (!has_binary_sink_)
+      return false;
+    uint16_t tag_id = get_tag_id();
+    if (tag_id == detail::LogTagRegistry::INVALID_ID)
+      return false;
+    std::shared_ptr<BinaryLogSink> sink;
+    {
+      std::lock_guard<std::mutex> lock(tag_mutex_);
+      sink = binary_sink_;
+    }
+    if (!sink)
+      return false;
+    sink->write(tag_id, static_cast<uint8_t>(level),
+                std::string_view(fmt_str.data(), fmt_str.size()), fmt_is_literal, args...);
+    return true;
+  }
+
+  template <typename... Args>
+  bool log_async(Verbosity level, fmt::string_view fmt_str, bool fmt_is_literal,
+                 const Args &...args) {
+    if (!async_)
+      return false;
+    uint16_t tag_id = get_tag_id();
+    if (tag_id == detail::LogTagRegistry::INVALID_ID)
+      return false;
+    return detail::AsyncLogBackend::get().log(tag_id, static_cast<uint8_t>(level),
+                                              std::string_view(fmt_str.data(), fmt_str.size()),
+                                              fmt_is_literal, args...);
+  }
+#endif
+
   std::mutex tag_mutex_;
 
   /**
@@ -230,14 +570,83 @@ protected:
   std::chrono::duration<float> rate_limit_{0.0f};
 
   /**
-   *   Last time a log was printed. Used for rate limiting.
+   *   Number of logs each rate limited call site may print in a burst.
+   */
+  size_t rate_limit_burst_{1};
+
+  /**
+   *   Token bucket for each call site of the *_rate_limited methods.
    */
-  std::chrono::high_resolution_clock::time_point last_print_{};
+  std::unordered_map<CallSite, TokenBucket, CallSiteHash> token_buckets_;
+  std::mutex rate_limit_mutex_;
 
   /**
    *   Current verbosity of the logger. Determines what will be printed to
    *   console.
    */
   std::atomic<Verbosity> level_;
+
+#if ESPP_LOGGER_ASYNC
+  /**
+   *   Whether logs are queued for the async backend.
+   */
+  std::atomic<bool> async_{false};
+
+  /**
+   *   Id of tag_ in the detail::LogTagRegistry, or -1 if not yet registered.
+   */
+  std::atomic<int32_t> tag_id_{-1};
+
+  /**
+   *   Sink to write binary log records to instead of printing text, if any.
+   */
+  std::shared_ptr<BinaryLogSink> binary_sink_;
+  std::atomic<bool> has_binary_sink_{false};
+#endif
 };
 } // namespace espp
+
+/**
+ * Log with \p logger at Verbosity::DEBUG (see Logger::debug()). Unlike calling
+ * the method directly, the arguments are not evaluated at all if DEBUG is
+ * below ESPP_LOGGER_MIN_LEVEL.
+ */
+#define ESPP_LOG_DEBUG(logger, ...)                                                                \
+  do {                                                                                             \
+    if constexpr (espp::Logger::MIN_VERBOSITY <= espp::Logger::Verbosity::DEBUG) {                 \
+      (logger).debug(__VA_ARGS__);                                                                 \
+    }                                                                                              \
+  } while (0)
+
+/**
+ * Log with \p logger at Verbosity::INFO (see Logger::info()), without
+ * evaluating the arguments if INFO is below ESPP_LOGGER_MIN_LEVEL.
+ */
+#define ESPP_LOG_INFO(logger, ...)                                                                 \
+  do {                                                                                             \
+    if constexpr (espp::Logger::MIN_VERBOSITY <= espp::Logger::Verbosity::INFO) {                  \
+      (logger).info(__VA_ARGS__);                                                                  \
+    }                                                                                              \
+  } while (0)
+
+/**
+ * Log with \p logger at Verbosity::WARN (see Logger::warn()), without
+ * evaluating the arguments if WARN is below ESPP_LOGGER_MIN_LEVEL.
+ */
+#define ESPP_LOG_WARN(logger, ...)                                                                 \
+  do {                                                                                             \
+    if constexpr (espp::Logger::MIN_VERBOSITY <= espp::Logger::Verbosity::WARN) {                  \
+      (logger).warn(__VA_ARGS__);                                                                  \
+    }                                                                                              \
+  } while (0)
+
+/**
+ * Log with \p logger at Verbosity::ERROR (see Logger::error()), without
+ * evaluating the arguments if ERROR is below ESPP_LOGGER_MIN_LEVEL.
+ */
+#define ESPP_LOG_ERROR(logger, ...)                                                                \
+  do {                                                                                             \
+    if constexpr (espp::Logger::MIN_VERBOSITY <= espp::Logger::Verbosity::ERROR) {                 \
+      (logger).error(__VA_ARGS__);                                                                 \
+    }                                                                                              \
+  } while (0)
@@ -0,0 +1,144 @@
+import socket
+import struct
+import sys
+
+# record types, see espp::BinaryLogSink::RecordType
+TAG = 0
+FORMAT = 1
+LOG = 2
+
+# argument types, see espp::detail::LogArgType
+ARG_FORMATS = {
+    0: '<?',  # BOOL
+    1: '<c',  # CHAR
+    6: '<f',  # FLOAT
+    7: '<d',  # DOUBLE
+}
+ARG_SIGNED_VARINTS = [2, 4]  # INT32, INT64
+ARG_UNSIGNED_VARINTS = [3, 5]  # UINT32, UINT64
+ARG_STRING = 8
+
+def read_varint(data, offset):
+    """Read an unsigned LEB128 varint, returning (value, new offset), or
+    (None, offset) if data does not hold a whole varint."""
+    value = 0
+    shift = 0
+    while offset < len(data):
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, offset
+    return None, offset
+
+def zigzag_decode(value):
+    return (value >> 1) ^ -(value & 1)
+
+LEVELS = ['D', 'I', 'W', 'E']
+
+class Decoder:
+    def __init__(self):
+        self.tags = {}
+        self.formats = {}
+        self.timestamp = 0
+        self.buffer = b''
+
+    def unpack_args(self, data):
+        args = []
+        offset = 0
+        while offset < len(data):
+            arg_type = data[offset]
+            offset += 1
+            if arg_type in ARG_SIGNED_VARINTS:
+                value, offset = read_varint(data, offset)
+                args.append(zigzag_decode(value))
+            elif arg_type in ARG_UNSIGNED_VARINTS:
+                value, offset = read_varint(data, offset)
+                args.append(value)
+            elif arg_type == ARG_STRING:
+                size, = struct.unpack_from('<H', data, offset)
+                offset += 2
+                args.append(data[offset:offset + size].decode('utf-8', errors='replace'))
+                offset += size
+            else:
+                fmt = ARG_FORMATS[arg_type]
+                value, = struct.unpack_from(fmt, data, offset)
+                offset += struct.calcsize(fmt)
+                if arg_type == 0:
+                    # match libfmt's formatting of bools
+                    value = 'true' if value else 'false'
+                elif arg_type == 1:
+                    value = value.decode('utf-8', errors='replace')
+                args.append(value)
+        return args
+
+    def format_log(self, tag_id, level, timestamp, format_id, args):
+        tag = self.tags.get(tag_id, f"tag {tag_id}")
+        level = LEVELS[level] if level < len(LEVELS) else '?'
+        fmt = self.formats.get(format_id)
+        if fmt is None:
+            msg = f"<unknown format {format_id}> {args}"
+        else:
+            try:
+                # libfmt format strings are (mostly) compatible with python's
+                msg = fmt.format(*args)
+            except (ValueError, IndexError, KeyError):
+                msg = f"{fmt} {args}"
+        return f"{timestamp / 1e6:.6f} [{tag}/{level}]:{msg}"
+
+    def decode(self, data):
+        """Decode data, returning the decoded log lines. Partial records are
+        kept until the rest of their data is passed in."""
+        self.buffer += data
+        lines = []
+        while self.buffer:
+            header = self.buffer[0]
+            size, offset = read_varint(self.buffer, 1)
+            if size is None or len(self.buffer) < offset + size:
+                break
+            payload = self.buffer[offset:offset + size]
+            self.buffer = self.buffer[offset + size:]
+            record_type = header & 0x3
+            if record_type == TAG:
+                tag_id, offset = read_varint(payload, 0)
+                self.tags[tag_id] = payload[offset:].decode('utf-8', errors='replace')
+            elif record_type == FORMAT:
+                format_id, offset = read_varint(payload, 0)
+                self.formats[format_id] = payload[offset:].decode('utf-8', errors='replace')
+            elif record_type == LOG:
+                level = (header >> 2) & 0x7
+                tag_id, offset = read_varint(payload, 0)
+                delta, offset = read_varint(payload, offset)
+                format_id, offset = read_varint(payload, offset)
+                self.timestamp += delta
+                args = self.unpack_args(payload[offset:])
+                lines.append(self.format_log(tag_id, level, self.timestamp, format_id, args))
+            else:
+                print(f"Unknown record type {record_type}, skipping {size} bytes")
+        return lines
+
+def decode_file(path):
+    decoder = Decoder()
+    with open(path, 'rb') as f:
+        for line in decoder.decode(f.read()):
+            print(line)
+
+def decode_udp(port):
+    decoder = Decoder()
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(('', port))
+    print(f"Listening for binary logs on UDP port {port}, press Ctrl+C to quit")
+    while True:
+        data, _ = sock.recvfrom(65536)
+        for line in decoder.decode(data):
+            print(line)
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print("Usage: python ./decode_binary_log.py <log file | udp port>")
+        sys.exit(1)
+    if sys.argv[1].isdigit():
+        decode_udp(int(sys.argv[1]))
+    else:
+        decode_file(sys.argv[1])
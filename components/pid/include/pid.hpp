@@ -6,6 +6,41 @@
 
 #include "logger.hpp"
 
+namespace espp {
+/**
+ * @brief Configuration for the Pid controller.
+ * @note Declared outside Pid (use Pid::Config) so that its formatter is
+ *       visible to the class's log calls.
+ */
+struct PidConfig {
+  float kp; /**< Proportional gain. */
+  float ki; /**< Integral gain. @note should not be pre-multiplied by the time constant. */
+  float kd; /**< Derivative gain. @note should not be pre-divided by the time-constant. */
+  float integrator_min; /**< Minimum value the integrator can wind down to. @note Operates at the
+                           same scale as \p output_min and \p output_max. Could be 0 or negative.
+                           Can have different magnitude from integrator_max for asymmetric
+                           response. */
+  float integrator_max; /**< Maximum value the integrator can wind up to. @note Operates at the
+                           same scale as \p output_min and \p output_max. */
+  float output_min; /**< Limit the minimum output value. Can be a different magnitude from output
+                       max for asymmetric output behavior. */
+  float output_max; /**< Limit the maximum output value. */
+  espp::Logger::Verbosity log_level{
+      espp::Logger::Verbosity::WARN}; /**< Verbosity for the adc logger. */
+};
+} // namespace espp
+
+// for allowing easy serialization/printing of the
+// espp::PidConfig
+template <> struct fmt::formatter<espp::PidConfig> {
+  template <typename ParseContext> constexpr auto parse(ParseContext &ctx) { return ctx.begin(); }
+
+  template <typename FormatContext> auto format(espp::PidConfig const &cfg, FormatContext &ctx) {
+    return fmt::format_to(ctx.out(), "{}, {}, {}, {}, {}, {}, {}", cfg.kp, cfg.ki, cfg.kd,
+                          cfg.integrator_min, cfg.integrator_max, cfg.output_min, cfg.output_max);
+  }
+};
+
 namespace espp {
 /**
  *  @brief Simple PID (proportional, integral, derivative) controller class
@@ -21,22 +56,7 @@ namespace espp {
  */
 class Pid {
 public:
-  struct Config {
-    float kp; /**< Proportional gain. */
-    float ki; /**< Integral gain. @note should not be pre-multiplied by the time constant. */
-    float kd; /**< Derivative gain. @note should not be pre-divided by the time-constant. */
-    float integrator_min; /**< Minimum value the integrator can wind down to. @note Operates at the
-                             same scale as \p output_min and \p output_max. Could be 0 or negative.
-                             Can have different magnitude from integrator_max for asymmetric
-                             response. */
-    float integrator_max; /**< Maximum value the integrator can wind up to. @note Operates at the
-                             same scale as \p output_min and \p output_max. */
-    float output_min; /**< Limit the minimum output value. Can be a different magnitude from output
-                         max for asymmetric output behavior. */
-    float output_max; /**< Limit the maximum output value. */
-    espp::Logger::Verbosity log_level{
-        espp::Logger::Verbosity::WARN}; /**< Verbosity for the adc logger. */
-  };
+  typedef PidConfig Config; ///< Configuration for the PID controller.
 
   /**
    * @brief Create the PID controller.
@@ -170,14 +190,3 @@ template <> struct fmt::formatter<espp::Pid> {
     return fmt::format_to(ctx.out(), "{}, {}", pid.get_error(), pid.get_integrator());
   }
 };
-
-// for allowing easy serialization/printing of the
-// espp::Pid::Config
-template <> struct fmt::formatter<espp::Pid::Config> {
-  template <typename ParseContext> constexpr auto parse(ParseContext &ctx) { return ctx.begin(); }
-
-  template <typename FormatContext> auto format(espp::Pid::Config const &cfg, FormatContext &ctx) {
-    return fmt::format_to(ctx.out(), "{}, {}, {}, {}, {}, {}, {}", cfg.kp, cfg.ki, cfg.kd,
-                          cfg.integrator_min, cfg.integrator_max, cfg.output_min, cfg.output_max);
-  }
-};
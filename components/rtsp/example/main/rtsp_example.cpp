@@ -1,8 +1,14 @@
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdlib>
 #include <functional>
 #include <iterator>
+#include <new>
+#include <string>
 #include <thread>
+#include <tuple>
+#include <vector>
 
 #include "sdkconfig.h"
 
@@ -22,6 +28,22 @@
 using namespace std::chrono_literals;
 using namespace std::placeholders;
 
+// count the heap allocations made by the process so that the benchmark below
+// can report allocations per frame
+static std::atomic<size_t> num_allocations{0};
+
+void *operator new(size_t size) {
+  num_allocations++;
+  void *ptr = std::malloc(size);
+  if (!ptr) {
+    std::abort();
+  }
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
 extern "C" void app_main(void) {
   espp::Logger logger({.tag = "main", .level = espp::Logger::Verbosity::INFO});
 
@@ -52,6 +74,352 @@ extern "C" void app_main(void) {
     std::this_thread::sleep_for(100ms);
   }
 
+  logger.info("Starting RTSP packetization benchmark!");
+  //! [rtsp_packetization_benchmark]
+  {
+    static constexpr size_t num_frames = 500;
+    // make a synthetic MJPEG frame of the given size with scan_size bytes of
+    // (random) scan data
+    auto make_frame = [](int width, int height, size_t scan_size) {
+      std::string q0(64, 16), q1(64, 17);
+      espp::JpegHeader header(width, height, q0, q1);
+      std::string data(header.get_data());
+      for (size_t i = 0; i < scan_size; i++) {
+        // avoid 0xFF, which would start a JPEG marker
+        data.push_back(static_cast<char>(std::rand() % 0xFF));
+      }
+      data += "\xFF\xD9";
+      return std::make_shared<const espp::JpegFrame>(data.data(), data.size());
+    };
+    // packetize frames which are never sent (no client is connected), returning
+    // {frames/s, allocations/frame}. Sending the frame by reference copies its
+    // scan data once, sending it as a shared_ptr doesn't copy it at all.
+    auto run_benchmark = [&](std::shared_ptr<const espp::JpegFrame> frame, bool by_reference) {
+      espp::RtspServer server({
+          .server_address = ip_address,
+          .port = CONFIG_RTSP_SERVER_PORT + 1,
+          .path = "/benchmark",
+      });
+      auto send_frame = [&]() {
+        if (by_reference) {
+          server.send_frame(*frame);
+        } else {
+          server.send_frame(frame);
+        }
+      };
+      // the first frames grow the packet pool to fit the frame
+      for (size_t i = 0; i < 3; i++) {
+        send_frame();
+      }
+      auto start = std::chrono::high_resolution_clock::now();
+      size_t start_allocations = num_allocations;
+      for (size_t i = 0; i < num_frames; i++) {
+        send_frame();
+      }
+      size_t allocations = num_allocations - start_allocations;
+      auto end = std::chrono::high_resolution_clock::now();
+      float elapsed = std::chrono::duration<float>(end - start).count();
+      return std::make_pair(num_frames / elapsed, (float)allocations / num_frames);
+    };
+
+    // roughly the size of a medium quality camera frame at each resolution
+    auto qvga_frame = make_frame(320, 240, 10 * 1024);
+    auto vga_frame = make_frame(640, 480, 30 * 1024);
+    for (bool by_reference : {true, false}) {
+      auto [qvga_rate, qvga_allocs] = run_benchmark(qvga_frame, by_reference);
+      auto [vga_rate, vga_allocs] = run_benchmark(vga_frame, by_reference);
+      fmt::print("Packetized {} frames ({}):\n"
+                 "  320x240: {:8.0f} frames/s, {:.2f} allocations/frame\n"
+                 "  640x480: {:8.0f} frames/s, {:.2f} allocations/frame\n",
+                 num_frames, by_reference ? "by reference" : "shared_ptr", qvga_rate, qvga_allocs,
+                 vga_rate, vga_allocs);
+    }
+  }
+  //! [rtsp_packetization_benchmark]
+
+  logger.info("Starting JPEG header benchmark!");
+  //! [jpeg_header_benchmark]
+  {
+    // start a JpegFrame from the first packet of many frames of a stream, as
+    // the RtspClient does when it reassembles them, generating the JPEG header
+    // for every frame or looking it up in a JpegHeaderCache
+    static constexpr size_t num_frames = 10000;
+    std::string q0(64, 16), q1(64, 17);
+    std::string scan(1000, 0x55);
+    espp::RtpJpegPacket first_packet(0, 0, 128, 640, 480, q0, q1, scan);
+    first_packet.serialize();
+    // the packet as it is received, with its tables parsed from its own data
+    espp::RtpJpegPacket packet(first_packet.get_data());
+    espp::JpegHeaderCache header_cache({});
+    espp::JpegFrame frame;
+    for (bool cached : {false, true}) {
+      auto reset_frame = [&]() {
+        if (cached) {
+          frame.reset(*header_cache.get(packet.get_width(), packet.get_height(),
+                                        packet.get_q_table(0), packet.get_q_table(1)),
+                      packet);
+        } else {
+          frame.reset(packet);
+        }
+      };
+      // the first frame grows the frame to fit (and fills the cache)
+      reset_frame();
+      auto start = std::chrono::high_resolution_clock::now();
+      size_t start_allocations = num_allocations;
+      for (size_t i = 0; i < num_frames; i++) {
+        reset_frame();
+      }
+      size_t allocations = num_allocations - start_allocations;
+      auto end = std::chrono::high_resolution_clock::now();
+      float elapsed = std::chrono::duration<float, std::nano>(end - start).count();
+      fmt::print("JPEG header {}: {:.0f} ns/frame, {:.2f} allocations/frame\n",
+                 cached ? "from cache" : "generated", elapsed / num_frames,
+                 (float)allocations / num_frames);
+    }
+  }
+  //! [jpeg_header_benchmark]
+
+  logger.info("Starting RTSP transport benchmark!");
+  //! [rtsp_transport_benchmark]
+  // stream frames over loopback to a client using UDP and then to a client
+  // using RTP over the RTSP (TCP) connection, and compare the throughput
+  espp::RtspServer benchmark_server({
+      .server_address = "127.0.0.1",
+      .port = CONFIG_RTSP_SERVER_PORT + 2,
+      .path = "/benchmark",
+      .session_adaptation = {.enabled = false},
+  });
+  benchmark_server.start();
+  {
+    static constexpr auto benchmark_duration = 2s;
+    std::string q0(64, 16), q1(64, 17);
+    espp::JpegHeader header(640, 480, q0, q1);
+    std::string data(header.get_data());
+    for (size_t i = 0; i < 30 * 1024; i++) {
+      // avoid 0xFF, which would start a JPEG marker
+      data.push_back(static_cast<char>(std::rand() % 0xFF));
+    }
+    data += "\xFF\xD9";
+    auto frame = std::make_shared<const espp::JpegFrame>(data.data(), data.size());
+
+    for (bool interleaved : {false, true}) {
+      std::atomic<size_t> frames_received{0};
+      std::atomic<size_t> bytes_received{0};
+      espp::RtspClient client({
+          .server_address = "127.0.0.1",
+          .rtsp_port = CONFIG_RTSP_SERVER_PORT + 2,
+          .path = "/benchmark",
+          .on_jpeg_frame =
+              [&](std::unique_ptr<espp::JpegFrame> jpeg_frame) {
+                frames_received++;
+                bytes_received += jpeg_frame->get_data().size();
+              },
+          .log_level = espp::Logger::Verbosity::WARN,
+      });
+      std::error_code ec;
+      client.connect(ec);
+      client.describe(ec);
+      if (interleaved) {
+        client.setup_interleaved(ec);
+      } else {
+        client.setup(ec);
+      }
+      client.play(ec);
+      if (ec) {
+        logger.error("Error starting the benchmark client: {}", ec.message());
+        continue;
+      }
+      // offer frames faster than they can be sent, the session only ever
+      // sends the latest one
+      auto start = std::chrono::high_resolution_clock::now();
+      while (std::chrono::high_resolution_clock::now() - start < benchmark_duration) {
+        benchmark_server.send_frame(frame);
+        std::this_thread::sleep_for(1ms);
+      }
+      std::this_thread::sleep_for(100ms);
+      auto end = std::chrono::high_resolution_clock::now();
+      float elapsed = std::chrono::duration<float>(end - start).count();
+      for (const auto &[session_id, stats] : benchmark_server.get_session_stats()) {
+        auto average_latency = stats.frames_sent
+                                   ? stats.total_send_latency.count() / stats.frames_sent
+                                   : 0;
+        fmt::print("{}: received {} frames ({:.2f} MB/s), sent {} packets, "
+                   "average send latency {} us, round trip time {} us\n",
+                   interleaved ? "TCP interleaved" : "UDP", frames_received.load(),
+                   bytes_received / elapsed / 1e6f, stats.packets_sent, average_latency,
+                   stats.round_trip_time.count());
+      }
+      // the client tears down the session when it is destroyed
+    }
+  }
+  //! [rtsp_transport_benchmark]
+
+  logger.info("Starting RTSP multicast benchmark!");
+  //! [rtsp_multicast_benchmark]
+  // stream frames to a growing number of multicast clients (which receive the
+  // group's packets because the server's multicast sockets loop them back to
+  // this device) and show that the server sends the same number of packets
+  // however many clients there are
+  espp::RtspServer multicast_server({
+      .server_address = ip_address,
+      .port = CONFIG_RTSP_SERVER_PORT + 3,
+      .path = "/multicast",
+      .multicast = {.group_address = "239.255.0.1"},
+  });
+  multicast_server.start();
+  {
+    static constexpr auto benchmark_duration = 2s;
+    std::string q0(64, 16), q1(64, 17);
+    espp::JpegHeader header(320, 240, q0, q1);
+    std::string data(header.get_data());
+    for (size_t i = 0; i < 10 * 1024; i++) {
+      // avoid 0xFF, which would start a JPEG marker
+      data.push_back(static_cast<char>(std::rand() % 0xFF));
+    }
+    data += "\xFF\xD9";
+    auto frame = std::make_shared<const espp::JpegFrame>(data.data(), data.size());
+
+    for (size_t num_clients : {1, 2, 4}) {
+      std::atomic<size_t> frames_received{0};
+      std::vector<std::unique_ptr<espp::RtspClient>> clients;
+      for (size_t i = 0; i < num_clients; i++) {
+        auto client = std::make_unique<espp::RtspClient>(espp::RtspClient::Config{
+            .server_address = ip_address,
+            .rtsp_port = CONFIG_RTSP_SERVER_PORT + 3,
+            .path = "/multicast",
+            .on_jpeg_frame =
+                [&](std::unique_ptr<espp::JpegFrame> jpeg_frame) { frames_received++; },
+            .log_level = espp::Logger::Verbosity::WARN,
+        });
+        std::error_code ec;
+        client->connect(ec);
+        client->describe(ec);
+        client->setup_multicast(ec);
+        client->play(ec);
+        if (ec) {
+          logger.error("Error starting multicast client {}: {}", i, ec.message());
+        }
+        clients.push_back(std::move(client));
+      }
+      auto start_stats = multicast_server.get_multicast_stats();
+      auto start = std::chrono::high_resolution_clock::now();
+      while (std::chrono::high_resolution_clock::now() - start < benchmark_duration) {
+        multicast_server.send_frame(frame);
+        std::this_thread::sleep_for(50ms);
+      }
+      std::this_thread::sleep_for(100ms);
+      auto stats = multicast_server.get_multicast_stats();
+      fmt::print("{} multicast client(s): server sent {} frames as {} packets, clients received "
+                 "{} frames in total\n",
+                 num_clients, stats.frames_sent - start_stats.frames_sent,
+                 stats.packets_sent - start_stats.packets_sent, frames_received.load());
+      // the clients tear down their sessions when they are destroyed
+    }
+  }
+  //! [rtsp_multicast_benchmark]
+
+  logger.info("Starting RTSP jitter buffer example!");
+  //! [rtsp_jitter_buffer_example]
+  // replay a captured RTP stream to a client, in order, with packets
+  // reordered, and with packets reordered and lost, and show that the client
+  // puts the packets back in order and only drops the frames which lost a
+  // packet. The server only sets up the session; the replayed packets are the
+  // only ones the client receives.
+  espp::RtspServer replay_server({
+      .server_address = "127.0.0.1",
+      .port = CONFIG_RTSP_SERVER_PORT + 4,
+      .path = "/replay",
+  });
+  replay_server.start();
+  {
+    static constexpr size_t num_frames = 100;
+    static constexpr size_t max_data_size = 1000;
+    static constexpr int client_rtp_port = 5010;
+    std::string q0(64, 16), q1(64, 17);
+    std::string scan;
+    for (size_t i = 0; i < 8 * 1024; i++) {
+      // avoid 0xFF, which would start a JPEG marker
+      scan.push_back(static_cast<char>(std::rand() % 0xFF));
+    }
+    // "capture" the packets a server would send for the frames
+    std::vector<std::string> capture;
+    uint16_t sequence_number = 0;
+    for (size_t i = 0; i < num_frames; i++) {
+      for (size_t offset = 0; offset < scan.size(); offset += max_data_size) {
+        auto scan_data = std::string_view(scan).substr(offset, max_data_size);
+        // like the server, only the first packet has the quantization tables
+        auto packet = offset == 0 ? espp::RtpJpegPacket(0, 0, 128, 320, 240, q0, q1, scan_data)
+                                  : espp::RtpJpegPacket(0, offset, 0, 96, 320, 240, scan_data);
+        packet.set_payload_type(26);
+        packet.set_sequence_number(sequence_number++);
+        packet.set_timestamp(i * 3000);
+        packet.set_ssrc(0x12345678);
+        packet.set_marker(offset + max_data_size >= scan.size());
+        packet.serialize();
+        capture.emplace_back(packet.get_data());
+      }
+    }
+
+    espp::UdpSocket replay_socket({.log_level = espp::Logger::Verbosity::WARN});
+    for (auto [name, reorder, lose] : {std::make_tuple("in order", false, false),
+                                       std::make_tuple("reordered", true, false),
+                                       std::make_tuple("reordered and lossy", true, true)}) {
+      // swap the first packet of every other group of 4 packets with one of
+      // the other 3, and lose 1% of the packets
+      std::vector<size_t> order;
+      for (size_t i = 0; i < capture.size(); i++) {
+        if (!lose || std::rand() % 100 != 0) {
+          order.push_back(i);
+        }
+      }
+      for (size_t i = 0; reorder && i + 3 < order.size(); i += 4) {
+        if (std::rand() % 2 == 0) {
+          std::swap(order[i], order[i + 1 + std::rand() % 3]);
+        }
+      }
+
+      std::atomic<size_t> frames_intact{0};
+      espp::RtspClient client({
+          .server_address = "127.0.0.1",
+          .rtsp_port = CONFIG_RTSP_SERVER_PORT + 4,
+          .path = "/replay",
+          .on_shared_jpeg_frame =
+              [&](std::shared_ptr<const espp::JpegFrame> jpeg_frame) {
+                if (jpeg_frame->get_scan_data() == scan) {
+                  frames_intact++;
+                }
+              },
+          .jitter_buffer_depth = 8,
+          .log_level = espp::Logger::Verbosity::WARN,
+      });
+      std::error_code ec;
+      client.connect(ec);
+      client.describe(ec);
+      client.setup(client_rtp_port, client_rtp_port + 1, ec);
+      if (ec) {
+        logger.error("Error setting up the replay client: {}", ec.message());
+        continue;
+      }
+      for (size_t i = 0; i < order.size(); i++) {
+        replay_socket.send(capture[order[i]],
+                           {.ip_address = "127.0.0.1", .port = client_rtp_port});
+        if (i % 8 == 7) {
+          // don't overflow the client's receive buffer
+          std::this_thread::sleep_for(1ms);
+        }
+      }
+      std::this_thread::sleep_for(100ms);
+      auto stats = client.get_stats();
+      fmt::print("Replayed {} of {} packets {}: {} reordered, {} lost, {} late; {} of {} frames "
+                 "received ({} intact), {} dropped\n",
+                 stats.packets_received, capture.size(), name, stats.packets_reordered,
+                 stats.packets_lost, stats.packets_late, stats.frames_received, num_frames,
+                 frames_intact.load(), stats.frames_dropped);
+      // the client tears down the session when it is destroyed
+    }
+  }
+  //! [rtsp_jitter_buffer_example]
+
   //! [rtsp_server_example]
   const int server_port = CONFIG_RTSP_SERVER_PORT;
   const std::string server_uri = fmt::format("rtsp://{}:{}/mjpeg/1", ip_address, server_port);
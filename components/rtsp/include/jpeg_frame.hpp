@@ -25,12 +25,52 @@ public:
     add_scan(packet);
   }
 
+  /// Construct an empty JpegFrame, e.g. to be filled in later with reset().
+  JpegFrame() = default;
+
   /// Construct a JpegFrame from buffer of jpeg data
   /// @param data The buffer containing the jpeg data.
   /// @param size The size of the buffer.
   explicit JpegFrame(const char *data, size_t size)
       : data_(data, data + size), header_(std::string_view((const char *)data_.data(), size)) {}
 
+  /// Restart the frame from the first RtpJpegPacket of a new frame, reusing
+  /// the frame's memory.
+  ///
+  /// This regenerates the header from the packet and replaces the frame's
+  /// data with it and the packet's JPEG data.
+  ///
+  /// @param packet The first packet of the new frame.
+  void reset(const RtpJpegPacket &packet) {
+    finalized_ = false;
+    header_.reset(packet.get_width(), packet.get_height(), packet.get_q_table(0),
+                  packet.get_q_table(1));
+    serialize_header();
+    add_scan(packet);
+  }
+
+  /// Restart the frame from the first RtpJpegPacket of a new frame and an
+  /// already generated header (e.g. from a JpegHeaderCache), reusing the
+  /// frame's memory.
+  ///
+  /// This copies the header instead of regenerating it from the packet, and
+  /// replaces the frame's data with it and the packet's JPEG data.
+  ///
+  /// @param header The header for the packet's image size and quantization
+  ///        tables.
+  /// @param packet The first packet of the new frame.
+  void reset(const JpegHeader &header, const RtpJpegPacket &packet) {
+    finalized_ = false;
+    header_ = header;
+    serialize_header();
+    add_scan(packet);
+  }
+
+  /// Reserve memory for the serialized frame, so that adding scans does not
+  /// allocate until the frame is larger than this.
+  /// @param size The number of bytes to reserve.
+  void reserve(size_t size) { data_.reserve(size); }
+
   /// Get a reference to the header.
   /// @return A reference to the header.
   const JpegHeader &get_header() const { return header_; }
@@ -96,7 +136,10 @@ protected:
       // TODO: handle this error
       return;
     }
-    data_.insert(std::end(data_), std::begin(scan), std::end(scan));
+    // insert as bytes, so that the scan is copied with memcpy rather than
+    // converted one char at a time
+    auto scan_data = reinterpret_cast<const uint8_t *>(scan.data());
+    data_.insert(std::end(data_), scan_data, scan_data + scan.size());
   }
 
   /// Add the EOI marker to the frame.
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "jpeg_frame.hpp"
+
+namespace espp {
+/// Pool of preallocated JpegFrames, which is reused across frames so that
+/// reassembling received frames does not allocate.
+///
+/// Frames are handed out as std::shared_ptr to slots that are allocated
+/// once; a slot is free again once the pool holds its only reference, i.e.
+/// once everyone the frame was handed to has released it. A frame's buffer
+/// only grows (allocates) if it has to hold a larger frame than it has ever
+/// held before, and the pool only grows if more frames are in use at once
+/// than it has.
+///
+/// @note This class is not thread safe: frames must be acquired from a
+///       single task, though they may be released from any task.
+class JpegFramePool {
+public:
+  /// @brief Configuration for the frame pool
+  struct Config {
+    size_t num_frames = 2; ///< The number of frames preallocated. 2 frames allow one frame to be
+                           ///< reassembled while the previous one is being used.
+    size_t max_num_frames = 4; ///< The maximum number of frames the pool can grow to, if more
+                               ///< than num_frames frames are in use at the same time.
+    size_t frame_size = 0; ///< The number of bytes reserved in each frame up front. If 0, the
+                           ///< frames grow to the size of the largest frame received.
+  };
+
+  /// @brief Construct the frame pool, allocating all of its frames
+  /// @param config The configuration for the frame pool
+  explicit JpegFramePool(const Config &config)
+      : frame_size_(config.frame_size),
+        max_num_frames_(std::max(config.num_frames, config.max_num_frames)) {
+    frames_.reserve(config.num_frames);
+    for (size_t i = 0; i < config.num_frames; i++) {
+      frames_.emplace_back(make_frame());
+    }
+  }
+
+  /// @brief Get a free frame to fill with JpegFrame::reset()
+  /// @details If all frames are in use, a new frame is added to the pool,
+  ///          unless the pool already has Config::max_num_frames frames.
+  /// @return The frame, or nullptr if all frames are in use
+  std::shared_ptr<JpegFrame> acquire() {
+    for (auto &frame : frames_) {
+      // NOTE: references are only created by the pool or copied from
+      // existing ones, so if the pool holds the only reference nobody else
+      // can get one
+      if (frame.use_count() == 1) {
+        // the frame may have been released by another task: see
+        // RtpPacketPool::acquire() for why this fence is enough
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return frame;
+      }
+    }
+    if (frames_.size() < max_num_frames_) {
+      return frames_.emplace_back(make_frame());
+    }
+    return nullptr;
+  }
+
+protected:
+  std::shared_ptr<JpegFrame> make_frame() const {
+    auto frame = std::make_shared<JpegFrame>();
+    frame->reserve(frame_size_);
+    return frame;
+  }
+
+  size_t frame_size_;
+  size_t max_num_frames_;
+  std::vector<std::shared_ptr<JpegFrame>> frames_;
+};
+} // namespace espp
@@ -21,13 +21,52 @@ public:
     serialize();
   }
 
+  /// Create an empty JPEG header, e.g. to be filled in later with reset().
+  JpegHeader() = default;
+
   /// Create a JPEG header from a given JPEG header data.
   explicit JpegHeader(std::string_view data) : data_(data.data(), data.data() + data.size()) {
     parse();
   }
 
+  /// Copy a JPEG header.
+  /// @param other The header to copy.
+  JpegHeader(const JpegHeader &other) { *this = other; }
+
+  /// Copy a JPEG header, reusing this header's memory.
+  /// @param other The header to copy.
+  /// @return A reference to this header.
+  JpegHeader &operator=(const JpegHeader &other) {
+    if (this != &other) {
+      width_ = other.width_;
+      height_ = other.height_;
+      data_ = other.data_;
+      // refer to our own copy of the tables, not the other header's
+      q0_table_ = other.rebind(other.q0_table_, data_);
+      q1_table_ = other.rebind(other.q1_table_, data_);
+    }
+    return *this;
+  }
+
+  JpegHeader(JpegHeader &&) = default;
+  JpegHeader &operator=(JpegHeader &&) = default;
+
   ~JpegHeader() {}
 
+  /// Regenerate the header in place for a given image size and quantization
+  /// tables, reusing its memory.
+  /// @param width The image width in pixels.
+  /// @param height The image height in pixels.
+  /// @param q0_table The quantization table for the Y channel.
+  /// @param q1_table The quantization table for the Cb and Cr channels.
+  void reset(int width, int height, std::string_view q0_table, std::string_view q1_table) {
+    width_ = width;
+    height_ = height;
+    q0_table_ = q0_table;
+    q1_table_ = q1_table;
+    serialize();
+  }
+
   /// Get the image width.
   /// @return The image width in pixels.
   int get_width() const { return width_; }
@@ -547,6 +586,16 @@ protected:
     return offset;
   }
 
+  /// Get the view of data_ at the same offset as a view of this header's
+  /// data_, or the view itself if it does not point into data_
+  std::string_view rebind(std::string_view view, const std::vector<uint8_t> &data) const {
+    auto begin = (const char *)data_.data();
+    if (view.data() < begin || view.data() + view.size() > begin + data_.size()) {
+      return view;
+    }
+    return std::string_view((const char *)data.data() + (view.data() - begin), view.size());
+  }
+
   void serialize() {
     int header_size = 2 + sizeof(JFIF_APP0_DATA) + DQT_HEADER_SIZE + q0_table_.size() +
                       DQT_HEADER_SIZE + q1_table_.size() + sizeof(HUFFMAN_TABLES) + SOF0_SIZE +
@@ -570,6 +619,8 @@ protected:
     data_[offset++] = 0x43;
     data_[offset++] = 0x00;
     memcpy(data_.data() + offset, q0_table_.data(), q0_table_.size());
+    // refer to our own copy of the table, which outlives the caller's
+    q0_table_ = std::string_view((const char *)data_.data() + offset, q0_table_.size());
     offset += q0_table_.size();
 
     // add the DQT marker for chrominance
@@ -579,6 +630,7 @@ protected:
     data_[offset++] = 0x43;
     data_[offset++] = 0x01;
     memcpy(data_.data() + offset, q1_table_.data(), q1_table_.size());
+    q1_table_ = std::string_view((const char *)data_.data() + offset, q1_table_.size());
     offset += q1_table_.size();
 
     // add huffman tables
@@ -755,8 +807,8 @@ protected:
     data_.resize(offset);
   }
 
-  int width_;
-  int height_;
+  int width_{0};
+  int height_{0};
   std::string_view q0_table_;
   std::string_view q1_table_;
 
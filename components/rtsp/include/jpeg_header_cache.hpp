@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "jpeg_header.hpp"
+
+namespace espp {
+/// Least recently used cache of serialized JPEG headers, keyed on the image
+/// size and quantization tables.
+///
+/// The size and quantization tables of a stream almost never change, so the
+/// headers of received frames can be looked up instead of being regenerated
+/// for every frame; JpegFrame::reset(const JpegHeader &, const RtpJpegPacket &)
+/// then just copies the cached header into the frame. The cache is small and
+/// searched linearly, most recently used entry first, so a hit is a few
+/// comparisons and does not allocate.
+///
+/// \section jpeg_header_cache_ex1 JpegHeaderCache Benchmark
+/// \snippet rtsp_example.cpp jpeg_header_benchmark
+///
+/// @note This class is not thread safe.
+class JpegHeaderCache {
+public:
+  /// @brief Configuration for the header cache
+  struct Config {
+    size_t max_num_headers = 4; ///< The maximum number of headers cached. When the cache is full,
+                                ///< the least recently used header is replaced.
+  };
+
+  /// @brief Construct the header cache
+  /// @param config The configuration for the header cache
+  explicit JpegHeaderCache(const Config &config)
+      : max_num_headers_(std::max<size_t>(config.max_num_headers, 1)) {
+    headers_.reserve(max_num_headers_);
+  }
+
+  /// @brief Get the header for an image size and quantization tables,
+  ///        generating it if it is not cached
+  /// @param width The image width in pixels.
+  /// @param height The image height in pixels.
+  /// @param q0_table The quantization table for the Y channel.
+  /// @param q1_table The quantization table for the Cb and Cr channels.
+  /// @return The header, which stays valid while it is held even if it is
+  ///         evicted from the cache
+  std::shared_ptr<const JpegHeader> get(int width, int height, std::string_view q0_table,
+                                        std::string_view q1_table) {
+    auto it = std::find_if(headers_.begin(), headers_.end(), [&](const auto &header) {
+      return header->get_width() == width && header->get_height() == height &&
+             header->get_quantization_table(0) == q0_table &&
+             header->get_quantization_table(1) == q1_table;
+    });
+    if (it != headers_.end()) {
+      num_hits_++;
+    } else {
+      num_misses_++;
+      auto header = std::make_shared<const JpegHeader>(width, height, q0_table, q1_table);
+      if (headers_.size() < max_num_headers_) {
+        it = headers_.insert(headers_.end(), std::move(header));
+      } else {
+        // replace the least recently used header
+        it = headers_.end() - 1;
+        *it = std::move(header);
+      }
+    }
+    // move the header to the front, as the most recently used
+    std::rotate(headers_.begin(), it, it + 1);
+    return headers_.front();
+  }
+
+  /// @brief Get the number of lookups which found a cached header
+  /// @return The number of cache hits
+  size_t get_num_hits() const { return num_hits_; }
+
+  /// @brief Get the number of lookups which had to generate a header
+  /// @return The number of cache misses
+  size_t get_num_misses() const { return num_misses_; }
+
+protected:
+  size_t max_num_headers_;
+  std::vector<std::shared_ptr<const JpegHeader>> headers_; ///< Most recently used first
+  size_t num_hits_{0};
+  size_t num_misses_{0};
+};
+} // namespace espp
@@ -1,25 +1,191 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace espp {
 /// @brief A class to represent a RTCP packet
-/// @details This class is used to represent a RTCP packet.
-///          It is used as a base class for all RTCP packet types.
+/// @details This class is used to represent a RTCP packet (RFC 3550).
+///          It is used as a base class for all RTCP packet types, and
+///          handles the common RTCP header and the reception report blocks
+///          which are shared by sender and receiver reports.
 class RtcpPacket {
 public:
+  /// The RTCP packet types
+  enum class Type : uint8_t {
+    SENDER_REPORT = 200,      ///< SR: sender report
+    RECEIVER_REPORT = 201,    ///< RR: receiver report
+    SOURCE_DESCRIPTION = 202, ///< SDES: source description
+    BYE = 203,                ///< BYE: goodbye
+    APP = 204,                ///< APP: application-defined
+  };
+
+  /// A reception report block, which is sent in sender and receiver reports
+  /// to report on the reception of RTP packets from one source
+  struct ReportBlock {
+    uint32_t ssrc{0};             ///< The SSRC of the source this block reports on
+    uint8_t fraction_lost{0};     ///< The fraction of packets lost since the last report, in
+                                  ///< units of 1/256
+    int32_t cumulative_lost{0};   ///< The number of packets lost since the start of reception
+                                  ///< (24 bit signed)
+    uint32_t highest_sequence{0}; ///< The extended highest sequence number received
+    uint32_t jitter{0};           ///< The interarrival jitter, in RTP timestamp units
+    uint32_t last_sr{0}; ///< The middle 32 bits of the NTP timestamp of the last sender report
+                         ///< received from the source, or 0
+    uint32_t delay_since_last_sr{0}; ///< The delay between receiving the last sender report and
+                                     ///< sending this report, in units of 1/65536 seconds
+  };
+
+  /// Construct an empty RtcpPacket
   RtcpPacket() = default;
+
+  /// Construct an RtcpPacket from a buffer, parsing its header
+  /// @param data The buffer containing a single RTCP packet
+  explicit RtcpPacket(std::string_view data) : packet_(data.begin(), data.end()) {
+    parse_header();
+  }
+
   virtual ~RtcpPacket() = default;
 
+  /// Get whether the packet has a valid RTCP header
+  /// @return True if the packet is valid, false otherwise
+  bool is_valid() const { return valid_; }
+
+  /// Get the packet type
+  /// @return The packet type field
+  int get_type() const { return type_; }
+
+  /// Get the count field, e.g. the number of report blocks in a report
+  /// @return The count field
+  int get_count() const { return count_; }
+
+  /// Get a string_view of the whole packet
+  /// @note Call serialize() after modifying a packet and before calling this
+  /// @return A string_view of the whole packet
   std::string_view get_data() const {
-    return std::string_view(reinterpret_cast<const char *>(m_buffer), m_bufferSize);
+    return std::string_view(reinterpret_cast<const char *>(packet_.data()), packet_.size());
+  }
+
+  /// Serialize the packet
+  virtual void serialize() {}
+
+  /// Split a compound RTCP packet into the RTCP packets it contains
+  /// @param data The compound packet
+  /// @return The RTCP packets in the compound packet. If a packet's length is
+  ///         invalid, it and any following packets are not returned.
+  static std::vector<std::string_view> split_compound(std::string_view data) {
+    std::vector<std::string_view> packets;
+    size_t offset = 0;
+    while (offset + HEADER_SIZE <= data.size()) {
+      auto header = reinterpret_cast<const uint8_t *>(data.data() + offset);
+      size_t size = (((header[2] << 8) | header[3]) + 1) * 4;
+      if ((header[0] >> 6) != VERSION || offset + size > data.size()) {
+        break;
+      }
+      packets.push_back(data.substr(offset, size));
+      offset += size;
+    }
+    return packets;
   }
 
-  void serialize() {}
+  /// Get the current wallclock time as a 64 bit NTP timestamp
+  /// @return The NTP timestamp (seconds since 1900 in the upper 32 bits, the
+  ///         fraction of a second in the lower 32 bits)
+  static uint64_t get_ntp_timestamp() {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(now);
+    auto fraction = std::chrono::duration_cast<std::chrono::nanoseconds>(now - seconds);
+    uint64_t ntp_seconds = seconds.count() + NTP_UNIX_EPOCH_OFFSET;
+    uint64_t ntp_fraction = (static_cast<uint64_t>(fraction.count()) << 32) / 1000000000;
+    return (ntp_seconds << 32) | ntp_fraction;
+  }
+
+  /// Get the middle 32 bits of an NTP timestamp, as used in the last_sr
+  /// field of report blocks and for round trip time calculation
+  /// @param ntp_timestamp The 64 bit NTP timestamp
+  /// @return The compact NTP timestamp, in units of 1/65536 seconds
+  static uint32_t get_compact_ntp_timestamp(uint64_t ntp_timestamp) {
+    return static_cast<uint32_t>(ntp_timestamp >> 16);
+  }
 
 protected:
-  uint8_t *m_buffer;
-  uint32_t m_bufferSize;
+  static constexpr int VERSION = 2;
+  static constexpr size_t HEADER_SIZE = 4;
+  static constexpr size_t REPORT_BLOCK_SIZE = 24;
+  static constexpr uint64_t NTP_UNIX_EPOCH_OFFSET = 2208988800ULL;
+
+  bool parse_header() {
+    valid_ = false;
+    if (packet_.size() < HEADER_SIZE || (packet_[0] >> 6) != VERSION) {
+      return false;
+    }
+    count_ = packet_[0] & 0x1F;
+    type_ = packet_[1];
+    size_t size = (((packet_[2] << 8) | packet_[3]) + 1) * 4;
+    if (size > packet_.size()) {
+      return false;
+    }
+    valid_ = true;
+    return true;
+  }
+
+  /// Write the header for the packet type and count, computing the length
+  /// field from the size of the packet_ vector (which must be a multiple of
+  /// 4 bytes)
+  void serialize_header(Type type, int count) {
+    type_ = static_cast<uint8_t>(type);
+    count_ = count;
+    size_t length = packet_.size() / 4 - 1;
+    packet_[0] = (VERSION << 6) | (count_ & 0x1F);
+    packet_[1] = type_;
+    packet_[2] = (length >> 8) & 0xFF;
+    packet_[3] = length & 0xFF;
+    valid_ = true;
+  }
+
+  static void write_u32(uint8_t *data, uint32_t value) {
+    data[0] = value >> 24;
+    data[1] = (value >> 16) & 0xFF;
+    data[2] = (value >> 8) & 0xFF;
+    data[3] = value & 0xFF;
+  }
+
+  static uint32_t read_u32(const uint8_t *data) {
+    return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+  }
+
+  static void serialize_report_block(uint8_t *data, const ReportBlock &block) {
+    write_u32(data, block.ssrc);
+    // clamp the cumulative number of lost packets to 24 bits (signed)
+    int32_t lost = std::max(-0x800000, std::min(0x7FFFFF, (int)block.cumulative_lost));
+    write_u32(data + 4, (block.fraction_lost << 24) | (lost & 0xFFFFFF));
+    write_u32(data + 8, block.highest_sequence);
+    write_u32(data + 12, block.jitter);
+    write_u32(data + 16, block.last_sr);
+    write_u32(data + 20, block.delay_since_last_sr);
+  }
+
+  static ReportBlock parse_report_block(const uint8_t *data) {
+    ReportBlock block;
+    block.ssrc = read_u32(data);
+    uint32_t lost = read_u32(data + 4);
+    block.fraction_lost = lost >> 24;
+    // sign extend the 24 bit cumulative number of lost packets
+    block.cumulative_lost = static_cast<int32_t>((lost & 0xFFFFFF) << 8) >> 8;
+    block.highest_sequence = read_u32(data + 8);
+    block.jitter = read_u32(data + 12);
+    block.last_sr = read_u32(data + 16);
+    block.delay_since_last_sr = read_u32(data + 20);
+    return block;
+  }
+
+  std::vector<uint8_t> packet_;
+  bool valid_{false};
+  uint8_t type_{0};
+  uint8_t count_{0};
 };
 } // namespace espp
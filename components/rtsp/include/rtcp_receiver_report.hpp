@@ -0,0 +1,80 @@
+#pragma once
+
+#include "rtcp_packet.hpp"
+
+namespace espp {
+/// @brief RTCP receiver report (RR) packet, as defined in RFC 3550 section
+///        6.4.2
+/// @details Sent periodically by the receivers of an RTP stream, with one
+///          report block for each source they receive from, reporting packet
+///          loss and interarrival jitter.
+class RtcpReceiverReport : public RtcpPacket {
+public:
+  /// Construct an empty receiver report
+  RtcpReceiverReport() = default;
+
+  /// Construct a receiver report from a buffer, parsing it
+  /// @note If the buffer is not a valid receiver report, is_valid() will
+  ///       return false.
+  /// @param data The buffer containing the receiver report
+  explicit RtcpReceiverReport(std::string_view data) : RtcpPacket(data) {
+    parse_receiver_report();
+  }
+
+  /// Get the SSRC of the receiver which sent the report
+  /// @return The SSRC of the sender of the report
+  uint32_t get_ssrc() const { return ssrc_; }
+
+  /// Get the report blocks
+  /// @return The report blocks, one for each source the receiver reports on
+  const std::vector<ReportBlock> &get_report_blocks() const { return report_blocks_; }
+
+  /// Set the SSRC of the receiver which sends the report
+  /// @param ssrc The SSRC of the sender of the report
+  void set_ssrc(uint32_t ssrc) { ssrc_ = ssrc; }
+
+  /// Set the report blocks
+  /// @param report_blocks The report blocks, at most 31
+  void set_report_blocks(const std::vector<ReportBlock> &report_blocks) {
+    report_blocks_ = report_blocks;
+  }
+
+  /// Serialize the receiver report
+  /// @note This method should be called after modifying the fields.
+  void serialize() override {
+    size_t num_blocks = std::min<size_t>(report_blocks_.size(), MAX_REPORT_BLOCKS);
+    packet_.resize(HEADER_SIZE + SSRC_SIZE + num_blocks * REPORT_BLOCK_SIZE);
+    serialize_header(Type::RECEIVER_REPORT, num_blocks);
+    uint8_t *data = packet_.data() + HEADER_SIZE;
+    write_u32(data, ssrc_);
+    data += SSRC_SIZE;
+    for (size_t i = 0; i < num_blocks; i++) {
+      serialize_report_block(data, report_blocks_[i]);
+      data += REPORT_BLOCK_SIZE;
+    }
+  }
+
+protected:
+  static constexpr size_t SSRC_SIZE = 4;
+  static constexpr size_t MAX_REPORT_BLOCKS = 31;
+
+  void parse_receiver_report() {
+    if (!valid_ || type_ != static_cast<uint8_t>(Type::RECEIVER_REPORT) ||
+        packet_.size() < HEADER_SIZE + SSRC_SIZE + count_ * REPORT_BLOCK_SIZE) {
+      valid_ = false;
+      return;
+    }
+    const uint8_t *data = packet_.data() + HEADER_SIZE;
+    ssrc_ = read_u32(data);
+    data += SSRC_SIZE;
+    report_blocks_.clear();
+    for (int i = 0; i < count_; i++) {
+      report_blocks_.push_back(parse_report_block(data));
+      data += REPORT_BLOCK_SIZE;
+    }
+  }
+
+  uint32_t ssrc_{0};
+  std::vector<ReportBlock> report_blocks_;
+};
+} // namespace espp
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "rtcp_packet.hpp"
+
+namespace espp {
+/// @brief RTCP sender report (SR) packet, as defined in RFC 3550 section 6.4.1
+/// @details Sent periodically by the sender of an RTP stream. It relates the
+///          RTP timestamps of the stream to wallclock (NTP) time, reports how
+///          many packets and octets were sent, and is used by receivers to
+///          compute the round trip time.
+class RtcpSenderReport : public RtcpPacket {
+public:
+  /// Construct an empty sender report
+  RtcpSenderReport() = default;
+
+  /// Construct a sender report from a buffer, parsing it
+  /// @note If the buffer is not a valid sender report, is_valid() will
+  ///       return false.
+  /// @param data The buffer containing the sender report
+  explicit RtcpSenderReport(std::string_view data) : RtcpPacket(data) { parse_sender_report(); }
+
+  /// Getters for the sender report fields
+  uint32_t get_ssrc() const { return ssrc_; }
+  uint64_t get_ntp_timestamp() const { return ntp_timestamp_; }
+  uint32_t get_rtp_timestamp() const { return rtp_timestamp_; }
+  uint32_t get_packet_count() const { return packet_count_; }
+  uint32_t get_octet_count() const { return octet_count_; }
+  const std::vector<ReportBlock> &get_report_blocks() const { return report_blocks_; }
+
+  /// Setters for the sender report fields
+  void set_ssrc(uint32_t ssrc) { ssrc_ = ssrc; }
+  void set_ntp_timestamp(uint64_t ntp_timestamp) { ntp_timestamp_ = ntp_timestamp; }
+  void set_rtp_timestamp(uint32_t rtp_timestamp) { rtp_timestamp_ = rtp_timestamp; }
+  void set_packet_count(uint32_t packet_count) { packet_count_ = packet_count; }
+  void set_octet_count(uint32_t octet_count) { octet_count_ = octet_count; }
+  void set_report_blocks(const std::vector<ReportBlock> &report_blocks) {
+    report_blocks_ = report_blocks;
+  }
+
+  /// Serialize the sender report
+  /// @note This method should be called after modifying the fields.
+  void serialize() override {
+    size_t num_blocks = std::min<size_t>(report_blocks_.size(), MAX_REPORT_BLOCKS);
+    packet_.resize(HEADER_SIZE + SENDER_INFO_SIZE + num_blocks * REPORT_BLOCK_SIZE);
+    serialize_header(Type::SENDER_REPORT, num_blocks);
+    uint8_t *data = packet_.data() + HEADER_SIZE;
+    write_u32(data, ssrc_);
+    write_u32(data + 4, ntp_timestamp_ >> 32);
+    write_u32(data + 8, ntp_timestamp_ & 0xFFFFFFFF);
+    write_u32(data + 12, rtp_timestamp_);
+    write_u32(data + 16, packet_count_);
+    write_u32(data + 20, octet_count_);
+    data += SENDER_INFO_SIZE;
+    for (size_t i = 0; i < num_blocks; i++) {
+      serialize_report_block(data, report_blocks_[i]);
+      data += REPORT_BLOCK_SIZE;
+    }
+  }
+
+protected:
+  static constexpr size_t SENDER_INFO_SIZE = 24; ///< SSRC + NTP ts + RTP ts + counts
+  static constexpr size_t MAX_REPORT_BLOCKS = 31;
+
+  void parse_sender_report() {
+    if (!valid_ || type_ != static_cast<uint8_t>(Type::SENDER_REPORT) ||
+        packet_.size() < HEADER_SIZE + SENDER_INFO_SIZE + count_ * REPORT_BLOCK_SIZE) {
+      valid_ = false;
+      return;
+    }
+    const uint8_t *data = packet_.data() + HEADER_SIZE;
+    ssrc_ = read_u32(data);
+    ntp_timestamp_ = (static_cast<uint64_t>(read_u32(data + 4)) << 32) | read_u32(data + 8);
+    rtp_timestamp_ = read_u32(data + 12);
+    packet_count_ = read_u32(data + 16);
+    octet_count_ = read_u32(data + 20);
+    data += SENDER_INFO_SIZE;
+    report_blocks_.clear();
+    for (int i = 0; i < count_; i++) {
+      report_blocks_.push_back(parse_report_block(data));
+      data += REPORT_BLOCK_SIZE;
+    }
+  }
+
+  uint32_t ssrc_{0};
+  uint64_t ntp_timestamp_{0};
+  uint32_t rtp_timestamp_{0};
+  uint32_t packet_count_{0};
+  uint32_t octet_count_{0};
+  std::vector<ReportBlock> report_blocks_;
+};
+} // namespace espp
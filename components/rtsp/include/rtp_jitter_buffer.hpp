@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "rtp_jpeg_packet.hpp"
+
+namespace espp {
+/// @brief Reorders received RTP/JPEG packets by sequence number
+/// @details Packets which arrive out of order are held back until the
+///          packets before them have arrived, and are then passed to the
+///          callback in sequence order. If a missing packet has not arrived
+///          by the time Config::depth packets are waiting behind it, it is
+///          counted as lost and skipped; packets which arrive after they
+///          were skipped (or were already received) are counted as late and
+///          discarded.
+///
+///          Packets are stored in preallocated slots and are swapped in
+///          rather than copied, so once the slots have grown to the size of
+///          the packets the buffer does not allocate.
+/// @note This class is not thread safe.
+class RtpJitterBuffer {
+public:
+  /// Function called with each packet, in sequence order
+  /// @param packet The packet. It is only valid for the duration of the call.
+  typedef std::function<void(const RtpJpegPacket &packet)> packet_callback_t;
+
+  /// @brief Configuration for the jitter buffer
+  struct Config {
+    size_t depth = 8; ///< The maximum number of packets held back waiting for a missing packet.
+                      ///< Larger values tolerate more reordering, but delay frames longer when
+                      ///< a packet is lost. 1 disables reordering.
+    packet_callback_t on_packet; ///< Called with each packet, in sequence order.
+  };
+
+  /// @brief Statistics about the packets pushed into the buffer
+  struct Stats {
+    size_t packets_received{0};  ///< The number of packets pushed.
+    size_t packets_lost{0};      ///< The number of packets skipped because they had not arrived.
+    size_t packets_reordered{0}; ///< The number of packets which arrived after a packet with a
+                                 ///< later sequence number, but in time to be put back in order.
+    size_t packets_late{0};      ///< The number of packets discarded because they arrived after
+                                 ///< they were skipped, or were duplicates.
+  };
+
+  /// @brief Construct the jitter buffer, allocating its slots
+  /// @param config The configuration for the jitter buffer
+  explicit RtpJitterBuffer(const Config &config)
+      : on_packet_(config.on_packet), depth_(std::max<size_t>(config.depth, 1)),
+        // a power of two number of slots divides the sequence number space,
+        // so consecutive sequence numbers map to distinct slots across the
+        // wrap around
+        slots_(std::bit_ceil(depth_)) {}
+
+  /// @brief Add a received packet to the buffer
+  /// @details Passes the packet, and any packets it was holding back which
+  ///          are now in order, to the callback.
+  /// @param packet The received packet. Its contents are swapped with an
+  ///        unused packet, so that its memory can be reused to receive the
+  ///        next packet without allocating.
+  void push(RtpJpegPacket &packet) {
+    uint16_t sequence_number = packet.get_sequence_number();
+    stats_.packets_received++;
+    if (!initialized_) {
+      restart(sequence_number);
+    }
+    int16_t diff = sequence_number - next_sequence_;
+    if (diff < -MAX_MISORDER || diff >= MAX_DROPOUT) {
+      // the sender restarted or skipped far ahead, so deliver what we have
+      // and start over
+      flush();
+      restart(sequence_number);
+      diff = 0;
+    } else if (diff < 0) {
+      // we already skipped over this packet
+      stats_.packets_late++;
+      return;
+    }
+    auto &slot = slots_[sequence_number % slots_.size()];
+    if (slot.valid && slot.packet.get_sequence_number() == sequence_number) {
+      // duplicate
+      stats_.packets_late++;
+      return;
+    }
+    if (static_cast<int16_t>(sequence_number - highest_sequence_) < 0) {
+      stats_.packets_reordered++;
+    } else {
+      highest_sequence_ = sequence_number;
+    }
+    // make room for the packet by giving up on the oldest missing packets
+    while (diff >= static_cast<int>(depth_)) {
+      stats_.packets_lost++;
+      next_sequence_++;
+      drain();
+      diff = sequence_number - next_sequence_;
+    }
+    std::swap(slot.packet, packet);
+    slot.valid = true;
+    num_buffered_++;
+    drain();
+  }
+
+  /// @brief Pass all packets held back to the callback, skipping over any
+  ///        missing packets between them
+  void flush() {
+    while (num_buffered_ > 0) {
+      if (!slots_[next_sequence_ % slots_.size()].valid) {
+        stats_.packets_lost++;
+        next_sequence_++;
+      }
+      drain();
+    }
+  }
+
+  /// @brief Discard all packets held back and start over with the next
+  ///        packet pushed
+  void reset() {
+    for (auto &slot : slots_) {
+      slot.valid = false;
+    }
+    num_buffered_ = 0;
+    initialized_ = false;
+  }
+
+  /// @brief Get the statistics about the packets pushed into the buffer
+  /// @return The statistics
+  const Stats &get_stats() const { return stats_; }
+
+protected:
+  static constexpr int MAX_DROPOUT = 3000;
+  static constexpr int MAX_MISORDER = 100;
+
+  struct Slot {
+    bool valid{false};
+    RtpJpegPacket packet;
+  };
+
+  void restart(uint16_t sequence_number) {
+    next_sequence_ = sequence_number;
+    highest_sequence_ = sequence_number;
+    initialized_ = true;
+  }
+
+  /// Pass the packets which are next in sequence to the callback
+  void drain() {
+    while (true) {
+      auto &slot = slots_[next_sequence_ % slots_.size()];
+      if (!slot.valid || slot.packet.get_sequence_number() != next_sequence_) {
+        break;
+      }
+      slot.valid = false;
+      num_buffered_--;
+      next_sequence_++;
+      if (on_packet_) {
+        on_packet_(slot.packet);
+      }
+    }
+  }
+
+  packet_callback_t on_packet_;
+  size_t depth_;
+  std::vector<Slot> slots_;
+  size_t num_buffered_{0};
+  bool initialized_{false};
+  uint16_t next_sequence_{0};
+  uint16_t highest_sequence_{0};
+  Stats stats_;
+};
+} // namespace espp
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstring>
+
 #include "rtp_packet.hpp"
 
 namespace espp {
@@ -11,6 +13,20 @@ public:
   /// @param data The buffer containing the RTP packet.
   explicit RtpJpegPacket(std::string_view data) : RtpPacket(data) { parse_mjpeg_header(); }
 
+  /// Construct an empty RTP packet, e.g. to be filled in later with reset()
+  /// or parse().
+  RtpJpegPacket() = default;
+
+  /// Refill the packet in place from a buffer, reusing its memory, and parse
+  /// its headers.
+  /// @note If the buffer is too short for the RTP/JPEG header (or the
+  ///       quantization tables it announces), is_valid() will return false.
+  /// @param data The buffer containing the RTP packet.
+  void parse(std::string_view data) {
+    RtpPacket::parse(data);
+    parse_mjpeg_header();
+  }
+
   /// Construct an RTP packet from fields
   /// @details This will construct a packet with quantization tables, so it
   ///          can only be used for the first packet in a frame.
@@ -24,12 +40,47 @@ public:
   /// @param scan_data The scan data.
   explicit RtpJpegPacket(const int type_specific, const int frag_type, const int q, const int width,
                          const int height, std::string_view q0, std::string_view q1,
-                         std::string_view scan_data)
-      : RtpPacket(PAYLOAD_OFFSET_WITH_QUANT + scan_data.size()), type_specific_(type_specific),
-        offset_(0), frag_type_(frag_type), q_(q), width_(width), height_(height) {
+                         std::string_view scan_data) {
+    reset(type_specific, frag_type, q, width, height, q0, q1, scan_data);
+  }
+
+  /// Construct an RTP packet from fields
+  /// @details This will construct a packet without quantization tables, so it
+  ///          cannot be used for the first packet in a frame.
+  /// @param type_specific The type-specific field.
+  /// @param offset The offset field.
+  /// @param frag_type The fragment type field.
+  /// @param q The q field.
+  /// @param width The width field.
+  /// @param height The height field.
+  /// @param scan_data The scan data.
+  explicit RtpJpegPacket(const int type_specific, const int offset, const int frag_type,
+                         const int q, const int width, const int height,
+                         std::string_view scan_data) {
+    reset(type_specific, offset, frag_type, q, width, height, scan_data);
+  }
 
+  /// Refill the packet in place from fields, reusing its memory.
+  /// @details This will fill the packet with quantization tables, so it can
+  ///          only be used for the first packet in a frame.
+  /// @note The RTP header fields are not changed, set them and call
+  ///       serialize() afterwards.
+  /// @param type_specific The type-specific field.
+  /// @param frag_type The fragment type field.
+  /// @param q The q field.
+  /// @param width The width field.
+  /// @param height The height field.
+  /// @param q0 The first quantization table.
+  /// @param q1 The second quantization table.
+  /// @param scan_data The scan data.
+  void reset(const int type_specific, const int frag_type, const int q, const int width,
+             const int height, std::string_view q0, std::string_view q1,
+             std::string_view scan_data) {
+    resize_payload(PAYLOAD_OFFSET_WITH_QUANT + scan_data.size());
+    set_mjpeg_fields(type_specific, 0, frag_type, q, width, height);
     jpeg_data_start_ = PAYLOAD_OFFSET_WITH_QUANT;
     jpeg_data_size_ = scan_data.size();
+    valid_ = true;
 
     serialize_mjpeg_header();
     serialize_q_tables(q0, q1);
@@ -39,9 +90,11 @@ public:
     memcpy(packet.data() + jpeg_offset, scan_data.data(), scan_data.size());
   }
 
-  /// Construct an RTP packet from fields
-  /// @details This will construct a packet without quantization tables, so it
+  /// Refill the packet in place from fields, reusing its memory.
+  /// @details This will fill the packet without quantization tables, so it
   ///          cannot be used for the first packet in a frame.
+  /// @note The RTP header fields are not changed, set them and call
+  ///       serialize() afterwards.
   /// @param type_specific The type-specific field.
   /// @param offset The offset field.
   /// @param frag_type The fragment type field.
@@ -49,12 +102,14 @@ public:
   /// @param width The width field.
   /// @param height The height field.
   /// @param scan_data The scan data.
-  explicit RtpJpegPacket(const int type_specific, const int offset, const int frag_type,
-                         const int q, const int width, const int height, std::string_view scan_data)
-      : RtpPacket(PAYLOAD_OFFSET_NO_QUANT + scan_data.size()), type_specific_(type_specific),
-        offset_(offset), frag_type_(frag_type), q_(q), width_(width), height_(height) {
+  void reset(const int type_specific, const int offset, const int frag_type, const int q,
+             const int width, const int height, std::string_view scan_data) {
+    resize_payload(PAYLOAD_OFFSET_NO_QUANT + scan_data.size());
+    set_mjpeg_fields(type_specific, offset, frag_type, q, width, height);
     jpeg_data_start_ = PAYLOAD_OFFSET_NO_QUANT;
     jpeg_data_size_ = scan_data.size();
+    valid_ = true;
+    q_tables_.clear();
 
     serialize_mjpeg_header();
 
@@ -63,7 +118,18 @@ public:
     memcpy(packet.data() + jpeg_offset, scan_data.data(), scan_data.size());
   }
 
-  ~RtpJpegPacket() {}
+  /// Get the largest size a packet can have when it carries at most
+  /// max_data_size bytes of JPEG data.
+  /// @param max_data_size The maximum number of bytes of JPEG data.
+  /// @return The maximum size of the packet, including the RTP header.
+  static size_t get_max_packet_size(size_t max_data_size) {
+    return RTP_HEADER_SIZE + PAYLOAD_OFFSET_WITH_QUANT + max_data_size;
+  }
+
+  /// Get whether the packet is long enough for its RTP/JPEG header and
+  /// quantization tables
+  /// @return True if the packet is valid, false otherwise
+  bool is_valid() const { return valid_; }
 
   /// Get the type-specific field.
   /// @return The type-specific field.
@@ -95,9 +161,9 @@ public:
   /// @note The quantization tables are optional. If they are present, the
   /// number of quantization tables is always 2.
   /// @note This check is based on the value of the q field. If the q field
-  ///       is 128-256, the packet contains quantization tables.
+  ///       is 128-255, the packet contains quantization tables.
   /// @return Whether the packet contains quantization tables.
-  bool has_q_tables() const { return q_ >= 128 && q_ <= 256; }
+  bool has_q_tables() const { return q_ >= 128; }
 
   /// Get the number of quantization tables.
   /// @note The quantization tables are optional. If they are present, the
@@ -142,31 +208,60 @@ protected:
       MJPEG_HEADER_SIZE + QUANT_HEADER_SIZE + (NUM_Q_TABLES * Q_TABLE_SIZE);
 
   void parse_mjpeg_header() {
+    valid_ = false;
+    q_tables_.clear();
+    jpeg_data_start_ = 0;
+    jpeg_data_size_ = 0;
+    if (get_packet().size() < get_rtp_header_size() + MJPEG_HEADER_SIZE) {
+      return;
+    }
     auto payload = get_payload();
-    type_specific_ = payload[0];
-    offset_ = (payload[1] << 16) | (payload[2] << 8) | payload[3];
-    frag_type_ = payload[4];
-    q_ = payload[5];
-    width_ = payload[6] * 8;
-    height_ = payload[7] * 8;
+    // read the fields as unsigned, since char may be signed
+    auto header = reinterpret_cast<const uint8_t *>(payload.data());
+    type_specific_ = header[0];
+    offset_ = (header[1] << 16) | (header[2] << 8) | header[3];
+    frag_type_ = header[4];
+    q_ = header[5];
+    width_ = header[6] * 8;
+    height_ = header[7] * 8;
 
     size_t offset = MJPEG_HEADER_SIZE;
 
-    if (has_q_tables()) {
-      uint8_t num_quant_bytes = payload[11];
-      int expected_num_quant_bytes = NUM_Q_TABLES * Q_TABLE_SIZE;
-      if (num_quant_bytes == expected_num_quant_bytes) {
+    // the quantization table header is only in the first packet of a frame
+    if (has_q_tables() && offset_ == 0) {
+      if (payload.size() < MJPEG_HEADER_SIZE + QUANT_HEADER_SIZE) {
+        return;
+      }
+      size_t num_quant_bytes = (header[10] << 8) | header[11];
+      if (payload.size() < MJPEG_HEADER_SIZE + QUANT_HEADER_SIZE + num_quant_bytes) {
+        return;
+      }
+      offset += QUANT_HEADER_SIZE;
+      if (num_quant_bytes == NUM_Q_TABLES * Q_TABLE_SIZE) {
         q_tables_.resize(NUM_Q_TABLES);
-        offset += QUANT_HEADER_SIZE;
         for (int i = 0; i < NUM_Q_TABLES; i++) {
           q_tables_[i] = std::string_view((char *)payload.data() + offset, Q_TABLE_SIZE);
           offset += Q_TABLE_SIZE;
         }
+      } else {
+        // skip tables we can't use (e.g. 16 bit precision)
+        offset += num_quant_bytes;
       }
     }
 
     jpeg_data_start_ = offset;
     jpeg_data_size_ = payload.size() - jpeg_data_start_;
+    valid_ = true;
+  }
+
+  void set_mjpeg_fields(int type_specific, int offset, int frag_type, int q, int width,
+                        int height) {
+    type_specific_ = type_specific;
+    offset_ = offset;
+    frag_type_ = frag_type;
+    q_ = q;
+    width_ = width;
+    height_ = height;
   }
 
   void serialize_mjpeg_header() {
@@ -210,5 +305,6 @@ protected:
   int jpeg_data_start_{0};
   int jpeg_data_size_{0};
   std::vector<std::string_view> q_tables_;
+  bool valid_{false};
 };
 } // namespace espp
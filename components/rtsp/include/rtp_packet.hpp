@@ -29,15 +29,18 @@ public:
   /// Construct an RtpPacket from a string_view.
   /// Store the string_view in the packet_ vector and parses the header.
   /// @param data The string_view to parse.
-  explicit RtpPacket(std::string_view data) {
+  explicit RtpPacket(std::string_view data) { parse(data); }
+
+  /// Refill the packet in place from a string_view, reusing its memory, and
+  /// parse the header.
+  /// @param data The string_view to parse.
+  void parse(std::string_view data) {
     packet_.assign(data.begin(), data.end());
-    payload_size_ = packet_.size() - RTP_HEADER_SIZE;
+    payload_size_ = packet_.size() >= RTP_HEADER_SIZE ? packet_.size() - RTP_HEADER_SIZE : 0;
     if (packet_.size() >= RTP_HEADER_SIZE)
       parse_rtp_header();
   }
 
-  ~RtpPacket() {}
-
   /// Getters for the RTP header fields.
   int get_version() const { return version_; }
   bool get_padding() const { return padding_; }
@@ -107,6 +110,15 @@ public:
 protected:
   static constexpr int RTP_HEADER_SIZE = 12;
 
+  /// Resize the packet to hold a payload of size payload_size.
+  /// @note Does not free any memory, so a packet which is reused for payloads
+  ///       no larger than before does not allocate.
+  /// @param payload_size The new size of the payload.
+  void resize_payload(size_t payload_size) {
+    packet_.resize(RTP_HEADER_SIZE + payload_size);
+    payload_size_ = payload_size;
+  }
+
   void parse_rtp_header() {
     version_ = (packet_[0] & 0xC0) >> 6;
     padding_ = (packet_[0] & 0x20) >> 5;
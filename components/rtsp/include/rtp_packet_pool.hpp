@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "jpeg_frame.hpp"
+#include "rtp_jpeg_packet.hpp"
+
+namespace espp {
+/// Ring of preallocated frames of RTP/JPEG packets, which is reused across
+/// frames so that packetizing a frame does not allocate.
+///
+/// A producer acquire()s a free frame, fills its packets in place and
+/// publish()es it; a consumer take()s the latest published frame. Frames are
+/// handed out as std::shared_ptr to slots that are allocated once, so copying
+/// them does not allocate either; a slot is free again once the pool holds
+/// its only reference.
+///
+/// Each packet is stored as its headers (RTP header, RTP/JPEG header and, for
+/// the first packet, the quantization tables) in a small preallocated buffer,
+/// plus a view of its JPEG data. The JPEG data stays in the JpegFrame (which
+/// the frame keeps alive) or in one buffer per frame, so that the packets can
+/// be sent with scatter-gather I/O without copying the data into each packet.
+/// A frame only grows (allocates) if it needs more packets or more data than
+/// it has ever held before, and the ring only grows if consumers hold on to
+/// more frames at once than it has.
+class RtpPacketPool {
+public:
+  /// @brief Configuration for the packet pool
+  struct Config {
+    size_t num_frames = 3; ///< The number of frames in the ring. With one producer and one
+                           ///< consumer, 3 frames allow one frame to be filled while one is
+                           ///< waiting and one is being sent.
+    size_t num_packets = 32; ///< The number of packets preallocated for each frame.
+    size_t max_num_frames = 16; ///< The maximum number of frames the ring can grow to, if more
+                                ///< than num_frames frames are in use at the same time (e.g.
+                                ///< queued for multiple clients).
+  };
+
+  /// @brief The packets of one frame
+  class Frame {
+  public:
+    /// @brief One RTP packet of the frame, split into headers and data
+    struct Packet {
+      RtpJpegPacket header;       ///< The packet without its JPEG data, i.e. just the headers.
+      std::string_view jpeg_data; ///< The JPEG data of the packet.
+    };
+
+    /// @brief Construct a frame with preallocated packets
+    /// @param num_packets The number of packets to preallocate
+    explicit Frame(size_t num_packets) {
+      packets_.resize(num_packets);
+      for (auto &packet : packets_) {
+        packet.header.get_packet().reserve(RtpJpegPacket::get_max_packet_size(0));
+      }
+    }
+
+    /// @brief Remove all packets and data from the frame, keeping their memory
+    void clear() {
+      num_packets_ = 0;
+      jpeg_frame_.reset();
+      scan_data_.clear();
+    }
+
+    /// @brief Keep the JpegFrame alive for as long as the frame is in use, so
+    ///        that the packets can refer to its data
+    /// @param jpeg_frame The JpegFrame the packets' data refers to
+    void set_jpeg_frame(std::shared_ptr<const JpegFrame> jpeg_frame) {
+      jpeg_frame_ = std::move(jpeg_frame);
+    }
+
+    /// @brief Copy the scan data into the frame's own buffer, for when the
+    ///        JpegFrame cannot be kept alive
+    /// @param scan_data The scan data to copy
+    /// @return A view of the copied scan data, valid until the frame is cleared
+    std::string_view copy_scan_data(std::string_view scan_data) {
+      scan_data_.assign(scan_data.begin(), scan_data.end());
+      return std::string_view(scan_data_.data(), scan_data_.size());
+    }
+
+    /// @brief Get the next unused packet of the frame
+    /// @note The packet still holds the contents of the last frame that used
+    ///       it, so all of its fields must be set.
+    /// @return A reference to the packet
+    Packet &add_packet() {
+      if (num_packets_ == packets_.size()) {
+        packets_.emplace_back().header.get_packet().reserve(
+            RtpJpegPacket::get_max_packet_size(0));
+      }
+      return packets_[num_packets_++];
+    }
+
+    /// @brief Get the packets of the frame
+    /// @return A span of the packets in the frame
+    std::span<const Packet> get_packets() const {
+      return std::span<const Packet>(packets_.data(), num_packets_);
+    }
+
+  protected:
+    size_t num_packets_{0};
+    std::vector<Packet> packets_;
+    std::shared_ptr<const JpegFrame> jpeg_frame_;
+    std::vector<char> scan_data_;
+  };
+
+  /// @brief Construct the packet pool, allocating all of its frames
+  /// @param config The configuration for the packet pool
+  explicit RtpPacketPool(const Config &config)
+      : num_packets_(config.num_packets),
+        max_num_frames_(std::max(config.num_frames, config.max_num_frames)) {
+    frames_.reserve(config.num_frames);
+    for (size_t i = 0; i < config.num_frames; i++) {
+      frames_.emplace_back(std::make_shared<Frame>(config.num_packets));
+    }
+  }
+
+  /// @brief Get a free frame to fill, in ring order
+  /// @details If all frames are in use (e.g. because consumers are still
+  ///          holding on to older frames), a new frame is added to the ring,
+  ///          unless the ring already has Config::max_num_frames frames.
+  /// @return The cleared frame, or nullptr if all frames are in use
+  std::shared_ptr<Frame> acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < frames_.size(); i++) {
+      auto &frame = frames_[(next_frame_ + i) % frames_.size()];
+      // NOTE: references are only created by the pool (under the mutex) or
+      // copied from existing ones, so if the pool holds the only reference
+      // nobody else can get one
+      if (frame.use_count() == 1) {
+        // use_count() is a relaxed load, but the last reference was released
+        // with a release decrement (as shared_ptr has to, so that a deleter
+        // sees all writes to the object), so this fence orders our writes
+        // to the frame after the last reader's reads of it
+        std::atomic_thread_fence(std::memory_order_acquire);
+        next_frame_ = (next_frame_ + i + 1) % frames_.size();
+        frame->clear();
+        return frame;
+      }
+    }
+    if (frames_.size() < max_num_frames_) {
+      // the ring order of the existing frames is unchanged, since the new
+      // frame is inserted just before the next frame
+      auto it = frames_.insert(frames_.begin() + next_frame_,
+                               std::make_shared<Frame>(num_packets_));
+      next_frame_ = (next_frame_ + 1) % frames_.size();
+      return *it;
+    }
+    return nullptr;
+  }
+
+  /// @brief Publish a filled frame, replacing any published frame which has
+  ///        not been taken yet
+  /// @param frame The frame to publish
+  void publish(std::shared_ptr<Frame> frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    latest_frame_ = std::move(frame);
+  }
+
+  /// @brief Take the latest published frame
+  /// @return The frame, or nullptr if no frame was published since the last
+  ///         call
+  std::shared_ptr<Frame> take() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::move(latest_frame_);
+  }
+
+protected:
+  size_t num_packets_;
+  size_t max_num_frames_;
+  std::mutex mutex_;
+  size_t next_frame_{0};
+  std::vector<std::shared_ptr<Frame>> frames_;
+  std::shared_ptr<Frame> latest_frame_;
+};
+} // namespace espp
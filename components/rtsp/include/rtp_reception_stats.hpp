@@ -0,0 +1,187 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "rtcp_packet.hpp"
+#include "rtcp_sender_report.hpp"
+#include "rtp_packet.hpp"
+
+namespace espp {
+/// @brief Statistics about the RTP packets received from one source, used to
+///        fill the report blocks of RTCP receiver reports
+/// @details Implements the sequence number tracking, loss computation and
+///          interarrival jitter estimation described in RFC 3550 appendices
+///          A.1, A.3 and A.8.
+/// @note This class is not thread safe.
+class RtpReceptionStats {
+public:
+  /// @brief Construct the reception statistics
+  /// @param clock_rate The RTP clock rate of the stream, in Hz (90 kHz for
+  ///        MJPEG), used to convert arrival times to RTP timestamp units
+  explicit RtpReceptionStats(uint32_t clock_rate = 90000)
+      : clock_rate_(clock_rate), start_time_(std::chrono::steady_clock::now()) {}
+
+  /// @brief Update the statistics with a received RTP packet, using the
+  ///        current time as its arrival time
+  /// @param packet The received packet
+  void update(const RtpPacket &packet) {
+    auto elapsed = std::chrono::steady_clock::now() - start_time_;
+    auto arrival = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() *
+                   clock_rate_ / 1000000;
+    update(packet.get_ssrc(), packet.get_sequence_number(), packet.get_timestamp(), arrival);
+  }
+
+  /// @brief Update the statistics with a received RTP packet
+  /// @param ssrc The SSRC of the packet
+  /// @param sequence_number The sequence number of the packet
+  /// @param rtp_timestamp The RTP timestamp of the packet
+  /// @param arrival_time The arrival time of the packet, in RTP timestamp units
+  void update(uint32_t ssrc, uint16_t sequence_number, uint32_t rtp_timestamp,
+              uint32_t arrival_time) {
+    if (!initialized_ || ssrc != ssrc_) {
+      // first packet, or the source changed, so start over
+      init(ssrc, sequence_number);
+    } else if (!update_sequence(sequence_number)) {
+      return;
+    }
+    received_++;
+    // the packets of a video frame all have the same timestamp but are sent
+    // back to back, so only the first packet of each frame is used for the
+    // jitter estimate
+    if (!has_transit_ || rtp_timestamp != last_timestamp_) {
+      int32_t transit = arrival_time - rtp_timestamp;
+      if (has_transit_) {
+        int32_t d = transit - last_transit_;
+        d = d < 0 ? -d : d;
+        // jitter_ is scaled by 16, see RFC 3550 appendix A.8
+        jitter_ += d - ((jitter_ + 8) >> 4);
+      }
+      last_transit_ = transit;
+      last_timestamp_ = rtp_timestamp;
+      has_transit_ = true;
+    }
+  }
+
+  /// @brief Record the reception of a sender report from the source, so that
+  ///        the next report block allows the sender to compute the round trip
+  ///        time
+  /// @param sender_report The received sender report
+  void on_sender_report(const RtcpSenderReport &sender_report) {
+    last_sr_ = RtcpPacket::get_compact_ntp_timestamp(sender_report.get_ntp_timestamp());
+    last_sr_time_ = std::chrono::steady_clock::now();
+  }
+
+  /// @brief Get whether any packets have been received
+  /// @return True if a packet has been received, false otherwise
+  bool has_received() const { return initialized_; }
+
+  /// @brief Get the number of packets received
+  /// @return The number of (non duplicate) packets received
+  uint32_t get_packets_received() const { return received_; }
+
+  /// @brief Get the number of packets lost since the start of reception
+  /// @return The number of packets lost, which may be negative if packets
+  ///         were duplicated
+  int32_t get_packets_lost() const { return get_expected() - received_; }
+
+  /// @brief Get the interarrival jitter
+  /// @return The interarrival jitter, in RTP timestamp units
+  uint32_t get_jitter() const { return jitter_ >> 4; }
+
+  /// @brief Build the report block for the next receiver report
+  /// @note This updates the state used to compute the fraction of packets
+  ///       lost, so it should be called once per report.
+  /// @return The report block
+  RtcpPacket::ReportBlock get_report_block() {
+    uint32_t expected = get_expected();
+    uint32_t expected_interval = expected - expected_prior_;
+    uint32_t received_interval = received_ - received_prior_;
+    int32_t lost_interval = expected_interval - received_interval;
+    expected_prior_ = expected;
+    received_prior_ = received_;
+    RtcpPacket::ReportBlock block;
+    block.ssrc = ssrc_;
+    if (expected_interval != 0 && lost_interval > 0) {
+      block.fraction_lost = (lost_interval << 8) / expected_interval;
+    }
+    block.cumulative_lost = get_packets_lost();
+    block.highest_sequence = cycles_ + max_sequence_;
+    block.jitter = get_jitter();
+    if (last_sr_ != 0) {
+      auto delay = std::chrono::steady_clock::now() - last_sr_time_;
+      block.last_sr = last_sr_;
+      block.delay_since_last_sr = static_cast<uint32_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(delay).count() * 65536 / 1000000);
+    }
+    return block;
+  }
+
+protected:
+  static constexpr uint16_t MAX_DROPOUT = 3000;
+  static constexpr uint16_t MAX_MISORDER = 100;
+
+  void init(uint32_t ssrc, uint16_t sequence_number) {
+    ssrc_ = ssrc;
+    base_sequence_ = sequence_number;
+    max_sequence_ = sequence_number;
+    bad_sequence_ = UINT32_MAX;
+    cycles_ = 0;
+    received_ = 0;
+    expected_prior_ = 0;
+    received_prior_ = 0;
+    has_transit_ = false;
+    jitter_ = 0;
+    initialized_ = true;
+  }
+
+  /// Update the highest sequence number, see RFC 3550 appendix A.1
+  /// @return True if the packet should be counted, false if it is part of a
+  ///         large jump in the sequence numbers which has not been confirmed
+  bool update_sequence(uint16_t sequence_number) {
+    uint16_t delta = sequence_number - max_sequence_;
+    if (delta < MAX_DROPOUT) {
+      // in order, with a permissible gap
+      if (sequence_number < max_sequence_) {
+        // the sequence number wrapped around
+        cycles_ += 1 << 16;
+      }
+      max_sequence_ = sequence_number;
+    } else if (delta <= (1 << 16) - MAX_MISORDER) {
+      // the sequence number made a very large jump
+      if (sequence_number == bad_sequence_) {
+        // two sequential packets, so assume the sender restarted
+        init(ssrc_, sequence_number);
+      } else {
+        bad_sequence_ = (sequence_number + 1) & 0xFFFF;
+        return false;
+      }
+    }
+    // otherwise it is a duplicate or reordered packet, which is counted
+    return true;
+  }
+
+  uint32_t get_expected() const { return cycles_ + max_sequence_ - base_sequence_ + 1; }
+
+  uint32_t clock_rate_;
+  std::chrono::steady_clock::time_point start_time_;
+
+  bool initialized_{false};
+  uint32_t ssrc_{0};
+  uint16_t base_sequence_{0};
+  uint16_t max_sequence_{0};
+  uint32_t bad_sequence_{UINT32_MAX};
+  uint32_t cycles_{0};
+  uint32_t received_{0};
+  uint32_t expected_prior_{0};
+  uint32_t received_prior_{0};
+
+  bool has_transit_{false};
+  int32_t last_transit_{0};
+  uint32_t last_timestamp_{0};
+  int32_t jitter_{0};
+
+  uint32_t last_sr_{0};
+  std::chrono::steady_clock::time_point last_sr_time_;
+};
+} // namespace espp
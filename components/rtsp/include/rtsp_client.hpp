@@ -1,15 +1,31 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string>
 #include <system_error>
 #include <vector>
 
+#include "esp_random.h"
+
 #include "logger.hpp"
 #include "tcp_socket.hpp"
 #include "udp_socket.hpp"
 
 #include "jpeg_frame.hpp"
+#include "jpeg_frame_pool.hpp"
+#include "jpeg_header_cache.hpp"
+#include "rtcp_packet.hpp"
+#include "rtcp_receiver_report.hpp"
+#include "rtcp_sender_report.hpp"
+#include "rtp_jitter_buffer.hpp"
+#include "rtp_reception_stats.hpp"
 
 namespace espp {
 
@@ -17,7 +33,22 @@ namespace espp {
 ///
 /// This class is used to connect to an RTSP server and receive JPEG frames
 /// over RTP. It uses the TCP socket to send RTSP requests and receive RTSP
-/// responses. It uses the UDP socket to receive RTP and RTCP packets.
+/// responses. It uses the UDP socket to receive RTP and RTCP packets, or, if
+/// set up with setup_interleaved(), receives them interleaved with the RTSP
+/// responses on the TCP socket (RFC 2326 section 10.12), which also works
+/// through NATs. If set up with setup_multicast(), it joins the multicast group
+/// the server sends the stream to, which the server shares between all of its
+/// multicast clients. It answers each RTCP sender report from the server with a
+/// receiver report, which tells the server about packet loss and jitter so
+/// that it can adapt.
+///
+/// Received RTP packets go through a jitter buffer, which puts reordered
+/// packets back in sequence order, and are reassembled into JpegFrames from a
+/// pool of preallocated frames, whose JPEG headers are copied from a
+/// JpegHeaderCache instead of being regenerated for every frame. A frame with
+/// a lost packet is dropped rather than passed on corrupted. If the frames are
+/// received with the on_shared_jpeg_frame callback, each frame returns to the
+/// pool once it is released, so reassembly does not allocate.
 ///
 /// The RTSP client is designed to be used with the RTSP server in the
 /// [camera-streamer]https://github.com/esp-cpp/camera-streamer) project, but it
@@ -25,11 +56,18 @@ namespace espp {
 ///
 /// \section RtspClient Example
 /// \snippet rtsp_example.cpp rtsp_client_example
+/// \section rtsp_client_ex2 RtspClient Jitter Buffer Example
+/// \snippet rtsp_example.cpp rtsp_jitter_buffer_example
 class RtspClient {
 public:
   /// Function type for the callback to call when a JPEG frame is received
   using jpeg_frame_callback_t = std::function<void(std::unique_ptr<JpegFrame> jpeg_frame)>;
 
+  /// Function type for the callback to call when a JPEG frame is received,
+  /// sharing the frame from the client's frame pool
+  using shared_jpeg_frame_callback_t =
+      std::function<void(std::shared_ptr<const JpegFrame> jpeg_frame)>;
+
   /// Configuration for the RTSP client
   struct Config {
     std::string server_address;   ///< The server IP Address to connect to
@@ -37,11 +75,36 @@ public:
     std::string path{"/mjpeg/1"}; ///< The path to the RTSP stream on the server. Will be appended
                                   ///< to the server address and port to form the full path of the
                                   ///< form "rtsp://<server_address>:<rtsp_port><path>"
-    jpeg_frame_callback_t on_jpeg_frame; ///< The callback to call when a JPEG frame is received
+    jpeg_frame_callback_t on_jpeg_frame; ///< The callback to call when a JPEG frame is received.
+                                         ///< The frame's memory is handed over to the callback,
+                                         ///< so its pool frame has to allocate again.
+    shared_jpeg_frame_callback_t
+        on_shared_jpeg_frame; ///< The callback to call when a JPEG frame is received, instead of
+                              ///< on_jpeg_frame. The frame returns to the pool to be reused once
+                              ///< it is released, e.g. when the callback returns.
+    size_t jitter_buffer_depth{8}; ///< The number of RTP packets the jitter buffer holds back
+                                   ///< waiting for a missing packet, see RtpJitterBuffer.
+    JpegFramePool::Config jpeg_frame_pool{}; ///< The configuration of the pool of frames which
+                                             ///< received frames are reassembled into
+    JpegHeaderCache::Config jpeg_header_cache{}; ///< The configuration of the cache of JPEG
+                                                 ///< headers for the received frames
     espp::Logger::Verbosity log_level =
         espp::Logger::Verbosity::INFO; ///< The verbosity of the logger
   };
 
+  /// Statistics about the received stream
+  struct Stats {
+    size_t packets_received{0};  ///< The number of RTP packets received
+    size_t packets_lost{0};      ///< The number of RTP packets which did not arrive in time
+    size_t packets_reordered{0}; ///< The number of RTP packets which arrived out of order, but
+                                 ///< were put back in order by the jitter buffer
+    size_t packets_late{0};      ///< The number of RTP packets discarded because they arrived
+                                 ///< too late or were duplicates
+    size_t frames_received{0};   ///< The number of complete JPEG frames passed to the callback
+    size_t frames_dropped{0};    ///< The number of JPEG frames dropped because packets were lost
+                                 ///< or all frames in the pool were in use
+  };
+
   /// Constructor
   /// \param config The configuration for the RTSP client
   explicit RtspClient(const Config &config)
@@ -49,8 +112,14 @@ public:
         rtsp_socket_({.log_level = espp::Logger::Verbosity::WARN}),
         rtp_socket_({.log_level = espp::Logger::Verbosity::WARN}),
         rtcp_socket_({.log_level = espp::Logger::Verbosity::WARN}),
-        on_jpeg_frame_(config.on_jpeg_frame), cseq_(0),
+        on_jpeg_frame_(config.on_jpeg_frame), on_shared_jpeg_frame_(config.on_shared_jpeg_frame),
+        cseq_(0),
         path_("rtsp://" + server_address_ + ":" + std::to_string(rtsp_port_) + config.path),
+        ssrc_(esp_random()),
+        jitter_buffer_({.depth = config.jitter_buffer_depth,
+                        .on_packet = std::bind(&RtspClient::handle_rtp_jpeg_packet, this,
+                                               std::placeholders::_1)}),
+        jpeg_frame_pool_(config.jpeg_frame_pool), jpeg_header_cache_(config.jpeg_header_cache),
         logger_({.tag = "RtspClient", .level = config.log_level}) {}
 
   /// Destructor
@@ -65,6 +134,8 @@ public:
 
   /// Send an RTSP request to the server
   /// \note This is a blocking call
+  /// \note If the stream is interleaved, the response is received by the
+  ///       interleaved receive task, which this waits for.
   /// \note This will parse the response and set the session ID if it is
   ///      present in the response. If the response is not a 200 OK, then
   ///      an error code will be set and the response will be returned.
@@ -100,6 +171,18 @@ public:
     request += "Accept: application/sdp\r\n";
     request += "\r\n";
     std::string response;
+    if (interleaved_) {
+      if (!send_interleaved_request(request, response)) {
+        ec = std::make_error_code(std::errc::io_error);
+        logger_.error("Failed to send request");
+        return {};
+      }
+      logger_.debug("Response:\n{}", response);
+      if (parse_response(response, ec)) {
+        return response;
+      }
+      return {};
+    }
     auto transmit_config = espp::detail::TcpTransmitConfig{
         .wait_for_response = true,
         .response_size = 1024,
@@ -160,6 +243,10 @@ public:
   void disconnect(std::error_code &ec) {
     // send the teardown request
     teardown(ec);
+    if (interleaved_task_) {
+      interleaved_task_->stop();
+    }
+    interleaved_ = false;
     rtsp_socket_.reinit();
   }
 
@@ -255,6 +342,92 @@ public:
     init_rtcp(rtcp_port, ec);
   }
 
+  /// Setup the RTSP stream with the RTP and RTCP packets interleaved on the
+  /// RTSP (TCP) connection, using channels 0 and 1
+  /// Sends the SETUP request to the RTSP server and parses the response.
+  /// \note Starts the interleaved receive task, which receives the packets and
+  ///       all further RTSP responses.
+  /// \param ec The error code to set if an error occurs
+  void setup_interleaved(std::error_code &ec) { setup_interleaved(0, 1, ec); }
+
+  /// Setup the RTSP stream with the RTP and RTCP packets interleaved on the
+  /// RTSP (TCP) connection
+  /// Sends the SETUP request to the RTSP server and parses the response.
+  /// \note Starts the interleaved receive task, which receives the packets and
+  ///       all further RTSP responses.
+  /// \param rtp_channel The channel of the RTP packets
+  /// \param rtcp_channel The channel of the RTCP packets
+  /// \param ec The error code to set if an error occurs
+  void setup_interleaved(uint8_t rtp_channel, uint8_t rtcp_channel, std::error_code &ec) {
+    // exit early if the error code is set
+    if (ec) {
+      return;
+    }
+
+    auto transport_header = "RTP/AVP/TCP;unicast;interleaved=" + std::to_string(rtp_channel) +
+                            "-" + std::to_string(rtcp_channel);
+
+    // send the setup request
+    auto response = send_request("SETUP", path_, {{"Transport", transport_header}}, ec);
+    if (ec) {
+      return;
+    }
+
+    rtp_channel_ = rtp_channel;
+    rtcp_channel_ = rtcp_channel;
+    // send the receiver reports immediately
+    rtsp_socket_.set_nodelay();
+    init_interleaved(ec);
+  }
+
+  /// Setup the RTSP stream to be received from the server's multicast group
+  /// Sends the SETUP request to the RTSP server and parses the multicast
+  /// group and ports from the response.
+  /// \note Starts the RTP and RTCP threads, which join the multicast group.
+  /// \note The server must have a multicast group configured, otherwise it
+  ///       rejects the request.
+  /// \param ec The error code to set if an error occurs
+  void setup_multicast(std::error_code &ec) {
+    // exit early if the error code is set
+    if (ec) {
+      return;
+    }
+
+    // send the setup request, the server chooses the group and ports
+    auto response = send_request("SETUP", path_, {{"Transport", "RTP/AVP;multicast"}}, ec);
+    if (ec) {
+      return;
+    }
+
+    // the transport header is of the form:
+    //   Transport: RTP/AVP;multicast;destination=<group>;port=<rtp>-<rtcp>;ttl=<ttl>
+    auto transport_start = response.find("Transport: ");
+    auto transport_end = response.find("\r\n", transport_start);
+    if (transport_start == std::string::npos || transport_end == std::string::npos) {
+      ec = std::make_error_code(std::errc::protocol_error);
+      logger_.error("Missing transport in setup response");
+      return;
+    }
+    auto transport = response.substr(transport_start, transport_end - transport_start);
+    auto destination_start = transport.find("destination=");
+    auto port_start = transport.find(";port=");
+    if (destination_start == std::string::npos || port_start == std::string::npos) {
+      ec = std::make_error_code(std::errc::protocol_error);
+      logger_.error("Invalid multicast transport: {}", transport);
+      return;
+    }
+    destination_start += 12;
+    auto multicast_group = transport.substr(
+        destination_start, transport.find(';', destination_start) - destination_start);
+    char *end;
+    size_t rtp_port = std::strtoul(transport.c_str() + port_start + 6, &end, 10);
+    size_t rtcp_port = *end == '-' ? std::strtoul(end + 1, nullptr, 10) : rtp_port + 1;
+    logger_.debug("Multicast group {}, ports {}-{}", multicast_group, rtp_port, rtcp_port);
+
+    init_rtp(rtp_port, ec, multicast_group);
+    init_rtcp(rtcp_port, ec, multicast_group);
+  }
+
   /// Play the RTSP stream
   /// Sends the PLAY request to the RTSP server and parses the response.
   /// \param ec The error code to set if an error occurs
@@ -291,6 +464,13 @@ public:
     send_request("TEARDOWN", path_, {}, ec);
   }
 
+  /// Get statistics about the received stream
+  /// \return The statistics
+  Stats get_stats() const {
+    std::lock_guard<std::mutex> lk(reception_stats_mutex_);
+    return stats_;
+  }
+
 protected:
   /// Parse the RTSP response
   /// \note Parses response data for the following fields:
@@ -325,7 +505,7 @@ protected:
     std::string status_message = response_data.substr(13, response_data.find("\r\n") - 13);
     if (status_code != 200) {
       ec = std::make_error_code(std::errc::protocol_error);
-      logger_.error(std::string("Request failed: ") + status_message);
+      logger_.error("Request failed: {}", status_message);
       return false;
     }
     // parse the session id
@@ -339,11 +519,146 @@ protected:
     return true;
   }
 
+  /// Start the interleaved receive task, which receives the RTP and RTCP
+  /// packets and the RTSP responses on the RTSP socket
+  /// \param ec The error code to set if an error occurs
+  void init_interleaved(std::error_code &ec) {
+    // exit early if the error code is set
+    if (ec) {
+      return;
+    }
+    logger_.debug("Starting interleaved receive task");
+    receive_buffer_.resize(INTERLEAVED_RECEIVE_SIZE);
+    interleaved_buffer_.clear();
+    interleaved_task_ = espp::Task::make_unique({
+        .name = "RtspInterleaved",
+        .callback = std::bind(&RtspClient::interleaved_task_fn, this, std::placeholders::_1,
+                              std::placeholders::_2),
+        .stack_size_bytes = 16 * 1024,
+    });
+    interleaved_ = true;
+    if (!interleaved_task_->start()) {
+      interleaved_ = false;
+      ec = std::make_error_code(std::errc::operation_canceled);
+      logger_.error("Failed to start interleaved receive task");
+    }
+  }
+
+  /// Send a request when the stream is interleaved, and wait for the
+  /// interleaved receive task to receive the response
+  /// \param request The request to send
+  /// \param response The response (output)
+  /// \return True if the response was received, false otherwise
+  bool send_interleaved_request(std::string_view request, std::string &response) {
+    std::unique_lock<std::mutex> lk(response_mutex_);
+    response_.reset();
+    logger_.debug("Request:\n{}", request);
+    {
+      std::lock_guard<std::mutex> write_lk(write_mutex_);
+      if (!rtsp_socket_.transmit(request)) {
+        return false;
+      }
+    }
+    if (!response_cv_.wait_for(lk, std::chrono::seconds(5),
+                               [this] { return response_.has_value(); })) {
+      logger_.error("Timed out waiting for response");
+      return false;
+    }
+    response = std::move(*response_);
+    response_.reset();
+    return true;
+  }
+
+  /// The task function for the interleaved receive task
+  /// Receives from the RTSP socket and handles the complete interleaved
+  /// packets and RTSP responses it contains.
+  /// \param m The mutex to lock when waiting on the condition variable
+  /// \param cv The condition variable to wait on
+  /// \return True if the task should stop, false otherwise
+  bool interleaved_task_fn(std::mutex &m, std::condition_variable &cv) {
+    int num_bytes = rtsp_socket_.receive(receive_buffer_.data(), receive_buffer_.size());
+    if (num_bytes <= 0) {
+      // stop if the server closed the connection, otherwise the receive
+      // timed out, so try again
+      return !rtsp_socket_.is_connected();
+    }
+    interleaved_buffer_.append(reinterpret_cast<char *>(receive_buffer_.data()), num_bytes);
+    std::string_view buffer(interleaved_buffer_);
+    size_t offset = 0;
+    while (offset < buffer.size()) {
+      auto remaining = buffer.substr(offset);
+      if (remaining[0] == '$') {
+        // interleaved packet: '$', channel, 16 bit length, packet
+        if (remaining.size() < 4) {
+          break;
+        }
+        uint8_t channel = remaining[1];
+        size_t size =
+            (static_cast<uint8_t>(remaining[2]) << 8) | static_cast<uint8_t>(remaining[3]);
+        if (remaining.size() < 4 + size) {
+          break;
+        }
+        handle_interleaved_packet(channel, remaining.substr(4, size));
+        offset += 4 + size;
+        continue;
+      }
+      // RTSP response, which ends with an empty line and may have a body
+      auto header_end = remaining.find("\r\n\r\n");
+      if (header_end == std::string_view::npos) {
+        break;
+      }
+      size_t size = header_end + 4;
+      auto content_length_index = remaining.substr(0, header_end).find("Content-Length: ");
+      if (content_length_index != std::string_view::npos) {
+        size += std::strtoul(remaining.data() + content_length_index + 16, nullptr, 10);
+      }
+      if (remaining.size() < size) {
+        break;
+      }
+      {
+        std::lock_guard<std::mutex> lk(response_mutex_);
+        response_ = std::string(remaining.substr(0, size));
+      }
+      response_cv_.notify_all();
+      offset += size;
+    }
+    interleaved_buffer_.erase(0, offset);
+    return false;
+  }
+
+  /// Handle a packet received on an interleaved channel
+  /// \param channel The channel the packet was received on
+  /// \param packet The packet
+  void handle_interleaved_packet(uint8_t channel, std::string_view packet) {
+    if (channel == rtp_channel_) {
+      handle_rtp_data(packet);
+      return;
+    }
+    if (channel != rtcp_channel_) {
+      return;
+    }
+    auto response = handle_rtcp_data(packet);
+    if (!response) {
+      return;
+    }
+    // send the response (receiver report) back on the rtcp channel
+    size_t size = response->size();
+    std::array<uint8_t, 4> prefix = {'$', rtcp_channel_, static_cast<uint8_t>(size >> 8),
+                                     static_cast<uint8_t>(size & 0xFF)};
+    std::array<struct iovec, 2> iovecs{{
+        {.iov_base = prefix.data(), .iov_len = prefix.size()},
+        {.iov_base = response->data(), .iov_len = response->size()},
+    }};
+    std::lock_guard<std::mutex> lk(write_mutex_);
+    rtsp_socket_.transmit(iovecs);
+  }
+
   /// Initialize the RTP socket
   /// \note Starts the RTP socket task.
   /// \param rtp_port The RTP client port
   /// \param ec The error code to set if an error occurs
-  void init_rtp(size_t rtp_port, std::error_code &ec) {
+  /// \param multicast_group The multicast group to join, if not empty
+  void init_rtp(size_t rtp_port, std::error_code &ec, const std::string &multicast_group = "") {
     // exit early if the error code is set
     if (ec) {
       return;
@@ -357,6 +672,8 @@ protected:
     auto rtp_config = espp::UdpSocket::ReceiveConfig{
         .port = rtp_port,
         .buffer_size = 2 * 1024,
+        .is_multicast_endpoint = !multicast_group.empty(),
+        .multicast_group = multicast_group,
         .on_receive_callback = std::bind(&RtspClient::handle_rtp_packet, this,
                                          std::placeholders::_1, std::placeholders::_2),
     };
@@ -371,7 +688,8 @@ protected:
   /// \note Starts the RTCP socket task.
   /// \param rtcp_port The RTCP client port
   /// \param ec The error code to set if an error occurs
-  void init_rtcp(size_t rtcp_port, std::error_code &ec) {
+  /// \param multicast_group The multicast group to join, if not empty
+  void init_rtcp(size_t rtcp_port, std::error_code &ec, const std::string &multicast_group = "") {
     // exit early if the error code is set
     if (ec) {
       return;
@@ -385,6 +703,8 @@ protected:
     auto rtcp_config = espp::UdpSocket::ReceiveConfig{
         .port = rtcp_port,
         .buffer_size = 1 * 1024,
+        .is_multicast_endpoint = !multicast_group.empty(),
+        .multicast_group = multicast_group,
         .on_receive_callback = std::bind(&RtspClient::handle_rtcp_packet, this,
                                          std::placeholders::_1, std::placeholders::_2),
     };
@@ -403,67 +723,165 @@ protected:
   /// sender
   std::optional<std::vector<uint8_t>> handle_rtp_packet(std::vector<uint8_t> &data,
                                                         const espp::Socket::Info &sender_info) {
-    // jpeg frame that we are building
-    static std::unique_ptr<JpegFrame> jpeg_frame;
+    handle_rtp_data(std::string_view(reinterpret_cast<char *>(data.data()), data.size()));
+    // return an empty vector to indicate that we don't want to send a response
+    return {};
+  }
 
-    logger_.debug("Got RTP packet of size: {}", data.size());
+  /// Handle the data of an RTP packet, received over UDP or interleaved
+  /// \note Parses the RTP packet and passes it to the jitter buffer, which
+  ///       passes it on to handle_rtp_jpeg_packet() in sequence order.
+  /// \param packet The RTP packet
+  void handle_rtp_data(std::string_view packet) {
+    logger_.debug("Got RTP packet of size: {}", packet.size());
+    if (packet.size() < MIN_RTP_JPEG_PACKET_SIZE) {
+      logger_.debug("Ignoring RTP packet of size {}, which is too small", packet.size());
+      return;
+    }
+
+    // parse the rtp packet in place, reusing the memory of a packet the
+    // jitter buffer is done with
+    rtp_jpeg_packet_.parse(packet);
+    if (!rtp_jpeg_packet_.is_valid()) {
+      logger_.debug("Ignoring RTP packet of size {}, which is malformed", packet.size());
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lk(reception_stats_mutex_);
+      reception_stats_.update(rtp_jpeg_packet_);
+    }
+    jitter_buffer_.push(rtp_jpeg_packet_);
+    {
+      std::lock_guard<std::mutex> lk(reception_stats_mutex_);
+      const auto &jitter_stats = jitter_buffer_.get_stats();
+      stats_.packets_received = jitter_stats.packets_received;
+      stats_.packets_lost = jitter_stats.packets_lost;
+      stats_.packets_reordered = jitter_stats.packets_reordered;
+      stats_.packets_late = jitter_stats.packets_late;
+    }
+  }
 
-    std::string_view packet(reinterpret_cast<char *>(data.data()), data.size());
-    // parse the rtp packet
-    RtpJpegPacket rtp_jpeg_packet(packet);
-    auto frag_offset = rtp_jpeg_packet.get_offset();
+  /// Handle an RTP/JPEG packet, in sequence order
+  /// \note Appends the packet to the current JPEG frame. If the packet is the
+  ///       last fragment of the frame, the frame is sent to the
+  ///       on_shared_jpeg_frame or on_jpeg_frame callback. If a fragment is
+  ///       missing, the frame is dropped.
+  /// \note This function is called by the jitter buffer.
+  /// \param packet The RTP/JPEG packet
+  void handle_rtp_jpeg_packet(const RtpJpegPacket &packet) {
+    auto frag_offset = packet.get_offset();
     if (frag_offset == 0) {
       // first fragment
       logger_.debug("Received first fragment, size: {}, sequence number: {}",
-                    rtp_jpeg_packet.get_data().size(), rtp_jpeg_packet.get_sequence_number());
-      if (jpeg_frame) {
-        // we already have a frame, this is an error
-        logger_.warn("Received first fragment but already have a frame");
-        jpeg_frame.reset();
+                    packet.get_data().size(), packet.get_sequence_number());
+      if (jpeg_frame_) {
+        // the last fragment of the previous frame was lost
+        logger_.debug("Received first fragment before the previous frame was complete");
+        drop_frame();
       }
-      jpeg_frame = std::make_unique<JpegFrame>(rtp_jpeg_packet);
-    } else if (jpeg_frame) {
-      logger_.debug("Received middle fragment, size: {}, sequence number: {}",
-                    rtp_jpeg_packet.get_data().size(), rtp_jpeg_packet.get_sequence_number());
-      // middle fragment
-      jpeg_frame->append(rtp_jpeg_packet);
+      frame_timestamp_ = packet.get_timestamp();
+      jpeg_frame_ = jpeg_frame_pool_.acquire();
+      if (!jpeg_frame_) {
+        logger_.warn("All JPEG frames in the pool are in use, dropping frame");
+        drop_frame();
+        return;
+      }
+      // the image size and quantization tables rarely change, so the header
+      // is almost always cached
+      auto header = jpeg_header_cache_.get(packet.get_width(), packet.get_height(),
+                                           packet.get_q_table(0), packet.get_q_table(1));
+      jpeg_frame_->reset(*header, packet);
+    } else if (!jpeg_frame_) {
+      // the first fragment of the frame was lost, or the frame was dropped
+      if (frame_timestamp_ != packet.get_timestamp()) {
+        logger_.debug("Received middle fragment without a frame");
+        frame_timestamp_ = packet.get_timestamp();
+        drop_frame();
+      }
+      return;
+    } else if (static_cast<size_t>(frag_offset) != jpeg_frame_->get_scan_data().size()) {
+      // a fragment before this one was lost
+      logger_.debug("Received fragment at offset {}, expected {}, dropping frame", frag_offset,
+                    jpeg_frame_->get_scan_data().size());
+      drop_frame();
+      return;
     } else {
-      // we don't have a frame to append to but we got a middle fragment
-      // this is an error
-      logger_.warn("Received middle fragment without a frame");
-      return {};
+      logger_.debug("Received middle fragment, size: {}, sequence number: {}",
+                    packet.get_data().size(), packet.get_sequence_number());
+      jpeg_frame_->append(packet);
     }
 
     // check if this is the last packet of the frame (the last packet will have
     // the marker bit set)
-    if (jpeg_frame && jpeg_frame->is_complete()) {
-      // get the jpeg data
-      auto jpeg_data = jpeg_frame->get_data();
-      logger_.debug("Received jpeg frame of size: {} B", jpeg_data.size());
-      // call the on_jpeg_frame callback
-      if (on_jpeg_frame_) {
-        on_jpeg_frame_(std::move(jpeg_frame));
+    if (jpeg_frame_->is_complete()) {
+      logger_.debug("Received jpeg frame of size: {} B", jpeg_frame_->get_data().size());
+      {
+        std::lock_guard<std::mutex> lk(reception_stats_mutex_);
+        stats_.frames_received++;
+      }
+      if (on_shared_jpeg_frame_) {
+        // the frame returns to the pool once everyone is done with it
+        on_shared_jpeg_frame_(std::move(jpeg_frame_));
+      } else if (on_jpeg_frame_) {
+        // the callback takes ownership, so hand over the frame's memory
+        on_jpeg_frame_(std::make_unique<JpegFrame>(std::move(*jpeg_frame_)));
       }
-      logger_.debug("Sent jpeg frame to callback, now jpeg_frame is nullptr? {}",
-                    jpeg_frame == nullptr);
+      jpeg_frame_.reset();
     }
-    // return an empty vector to indicate that we don't want to send a response
-    return {};
+  }
+
+  /// Drop the JPEG frame being reassembled, if any, and count it as dropped
+  void drop_frame() {
+    jpeg_frame_.reset();
+    std::lock_guard<std::mutex> lk(reception_stats_mutex_);
+    stats_.frames_dropped++;
   }
 
   /// Handle an RTCP packet
-  /// \note Parses the RTCP packet and sends a response if necessary.
+  /// \note Parses the RTCP packet and, if it contains a sender report,
+  ///       responds with a receiver report.
   /// \note This function is called by the RTCP socket task.
   /// \param data The data to handle
   /// \param sender_info The sender info
   /// \return Optional data to send back to the sender
   std::optional<std::vector<uint8_t>> handle_rtcp_packet(std::vector<uint8_t> &data,
                                                          const espp::Socket::Info &sender_info) {
-    // receive the rtcp packet
-    std::string_view packet(reinterpret_cast<char *>(data.data()), data.size());
-    // TODO: parse the rtcp packet
-    // return an empty vector to indicate that we don't want to send a response
-    return {};
+    return handle_rtcp_data(std::string_view(reinterpret_cast<char *>(data.data()), data.size()));
+  }
+
+  /// Handle a (compound) RTCP packet, received over UDP or interleaved
+  /// \param compound_packet The (compound) RTCP packet
+  /// \return The receiver report to send back, if the packet contained a
+  ///         sender report
+  std::optional<std::vector<uint8_t>> handle_rtcp_data(std::string_view compound_packet) {
+    bool got_sender_report = false;
+    for (auto packet : RtcpPacket::split_compound(compound_packet)) {
+      RtcpSenderReport sender_report(packet);
+      if (!sender_report.is_valid()) {
+        continue;
+      }
+      logger_.debug("Received RTCP sender report, {} packets sent",
+                    sender_report.get_packet_count());
+      std::lock_guard<std::mutex> lk(reception_stats_mutex_);
+      reception_stats_.on_sender_report(sender_report);
+      got_sender_report = true;
+    }
+    if (!got_sender_report) {
+      // return an empty vector to indicate that we don't want to send a response
+      return {};
+    }
+    // respond with a receiver report
+    RtcpReceiverReport receiver_report;
+    receiver_report.set_ssrc(ssrc_);
+    {
+      std::lock_guard<std::mutex> lk(reception_stats_mutex_);
+      if (reception_stats_.has_received()) {
+        receiver_report.set_report_blocks({reception_stats_.get_report_block()});
+      }
+    }
+    receiver_report.serialize();
+    auto response = receiver_report.get_data();
+    return std::vector<uint8_t>(response.begin(), response.end());
   }
 
   std::string server_address_;
@@ -474,12 +892,40 @@ protected:
   espp::UdpSocket rtcp_socket_;
 
   jpeg_frame_callback_t on_jpeg_frame_{nullptr};
+  shared_jpeg_frame_callback_t on_shared_jpeg_frame_{nullptr};
 
   int cseq_ = 0;
   int video_port_ = 0;
   int video_payload_type_ = 0;
   std::string path_;
   std::string session_id_;
+  uint32_t ssrc_; ///< The SSRC of the client, sent in its receiver reports
+
+  mutable std::mutex reception_stats_mutex_; ///< Protects reception_stats_ and stats_
+  RtpReceptionStats reception_stats_;
+  Stats stats_;
+
+  // NOTE: only used by the task which receives the RTP packets
+  RtpJitterBuffer jitter_buffer_;
+  JpegFramePool jpeg_frame_pool_;
+  JpegHeaderCache jpeg_header_cache_;
+  RtpJpegPacket rtp_jpeg_packet_;           ///< The packet received packets are parsed into
+  std::shared_ptr<JpegFrame> jpeg_frame_;   ///< The JPEG frame being reassembled
+  std::optional<uint32_t> frame_timestamp_; ///< The RTP timestamp of the current or dropped
+                                            ///< frame
+
+  static constexpr size_t MIN_RTP_JPEG_PACKET_SIZE = 20; ///< RTP header + RTP/JPEG header
+  static constexpr size_t INTERLEAVED_RECEIVE_SIZE = 16 * 1024;
+  std::atomic<bool> interleaved_{false}; ///< Whether the stream is interleaved on rtsp_socket_
+  uint8_t rtp_channel_{0};
+  uint8_t rtcp_channel_{1};
+  std::mutex write_mutex_; ///< Serializes requests and receiver reports on rtsp_socket_
+  std::mutex response_mutex_;
+  std::condition_variable response_cv_;
+  std::optional<std::string> response_; ///< The response received by the interleaved task
+  std::vector<uint8_t> receive_buffer_;
+  std::string interleaved_buffer_; ///< Received data which is not a complete message
+  std::unique_ptr<espp::Task> interleaved_task_;
 
   espp::Logger logger_;
 };
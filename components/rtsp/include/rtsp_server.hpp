@@ -14,8 +14,10 @@
 
 #include "jpeg_frame.hpp"
 #include "rtcp_packet.hpp"
+#include "rtcp_receiver_report.hpp"
 #include "rtp_jpeg_packet.hpp"
 #include "rtp_packet.hpp"
+#include "rtp_packet_pool.hpp"
 
 #include "rtsp_session.hpp"
 
@@ -23,11 +25,25 @@ namespace espp {
 /// Class for streaming MJPEG data from a camera using RTSP + RTP
 /// Starts a TCP socket to listen for RTSP connections, and then spawns off a
 /// new RTSP session for each connection.
+/// Each session sends RTCP sender reports to its client and adapts the frame
+/// rate it sends at to the loss and jitter in the client's receiver reports.
+///
+/// If a multicast group is configured, clients can request a multicast
+/// transport in their SETUP request. Each frame is then packetized and sent
+/// once, to the group, however many multicast clients there are, so the CPU
+/// time and airtime used stay constant as viewers are added. The multicast
+/// stream does not adapt its frame rate, since that would affect all of its
+/// clients, but its reception stats are available from get_multicast_stats().
 /// @see RtspSession
-/// @note This class does not currently send RTCP packets
 ///
 /// \section RtspServer example
 /// \snippet rtsp_example.cpp rtsp_server_example
+/// \section rtsp_server_ex2 RtspServer Packetization Benchmark
+/// \snippet rtsp_example.cpp rtsp_packetization_benchmark
+/// \section rtsp_server_ex3 RtspServer UDP vs TCP Interleaved Benchmark
+/// \snippet rtsp_example.cpp rtsp_transport_benchmark
+/// \section rtsp_server_ex4 RtspServer Multicast Benchmark
+/// \snippet rtsp_example.cpp rtsp_multicast_benchmark
 class RtspServer {
 public:
   /// @brief Configuration for the RTSP server
@@ -40,6 +56,18 @@ public:
               ///< up into multiple packets if they are larger than this. It seems that 1500 works
               ///< well for sending, but is too large for the esp32 (camera-display) to receive
               ///< properly.
+    size_t session_send_queue_size =
+        1; ///< The maximum number of frames waiting to be sent to each client. When a client's
+           ///< queue is full, its oldest waiting frame is dropped.
+           ///< @see RtspSession::Config::send_queue_size
+    std::chrono::milliseconds rtcp_interval{1000}; ///< The interval between the RTCP sender
+                                                   ///< reports sent to each unicast client and
+                                                   ///< to the multicast group
+    RtspSession::AdaptationConfig session_adaptation{}; ///< How each session adapts its frame
+                                                        ///< rate to its client's RTCP reports
+    RtspSession::MulticastConfig multicast{}; ///< The multicast group to send to, for clients
+                                              ///< which request a multicast transport.
+                                              ///< Disabled by default.
     Logger::Verbosity log_level = Logger::Verbosity::WARN; ///< The log level for the RTSP server
   };
 
@@ -49,6 +77,11 @@ public:
       : server_address_(config.server_address), port_(config.port), path_(config.path),
         rtsp_socket_({.log_level = espp::Logger::Verbosity::WARN}),
         max_data_size_(config.max_data_size),
+        session_send_queue_size_(config.session_send_queue_size),
+        rtcp_interval_(config.rtcp_interval),
+        session_adaptation_(config.session_adaptation), multicast_config_(config.multicast),
+        multicast_rtp_socket_({.log_level = espp::Logger::Verbosity::WARN}),
+        multicast_rtcp_socket_({.log_level = espp::Logger::Verbosity::WARN}), packet_pool_({}),
         logger_({.tag = "RTSP Server", .level = config.log_level}) {
     // generate a random ssrc
     ssrc_ = esp_random();
@@ -64,6 +97,27 @@ public:
   /// @param log_level The log level to set
   void set_session_log_level(Logger::Verbosity log_level) { session_log_level_ = log_level; }
 
+  /// @brief Get the statistics of each RTSP session
+  /// @return A map from session id to the statistics of that session
+  std::unordered_map<uint32_t, RtspSession::Stats> get_session_stats() {
+    std::lock_guard<std::mutex> lk(session_mutex_);
+    std::unordered_map<uint32_t, RtspSession::Stats> stats;
+    for (const auto &[session_id, session] : sessions_) {
+      stats[session->get_session_id()] = session->get_stats();
+    }
+    return stats;
+  }
+
+  /// @brief Get the statistics of the multicast stream
+  /// @note The frame, packet and octet counts are for the stream as a whole,
+  ///       and the reception quality is from the last receiver report of any
+  ///       of its clients. The frame divisor is always 1.
+  /// @return The statistics of the multicast stream
+  RtspSession::Stats get_multicast_stats() {
+    std::lock_guard<std::mutex> lk(multicast_mutex_);
+    return multicast_stats_;
+  }
+
   /// @brief Start the RTSP server
   /// Starts the accept task, session task, and binds the RTSP socket
   /// @return True if the server was started successfully, false otherwise
@@ -75,6 +129,11 @@ public:
 
     logger_.info("Starting RTSP server on port {}", port_);
 
+    if (!multicast_config_.group_address.empty() && !start_multicast()) {
+      logger_.error("Failed to set up multicast to {}", multicast_config_.group_address);
+      return false;
+    }
+
     if (!rtsp_socket_.bind(port_)) {
       logger_.error("Failed to bind to port {}", port_);
       return false;
@@ -119,12 +178,149 @@ public:
   /// Converts the full JPEG frame into a series of simplified RTP/JPEG
   /// packets and stores it to be sent over the RTP socket, but does not
   /// actually send it
+  /// @note The scan data of the frame is copied once, into a buffer of the
+  ///       server's RtpPacketPool. Use the std::shared_ptr overload to avoid
+  ///       this copy.
   /// @note Overwrites any existing frame that has not been sent
   /// @param frame The frame to send
   void send_frame(const JpegFrame &frame) {
-    // get the frame scan data
-    auto frame_header = frame.get_header();
-    auto frame_data = frame.get_scan_data();
+    auto packets = packet_pool_.acquire();
+    if (!packets) {
+      logger_.warn("No free frame in the packet pool, dropping frame");
+      return;
+    }
+    packetize(*packets, frame, packets->copy_scan_data(frame.get_scan_data()));
+    // now hand the frame over to the session task
+    packet_pool_.publish(std::move(packets));
+  }
+
+  /// @brief Send a frame over the RTSP connection, without copying it
+  /// Converts the full JPEG frame into a series of simplified RTP/JPEG
+  /// packets and stores it to be sent over the RTP socket, but does not
+  /// actually send it. The packets refer to the frame's data, which is sent
+  /// straight from the frame.
+  /// @note The server keeps a reference to the frame until it has been sent
+  ///       (or dropped) and its packet pool frame is reused, so the frame
+  ///       must not be modified after it is passed to this function.
+  /// @note Overwrites any existing frame that has not been sent
+  /// @param frame The frame to send
+  void send_frame(std::shared_ptr<const JpegFrame> frame) {
+    if (!frame) {
+      return;
+    }
+    auto packets = packet_pool_.acquire();
+    if (!packets) {
+      logger_.warn("No free frame in the packet pool, dropping frame");
+      return;
+    }
+    packetize(*packets, *frame, frame->get_scan_data());
+    packets->set_jpeg_frame(std::move(frame));
+    // now hand the frame over to the session task
+    packet_pool_.publish(std::move(packets));
+  }
+
+protected:
+  /// @brief Set up the sockets for the multicast stream
+  /// The RTP socket is configured once for multicast (with the configured
+  /// TTL) and connected to the group, and the RTCP socket receives the
+  /// clients' receiver reports, which they send back to the address the
+  /// sender reports come from.
+  /// @return True if the sockets were set up, false otherwise
+  bool start_multicast() {
+    if (!multicast_rtp_socket_.make_multicast(multicast_config_.time_to_live) ||
+        !multicast_rtcp_socket_.make_multicast(multicast_config_.time_to_live)) {
+      return false;
+    }
+    if (!multicast_rtp_socket_.connect({.ip_address = multicast_config_.group_address,
+                                        .port = (size_t)multicast_config_.rtp_port})) {
+      return false;
+    }
+    using namespace std::placeholders;
+    auto rtcp_task_config = Task::Config{
+        .name = "RTSP Multicast RTCP",
+        .callback = nullptr,
+        .stack_size_bytes = 4 * 1024,
+        .log_level = Logger::Verbosity::WARN,
+    };
+    return multicast_rtcp_socket_.start_receiving(
+        rtcp_task_config,
+        {
+            .port = 0,
+            .buffer_size = 1024,
+            .on_receive_callback =
+                std::bind(&RtspServer::handle_multicast_rtcp_packet, this, _1, _2),
+        });
+  }
+
+  /// @brief Send a frame once to the multicast group, followed by a sender
+  ///        report if it is time for one
+  /// @param frame The frame to send
+  void send_multicast_frame(const RtpPacketPool::Frame &frame) {
+    auto packets = frame.get_packets();
+    if (packets.empty()) {
+      return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    bool sent = RtspSession::send_rtp_packets(multicast_rtp_socket_, packets);
+    auto now = std::chrono::steady_clock::now();
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(now - start);
+    std::lock_guard<std::mutex> lk(multicast_mutex_);
+    if (!sent) {
+      logger_.warn("Failed to send frame to multicast group");
+      multicast_stats_.frames_dropped++;
+      return;
+    }
+    multicast_stats_.frames_sent++;
+    multicast_stats_.packets_sent += packets.size();
+    multicast_stats_.octets_sent += RtspSession::get_payload_size(packets);
+    multicast_stats_.last_send_latency = latency;
+    multicast_stats_.max_send_latency = std::max(multicast_stats_.max_send_latency, latency);
+    multicast_stats_.total_send_latency += latency;
+    if (now - last_multicast_sender_report_time_ >= rtcp_interval_) {
+      auto sender_report = RtspSession::make_sender_report(
+          frame, start, multicast_stats_.packets_sent, multicast_stats_.octets_sent);
+      // NOTE: the rtcp socket is also receiving (in its own task), so we must
+      // not change its receive timeout
+      multicast_rtcp_socket_.send(sender_report.get_data(),
+                                  {
+                                      .ip_address = multicast_config_.group_address,
+                                      .port = (size_t)multicast_config_.rtcp_port,
+                                      .response_timeout = std::chrono::seconds(0),
+                                  });
+      last_multicast_sender_report_time_ = now;
+    }
+  }
+
+  /// @brief Handle an RTCP packet from a multicast client, updating the
+  ///        multicast stats from its receiver reports
+  /// @param data The (compound) RTCP packet
+  /// @param sender_info The sender info
+  /// @return Optional data to send back to the sender (always empty)
+  std::optional<std::vector<uint8_t>>
+  handle_multicast_rtcp_packet(std::vector<uint8_t> &data, const Socket::Info &sender_info) {
+    auto compound_packet = std::string_view(reinterpret_cast<char *>(data.data()), data.size());
+    for (auto packet : RtcpPacket::split_compound(compound_packet)) {
+      RtcpReceiverReport receiver_report(packet);
+      if (!receiver_report.is_valid() || receiver_report.get_report_blocks().empty()) {
+        continue;
+      }
+      std::lock_guard<std::mutex> lk(multicast_mutex_);
+      RtspSession::update_report_stats(multicast_stats_, receiver_report.get_report_blocks()[0]);
+    }
+    return {};
+  }
+
+  /// @brief Fill \p packets with the RTP/JPEG packets for \p frame
+  /// The packets' headers are written in place into the packet pool frame,
+  /// and their JPEG data refers to \p frame_data.
+  /// @param packets The packet pool frame to fill
+  /// @param frame The frame to packetize
+  /// @param frame_data The scan data of the frame, which must remain valid
+  ///        while the packets are in use
+  void packetize(RtpPacketPool::Frame &packets, const JpegFrame &frame,
+                 std::string_view frame_data) {
+    // get the frame header
+    const auto &frame_header = frame.get_header();
 
     auto width = frame_header.get_width();
     auto height = frame_header.get_height();
@@ -137,11 +333,15 @@ public:
     logger_.debug("Frame data is {} bytes, breaking into {} packets", frame_data.size(),
                   num_packets);
 
-    // create num_packets RtpJpegPackets
+    // all packets of a frame share the same timestamp
+    static auto start_time = std::chrono::steady_clock::now();
+    auto now = std::chrono::steady_clock::now();
+    auto timestamp =
+        std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time).count();
+
+    // fill num_packets RtpJpegPackets
     // The first packet will have the quantization tables, and the last packet
     // will have the end of image marker and the marker bit set
-    std::vector<std::unique_ptr<RtpJpegPacket>> packets;
-    packets.reserve(num_packets);
     for (size_t i = 0; i < num_packets; i++) {
       // get the start and end indices for the current packet
       size_t start_index = i * max_data_size_;
@@ -151,59 +351,37 @@ public:
       static const int fragment_type = 0;
       int offset = i * max_data_size_;
 
-      std::unique_ptr<RtpJpegPacket> packet;
+      auto &packet = packets.add_packet();
+      auto &header = packet.header;
+      // the packet only holds the headers, its data is sent straight from
+      // frame_data
+      packet.jpeg_data = frame_data.substr(start_index, end_index - start_index);
       // if this is the first packet, it has the quantization tables
       if (i == 0) {
         // use the original q value and include the quantization tables
-        packet = std::make_unique<RtpJpegPacket>(
-            type_specific, fragment_type, 128, width, height, q0, q1,
-            frame_data.substr(start_index, end_index - start_index));
+        header.reset(type_specific, fragment_type, 128, width, height, q0, q1, {});
       } else {
         // use a different q value (less than 128) and don't include the
         // quantization tables
-        packet = std::make_unique<RtpJpegPacket>(
-            type_specific, offset, fragment_type, 96, width, height,
-            frame_data.substr(start_index, end_index - start_index));
+        header.reset(type_specific, offset, fragment_type, 96, width, height, {});
       }
 
       // set the payload type to 26 (JPEG)
-      packet->set_payload_type(26);
+      header.set_payload_type(26);
       // set the sequence number
-      packet->set_sequence_number(sequence_number_++);
+      header.set_sequence_number(sequence_number_++);
       // set the timestamp
-      static auto start_time = std::chrono::steady_clock::now();
-      auto now = std::chrono::steady_clock::now();
-      auto timestamp =
-          std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time).count();
-      packet->set_timestamp(timestamp * 90);
-
+      header.set_timestamp(timestamp * 90);
       // set the ssrc
-      packet->set_ssrc(ssrc_);
-
-      auto mjpeg_header = packet->get_mjpeg_header();
-      std::vector<char> mjpeg_vec(mjpeg_header.begin(), mjpeg_header.end());
-
+      header.set_ssrc(ssrc_);
       // if it's the last packet, set the marker bit
-      if (i == num_packets - 1) {
-        packet->set_marker(true);
-      }
+      header.set_marker(i == num_packets - 1);
 
       // make sure the packet header has been serialized
-      packet->serialize();
-
-      // add the packet to the list of packets
-      packets.emplace_back(std::move(packet));
-    }
-
-    // now move the packets into the rtp_packets_ vector
-    {
-      std::unique_lock<std::mutex> lock(rtp_packets_mutex_);
-      // move the new packets into the list
-      rtp_packets_ = std::move(packets);
+      header.serialize();
     }
   }
 
-protected:
   bool accept_task_function(std::mutex &m, std::condition_variable &cv) {
     // accept a new connection
     auto control_socket = rtsp_socket_.accept();
@@ -219,11 +397,18 @@ protected:
         std::move(control_socket),
         RtspSession::Config{.server_address = fmt::format("{}:{}", server_address_, port_),
                             .rtsp_path = path_,
+                            .send_queue_size = session_send_queue_size_,
+                            .rtcp_interval = rtcp_interval_,
+                            .adaptation = session_adaptation_,
+                            .multicast = multicast_config_,
                             .log_level = session_log_level_});
 
     // add the session to the list of sessions
     auto session_id = session->get_session_id();
-    sessions_.emplace(session_id, std::move(session));
+    {
+      std::lock_guard<std::mutex> lk(session_mutex_);
+      sessions_.emplace(session_id, std::move(session));
+    }
 
     // start the session task if it is not already running
     using namespace std::placeholders;
@@ -249,50 +434,53 @@ protected:
       cv.wait_for(lk, 10ms);
     }
 
-    // when this function returns, the vector of pointers will go out of scope
-    // and the pointers will be deleted (which is good because it means we
-    // won't send the same frame twice)
-    std::vector<std::unique_ptr<RtpJpegPacket>> packets;
-    {
-      // copy the rtp packets into a local vector
-      std::unique_lock<std::mutex> lock(rtp_packets_mutex_);
-      if (rtp_packets_.empty()) {
-        // if there is not a new frame (no packets), then simply return
-        // we do not want to stop the task
-        return false;
-      }
-      // move the packets into the local vector
-      packets = std::move(rtp_packets_);
+    // the frame is released back to the packet pool once every session has
+    // sent (or dropped) it, which means we won't send the same frame twice
+    auto frame = packet_pool_.take();
+    if (!frame) {
+      // if there is not a new frame, then simply return
+      // we do not want to stop the task
+      return false;
     }
 
-    logger_.debug("Sending frame data to clients");
+    logger_.debug("Queueing frame data for clients");
 
     // for each session in sessions_
     // if the session is active
-    // send the latest frame to the client
-    std::lock_guard<std::mutex> lk(session_mutex_);
-    for (auto &session : sessions_) {
-      [[maybe_unused]] auto session_id = session.first;
-      auto &session_ptr = session.second;
-      // send the packets to the client
-      for (auto &packet : packets) {
-        // if the session is not active or is closed, then stop sending
+    // queue the latest frame to be sent to the client by the session's own
+    // send task, so that a slow client does not delay the others
+    bool send_multicast = false;
+    {
+      std::lock_guard<std::mutex> lk(session_mutex_);
+      for (auto &session : sessions_) {
+        [[maybe_unused]] auto session_id = session.first;
+        auto &session_ptr = session.second;
+        // if the session is not active or is closed, then don't send
         if (!session_ptr->is_active() || session_ptr->is_closed()) {
-          break;
+          continue;
+        }
+        if (session_ptr->is_multicast()) {
+          // the frame is sent to the group once, for all multicast sessions
+          send_multicast = true;
+          continue;
         }
-        session_ptr->send_rtp_packet(*packet);
+        // queue the packets for the client
+        session_ptr->queue_frame(frame);
       }
-    }
-    // loop over the sessions and erase ones which are closed
-    for (auto it = sessions_.begin(); it != sessions_.end();) {
-      auto &session = it->second;
-      if (session->is_closed()) {
-        logger_.info("Removing session {}", session->get_session_id());
-        it = sessions_.erase(it);
-      } else {
-        ++it;
+      // loop over the sessions and erase ones which are closed
+      for (auto it = sessions_.begin(); it != sessions_.end();) {
+        auto &session = it->second;
+        if (session->is_closed()) {
+          logger_.info("Removing session {}", session->get_session_id());
+          it = sessions_.erase(it);
+        } else {
+          ++it;
+        }
       }
     }
+    if (send_multicast) {
+      send_multicast_frame(*frame);
+    }
 
     // we do not want to stop the task
     return false;
@@ -308,9 +496,18 @@ protected:
   TcpSocket rtsp_socket_;
 
   size_t max_data_size_;
-
-  std::mutex rtp_packets_mutex_;
-  std::vector<std::unique_ptr<RtpJpegPacket>> rtp_packets_;
+  size_t session_send_queue_size_;
+  std::chrono::milliseconds rtcp_interval_;
+  RtspSession::AdaptationConfig session_adaptation_;
+
+  RtspSession::MulticastConfig multicast_config_;
+  UdpSocket multicast_rtp_socket_;
+  UdpSocket multicast_rtcp_socket_;
+  std::mutex multicast_mutex_;
+  RtspSession::Stats multicast_stats_;
+  std::chrono::steady_clock::time_point last_multicast_sender_report_time_{};
+
+  RtpPacketPool packet_pool_;
 
   Logger::Verbosity session_log_level_{Logger::Verbosity::WARN};
   std::mutex session_mutex_;
@@ -1,6 +1,14 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
 #include <memory>
+#include <mutex>
+#include <span>
 #include <string>
 #include <system_error>
 #include <vector>
@@ -13,20 +21,98 @@
 #include "udp_socket.hpp"
 
 #include "rtcp_packet.hpp"
+#include "rtcp_receiver_report.hpp"
+#include "rtcp_sender_report.hpp"
 #include "rtp_packet.hpp"
+#include "rtp_packet_pool.hpp"
 
 namespace espp {
 /// Class that reepresents an RTSP session, which is uniquely identified by a
 /// session id and sends frame data over RTP and RTCP to the client
+///
+/// The RTP and RTCP packets are sent either over UDP, to the ports the client
+/// requested in its SETUP request, or interleaved with the RTSP messages on
+/// the control (TCP) connection (RFC 2326 section 10.12) if the client
+/// requested the RTP/AVP/TCP transport, e.g. because it is behind a NAT or on
+/// a lossy network.
+///
+/// If the server has a multicast group configured (see MulticastConfig) and
+/// the client requests a multicast transport, the session does not send any
+/// packets itself: the server sends each frame once to the multicast group,
+/// which all multicast clients receive.
+///
+/// While frames are being sent, the session periodically sends RTCP sender
+/// reports to the client, and uses the packet loss and jitter from the
+/// client's receiver reports to adapt the frame rate it sends at: when the
+/// client falls behind, only every n-th frame is sent (see
+/// AdaptationConfig), so that the latency stays bounded instead of packets
+/// queueing up on the link.
 class RtspSession {
 public:
+  /// Configuration for adapting the frame rate to the client's reception
+  /// quality, as reported in its RTCP receiver reports
+  struct AdaptationConfig {
+    bool enabled = true;            ///< Whether to adapt the frame rate at all
+    float max_fraction_lost = 0.05; ///< The fraction of packets lost (since the last report)
+                                    ///< above which the client is considered congested
+    std::chrono::milliseconds max_jitter{30}; ///< The interarrival jitter above which the client
+                                              ///< is considered congested
+    size_t max_frame_divisor = 8; ///< The maximum frame divisor, i.e. at most every
+                                  ///< max_frame_divisor-th frame is sent
+  };
+
+  /// Configuration for sending the stream to a multicast group, which all
+  /// clients that request a multicast transport share
+  struct MulticastConfig {
+    std::string group_address{}; ///< The multicast group (224.0.0.0 to 239.255.255.255) to send
+                                 ///< to. If empty, multicast is disabled and SETUP requests for
+                                 ///< a multicast transport are rejected.
+    int rtp_port = 5004;         ///< The group port the RTP packets are sent to
+    int rtcp_port = 5005;        ///< The group port the RTCP sender reports are sent to
+    uint8_t time_to_live = 1;    ///< The number of hops the multicast packets may take
+  };
+
   /// Configuration for the RTSP session
   struct Config {
     std::string server_address;                            ///< The address of the server
     std::string rtsp_path;                                 ///< The RTSP path of the session
+    size_t send_queue_size = 1; ///< The maximum number of frames waiting to be sent to the
+                                ///< client. When the queue is full, the oldest waiting frame is
+                                ///< dropped (the latest frame wins).
+    std::chrono::milliseconds rtcp_interval{1000}; ///< The interval between RTCP sender reports
+    std::chrono::milliseconds interleaved_send_timeout{1000}; ///< How long writing interleaved
+                                                              ///< packets may block before the
+                                                              ///< client, which stopped reading,
+                                                              ///< is disconnected
+    AdaptationConfig adaptation{};                 ///< The frame rate adaptation policy
+    MulticastConfig multicast{}; ///< The multicast group of the server, if any
     Logger::Verbosity log_level = Logger::Verbosity::WARN; ///< The log level of the session
   };
 
+  /// Statistics about the frames sent to the client
+  struct Stats {
+    size_t frames_sent{0};    ///< The number of frames which were sent to the client
+    size_t frames_dropped{0}; ///< The number of frames which were dropped, because the send queue
+                              ///< was full or because sending them failed
+    std::chrono::microseconds last_send_latency{0}; ///< The time between queueing and having sent
+                                                    ///< the last frame
+    std::chrono::microseconds max_send_latency{0};  ///< The maximum send latency of any frame
+    std::chrono::microseconds total_send_latency{0}; ///< The sum of the send latencies of all
+                                                     ///< frames sent, for computing the average
+    size_t frames_skipped{0}; ///< The number of frames which were not sent because of the frame
+                              ///< divisor
+    size_t frame_divisor{1};  ///< Only every frame_divisor-th frame is currently sent
+    size_t packets_sent{0};   ///< The number of RTP packets sent
+    size_t octets_sent{0};    ///< The number of RTP payload octets sent
+    size_t reports_received{0}; ///< The number of RTCP receiver reports received
+    float fraction_lost{0};     ///< The fraction of packets lost, from the last receiver report
+    int32_t cumulative_lost{0}; ///< The number of packets lost, from the last receiver report
+    std::chrono::microseconds jitter{0};          ///< The interarrival jitter, from the last
+                                                  ///< receiver report
+    std::chrono::microseconds round_trip_time{0}; ///< The round trip time, computed from the
+                                                  ///< last receiver report
+  };
+
   /// @brief Construct a new RtspSession object
   /// @param control_socket The control socket of the session
   /// @param config The configuration of the session
@@ -36,9 +122,36 @@ public:
         rtcp_socket_({.log_level = Logger::Verbosity::WARN}), session_id_(generate_session_id()),
         server_address_(config.server_address), rtsp_path_(config.rtsp_path),
         client_address_(control_socket_->get_remote_info().address),
+        send_queue_(std::max<size_t>(config.send_queue_size, 1)),
+        rtcp_interval_(config.rtcp_interval),
+        interleaved_send_timeout_(config.interleaved_send_timeout), adaptation_(config.adaptation),
+        multicast_config_(config.multicast),
         logger_({.tag = "RtspSession " + std::to_string(session_id_), .level = config.log_level}) {
-    // start the session task to handle RTSP commands
     using namespace std::placeholders;
+    // receive RTCP receiver reports from the client on the socket we send
+    // sender reports from (bound to any free port)
+    // NOTE: the task config only refers to the name
+    std::string rtcp_task_name = "RtspSession " + std::to_string(session_id_) + " rtcp";
+    auto rtcp_task_config = Task::Config{
+        .name = rtcp_task_name,
+        .callback = nullptr,
+        .stack_size_bytes = 4 * 1024,
+        .log_level = Logger::Verbosity::WARN,
+    };
+    if (!rtcp_socket_.start_receiving(rtcp_task_config,
+                                      {
+                                          .port = 0,
+                                          .buffer_size = 1024,
+                                          .on_receive_callback = std::bind(
+                                              &RtspSession::handle_rtcp_packet, this, _1, _2),
+                                      })) {
+      logger_.error("Failed to start receiving RTCP packets");
+    }
+    // responses are written with TcpSocket::write, which (unlike transmit)
+    // doesn't set the receive timeout, so set it here so that the control
+    // task can be stopped while it waits for requests
+    control_socket_->set_receive_timeout(std::chrono::milliseconds(500));
+    // start the session task to handle RTSP commands
     control_task_ = std::make_unique<Task>(Task::Config{
         .name = "RtspSession " + std::to_string(session_id_),
         .callback = std::bind(&RtspSession::control_task_fn, this, _1, _2),
@@ -46,15 +159,36 @@ public:
         .log_level = Logger::Verbosity::WARN,
     });
     control_task_->start();
+    // start the send task to send queued frames to the client
+    send_task_ = std::make_unique<Task>(Task::Config{
+        .name = "RtspSession " + std::to_string(session_id_) + " send",
+        .callback = std::bind(&RtspSession::send_task_fn, this, _1, _2),
+        .stack_size_bytes = 6 * 1024,
+        .log_level = Logger::Verbosity::WARN,
+    });
+    send_task_->start();
   }
 
   ~RtspSession() {
+    // stop receiving RTCP packets first, since the rtcp socket is destroyed
+    // after the members its callback uses
+    rtcp_socket_.stop_receiving();
     teardown();
+    // shut down the control connection, so that a send blocked on a client
+    // which stopped reading returns and the tasks can be stopped
+    if (control_socket_) {
+      control_socket_->shutdown();
+    }
     // stop the session task
     if (control_task_ && control_task_->is_started()) {
       logger_.info("Stopping control task");
       control_task_->stop();
     }
+    // stop the send task
+    if (send_task_ && send_task_->is_started()) {
+      logger_.info("Stopping send task");
+      send_task_->stop();
+    }
   }
 
   /// @brief Get the session id
@@ -73,6 +207,12 @@ public:
   /// @return True if the session is active, false otherwise
   bool is_active() const { return session_active_; }
 
+  /// Get whether the client requested a multicast transport, in which case
+  /// the server sends the frames to the multicast group instead of queueing
+  /// them for the session
+  /// @return True if the session is multicast, false otherwise
+  bool is_multicast() const { return transport_ == Transport::MULTICAST; }
+
   /// Mark the session as active
   /// This will cause the server to start sending frames to the client
   void play() { session_active_ = true; }
@@ -88,7 +228,63 @@ public:
   /// and close the connection
   void teardown() {
     session_active_ = false;
-    closed_ = true;
+    {
+      std::lock_guard<std::mutex> lk(send_queue_mutex_);
+      closed_ = true;
+    }
+    // wake up the send task so that it stops
+    send_queue_cv_.notify_all();
+  }
+
+  /// Queue a frame to be sent to the client by the session's send task
+  /// This never blocks: if the send queue is full, the oldest frame in the
+  /// queue is dropped, so a slow client only loses whole frames and does not
+  /// delay the server or other clients.
+  /// @note While the client is congested, only every
+  ///       Stats::frame_divisor-th frame is queued and the others are
+  ///       skipped.
+  /// @param frame The frame of RTP packets to send
+  /// @return True if the frame was queued (or skipped) without dropping
+  ///         another frame, false otherwise
+  bool queue_frame(std::shared_ptr<const RtpPacketPool::Frame> frame) {
+    bool dropped = false;
+    {
+      std::lock_guard<std::mutex> lk(send_queue_mutex_);
+      if (closed_) {
+        return false;
+      }
+      if (frame_count_++ % stats_.frame_divisor != 0) {
+        stats_.frames_skipped++;
+        return true;
+      }
+      if (send_queue_count_ == send_queue_.size()) {
+        // the queue is full, so drop the oldest frame
+        send_queue_[send_queue_head_].frame.reset();
+        send_queue_head_ = (send_queue_head_ + 1) % send_queue_.size();
+        send_queue_count_--;
+        stats_.frames_dropped++;
+        dropped = true;
+      }
+      auto &entry = send_queue_[(send_queue_head_ + send_queue_count_) % send_queue_.size()];
+      entry.frame = std::move(frame);
+      entry.queue_time = std::chrono::steady_clock::now();
+      send_queue_count_++;
+    }
+    send_queue_cv_.notify_all();
+    if (dropped) {
+      logger_.debug("Send queue full, dropped oldest frame");
+    }
+    return !dropped;
+  }
+
+  /// Get the statistics about the frames sent to the client and its
+  /// reception quality
+  /// @note The application can use these e.g. to lower the JPEG quality of
+  ///       the frames it encodes when clients are congested.
+  /// @return The statistics of the session
+  Stats get_stats() const {
+    std::lock_guard<std::mutex> lk(send_queue_mutex_);
+    return stats_;
   }
 
   /// Send an RTP packet to the client
@@ -96,10 +292,115 @@ public:
   /// @return True if the packet was sent successfully, false otherwise
   bool send_rtp_packet(const RtpPacket &packet) {
     logger_.debug("Sending RTP packet");
-    return rtp_socket_.send(packet.get_data(), {
-                                                   .ip_address = client_address_,
-                                                   .port = (size_t)client_rtp_port_,
-                                               });
+    return rtp_socket_.send(packet.get_data());
+  }
+
+  /// Send all RTP packets of a frame to the client
+  /// Each packet is sent as its headers followed by its JPEG data, gathered
+  /// with scatter-gather I/O, so the data is never copied into the packet.
+  /// The packets are sent in batches (using sendmmsg where available), or
+  /// with a few large writes on the control socket if the session is
+  /// interleaved.
+  /// @param frame The frame of RTP packets to send
+  /// @return True if all packets were sent successfully, false otherwise
+  bool send_rtp_frame(const RtpPacketPool::Frame &frame) {
+    if (transport_ == Transport::INTERLEAVED) {
+      return send_interleaved_rtp_frame(frame);
+    }
+    auto packets = frame.get_packets();
+    logger_.debug("Sending {} RTP packets", packets.size());
+    if (!send_rtp_packets(rtp_socket_, packets)) {
+      return false;
+    }
+    count_sent_packets(packets);
+    return true;
+  }
+
+  /// Send RTP packets over UDP, each as its headers followed by its JPEG
+  /// data, in batches (using sendmmsg where available)
+  /// @note This is also used by the server to send frames to the multicast
+  ///       group.
+  /// @param socket The socket to send the packets with, which is connected
+  ///       to their destination
+  /// @param packets The RTP packets to send
+  /// @return True if all packets were sent successfully, false otherwise
+  static bool send_rtp_packets(UdpSocket &socket,
+                               std::span<const RtpPacketPool::Frame::Packet> packets) {
+    std::array<std::array<struct iovec, 2>, RTP_BATCH_SIZE> iovecs;
+    std::array<std::span<const struct iovec>, RTP_BATCH_SIZE> datagrams;
+    for (size_t start = 0; start < packets.size(); start += RTP_BATCH_SIZE) {
+      size_t batch_size = std::min(packets.size() - start, RTP_BATCH_SIZE);
+      for (size_t i = 0; i < batch_size; i++) {
+        const auto &packet = packets[start + i];
+        auto header = packet.header.get_data();
+        iovecs[i][0] = {.iov_base = (void *)header.data(), .iov_len = header.size()};
+        iovecs[i][1] = {.iov_base = (void *)packet.jpeg_data.data(),
+                        .iov_len = packet.jpeg_data.size()};
+        datagrams[i] = iovecs[i];
+      }
+      if (!socket.send_batch(std::span(datagrams.data(), batch_size))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Get the number of RTP payload octets in packets, as counted in RTCP
+  /// sender reports
+  /// @param packets The RTP packets
+  /// @return The number of payload octets, i.e. excluding the RTP headers
+  static size_t get_payload_size(std::span<const RtpPacketPool::Frame::Packet> packets) {
+    size_t size = 0;
+    for (const auto &packet : packets) {
+      size += packet.header.get_data().size() - packet.header.get_rtp_header_size() +
+              packet.jpeg_data.size();
+    }
+    return size;
+  }
+
+  /// Make an RTCP sender report for a frame which was just sent
+  /// @param frame The frame which was sent, which must not be empty
+  /// @param queue_time The time the frame was queued, which corresponds to
+  ///        its RTP timestamp
+  /// @param packet_count The number of RTP packets sent so far
+  /// @param octet_count The number of RTP payload octets sent so far
+  /// @return The serialized sender report
+  static RtcpSenderReport make_sender_report(const RtpPacketPool::Frame &frame,
+                                             std::chrono::steady_clock::time_point queue_time,
+                                             uint32_t packet_count, uint32_t octet_count) {
+    const auto &header = frame.get_packets()[0].header;
+    // the RTP timestamp (90 kHz) which corresponds to the current time
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - queue_time);
+    uint32_t rtp_timestamp = static_cast<uint32_t>(header.get_timestamp()) +
+                             static_cast<uint32_t>(elapsed.count() * 90 / 1000);
+    RtcpSenderReport sender_report;
+    sender_report.set_ssrc(header.get_ssrc());
+    sender_report.set_ntp_timestamp(RtcpPacket::get_ntp_timestamp());
+    sender_report.set_rtp_timestamp(rtp_timestamp);
+    sender_report.set_packet_count(packet_count);
+    sender_report.set_octet_count(octet_count);
+    sender_report.serialize();
+    return sender_report;
+  }
+
+  /// Update the reception quality in \p stats from a report block of a
+  /// receiver report
+  /// @note This is also used by the server for the multicast stream.
+  /// @param stats The stats to update
+  /// @param block The report block from a receiver report
+  static void update_report_stats(Stats &stats, const RtcpPacket::ReportBlock &block) {
+    stats.reports_received++;
+    stats.fraction_lost = block.fraction_lost / 256.0f;
+    stats.cumulative_lost = block.cumulative_lost;
+    // the jitter is in units of the 90 kHz RTP clock
+    stats.jitter = std::chrono::microseconds(block.jitter * 1000ULL / 90);
+    if (block.last_sr != 0) {
+      // the round trip time is in units of 1/65536 seconds
+      uint32_t now = RtcpPacket::get_compact_ntp_timestamp(RtcpPacket::get_ntp_timestamp());
+      uint32_t round_trip_time = now - block.last_sr - block.delay_since_last_sr;
+      stats.round_trip_time = std::chrono::microseconds(round_trip_time * 1000000ULL / 65536);
+    }
   }
 
   /// Send an RTCP packet to the client
@@ -107,13 +408,169 @@ public:
   /// @return True if the packet was sent successfully, false otherwise
   bool send_rtcp_packet(const RtcpPacket &packet) {
     logger_.debug("Sending RTCP packet");
+    if (transport_ == Transport::INTERLEAVED) {
+      auto data = packet.get_data();
+      auto prefix = make_interleaved_header(rtcp_channel_, data.size());
+      std::array<struct iovec, 2> iovecs{{
+          {.iov_base = prefix.data(), .iov_len = prefix.size()},
+          {.iov_base = (void *)data.data(), .iov_len = data.size()},
+      }};
+      std::lock_guard<std::mutex> lk(control_write_mutex_);
+      if (!control_socket_->transmit(iovecs)) {
+        // see send_interleaved_rtp_frame
+        control_socket_->shutdown();
+        teardown();
+        return false;
+      }
+      return true;
+    }
+    // NOTE: the rtcp socket is also receiving (in its own task), so we must
+    // not change its receive timeout
     return rtcp_socket_.send(packet.get_data(), {
                                                     .ip_address = client_address_,
                                                     .port = (size_t)client_rtcp_port_,
+                                                    .response_timeout = std::chrono::seconds(0),
                                                 });
   }
 
 protected:
+  static constexpr size_t RTP_BATCH_SIZE = 16; ///< Number of RTP packets sent per batch
+  static constexpr size_t INTERLEAVED_HEADER_SIZE = 4; ///< '$', channel, 16 bit length
+  static constexpr size_t MAX_CONTROL_BUFFER_SIZE = 4096; ///< Max size of a buffered request
+
+  /// How the RTP and RTCP packets are sent to the client
+  enum class Transport {
+    UNICAST,     ///< Over UDP, to the client's ports
+    INTERLEAVED, ///< Interleaved on the control connection
+    MULTICAST,   ///< Over UDP, to the server's multicast group (by the server)
+  };
+
+  /// Make the header which precedes each interleaved packet on the control
+  /// connection
+  /// @param channel The channel of the packet
+  /// @param size The size of the packet
+  /// @return The header
+  static std::array<uint8_t, INTERLEAVED_HEADER_SIZE> make_interleaved_header(uint8_t channel,
+                                                                              size_t size) {
+    return {'$', channel, static_cast<uint8_t>(size >> 8), static_cast<uint8_t>(size & 0xFF)};
+  }
+
+  /// Send all RTP packets of a frame to the client, interleaved on the
+  /// control connection
+  /// Each packet is sent as its interleaved header, its RTP headers and its
+  /// JPEG data, gathered so that a batch of packets is sent with one write.
+  /// @param frame The frame of RTP packets to send
+  /// @return True if all packets were sent successfully, false otherwise
+  bool send_interleaved_rtp_frame(const RtpPacketPool::Frame &frame) {
+    auto packets = frame.get_packets();
+    logger_.debug("Sending {} interleaved RTP packets", packets.size());
+    std::array<std::array<uint8_t, INTERLEAVED_HEADER_SIZE>, RTP_BATCH_SIZE> prefixes;
+    std::array<struct iovec, 3 * RTP_BATCH_SIZE> iovecs;
+    for (size_t start = 0; start < packets.size(); start += RTP_BATCH_SIZE) {
+      size_t batch_size = std::min(packets.size() - start, RTP_BATCH_SIZE);
+      for (size_t i = 0; i < batch_size; i++) {
+        const auto &packet = packets[start + i];
+        auto header = packet.header.get_data();
+        prefixes[i] =
+            make_interleaved_header(rtp_channel_, header.size() + packet.jpeg_data.size());
+        iovecs[3 * i] = {.iov_base = prefixes[i].data(), .iov_len = prefixes[i].size()};
+        iovecs[3 * i + 1] = {.iov_base = (void *)header.data(), .iov_len = header.size()};
+        iovecs[3 * i + 2] = {.iov_base = (void *)packet.jpeg_data.data(),
+                             .iov_len = packet.jpeg_data.size()};
+      }
+      {
+        // only whole batches of packets are written, so RTSP responses can
+        // be sent between them
+        std::lock_guard<std::mutex> lk(control_write_mutex_);
+        if (!control_socket_->transmit(std::span(iovecs.data(), 3 * batch_size))) {
+          // the write failed or timed out, possibly part way through a
+          // packet, so the stream can't be resynchronized: close the session
+          logger_.warn("Failed to send interleaved RTP packets, closing the session");
+          control_socket_->shutdown();
+          teardown();
+          return false;
+        }
+      }
+      count_sent_packets(packets.subspan(start, batch_size));
+    }
+    return true;
+  }
+
+  /// Update the packet and octet counts for the sender reports
+  /// @param packets The RTP packets which were sent
+  void count_sent_packets(std::span<const RtpPacketPool::Frame::Packet> packets) {
+    octets_sent_ += get_payload_size(packets);
+    packets_sent_ += packets.size();
+  }
+
+  /// Send an RTCP sender report for the frame which was just sent
+  /// @param frame The frame which was sent
+  /// @param queue_time The time the frame was queued, which corresponds to
+  ///        its RTP timestamp
+  /// @return True if the report was sent successfully, false otherwise
+  bool send_sender_report(const RtpPacketPool::Frame &frame,
+                          std::chrono::steady_clock::time_point queue_time) {
+    if (frame.get_packets().empty()) {
+      return false;
+    }
+    return send_rtcp_packet(make_sender_report(frame, queue_time, packets_sent_, octets_sent_));
+  }
+
+  /// Handle an RTCP packet from the client, updating the reception stats and
+  /// frame rate adaptation from its receiver reports
+  /// @param data The (compound) RTCP packet
+  /// @param sender_info The sender info
+  /// @return Optional data to send back to the sender (always empty)
+  std::optional<std::vector<uint8_t>> handle_rtcp_packet(std::vector<uint8_t> &data,
+                                                         const Socket::Info &sender_info) {
+    if (closed_) {
+      return {};
+    }
+    handle_rtcp_data(std::string_view(reinterpret_cast<char *>(data.data()), data.size()));
+    return {};
+  }
+
+  /// Handle a (compound) RTCP packet from the client, received over UDP or
+  /// interleaved on the control connection
+  /// @param compound_packet The (compound) RTCP packet
+  void handle_rtcp_data(std::string_view compound_packet) {
+    for (auto packet : RtcpPacket::split_compound(compound_packet)) {
+      RtcpReceiverReport receiver_report(packet);
+      if (!receiver_report.is_valid() || receiver_report.get_report_blocks().empty()) {
+        continue;
+      }
+      handle_report_block(receiver_report.get_report_blocks()[0]);
+    }
+  }
+
+  /// Update the reception stats and the frame divisor from a report block
+  /// @param block The report block from a receiver report
+  void handle_report_block(const RtcpPacket::ReportBlock &block) {
+    std::lock_guard<std::mutex> lk(send_queue_mutex_);
+    update_report_stats(stats_, block);
+    if (!adaptation_.enabled) {
+      return;
+    }
+    bool congested = stats_.fraction_lost > adaptation_.max_fraction_lost ||
+                     stats_.jitter > adaptation_.max_jitter;
+    bool healthy = stats_.fraction_lost <= adaptation_.max_fraction_lost / 2 &&
+                   stats_.jitter <= adaptation_.max_jitter / 2;
+    auto frame_divisor = stats_.frame_divisor;
+    auto max_frame_divisor = std::max<size_t>(adaptation_.max_frame_divisor, 1);
+    if (congested) {
+      // back off quickly
+      frame_divisor = std::min(frame_divisor * 2, max_frame_divisor);
+    } else if (healthy && frame_divisor > 1) {
+      // and recover slowly
+      frame_divisor--;
+    }
+    if (frame_divisor != stats_.frame_divisor) {
+      logger_.info("Client reports {:.1f}% loss, {} us jitter, sending every {} frame(s)",
+                   stats_.fraction_lost * 100.0f, stats_.jitter.count(), frame_divisor);
+      stats_.frame_divisor = frame_divisor;
+    }
+  }
+
   /// Send a response to a RTSP request
   /// @param code The response code
   /// @param message The response message
@@ -138,10 +595,12 @@ protected:
     } else {
       response += "\r\n";
     }
-    logger_.info("Sending RTSP response");
+    logger_.debug("Sending RTSP response");
     logger_.debug("{}", response);
-    // send the response
-    return control_socket_->transmit(response);
+    // buffer the response, it is sent with the responses to any other
+    // requests received at the same time (or with the next RTP packets)
+    std::lock_guard<std::mutex> lk(control_write_mutex_);
+    return control_socket_->write(response);
   }
 
   /// Handle a RTSP options request
@@ -192,8 +651,7 @@ protected:
                        "b=AS:256\r\n"         // 256kbps
                        "a=control:" +
                        rtsp_path +
-                       "\r\n"
-                       "a=udp-only\r\n";
+                       "\r\n";
 
     std::string headers = "Content-Type: application/sdp\r\n"
                           "Content-Base: " +
@@ -208,9 +666,11 @@ protected:
   bool handle_rtsp_setup(std::string_view request) {
     // parse the rtsp path from the request
     std::string_view rtsp_path;
+    Transport transport_mode;
     int client_rtp_port;
     int client_rtcp_port;
-    if (!parse_rtsp_setup_request(request, rtsp_path, client_rtp_port, client_rtcp_port)) {
+    if (!parse_rtsp_setup_request(request, rtsp_path, transport_mode, client_rtp_port,
+                                  client_rtcp_port)) {
       // the parse function will send the response, so we just need to return
       return false;
     }
@@ -220,17 +680,60 @@ protected:
       return handle_rtsp_invalid_request(request);
     }
     logger_.info("RTSP SETUP request");
-    // save the client port numbers
-    client_rtp_port_ = client_rtp_port;
-    client_rtcp_port_ = client_rtcp_port;
+    if (transport_mode == Transport::MULTICAST && multicast_config_.group_address.empty()) {
+      logger_.warn("Client requested multicast, but no multicast group is configured");
+      return send_response(461, "Unsupported Transport", sequence_number);
+    }
+    if (transport_mode == Transport::INTERLEAVED &&
+        (client_rtp_port < 0 || client_rtp_port > 255 || client_rtcp_port < 0 ||
+         client_rtcp_port > 255)) {
+      logger_.error("Invalid interleaved channels");
+      return send_response(461, "Unsupported Transport", sequence_number);
+    }
+    std::string transport;
+    if (transport_mode == Transport::MULTICAST) {
+      // the server sends the packets to the group, the client only needs to
+      // know where to receive them
+      transport = "RTP/AVP;multicast;destination=" + multicast_config_.group_address +
+                  ";port=" + std::to_string(multicast_config_.rtp_port) + "-" +
+                  std::to_string(multicast_config_.rtcp_port) +
+                  ";ttl=" + std::to_string(multicast_config_.time_to_live);
+    } else if (transport_mode == Transport::INTERLEAVED) {
+      // the packets are written in large batches, so don't let Nagle's
+      // algorithm delay the end of each frame or the RTCP packets
+      control_socket_->set_nodelay();
+      // don't let a client which stops reading block the send task (and
+      // with it the responses to its requests) forever
+      if (!control_socket_->set_send_timeout(interleaved_send_timeout_)) {
+        logger_.error("Failed to set the send timeout of the control socket");
+        return send_response(500, "Internal Server Error", sequence_number);
+      }
+      // save the channels
+      rtp_channel_ = client_rtp_port;
+      rtcp_channel_ = client_rtcp_port;
+      transport = "RTP/AVP/TCP;unicast;interleaved=" + std::to_string(client_rtp_port) + "-" +
+                  std::to_string(client_rtcp_port);
+    } else {
+      // connect the rtp socket to the client, so that its address is only
+      // resolved once rather than for every packet
+      if (!rtp_socket_.connect({.ip_address = client_address_, .port = (size_t)client_rtp_port})) {
+        logger_.error("Failed to connect the RTP socket to the client");
+        return send_response(500, "Internal Server Error", sequence_number);
+      }
+      // save the client port numbers
+      client_rtp_port_ = client_rtp_port;
+      client_rtcp_port_ = client_rtcp_port;
+      transport = "RTP/AVP;unicast;client_port=" + std::to_string(client_rtp_port) + "-" +
+                  std::to_string(client_rtcp_port);
+    }
+    // only commit the transport once the setup can no longer fail
+    transport_ = transport_mode;
     // create a response
     int code = 200;
     std::string message = "OK";
     // flesh out the transport header
     std::string headers =
-        "Session: " + std::to_string(session_id_) + "\r\n" +
-        "Transport: RTP/AVP;unicast;client_port=" + std::to_string(client_rtp_port) + "-" +
-        std::to_string(client_rtcp_port) + "\r\n";
+        "Session: " + std::to_string(session_id_) + "\r\n" + "Transport: " + transport + "\r\n";
     return send_response(code, message, sequence_number, headers);
   }
 
@@ -245,12 +748,15 @@ protected:
       return handle_rtsp_invalid_request(request);
     }
     logger_.info("RTSP PLAY request");
-    play();
     int code = 200;
     std::string message = "OK";
     std::string headers =
         "Session: " + std::to_string(session_id_) + "\r\n" + "Range: npt=0.000-\r\n";
-    return send_response(code, message, sequence_number, headers);
+    // respond before starting to send frames, so that an interleaved client
+    // receives the response before the first packet
+    bool sent = send_response(code, message, sequence_number, headers);
+    play();
+    return sent;
   }
 
   /// Handle a RTSP pause request
@@ -349,6 +855,48 @@ protected:
     return handle_rtsp_invalid_request(request_body);
   }
 
+  /// @brief The task function for the send thread
+  /// Waits for a queued frame and sends it to the client.
+  /// @param m The mutex to lock when waiting on the condition variable
+  /// @param cv The condition variable to wait on
+  /// @return True if the task should stop, false otherwise
+  bool send_task_fn(std::mutex &m, std::condition_variable &cv) {
+    QueuedFrame entry;
+    {
+      std::unique_lock<std::mutex> lk(send_queue_mutex_);
+      send_queue_cv_.wait(lk, [this] { return closed_ || send_queue_count_ > 0; });
+      if (closed_) {
+        // return true to stop the task
+        return true;
+      }
+      entry = std::move(send_queue_[send_queue_head_]);
+      send_queue_head_ = (send_queue_head_ + 1) % send_queue_.size();
+      send_queue_count_--;
+    }
+    bool sent = send_rtp_frame(*entry.frame);
+    auto now = std::chrono::steady_clock::now();
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(now - entry.queue_time);
+    if (sent && now - last_sender_report_time_ >= rtcp_interval_) {
+      send_sender_report(*entry.frame, entry.queue_time);
+      last_sender_report_time_ = now;
+    }
+    // release the frame before updating the stats, so that it can be reused
+    entry.frame.reset();
+    std::lock_guard<std::mutex> lk(send_queue_mutex_);
+    if (!sent) {
+      stats_.frames_dropped++;
+      return false;
+    }
+    stats_.frames_sent++;
+    stats_.packets_sent = packets_sent_;
+    stats_.octets_sent = octets_sent_;
+    stats_.last_send_latency = latency;
+    stats_.max_send_latency = std::max(stats_.max_send_latency, latency);
+    stats_.total_send_latency += latency;
+    // we do not want to stop the task
+    return false;
+  }
+
   /// @brief The task function for the control thread
   /// @param m The mutex to lock when waiting on the condition variable
   /// @param cv The condition variable to wait on
@@ -375,18 +923,69 @@ protected:
     std::vector<uint8_t> buffer;
     logger_.info("Waiting for RTSP request");
     if (control_socket_->receive(buffer, max_request_size)) {
-      // parse the request
-      std::string_view request(reinterpret_cast<char *>(buffer.data()), buffer.size());
-      // handle the request
-      if (!handle_rtsp_request(request)) {
-        logger_.warn("Failed to handle RTSP request");
-      }
+      handle_control_data(std::string_view(reinterpret_cast<char *>(buffer.data()), buffer.size()));
     }
     // the receive handles most of the blocking, so we don't need to sleep
     // here, just return false to keep the task running
     return false;
   }
 
+  /// Handle data received on the control connection
+  /// The data is buffered until it contains complete messages, which are
+  /// either RTSP requests or (for interleaved sessions) '$'-framed RTCP
+  /// packets from the client.
+  /// @param data The received data
+  void handle_control_data(std::string_view data) {
+    control_buffer_.append(data);
+    std::string_view buffer(control_buffer_);
+    size_t offset = 0;
+    while (offset < buffer.size()) {
+      auto remaining = buffer.substr(offset);
+      if (remaining[0] == '$') {
+        // interleaved packet
+        if (remaining.size() < INTERLEAVED_HEADER_SIZE) {
+          break;
+        }
+        uint8_t channel = remaining[1];
+        size_t size =
+            (static_cast<uint8_t>(remaining[2]) << 8) | static_cast<uint8_t>(remaining[3]);
+        if (remaining.size() < INTERLEAVED_HEADER_SIZE + size) {
+          break;
+        }
+        if (transport_ == Transport::INTERLEAVED && channel == rtcp_channel_) {
+          handle_rtcp_data(remaining.substr(INTERLEAVED_HEADER_SIZE, size));
+        }
+        offset += INTERLEAVED_HEADER_SIZE + size;
+        continue;
+      }
+      // RTSP request, which ends with an empty line and may have a body
+      auto header_end = remaining.find("\r\n\r\n");
+      if (header_end == std::string_view::npos) {
+        break;
+      }
+      size_t size = header_end + 4;
+      auto content_length_index = remaining.substr(0, header_end).find("Content-Length: ");
+      if (content_length_index != std::string_view::npos) {
+        size += std::strtoul(remaining.data() + content_length_index + 16, nullptr, 10);
+      }
+      if (remaining.size() < size) {
+        break;
+      }
+      if (!handle_rtsp_request(remaining.substr(0, size))) {
+        logger_.warn("Failed to handle RTSP request");
+      }
+      offset += size;
+    }
+    control_buffer_.erase(0, offset);
+    if (control_buffer_.size() > MAX_CONTROL_BUFFER_SIZE) {
+      logger_.warn("Discarding {} B of incomplete data from the client", control_buffer_.size());
+      control_buffer_.clear();
+    }
+    // send the responses to all of the requests together
+    std::lock_guard<std::mutex> lk(control_write_mutex_);
+    control_socket_->flush();
+  }
+
   /// Generate a new RTSP session id for the client
   /// Session IDs are generated randomly when a client sends a SETUP request and are
   /// used to identify the client in subsequent requests when managing the RTP session.
@@ -428,15 +1027,21 @@ protected:
   }
 
   /// Parse a RTSP setup request
-  /// Looks for the client RTP and RTCP port numbers in the request
-  /// and returns them
+  /// Looks for the client RTP and RTCP port numbers (or, for the RTP/AVP/TCP
+  /// transport, the interleaved channels) in the request and returns them
   /// @param request The request to parse
   /// @param rtsp_path The RTSP path from the request (output)
-  /// @param client_rtp_port The client RTP port number (output)
-  /// @param client_rtcp_port The client RTCP port number (output)
+  /// @param transport The transport the client requested: RTP/AVP/TCP
+  ///        (interleaving the packets on the control connection), multicast
+  ///        or unicast UDP (output)
+  /// @param client_rtp_port The client RTP port number, or the RTP channel if
+  ///        interleaved, unset if multicast (output)
+  /// @param client_rtcp_port The client RTCP port number, or the RTCP channel
+  ///        if interleaved, unset if multicast (output)
   /// @return True if the request was parsed successfully, false otherwise
   bool parse_rtsp_setup_request(std::string_view request, std::string_view &rtsp_path,
-                                int &client_rtp_port, int &client_rtcp_port) {
+                                Transport &transport_mode, int &client_rtp_port,
+                                int &client_rtcp_port) {
     // parse the rtsp path from the request
     rtsp_path = parse_rtsp_path(request);
     if (rtsp_path.empty()) {
@@ -458,12 +1063,26 @@ protected:
       return false;
     }
     logger_.debug("Transport header: {}", transport);
-    // we don't support TCP, so return an error if the transport is not RTP/AVP/UDP
     if (transport.find("RTP/AVP/TCP") != std::string::npos) {
-      logger_.error("TCP transport is not supported");
-      // TODO: this doesn't send the sequence number back to the client
-      send_response(461, "Unsupported Transport");
-      return false;
+      transport_mode = Transport::INTERLEAVED;
+    } else if (transport.find("multicast") != std::string::npos) {
+      // the server chooses the group and ports
+      transport_mode = Transport::MULTICAST;
+      return true;
+    } else {
+      transport_mode = Transport::UNICAST;
+    }
+    if (transport_mode == Transport::INTERLEAVED) {
+      // parse the interleaved channels, defaulting to 0-1
+      client_rtp_port = 0;
+      client_rtcp_port = 1;
+      auto interleaved_index = transport.find("interleaved=");
+      if (interleaved_index != std::string::npos) {
+        char *end;
+        client_rtp_port = std::strtol(transport.data() + interleaved_index + 12, &end, 10);
+        client_rtcp_port = *end == '-' ? std::strtol(end + 1, nullptr, 10) : client_rtp_port + 1;
+      }
+      return true;
     }
 
     // parse the rtp port from the request
@@ -489,19 +1108,50 @@ protected:
   std::unique_ptr<espp::TcpSocket> control_socket_;
   espp::UdpSocket rtp_socket_;
   espp::UdpSocket rtcp_socket_;
+  std::mutex control_write_mutex_; ///< Serializes RTSP responses and interleaved packets
+  std::string control_buffer_;     ///< Received control data which is not a complete message
+
+  /// A frame waiting in the send queue
+  struct QueuedFrame {
+    std::shared_ptr<const RtpPacketPool::Frame> frame;
+    std::chrono::steady_clock::time_point queue_time;
+  };
 
   uint32_t session_id_;
-  bool closed_ = false;
-  bool session_active_ = false;
+  std::atomic<bool> closed_ = false;
+  std::atomic<bool> session_active_ = false;
 
   std::string server_address_;
   std::string rtsp_path_;
 
   std::string client_address_;
-  int client_rtp_port_;
-  int client_rtcp_port_;
+  int client_rtp_port_{0};
+  int client_rtcp_port_{0};
+  // NOTE: these are set by SETUP, before the session starts sending
+  std::atomic<Transport> transport_{Transport::UNICAST};
+  uint8_t rtp_channel_{0};
+  uint8_t rtcp_channel_{1};
+
+  mutable std::mutex send_queue_mutex_;
+  std::condition_variable send_queue_cv_;
+  std::vector<QueuedFrame> send_queue_; ///< Ring of frames waiting to be sent
+  size_t send_queue_head_{0};
+  size_t send_queue_count_{0};
+  size_t frame_count_{0}; ///< The number of frames passed to queue_frame, for skipping frames
+  Stats stats_;
+
+  // only used by the send task
+  std::chrono::milliseconds rtcp_interval_;
+  std::chrono::milliseconds interleaved_send_timeout_;
+  std::chrono::steady_clock::time_point last_sender_report_time_{};
+  uint32_t packets_sent_{0};
+  uint32_t octets_sent_{0};
+
+  AdaptationConfig adaptation_;
+  MulticastConfig multicast_config_;
 
   std::unique_ptr<Task> control_task_;
+  std::unique_ptr<Task> send_task_;
 
   Logger logger_;
 };
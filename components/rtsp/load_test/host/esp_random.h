@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+// Host stand-in for ESP-IDF's esp_random(), so that the rtsp headers build on
+// Linux. They only use it for SSRCs and session IDs, which need to differ
+// between clients and sessions but do not need to be cryptographically random.
+inline uint32_t esp_random() {
+  static thread_local std::mt19937 generator{std::random_device{}()};
+  return generator();
+}
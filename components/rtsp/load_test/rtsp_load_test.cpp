@@ -0,0 +1,445 @@
+// RTSP load generator: streams synthetic MJPEG frames from an RtspServer to a
+// growing number of RtspClients over loopback and reports how the server
+// copes. See README.md.
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "rtsp_client.hpp"
+#include "rtsp_server.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+struct Options {
+  std::vector<size_t> num_clients{1, 2, 4, 8, 16};
+  float fps{30};
+  std::chrono::seconds duration{5s};
+  size_t frame_size{30 * 1024};
+  std::string transport{"udp"}; // udp, tcp or multicast
+  int port{8554};
+  int client_port{20000};
+  bool adaptation{false};
+};
+
+/// What the server process reports back to the load generator after a run
+struct ServerResult {
+  size_t frames_sent{0};    ///< Frames passed to send_frame()
+  size_t frames_dropped{0}; ///< Frames the sessions dropped, summed over all sessions
+  int64_t cpu_us{0};        ///< CPU time of the server process while streaming, without the
+                            ///< time spent making the synthetic frames
+};
+
+struct RunResult {
+  size_t num_clients{0};
+  size_t num_connected{0};
+  float duration_s{0};
+  ServerResult server;
+  std::vector<float> client_fps;
+  std::vector<int64_t> latencies_us; ///< End-to-end latency of every frame received
+  size_t packets_received{0};
+  size_t packets_lost{0};
+  size_t frames_dropped{0}; ///< Frames the clients dropped because packets were lost
+};
+
+// Each frame starts its scan data with the time it was sent, as hex digits
+// (which can't form a JPEG marker). steady_clock is CLOCK_MONOTONIC, which is
+// shared by the server and client processes.
+static constexpr size_t TIMESTAMP_SIZE = 16;
+
+int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void write_timestamp(char *data, int64_t timestamp) {
+  static constexpr char digits[] = "0123456789abcdef";
+  for (size_t i = 0; i < TIMESTAMP_SIZE; i++) {
+    data[TIMESTAMP_SIZE - 1 - i] = digits[(timestamp >> (4 * i)) & 0xF];
+  }
+}
+
+int64_t read_timestamp(std::string_view data) {
+  int64_t timestamp = 0;
+  for (size_t i = 0; i < TIMESTAMP_SIZE; i++) {
+    char c = data[i];
+    timestamp = (timestamp << 4) | (c <= '9' ? c - '0' : c - 'a' + 10);
+  }
+  return timestamp;
+}
+
+int64_t get_process_cpu_us() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec +
+         usage.ru_stime.tv_usec;
+}
+
+int64_t get_thread_cpu_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// NOTE: the server and the load generator exchange single bytes and the
+// ServerResult over pipes
+enum Command : char { READY = 'r', START = 's', STOP = 'x', QUIT = 'q' };
+
+bool write_all(int fd, const void *data, size_t size) {
+  auto bytes = static_cast<const char *>(data);
+  while (size > 0) {
+    auto written = write(fd, bytes, size);
+    if (written <= 0) {
+      return false;
+    }
+    bytes += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool read_all(int fd, void *data, size_t size) {
+  auto bytes = static_cast<char *>(data);
+  while (size > 0) {
+    auto num_read = read(fd, bytes, size);
+    if (num_read <= 0) {
+      return false;
+    }
+    bytes += num_read;
+    size -= num_read;
+  }
+  return true;
+}
+
+/// Run the server, in its own process so that its CPU time can be measured
+/// separately from the clients'. Never returns.
+[[noreturn]] void run_server(const Options &options, int command_fd, int result_fd) {
+  espp::RtspServer::Config config{
+      .server_address = "127.0.0.1",
+      .port = options.port,
+      .path = "/load",
+      .session_adaptation = {.enabled = options.adaptation},
+  };
+  if (options.transport == "multicast") {
+    config.multicast = {.group_address = "239.255.0.1"};
+  }
+  // NOTE: the server is never destroyed, the process exits instead
+  auto &server = *new espp::RtspServer(config);
+  if (!server.start()) {
+    _exit(1);
+  }
+
+  // the frame to send, with random scan data
+  std::string q0(64, 16), q1(64, 17);
+  espp::JpegHeader header(640, 480, q0, q1);
+  std::string data(header.get_data());
+  size_t timestamp_offset = data.size();
+  for (size_t i = 0; i < std::max(options.frame_size, TIMESTAMP_SIZE); i++) {
+    // avoid 0xFF, which would start a JPEG marker
+    data.push_back(static_cast<char>(std::rand() % 0xFF));
+  }
+  data += "\xFF\xD9";
+
+  char command = READY;
+  write_all(result_fd, &command, 1);
+  if (!read_all(command_fd, &command, 1) || command != START) {
+    _exit(1);
+  }
+
+  ServerResult result;
+  int64_t start_cpu_us = get_process_cpu_us();
+  int64_t frame_cpu_ns = 0;
+  auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<float>(1.0f / options.fps));
+  auto next_frame = std::chrono::steady_clock::now();
+  while (true) {
+    // wait for the next frame, or for the stop command
+    auto wait = std::chrono::ceil<std::chrono::milliseconds>(next_frame -
+                                                             std::chrono::steady_clock::now());
+    struct pollfd pfd = {.fd = command_fd, .events = POLLIN, .revents = 0};
+    if (poll(&pfd, 1, std::max<int>(wait.count(), 0)) != 0) {
+      // consume the stop command, so that it is not mistaken for the quit
+      // command below
+      read_all(command_fd, &command, 1);
+      break;
+    }
+    int64_t frame_start_ns = get_thread_cpu_ns();
+    write_timestamp(data.data() + timestamp_offset, now_ns());
+    auto frame = std::make_shared<const espp::JpegFrame>(data.data(), data.size());
+    frame_cpu_ns += get_thread_cpu_ns() - frame_start_ns;
+    server.send_frame(frame);
+    result.frames_sent++;
+    next_frame += interval;
+  }
+  result.cpu_us = get_process_cpu_us() - start_cpu_us - frame_cpu_ns / 1000;
+  for (const auto &[session_id, stats] : server.get_session_stats()) {
+    result.frames_dropped += stats.frames_dropped;
+  }
+  write_all(result_fd, &result, sizeof(result));
+  // keep serving until the clients have torn down their sessions
+  read_all(command_fd, &command, 1);
+  _exit(0);
+}
+
+/// A client which records the end-to-end latency of each frame it receives
+class LoadClient {
+public:
+  /// @param latencies_us Where the latencies are recorded. It is written by
+  ///        the client's receive task, so it must outlive the client and only
+  ///        be read once the client has been destroyed.
+  LoadClient(const Options &options, size_t index, std::vector<int64_t> &latencies_us)
+      : index_(index), latencies_us_(latencies_us),
+        client_({
+            .server_address = "127.0.0.1",
+            .rtsp_port = options.port,
+            .path = "/load",
+            .on_jpeg_frame = nullptr, // frames are received with on_shared_jpeg_frame
+            .on_shared_jpeg_frame =
+                [this](std::shared_ptr<const espp::JpegFrame> frame) { on_frame(*frame); },
+            .log_level = espp::Logger::Verbosity::WARN,
+        }) {
+    latencies_us_.reserve(static_cast<size_t>(options.fps * options.duration.count() * 2));
+  }
+
+  bool start(const std::string &transport, int client_port) {
+    std::error_code ec;
+    client_.connect(ec);
+    client_.describe(ec);
+    if (transport == "tcp") {
+      client_.setup_interleaved(ec);
+    } else if (transport == "multicast") {
+      client_.setup_multicast(ec);
+    } else {
+      client_.setup(client_port + 2 * index_, client_port + 2 * index_ + 1, ec);
+    }
+    client_.play(ec);
+    if (ec) {
+      fmt::print(stderr, "Client {} failed to start: {}\n", index_, ec.message());
+      return false;
+    }
+    return true;
+  }
+
+  espp::RtspClient::Stats get_stats() const { return client_.get_stats(); }
+
+protected:
+  void on_frame(const espp::JpegFrame &frame) {
+    auto now = now_ns();
+    auto scan = frame.get_scan_data();
+    if (scan.size() >= TIMESTAMP_SIZE) {
+      latencies_us_.push_back((now - read_timestamp(scan)) / 1000);
+    }
+  }
+
+  size_t index_;
+  std::vector<int64_t> &latencies_us_;
+  espp::RtspClient client_;
+};
+
+RunResult run(const Options &options, size_t num_clients) {
+  RunResult result;
+  result.num_clients = num_clients;
+  result.duration_s = options.duration.count();
+
+  int command_pipe[2], result_pipe[2];
+  if (pipe(command_pipe) != 0 || pipe(result_pipe) != 0) {
+    fmt::print(stderr, "Failed to create pipes\n");
+    return result;
+  }
+  // flush what has been printed so far, so the server process does not print
+  // it again from its copy of the buffer
+  std::fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    fmt::print(stderr, "Failed to fork the server process\n");
+    return result;
+  }
+  if (pid == 0) {
+    close(command_pipe[1]);
+    close(result_pipe[0]);
+    run_server(options, command_pipe[0], result_pipe[1]);
+  }
+  close(command_pipe[0]);
+  close(result_pipe[1]);
+  int command_fd = command_pipe[1];
+  int result_fd = result_pipe[0];
+
+  char command;
+  if (!read_all(result_fd, &command, 1) || command != READY) {
+    fmt::print(stderr, "The server failed to start\n");
+    waitpid(pid, nullptr, 0);
+    close(command_fd);
+    close(result_fd);
+    return result;
+  }
+
+  // NOTE: sized up front, since the clients keep references to the elements
+  std::vector<std::vector<int64_t>> client_latencies(num_clients);
+  std::vector<std::unique_ptr<LoadClient>> clients;
+  for (size_t i = 0; i < num_clients; i++) {
+    auto client = std::make_unique<LoadClient>(options, i, client_latencies[i]);
+    if (client->start(options.transport, options.client_port)) {
+      result.num_connected++;
+    }
+    clients.push_back(std::move(client));
+  }
+
+  command = START;
+  write_all(command_fd, &command, 1);
+  std::this_thread::sleep_for(options.duration);
+  command = STOP;
+  write_all(command_fd, &command, 1);
+  read_all(result_fd, &result.server, sizeof(result.server));
+  // let the last frames arrive
+  std::this_thread::sleep_for(200ms);
+
+  for (auto &client : clients) {
+    auto stats = client->get_stats();
+    result.packets_received += stats.packets_received;
+    result.packets_lost += stats.packets_lost;
+    result.frames_dropped += stats.frames_dropped;
+  }
+  // destroying the clients tears down their sessions and stops their receive
+  // tasks, after which nothing writes to their latencies anymore
+  clients.clear();
+  for (const auto &latencies : client_latencies) {
+    result.client_fps.push_back(latencies.size() / result.duration_s);
+    result.latencies_us.insert(result.latencies_us.end(), latencies.begin(), latencies.end());
+  }
+
+  command = QUIT;
+  write_all(command_fd, &command, 1);
+  waitpid(pid, nullptr, 0);
+  close(command_fd);
+  close(result_fd);
+  return result;
+}
+
+void print_header() {
+  fmt::print("{:>7} | {:>8} | {:>17} | {:>33} | {:>6} | {:>14} | {:>19}\n", "clients",
+             "sent fps", "client fps min/avg", "latency ms p50/p90/p99/max", "loss %",
+             "frames dropped", "server CPU us/frame");
+}
+
+void print_result(const RunResult &result) {
+  auto latencies = result.latencies_us;
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile_ms = [&](float percentile) {
+    if (latencies.empty()) {
+      return 0.0f;
+    }
+    size_t index = std::min(latencies.size() - 1, (size_t)(percentile * latencies.size()));
+    return latencies[index] / 1000.0f;
+  };
+  float min_fps = result.client_fps.empty()
+                      ? 0
+                      : *std::min_element(result.client_fps.begin(), result.client_fps.end());
+  float avg_fps = 0;
+  for (auto fps : result.client_fps) {
+    avg_fps += fps / result.client_fps.size();
+  }
+  size_t packets_expected = result.packets_received + result.packets_lost;
+  float loss = packets_expected ? 100.0f * result.packets_lost / packets_expected : 0;
+  float sent_fps = result.server.frames_sent / result.duration_s;
+  float cpu_per_frame =
+      result.server.frames_sent ? (float)result.server.cpu_us / result.server.frames_sent : 0;
+  fmt::print("{:>7} | {:>8.1f} | {:>8.1f}/{:<8.1f} | {:>7.2f}/{:>7.2f}/{:>7.2f}/{:>8.2f} | "
+             "{:>6.2f} | {:>6}/{:<7} | {:>19.0f}\n",
+             fmt::format("{}/{}", result.num_connected, result.num_clients), sent_fps, min_fps,
+             avg_fps, percentile_ms(0.5f), percentile_ms(0.9f), percentile_ms(0.99f),
+             percentile_ms(1.0f), loss, result.server.frames_dropped, result.frames_dropped,
+             cpu_per_frame);
+}
+
+void print_usage(const char *name) {
+  fmt::print("Usage: {} [options]\n"
+             "  --clients N[,N...]  numbers of clients to run, one run each (default 1,2,4,8,16)\n"
+             "  --fps F             frames per second the server sends (default 30)\n"
+             "  --duration S        seconds each run streams for (default 5)\n"
+             "  --frame-size B      bytes of JPEG scan data per frame (default 30720)\n"
+             "  --transport T       udp, tcp (interleaved) or multicast (default udp)\n"
+             "  --port P            RTSP port of the server (default 8554)\n"
+             "  --client-port P     first RTP port of the UDP clients (default 20000)\n"
+             "  --adaptation        let the sessions adapt their frame rate to loss\n",
+             name);
+}
+
+bool parse_options(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (arg == "--adaptation") {
+      options.adaptation = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--clients") {
+      options.num_clients.clear();
+      size_t start = 0;
+      while (start < value.size()) {
+        size_t end = value.find(',', start);
+        end = end == std::string::npos ? value.size() : end;
+        options.num_clients.push_back(std::stoul(value.substr(start, end - start)));
+        start = end + 1;
+      }
+    } else if (arg == "--fps") {
+      options.fps = std::stof(value);
+    } else if (arg == "--duration") {
+      options.duration = std::chrono::seconds(std::stoi(value));
+    } else if (arg == "--frame-size") {
+      options.frame_size = std::stoul(value);
+    } else if (arg == "--transport") {
+      options.transport = value;
+    } else if (arg == "--port") {
+      options.port = std::stoi(value);
+    } else if (arg == "--client-port") {
+      options.client_port = std::stoi(value);
+    } else {
+      return false;
+    }
+  }
+  return options.fps > 0 && options.duration.count() > 0 && !options.num_clients.empty() &&
+         (options.transport == "udp" || options.transport == "tcp" ||
+          options.transport == "multicast");
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  try {
+    if (!parse_options(argc, argv, options)) {
+      print_usage(argv[0]);
+      return 1;
+    }
+  } catch (const std::exception &) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  // a client whose server went away must not kill the load generator
+  signal(SIGPIPE, SIG_IGN);
+
+  fmt::print("Streaming {} B frames at {} fps over {} for {} s per run\n", options.frame_size,
+             options.fps, options.transport, options.duration.count());
+  print_header();
+  for (auto num_clients : options.num_clients) {
+    print_result(run(options, num_clients));
+  }
+  return 0;
+}
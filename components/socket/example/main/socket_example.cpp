@@ -1,7 +1,12 @@
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <functional>
 #include <iterator>
+#include <mutex>
+#include <span>
+#include <string_view>
 #include <thread>
 
 #if CONFIG_ESP32_WIFI_NVS_ENABLED
@@ -9,6 +14,7 @@
 #endif
 
 #include "logger.hpp"
+#include "reactor.hpp"
 #include "task.hpp"
 #include "tcp_socket.hpp"
 #include "udp_socket.hpp"
@@ -217,6 +223,132 @@ std::this_thread::sleep_for(test_duration);
 
 fmt::print(fg(fmt::terminal_color::green) | fmt::emphasis::bold, "UDP multicast test finished.\n");
 std::this_thread::sleep_for(100ms);
+fmt::print(fg(fmt::terminal_color::yellow) | fmt::emphasis::bold,
+           "Staring UDP receive benchmark.\n");
+
+{
+  //! [UDP receive benchmark]
+  size_t port = 5000;
+  espp::UdpSocket server_socket({});
+  server_socket.bind(port);
+  // don't block forever if a datagram was dropped
+  server_socket.set_receive_timeout(100ms);
+  espp::UdpSocket client_socket({});
+  espp::UdpSocket::SendConfig send_config{.ip_address = "127.0.0.1", .port = port};
+
+  // send bursts of small datagrams (as from a sensor), and time receiving
+  // them. The bursts are small enough to fit in lwIP's default UDP receive
+  // mailbox (CONFIG_LWIP_UDP_RECVMBOX_SIZE).
+  static constexpr size_t burst_size = 4;
+  static constexpr size_t num_bursts = 500;
+  static constexpr size_t max_datagram_size = 1500;
+  std::array<uint8_t, 64> payload{};
+  struct iovec payload_iovec = {.iov_base = payload.data(), .iov_len = payload.size()};
+  std::array<std::span<const struct iovec>, burst_size> burst;
+  burst.fill(std::span<const struct iovec>(&payload_iovec, 1));
+
+  auto benchmark = [&](std::string_view name, auto &&receive_burst) {
+    size_t num_received = 0;
+    std::chrono::nanoseconds elapsed{0};
+    for (size_t i = 0; i < num_bursts; i++) {
+      client_socket.send_batch(burst, send_config);
+      auto start = std::chrono::high_resolution_clock::now();
+      num_received += receive_burst();
+      elapsed += std::chrono::high_resolution_clock::now() - start;
+    }
+    fmt::print("{}: received {}/{} datagrams, {} ns per datagram\n", name, num_received,
+               burst_size * num_bursts, elapsed.count() / std::max<size_t>(num_received, 1));
+  };
+
+  espp::Socket::Info sender_info;
+  benchmark("receive into a new vector", [&]() {
+    size_t num_received = 0;
+    for (size_t i = 0; i < burst_size; i++) {
+      std::vector<uint8_t> data;
+      num_received += server_socket.receive(max_datagram_size, data, sender_info);
+    }
+    return num_received;
+  });
+
+  std::vector<uint8_t> buffer(max_datagram_size);
+  benchmark("receive into a reused buffer", [&]() {
+    size_t num_received = 0;
+    for (size_t i = 0; i < burst_size; i++) {
+      num_received += server_socket.receive(std::span<uint8_t>(buffer), sender_info) >= 0;
+    }
+    return num_received;
+  });
+
+  espp::UdpSocket::ReceiveBatch batch(burst_size, max_datagram_size);
+  benchmark("receive_batch", [&]() {
+    size_t num_received = 0;
+    while (num_received < burst_size && server_socket.receive_batch(batch) > 0) {
+      num_received += batch.size();
+    }
+    return num_received;
+  });
+  //! [UDP receive benchmark]
+}
+
+fmt::print(fg(fmt::terminal_color::green) | fmt::emphasis::bold,
+           "UDP receive benchmark finished.\n");
+std::this_thread::sleep_for(100ms);
+fmt::print(fg(fmt::terminal_color::yellow) | fmt::emphasis::bold,
+           "Staring UDP connected send benchmark.\n");
+
+{
+  //! [UDP connected send benchmark]
+  size_t port = 5000;
+  // a server which just counts the datagrams
+  std::atomic<size_t> num_received{0};
+  espp::UdpSocket server_socket({});
+  auto server_task_config = espp::Task::Config{
+      .name = "UdpServer",
+      .callback = nullptr,
+      .stack_size_bytes = 6 * 1024,
+  };
+  server_socket.start_receiving(
+      server_task_config,
+      {.port = port,
+       .buffer_size = 1500,
+       .on_receive_callback = [&](auto &, auto &) -> std::optional<std::vector<uint8_t>> {
+         num_received++;
+         return {};
+       }});
+
+  static constexpr size_t num_datagrams = 2000;
+  std::array<uint8_t, 64> payload{};
+  std::string_view data((const char *)payload.data(), payload.size());
+  auto benchmark = [&](std::string_view name, auto &&send) {
+    size_t num_sent = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < num_datagrams; i++) {
+      num_sent += send();
+    }
+    auto elapsed = std::chrono::high_resolution_clock::now() - start;
+    fmt::print("{}: sent {}/{} datagrams, {} ns per datagram\n", name, num_sent, num_datagrams,
+               std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() /
+                   num_datagrams);
+  };
+
+  // every send resolves the address and configures the socket again
+  espp::UdpSocket client_socket({});
+  benchmark("send with a SendConfig",
+            [&]() { return client_socket.send(data, {.ip_address = "127.0.0.1", .port = port}); });
+
+  // the address is resolved once, when connecting
+  espp::UdpSocket connected_socket({});
+  connected_socket.connect({.ip_address = "127.0.0.1", .port = port});
+  benchmark("send on a connected socket", [&]() { return connected_socket.send(data); });
+  //! [UDP connected send benchmark]
+  // let the server receive the datagrams
+  std::this_thread::sleep_for(100ms);
+  fmt::print("Server received {} datagrams\n", num_received.load());
+}
+
+fmt::print(fg(fmt::terminal_color::green) | fmt::emphasis::bold,
+           "UDP connected send benchmark finished.\n");
+std::this_thread::sleep_for(100ms);
 fmt::print(fg(fmt::terminal_color::yellow) | fmt::emphasis::bold, "Staring Basic TCP test.\n");
 
 // Unicast (client-server) example
@@ -373,6 +505,174 @@ fmt::print(fg(fmt::terminal_color::yellow) | fmt::emphasis::bold,
 fmt::print(fg(fmt::terminal_color::green) | fmt::emphasis::bold,
            "TCP send waiting for response test finished.\n");
 std::this_thread::sleep_for(100ms);
+fmt::print(fg(fmt::terminal_color::yellow) | fmt::emphasis::bold, "Staring Reactor test.\n");
+
+// Many sockets served by one task
+{
+  //! [Reactor example]
+  // one task waits for all of the sockets below, instead of one task per socket
+  espp::Reactor reactor({.stack_size_bytes = 6 * 1024});
+  reactor.start();
+
+  // UDP servers on a few ports
+  std::vector<std::unique_ptr<espp::UdpSocket>> udp_servers;
+  for (size_t port = 5000; port < 5004; port++) {
+    auto server = std::make_unique<espp::UdpSocket>(espp::UdpSocket::Config{});
+    server->start_receiving(
+        reactor, {.port = port,
+                  .buffer_size = 1024,
+                  .on_receive_callback = [port](auto &data, auto &sender_info)
+                      -> std::optional<std::vector<uint8_t>> {
+                    fmt::print("Server on port {} received: {} from {}\n", port, data,
+                               sender_info);
+                    return {};
+                  }});
+    udp_servers.push_back(std::move(server));
+  }
+
+  // a TCP server, whose connections are served by the reactor as well
+  std::mutex connections_mutex;
+  std::vector<std::unique_ptr<espp::TcpSocket>> connections;
+  espp::TcpSocket tcp_server({.log_level = espp::Logger::Verbosity::WARN});
+  tcp_server.bind(5010);
+  tcp_server.listen(4);
+  tcp_server.start_accepting(reactor, [&](std::unique_ptr<espp::TcpSocket> connection) {
+    fmt::print("Server accepted connection from: {}\n", connection->get_remote_info());
+    size_t max_receive_size = 1024;
+    connection->start_receiving(
+        reactor, max_receive_size, [](auto &data, auto &) -> std::optional<std::vector<uint8_t>> {
+          if (data.empty()) {
+            fmt::print("Client closed the connection\n");
+            return {};
+          }
+          fmt::print("Server received: {}\n", data);
+          // send the data back reversed
+          std::reverse(data.begin(), data.end());
+          return data;
+        });
+    std::lock_guard<std::mutex> lock(connections_mutex);
+    connections.push_back(std::move(connection));
+  });
+  //! [Reactor example]
+
+  espp::UdpSocket udp_client({});
+  for (size_t port = 5000; port < 5004; port++) {
+    std::vector<uint8_t> data{0, 1, 2, 3, 4};
+    udp_client.send(data, {.ip_address = "127.0.0.1", .port = port});
+  }
+  espp::TcpSocket tcp_client({});
+  tcp_client.connect({.ip_address = "127.0.0.1", .port = 5010});
+  std::vector<uint8_t> data{0, 1, 2, 3, 4};
+  tcp_client.transmit(data, {.wait_for_response = true,
+                             .response_size = 128,
+                             .on_response_callback = [](auto &response) {
+                               fmt::print("Client received: {}\n", response);
+                             }});
+  // now sleep for a while to let the monitor do its thing
+  std::this_thread::sleep_for(test_duration);
+}
+
+fmt::print(fg(fmt::terminal_color::green) | fmt::emphasis::bold, "Reactor test finished.\n");
+std::this_thread::sleep_for(100ms);
+fmt::print(fg(fmt::terminal_color::yellow) | fmt::emphasis::bold,
+           "Staring TCP request/response benchmark.\n");
+
+{
+  //! [TCP request/response benchmark]
+  // a server for a text protocol, which answers each request line with a
+  // response written in three parts (status, message and line ending)
+  size_t port = 5000;
+  espp::TcpSocket server_socket({});
+  server_socket.bind(port);
+  server_socket.listen(1);
+
+  enum class Mode {
+    TRANSMIT, // each part is sent with its own transmit()
+    CORK,     // the same, but the socket is corked while the requests are handled
+    WRITE,    // each part is buffered with write(), then all of them are flushed
+  };
+  auto serve = [&](Mode mode) {
+    auto connection = server_socket.accept();
+    if (!connection) {
+      return;
+    }
+    connection->set_nodelay();
+    std::vector<uint8_t> data;
+    while (connection->receive(data, 1024)) {
+      size_t num_requests = std::count(data.begin(), data.end(), '\n');
+      if (mode == Mode::CORK) {
+        connection->set_cork(true);
+      }
+      for (size_t i = 0; i < num_requests; i++) {
+        for (std::string_view part : {"200", " OK", "\r\n"}) {
+          if (mode == Mode::WRITE) {
+            connection->write(part);
+          } else {
+            connection->transmit(part);
+          }
+        }
+      }
+      if (mode == Mode::CORK) {
+        connection->set_cork(false);
+      } else if (mode == Mode::WRITE) {
+        connection->flush();
+      }
+    }
+  };
+
+  // the client sends its requests in batches of pipeline_depth, and waits
+  // for all of their responses before sending the next batch
+  static constexpr size_t num_requests = 4000;
+  static constexpr size_t pipeline_depth = 8;
+  static constexpr size_t response_size = 8; // "200 OK\r\n"
+  std::string requests;
+  for (size_t i = 0; i < pipeline_depth; i++) {
+    requests += "GET\r\n";
+  }
+  auto benchmark = [&](std::string_view name, Mode mode) {
+    std::thread server_thread(serve, mode);
+    {
+      espp::TcpSocket client_socket({});
+      client_socket.connect({.ip_address = "127.0.0.1", .port = port});
+      client_socket.set_nodelay();
+      client_socket.set_receive_timeout(1s);
+      std::array<uint8_t, pipeline_depth * response_size> responses;
+      size_t num_completed = 0;
+      auto start = std::chrono::high_resolution_clock::now();
+      while (num_completed < num_requests) {
+        client_socket.write(requests);
+        client_socket.flush();
+        size_t num_received = 0;
+        while (num_received < responses.size()) {
+          size_t size = client_socket.receive(responses.data() + num_received,
+                                              responses.size() - num_received);
+          if (size == 0 || size > responses.size() - num_received) {
+            break;
+          }
+          num_received += size;
+        }
+        if (num_received < responses.size()) {
+          fmt::print("{}: the server did not respond\n", name);
+          break;
+        }
+        num_completed += pipeline_depth;
+      }
+      auto elapsed = std::chrono::high_resolution_clock::now() - start;
+      fmt::print("{}: {} requests, {:.0f} messages/s\n", name, num_completed,
+                 num_completed / std::chrono::duration<float>(elapsed).count());
+    } // destroying the client closes the connection, which stops the server
+    server_thread.join();
+  };
+
+  benchmark("transmit per part", Mode::TRANSMIT);
+  benchmark("transmit per part, corked", Mode::CORK);
+  benchmark("write per part, flush per batch", Mode::WRITE);
+  //! [TCP request/response benchmark]
+}
+
+fmt::print(fg(fmt::terminal_color::green) | fmt::emphasis::bold,
+           "TCP request/response benchmark finished.\n");
+std::this_thread::sleep_for(100ms);
 fmt::print(fg(fmt::terminal_color::green) | fmt::emphasis::bold, "Socket example finished!\n");
 
 // sleep forever
@@ -0,0 +1,518 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#else
+#include <sys/select.h>
+#endif
+
+#include "logger.hpp"
+#include "task.hpp"
+
+namespace espp {
+/**
+ *   @brief Event loop which waits for many file descriptors (e.g. sockets) to
+ *          become readable, and calls a callback for each one which is, so
+ *          that the sockets do not each need their own task blocked in a
+ *          receive / accept call.
+ *
+ *          The reactor waits with epoll on Linux and select on lwIP (ESP-IDF).
+ *          Callbacks run on the reactor's own task, or, if Config::num_workers
+ *          is > 0, on a pool of worker tasks so that a slow callback does not
+ *          delay the other file descriptors. Either way, a file descriptor is
+ *          not watched while its callback is running, so the callbacks for one
+ *          file descriptor never run concurrently and each callback only has to
+ *          handle what is readable when it is called (e.g. receive one datagram
+ *          or accept one connection).
+ *
+ *          UdpSocket::start_receiving, TcpSocket::start_accepting and
+ *          TcpSocket::start_receiving register sockets with a reactor.
+ *
+ * \section reactor_ex1 Reactor Example
+ * \snippet socket_example.cpp Reactor example
+ */
+class Reactor {
+public:
+  /**
+   * @brief Callback function called when a registered file descriptor is
+   *        readable (or has an error, or its remote end closed).
+   */
+  typedef std::function<void()> callback_fn;
+
+  /**
+   * @brief Config struct for the reactor.
+   */
+  struct Config {
+    size_t num_workers{0}; /**< Number of worker tasks which run the callbacks. If 0, the callbacks
+                              run on the reactor's task. */
+    size_t stack_size_bytes{4 * 1024}; /**< Stack size of the reactor's task and of each worker
+                                          task, which the callbacks run on. */
+    size_t priority{0}; /**< Priority of the reactor's task and of each worker task. */
+    Logger::Verbosity log_level{Logger::Verbosity::WARN}; /**< Verbosity of the reactor's logger. */
+  };
+
+  /**
+   * @brief Create the reactor. It does not call any callbacks until it is
+   *        started.
+   * @param config Config for the reactor.
+   */
+  explicit Reactor(const Config &config)
+      : num_workers_(config.num_workers), logger_({.tag = "Reactor", .level = config.log_level}) {
+    using namespace std::placeholders;
+    loop_task_ = Task::make_unique({
+        .name = "Reactor",
+        .callback = std::bind(&Reactor::loop_task_function, this, _1, _2),
+        .stack_size_bytes = config.stack_size_bytes,
+        .priority = config.priority,
+    });
+    for (size_t i = 0; i < num_workers_; i++) {
+      worker_tasks_.push_back(Task::make_unique({
+          .name = "ReactorWorker " + std::to_string(i),
+          .callback = std::bind(&Reactor::worker_task_function, this, _1, _2),
+          .stack_size_bytes = config.stack_size_bytes,
+          .priority = config.priority,
+      }));
+    }
+    init();
+  }
+
+  /**
+   * @brief Stop the reactor and release its resources.
+   * @note The registered file descriptors are not closed.
+   */
+  ~Reactor() {
+    stop();
+    cleanup();
+  }
+
+  /**
+   * @brief Start waiting for the registered file descriptors and calling
+   *        their callbacks.
+   * @return true if the reactor was started, false if it could not be
+   *         initialized or is already running.
+   */
+  bool start() {
+    if (running_) {
+      logger_.warn("Already running");
+      return false;
+    }
+    if (!is_valid()) {
+      logger_.error("Reactor invalid, cannot start");
+      return false;
+    }
+    running_ = true;
+    for (auto &worker_task : worker_tasks_) {
+      worker_task->start();
+    }
+    loop_task_->start();
+    return true;
+  }
+
+  /**
+   * @brief Stop calling callbacks, blocking until the running callbacks have
+   *        returned. The file descriptors stay registered.
+   * @note Must not be called from a callback.
+   */
+  void stop() {
+    {
+      // set under the lock, so that a worker can't see running_ still set
+      // and then miss the notification below before it waits
+      std::lock_guard<std::mutex> lk(mutex_);
+      running_ = false;
+    }
+    wake();
+    loop_task_->stop();
+    work_cv_.notify_all();
+    for (auto &worker_task : worker_tasks_) {
+      worker_task->stop();
+    }
+    // callbacks which were waiting for a worker are not called, so watch
+    // their file descriptors again in case the reactor is restarted
+    std::lock_guard<std::mutex> lk(mutex_);
+    for (auto &registration : work_queue_) {
+      if (!registration->removed) {
+        registration->state = State::IDLE;
+        rearm(*registration);
+      }
+    }
+    work_queue_.clear();
+    idle_cv_.notify_all();
+  }
+
+  /**
+   * @brief Is the reactor running?
+   * @return true if the reactor is started and calling callbacks.
+   */
+  bool is_running() const { return running_; }
+
+  /**
+   * @brief Call \p callback whenever \p fd is readable.
+   * @param fd The file descriptor, which must stay open until it is removed.
+   * @param callback The function to call when \p fd is readable. It should
+   *        read from \p fd (at least once), otherwise it is called again
+   *        straight away.
+   * @return true if \p fd was registered, false if it is invalid or already
+   *         registered.
+   */
+  bool add(int fd, const callback_fn &callback) {
+    if (fd < 0 || !callback) {
+      logger_.error("Cannot add invalid fd {} / callback", fd);
+      return false;
+    }
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (registrations_.contains(fd)) {
+      logger_.error("fd {} is already registered", fd);
+      return false;
+    }
+    auto registration = std::make_shared<Registration>();
+    registration->fd = fd;
+    registration->id = ++last_id_;
+    registration->callback = callback;
+#if defined(__linux__)
+    struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT,
+                                .data = {.u64 = event_data(*registration)}};
+    if (epoll_ctl(poll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+      logger_.error("Cannot add fd {}: {} - '{}'", fd, errno, strerror(errno));
+      return false;
+    }
+#endif
+    registrations_.emplace(fd, std::move(registration));
+    logger_.debug("Added fd {}", fd);
+    // for select, the loop has to rebuild its set of file descriptors
+    wake();
+    return true;
+  }
+
+  /**
+   * @brief Stop calling the callback for \p fd.
+   * @details If the callback is running on another task, this blocks until
+   *          it returns, so that once this returns \p fd can be closed and
+   *          anything the callback uses can be destroyed. A callback may
+   *          remove its own file descriptor (or any other).
+   * @param fd The file descriptor to remove.
+   * @return true if \p fd was removed, false if it was not registered.
+   */
+  bool remove(int fd) {
+    std::unique_lock<std::mutex> lk(mutex_);
+    auto it = registrations_.find(fd);
+    if (it == registrations_.end()) {
+      return false;
+    }
+    auto registration = it->second;
+    registrations_.erase(it);
+    registration->removed = true;
+#if defined(__linux__)
+    epoll_ctl(poll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+    // a callback which is waiting for a worker is skipped, but one which is
+    // running has to return first
+    auto this_thread = std::this_thread::get_id();
+    idle_cv_.wait(lk, [&] {
+      return registration->state != State::RUNNING || registration->runner == this_thread;
+    });
+    logger_.debug("Removed fd {}", fd);
+    return true;
+  }
+
+protected:
+  static constexpr int MAX_EVENTS = 16;
+  /// Max time the loop waits, so that it notices being stopped even if it
+  /// could not be woken up
+  static constexpr int MAX_WAIT_MS = 100;
+
+  enum class State {
+    IDLE,    ///< Waiting for the file descriptor to be readable
+    QUEUED,  ///< Readable, waiting for a worker
+    RUNNING, ///< The callback is running
+  };
+
+  struct Registration {
+    int fd;
+    uint32_t id; ///< Distinguishes registrations which reuse a closed file descriptor
+    callback_fn callback;
+    State state{State::IDLE};
+    bool removed{false};
+    std::thread::id runner;
+  };
+
+#if defined(__linux__)
+  static uint64_t event_data(const Registration &registration) {
+    return (static_cast<uint64_t>(registration.id) << 32) | static_cast<uint32_t>(registration.fd);
+  }
+#endif
+
+  bool is_valid() const {
+#if defined(__linux__)
+    return poll_fd_ >= 0 && wake_fd_ >= 0;
+#else
+    return wake_fd_ >= 0;
+#endif
+  }
+
+  void init() {
+#if defined(__linux__)
+    poll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (poll_fd_ < 0) {
+      logger_.error("Cannot create epoll: {} - '{}'", errno, strerror(errno));
+      return;
+    }
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+      logger_.error("Cannot create eventfd: {} - '{}'", errno, strerror(errno));
+      return;
+    }
+    // registration ids start at 1, so the wake up event has id 0
+    struct epoll_event event = {.events = EPOLLIN,
+                                .data = {.u64 = static_cast<uint32_t>(wake_fd_)}};
+    if (epoll_ctl(poll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) < 0) {
+      logger_.error("Cannot add eventfd: {} - '{}'", errno, strerror(errno));
+      cleanup();
+    }
+#else
+    // lwIP has no eventfd (without registering the VFS driver), so the loop
+    // is woken up by a UDP socket which sends to itself over loopback
+    wake_fd_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (wake_fd_ < 0) {
+      logger_.error("Cannot create wake socket: {} - '{}'", errno, strerror(errno));
+      return;
+    }
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t address_size = sizeof(address);
+    if (bind(wake_fd_, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        getsockname(wake_fd_, (struct sockaddr *)&address, &address_size) < 0 ||
+        connect(wake_fd_, (struct sockaddr *)&address, sizeof(address)) < 0) {
+      logger_.error("Cannot set up wake socket: {} - '{}'", errno, strerror(errno));
+      cleanup();
+    }
+#endif
+  }
+
+  void cleanup() {
+    if (wake_fd_ >= 0) {
+      close(wake_fd_);
+      wake_fd_ = -1;
+    }
+#if defined(__linux__)
+    if (poll_fd_ >= 0) {
+      close(poll_fd_);
+      poll_fd_ = -1;
+    }
+#endif
+  }
+
+  /// Make the loop return from waiting
+  void wake() {
+    if (wake_fd_ < 0) {
+      return;
+    }
+#if defined(__linux__)
+    uint64_t value = 1;
+    [[maybe_unused]] auto result = write(wake_fd_, &value, sizeof(value));
+#else
+    uint8_t value = 0;
+    send(wake_fd_, &value, sizeof(value), MSG_DONTWAIT);
+#endif
+  }
+
+  void drain_wake() {
+#if defined(__linux__)
+    uint64_t value;
+    [[maybe_unused]] auto result = read(wake_fd_, &value, sizeof(value));
+#else
+    uint8_t value;
+    while (recv(wake_fd_, &value, sizeof(value), MSG_DONTWAIT) > 0) {
+    }
+#endif
+  }
+
+  /// Watch the file descriptor again after its callback has run
+  /// @note Must be called with mutex_ locked.
+  void rearm(const Registration &registration) {
+#if defined(__linux__)
+    struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT,
+                                .data = {.u64 = event_data(registration)}};
+    if (epoll_ctl(poll_fd_, EPOLL_CTL_MOD, registration.fd, &event) < 0) {
+      logger_.error("Cannot rearm fd {}: {} - '{}'", registration.fd, errno, strerror(errno));
+    }
+#else
+    // the loop only adds idle file descriptors to its set when it starts
+    // waiting
+    if (std::this_thread::get_id() != loop_thread_) {
+      wake();
+    }
+#endif
+  }
+
+  bool loop_task_function(std::mutex &m, std::condition_variable &cv) {
+    if (!running_) {
+      // return true to stop the task
+      return true;
+    }
+#if defined(__linux__)
+    std::array<struct epoll_event, MAX_EVENTS> events;
+    int num_events = epoll_wait(poll_fd_, events.data(), events.size(), MAX_WAIT_MS);
+    if (num_events < 0) {
+      if (errno != EINTR) {
+        logger_.error("epoll_wait failed: {} - '{}'", errno, strerror(errno));
+      }
+      return false;
+    }
+    for (int i = 0; i < num_events && running_; i++) {
+      int fd = static_cast<int>(events[i].data.u64 & 0xFFFFFFFF);
+      uint32_t id = events[i].data.u64 >> 32;
+      if (id == 0) {
+        drain_wake();
+      } else {
+        dispatch(fd, id);
+      }
+    }
+#else
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(wake_fd_, &readfds);
+    int max_fd = wake_fd_;
+    // the registrations which are waited for, as fd and id
+    select_ids_.clear();
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      loop_thread_ = std::this_thread::get_id();
+      for (const auto &[fd, registration] : registrations_) {
+        if (registration->state == State::IDLE) {
+          FD_SET(fd, &readfds);
+          max_fd = std::max(max_fd, fd);
+          select_ids_.emplace_back(fd, registration->id);
+        }
+      }
+    }
+    struct timeval tv = {.tv_sec = 0, .tv_usec = MAX_WAIT_MS * 1000};
+    int num_ready = ::select(max_fd + 1, &readfds, nullptr, nullptr, &tv);
+    if (num_ready < 0) {
+      // EBADF if a file descriptor was removed and closed while waiting
+      if (errno != EINTR && errno != EBADF) {
+        logger_.error("select failed: {} - '{}'", errno, strerror(errno));
+      }
+      return false;
+    }
+    if (FD_ISSET(wake_fd_, &readfds)) {
+      drain_wake();
+    }
+    for (const auto &[fd, id] : select_ids_) {
+      if (!running_) {
+        break;
+      }
+      if (FD_ISSET(fd, &readfds)) {
+        dispatch(fd, id);
+      }
+    }
+#endif
+    // we do not want to stop the task
+    return false;
+  }
+
+  /// Run the callback for a readable file descriptor, or queue it for a
+  /// worker
+  void dispatch(int fd, uint32_t id) {
+    std::shared_ptr<Registration> registration;
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      auto it = registrations_.find(fd);
+      // if the id differs, the file descriptor was removed (and closed) and
+      // its number reused while the loop was waiting
+      if (it == registrations_.end() || it->second->id != id ||
+          it->second->state != State::IDLE) {
+        return;
+      }
+      registration = it->second;
+      if (num_workers_ > 0) {
+        registration->state = State::QUEUED;
+        work_queue_.push_back(registration);
+      } else {
+        registration->state = State::RUNNING;
+        registration->runner = std::this_thread::get_id();
+      }
+    }
+    if (num_workers_ > 0) {
+      work_cv_.notify_one();
+    } else {
+      run(registration);
+    }
+  }
+
+  bool worker_task_function(std::mutex &m, std::condition_variable &cv) {
+    std::shared_ptr<Registration> registration;
+    {
+      std::unique_lock<std::mutex> lk(mutex_);
+      work_cv_.wait(lk, [this] { return !running_ || !work_queue_.empty(); });
+      if (!running_) {
+        // return true to stop the task
+        return true;
+      }
+      registration = std::move(work_queue_.front());
+      work_queue_.pop_front();
+      if (registration->removed) {
+        // removed while it was waiting
+        return false;
+      }
+      registration->state = State::RUNNING;
+      registration->runner = std::this_thread::get_id();
+    }
+    run(registration);
+    // we do not want to stop the task
+    return false;
+  }
+
+  /// Call the callback, then watch the file descriptor again
+  void run(const std::shared_ptr<Registration> &registration) {
+    registration->callback();
+    std::lock_guard<std::mutex> lk(mutex_);
+    registration->state = State::IDLE;
+    registration->runner = {};
+    if (!registration->removed) {
+      rearm(*registration);
+    }
+    idle_cv_.notify_all();
+  }
+
+  size_t num_workers_;
+  std::atomic<bool> running_{false};
+  int wake_fd_{-1};
+#if defined(__linux__)
+  int poll_fd_{-1};
+#else
+  std::thread::id loop_thread_;
+  std::vector<std::pair<int, uint32_t>> select_ids_;
+#endif
+
+  std::mutex mutex_; ///< Guards the registrations and the work queue
+  std::unordered_map<int, std::shared_ptr<Registration>> registrations_;
+  uint32_t last_id_{0};
+  std::deque<std::shared_ptr<Registration>> work_queue_;
+  std::condition_variable work_cv_; ///< Signalled when work is queued
+  std::condition_variable idle_cv_; ///< Signalled when a callback returns
+
+  std::unique_ptr<Task> loop_task_;
+  std::vector<std::unique_ptr<Task>> worker_tasks_;
+  Logger logger_;
+};
+} // namespace espp
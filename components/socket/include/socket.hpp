@@ -14,6 +14,7 @@
 
 #include "format.hpp"
 #include "logger.hpp"
+#include "reactor.hpp"
 
 namespace espp {
 /**
@@ -81,7 +82,7 @@ public:
         address = inet_ntoa(((struct sockaddr_in *)&raw)->sin_addr);
         port = ((struct sockaddr_in *)&raw)->sin_port;
       } else if (raw.ss_family == PF_INET6) {
-        address = inet_ntoa(((struct sockaddr_in6 *)&raw)->sin6_addr);
+        address = ipv6_to_string(((struct sockaddr_in6 *)&raw)->sin6_addr);
         port = ((struct sockaddr_in6 *)&raw)->sin6_port;
       }
     }
@@ -110,10 +111,24 @@ public:
      * @param &source_address sockaddr info filled out by recvfrom.
      */
     void from_sockaddr(const struct sockaddr_in6 &source_address) {
-      address = inet_ntoa(source_address.sin6_addr);
+      address = ipv6_to_string(source_address.sin6_addr);
       port = source_address.sin6_port;
       memcpy(&raw, &source_address, sizeof(source_address));
     }
+
+  protected:
+    /**
+     * @brief Convert an IPv6 address to its text form.
+     * @param address The IPv6 address.
+     * @return The address as a string, or an empty string on error.
+     */
+    static std::string ipv6_to_string(const struct in6_addr &address) {
+      char buffer[INET6_ADDRSTRLEN];
+      if (!inet_ntop(AF_INET6, &address, buffer, sizeof(buffer))) {
+        return {};
+      }
+      return buffer;
+    }
   };
 
   /**
@@ -221,6 +236,30 @@ public:
     return true;
   }
 
+  /**
+   * @brief Set the send timeout on the provided socket, after which a blocked
+   *        send fails (with EAGAIN) instead of waiting for the remote to make
+   *        room, e.g. because it stopped reading.
+   * @param timeout requested timeout, must be > 0.
+   * @return true if SO_SNDTIMEO was successfully set.
+   */
+  bool set_send_timeout(const std::chrono::duration<float> &timeout) {
+    float seconds = timeout.count();
+    if (seconds <= 0) {
+      return true;
+    }
+    float intpart;
+    float fractpart = modf(seconds, &intpart);
+    struct timeval tv;
+    tv.tv_sec = (int)intpart;
+    tv.tv_usec = (int)(fractpart * 1E6);
+    int err = setsockopt(socket_, SOL_SOCKET, SO_SNDTIMEO, (const char *)&tv, sizeof(tv));
+    if (err < 0) {
+      return false;
+    }
+    return true;
+  }
+
   /**
    * @brief Allow others to use this address/port combination after we're done
    *        with it.
@@ -291,9 +330,9 @@ public:
     int err = 0;
 
     // Configure source interface
-    imreq.imr_interface.s_addr = IPADDR_ANY;
+    imreq.imr_interface.s_addr = htonl(INADDR_ANY);
     // Configure multicast address to listen to
-    err = inet_aton(multicast_group.c_str(), &imreq.imr_multiaddr.s_addr);
+    err = inet_aton(multicast_group.c_str(), &imreq.imr_multiaddr);
 
     if (err != 1 || !IN_MULTICAST(ntohl(imreq.imr_multiaddr.s_addr))) {
       // it's not actually a multicast address, so return false?
@@ -304,6 +343,7 @@ public:
     // Assign the IPv4 multicast source interface, via its IP
     // (only necessary if this socket is IPV4 only)
     struct in_addr iaddr;
+    iaddr.s_addr = htonl(INADDR_ANY);
     err = setsockopt(socket_, IPPROTO_IP, IP_MULTICAST_IF, &iaddr, sizeof(struct in_addr));
     if (err < 0) {
       fmt::print(fg(fmt::color::red), "Couldn't set IP_MULTICAST_IF: {} - '{}'\n", errno,
@@ -321,6 +361,20 @@ public:
     return true;
   }
 
+  /**
+   * @brief Stop the reactor the socket was registered with (e.g. by
+   *        UdpSocket::start_receiving) from calling the socket's callback.
+   * @note Blocks until a callback which is running on another task returns.
+   * @note This is called when the socket is closed, so the reactor never
+   *       waits for a closed socket.
+   */
+  void remove_from_reactor() {
+    if (reactor_) {
+      reactor_->remove(socket_);
+      reactor_ = nullptr;
+    }
+  }
+
   int select(std::chrono::microseconds timeout) {
     fd_set readfds;
     fd_set writefds;
@@ -376,10 +430,32 @@ protected:
     return true;
   }
 
+  /**
+   * @brief Register the socket with \p reactor, which then calls \p callback
+   *        whenever the socket is readable.
+   * @param reactor The reactor, which must outlive the socket or its
+   *        registration.
+   * @param callback Function to call when the socket is readable.
+   * @return true if the socket was registered.
+   */
+  bool add_to_reactor(Reactor &reactor, const Reactor::callback_fn &callback) {
+    if (reactor_) {
+      logger_.error("Socket is already registered with a reactor");
+      return false;
+    }
+    if (!reactor.add(socket_, callback)) {
+      logger_.error("Could not register socket with reactor");
+      return false;
+    }
+    reactor_ = &reactor;
+    return true;
+  }
+
   /**
    *  @brief If the socket was created, we shut it down and close it here.
    */
   void cleanup() {
+    remove_from_reactor();
     if (is_valid()) {
       shutdown(socket_, 0);
       close(socket_);
@@ -392,6 +468,7 @@ protected:
   static constexpr int ip_protocol_{IPPROTO_IP};
 
   int socket_;
+  Reactor *reactor_{nullptr};
   Logger logger_;
 };
 } // namespace espp
@@ -1,9 +1,25 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <optional>
+#include <span>
 #include <string_view>
 #include <vector>
 
+#include <unistd.h>
+
+#if !defined(ESP_PLATFORM)
+// lwIP declares TCP_NODELAY in its sockets.h
+#include <netinet/tcp.h>
+#endif
+
+#if defined(__linux__)
+#include <signal.h>
+#include <sys/sendfile.h>
+#endif
+
 #include "logger.hpp"
 #include "socket.hpp"
 #include "task.hpp"
@@ -43,17 +59,35 @@ struct TcpTransmitConfig {
  * \section tcp_ex4 TCP Server Response Example
  * \snippet socket_example.cpp TCP Server Response example
  *
+ * \section tcp_ex5 TCP Server with Reactor Example
+ * \snippet socket_example.cpp Reactor example
+ *
+ * \section tcp_ex6 TCP Request/Response Benchmark
+ * \snippet socket_example.cpp TCP request/response benchmark
+ *
  */
 class TcpSocket : public Socket {
 public:
+  static constexpr size_t DEFAULT_WRITE_BUFFER_SIZE =
+      1024; ///< Default size of the buffer which collects the data given to write().
+
   /**
    * @brief Config struct for the TCP socket.
    */
   struct Config {
     Logger::Verbosity log_level{
         Logger::Verbosity::WARN}; /**< Verbosity level for the TCP socket logger. */
+    size_t write_buffer_size{
+        DEFAULT_WRITE_BUFFER_SIZE}; /**< Size of the buffer which collects the data given to
+                                       write() until it is flushed. 0 disables buffering. */
   };
 
+  /**
+   * @brief Callback function to be called when a connection is accepted.
+   * @param socket The socket for the accepted connection.
+   */
+  typedef std::function<void(std::unique_ptr<TcpSocket> socket)> accept_callback_fn;
+
   /**
    * @brief Config struct for connecting to a remote TCP server.
    */
@@ -68,7 +102,8 @@ public:
    * @param config Config for the socket.
    */
   TcpSocket(const Config &config)
-      : Socket(Type::STREAM, Logger::Config{.tag = "TcpSocket", .level = config.log_level}) {
+      : Socket(Type::STREAM, Logger::Config{.tag = "TcpSocket", .level = config.log_level}),
+        write_buffer_size_(config.write_buffer_size) {
     set_keepalive();
   }
 
@@ -96,7 +131,24 @@ public:
   /**
    * @brief Close the socket.
    */
-  void close() { ::close(socket_); }
+  void close() {
+    remove_from_reactor();
+    ::close(socket_);
+    connected_ = false;
+    write_buffer_.clear();
+  }
+
+  /**
+   * @brief Shut down both directions of the connection, without closing the
+   *        socket. Any send or receive blocked on the socket (in another task)
+   *        returns, and later ones fail right away.
+   */
+  void shutdown() {
+    if (is_valid()) {
+      ::shutdown(socket_, SHUT_RDWR);
+    }
+    connected_ = false;
+  }
 
   /**
    * @brief Check if the socket is connected to a remote endpoint.
@@ -192,15 +244,11 @@ public:
       return false;
     }
     // write
-    logger_.info("Client sending {} bytes", data.size());
-    int num_bytes_sent = write(socket_, data.data(), data.size());
-    if (num_bytes_sent < 0) {
-      logger_.error("Error occurred during sending: {} - '{}'", errno, strerror(errno));
-      // update our connection state here since remote end was likely closed...
-      connected_ = false;
+    logger_.debug("Client sending {} bytes", data.size());
+    struct iovec iov = {.iov_base = (void *)data.data(), .iov_len = data.size()};
+    if (!transmit(std::span<const struct iovec>(&iov, 1))) {
       return false;
     }
-    logger_.debug("Client sent {} bytes", num_bytes_sent);
     // we don't need to wait for a response and the socket is good;
     if (!transmit_config.wait_for_response) {
       return true;
@@ -227,6 +275,254 @@ public:
     return true;
   }
 
+  /**
+   * @brief Send data, gathered from multiple buffers, to the endpoint already
+   *        connected to by TcpSocket::connect, using sendmsg() so that the
+   *        buffers don't need to be copied into one. Many small buffers (e.g.
+   *        packet headers and payloads) are written with a few large writes.
+   *
+   *        Blocks until all of the data has been written (retrying partial
+   *        writes), and does not wait for a response.
+   * @note Any data buffered by write() is sent first, with the same
+   *       sendmsg() call as the first of the buffers.
+   * @param data Buffers which are sent, in order.
+   * @return true if all of the data was sent, false otherwise.
+   */
+  bool transmit(std::span<const struct iovec> data) {
+    if (!is_valid()) {
+      logger_.error("Socket invalid, cannot send");
+      return false;
+    }
+    logger_.debug("Client sending {} buffers", data.size());
+    if (write_buffer_.empty()) {
+      return send_buffers(data);
+    }
+    std::array<struct iovec, MAX_IOVECS> iovecs;
+    size_t num_iovecs = std::min(data.size(), MAX_IOVECS - 1);
+    iovecs[0] = {.iov_base = write_buffer_.data(), .iov_len = write_buffer_.size()};
+    std::copy_n(data.begin(), num_iovecs, iovecs.begin() + 1);
+    bool sent = send_buffers(std::span(iovecs.data(), num_iovecs + 1));
+    write_buffer_.clear();
+    return sent && send_buffers(data.subspan(num_iovecs));
+  }
+
+  /**
+   * @brief Buffer data to send to the endpoint already connected to by
+   *        TcpSocket::connect, until flush() is called. Many small writes
+   *        (e.g. the parts of a protocol message, or the responses to
+   *        pipelined requests) are then sent with one system call, in as few
+   *        segments as possible.
+   *
+   *        Data which does not fit in the write buffer
+   *        (Config::write_buffer_size) is not copied: it is sent right away,
+   *        together with the buffered data, with one sendmsg() call.
+   * @note The buffered data is also sent by transmit(), before its own data.
+   * @param data vector of bytes to send to the remote endpoint.
+   * @return true if the data was buffered or sent, false otherwise.
+   */
+  bool write(const std::vector<uint8_t> &data) {
+    return write(std::string_view{(const char *)data.data(), data.size()});
+  }
+
+  /**
+   * @brief Buffer data to send to the endpoint already connected to by
+   *        TcpSocket::connect, until flush() is called. Many small writes
+   *        (e.g. the parts of a protocol message, or the responses to
+   *        pipelined requests) are then sent with one system call, in as few
+   *        segments as possible.
+   *
+   *        Data which does not fit in the write buffer
+   *        (Config::write_buffer_size) is not copied: it is sent right away,
+   *        together with the buffered data, with one sendmsg() call.
+   * @note The buffered data is also sent by transmit(), before its own data.
+   * @param data string view of bytes to send to the remote endpoint.
+   * @return true if the data was buffered or sent, false otherwise.
+   */
+  bool write(std::string_view data) {
+    if (write_buffer_.size() + data.size() <= write_buffer_size_) {
+      if (write_buffer_.capacity() == 0) {
+        write_buffer_.reserve(write_buffer_size_);
+      }
+      write_buffer_.insert(write_buffer_.end(), data.begin(), data.end());
+      return true;
+    }
+    struct iovec iov = {.iov_base = (void *)data.data(), .iov_len = data.size()};
+    return transmit(std::span<const struct iovec>(&iov, 1));
+  }
+
+  /**
+   * @brief Send the data buffered by write(), if any.
+   * @return true if all of the buffered data was sent, false otherwise.
+   */
+  bool flush() {
+    if (write_buffer_.empty()) {
+      return true;
+    }
+    return transmit(std::span<const struct iovec>{});
+  }
+
+  /**
+   * @brief Get the number of bytes buffered by write() which have not been
+   *        sent yet.
+   * @return The number of buffered bytes.
+   */
+  size_t get_buffered_size() const { return write_buffer_.size(); }
+
+  /**
+   * @brief Send part of a file to the endpoint already connected to by
+   *        TcpSocket::connect.
+   *
+   *        On Linux this uses sendfile(), so the file's data is sent by the
+   *        kernel without being copied through user space. Elsewhere (or if
+   *        the file does not support sendfile()), the file is read into a
+   *        buffer of \p buffer_size bytes and sent a chunk at a time.
+   * @note Any data buffered by write() is sent first.
+   * @param file_descriptor The file to send, opened for reading.
+   * @param offset The offset in the file of the first byte to send.
+   * @param size The number of bytes to send.
+   * @param buffer_size The size of the buffer used when the file can't be
+   *        sent with sendfile().
+   * @return true if all \p size bytes were sent, false otherwise.
+   */
+  bool transmit_file(int file_descriptor, size_t offset, size_t size,
+                     size_t buffer_size = 4096) {
+    if (!is_valid()) {
+      logger_.error("Socket invalid, cannot send");
+      return false;
+    }
+    if (!flush()) {
+      return false;
+    }
+    logger_.debug("Client sending {} bytes of file", size);
+#if defined(__linux__)
+    // sendfile() has no MSG_NOSIGNAL, so block SIGPIPE on this thread while
+    // sending, and discard the one raised if the remote closed
+    sigset_t sigpipe_set, old_set;
+    sigemptyset(&sigpipe_set);
+    sigaddset(&sigpipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe_set, &old_set);
+    off_t file_offset = offset;
+    size_t num_sent = 0;
+    int error = 0;
+    while (num_sent < size) {
+      ssize_t num_bytes_sent = sendfile(socket_, file_descriptor, &file_offset, size - num_sent);
+      if (num_bytes_sent < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        error = errno;
+        break;
+      }
+      if (num_bytes_sent == 0) {
+        // the file is shorter than expected
+        break;
+      }
+      num_sent += num_bytes_sent;
+    }
+    if (error == EPIPE) {
+      struct timespec no_wait = {};
+      sigtimedwait(&sigpipe_set, nullptr, &no_wait);
+    }
+    pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+    if (num_sent == size) {
+      return true;
+    }
+    if (num_sent > 0 || (error != EINVAL && error != ENOSYS)) {
+      if (error == 0) {
+        logger_.error("The file ended after {} of {} bytes", num_sent, size);
+      } else {
+        logger_.error("Error occurred during sending: {} - '{}'", error, strerror(error));
+        // update our connection state here since remote end was likely closed...
+        connected_ = false;
+      }
+      return false;
+    }
+    // the file can't be sent with sendfile(), so send it a chunk at a time
+    logger_.debug("Cannot sendfile(), sending the file in chunks");
+#endif
+    if (lseek(file_descriptor, offset, SEEK_SET) < 0) {
+      logger_.error("Cannot seek in the file: {} - '{}'", errno, strerror(errno));
+      return false;
+    }
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[buffer_size]);
+    size_t remaining = size;
+    while (remaining > 0) {
+      ssize_t num_bytes_read =
+          ::read(file_descriptor, buffer.get(), std::min(remaining, buffer_size));
+      if (num_bytes_read < 0 && errno == EINTR) {
+        continue;
+      }
+      if (num_bytes_read <= 0) {
+        logger_.error("Cannot read the file: {} - '{}'", errno, strerror(errno));
+        return false;
+      }
+      struct iovec iov = {.iov_base = buffer.get(), .iov_len = (size_t)num_bytes_read};
+      if (!send_buffers(std::span<const struct iovec>(&iov, 1))) {
+        return false;
+      }
+      remaining -= num_bytes_read;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Enable or disable TCP_CORK (TCP_NOPUSH on BSD / macOS), i.e.
+   *        whether the network stack holds back partial segments until the
+   *        socket is uncorked. Useful when a message is written with several
+   *        transmit() calls which should be sent in full segments. Disabling
+   *        it sends the data which was held back right away.
+   * @note lwIP has no such option, so this fails on ESP32; use write() and
+   *       flush() instead, which coalesce the data before it is sent.
+   * @param enabled Whether to cork the socket.
+   * @return true if TCP_CORK was set.
+   */
+  bool set_cork(bool enabled = true) {
+    if (!is_valid()) {
+      logger_.error("Socket invalid, cannot set cork.");
+      return false;
+    }
+#if defined(TCP_CORK) || defined(TCP_NOPUSH)
+#if defined(TCP_CORK)
+    static constexpr int option = TCP_CORK;
+#else
+    static constexpr int option = TCP_NOPUSH;
+#endif
+    int optval = enabled;
+    auto err = setsockopt(socket_, IPPROTO_TCP, option, &optval, sizeof(optval));
+    if (err < 0) {
+      logger_.error("Unable to set cork: {} - '{}'", errno, strerror(errno));
+      return false;
+    }
+    return true;
+#else
+    logger_.error("Cork is not supported on this platform.");
+    return false;
+#endif
+  }
+
+  /**
+   * @brief Enable or disable TCP_NODELAY, i.e. whether small writes are sent
+   *        immediately instead of being delayed (by Nagle's algorithm) until
+   *        the data which was already sent has been acknowledged. Useful
+   *        when the data is already written in large batches, and small
+   *        (e.g. control) messages should not wait behind them.
+   * @param enabled Whether to enable TCP_NODELAY.
+   * @return true if TCP_NODELAY was set.
+   */
+  bool set_nodelay(bool enabled = true) {
+    if (!is_valid()) {
+      logger_.error("Socket invalid, cannot set nodelay.");
+      return false;
+    }
+    int optval = enabled;
+    auto err = setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+    if (err < 0) {
+      logger_.error("Unable to set nodelay: {} - '{}'", errno, strerror(errno));
+      return false;
+    }
+    return true;
+  }
+
   /**
    * @brief Call read on the socket, assuming it has already been configured
    *        appropriately.
@@ -358,7 +654,126 @@ public:
     return std::unique_ptr<TcpSocket>(new TcpSocket(accepted_socket, connected_client_info));
   }
 
+  /**
+   * @brief Register the listening socket with \p reactor, which then accepts
+   *        each incoming connection and passes it to \p on_accept, instead of
+   *        a task blocking in accept.
+   * @note Must be called after listen.
+   * @param reactor Reactor which accepts the connections; it must outlive the
+   *        socket.
+   * @param on_accept Function called with the socket of each accepted
+   *        connection. It runs on the reactor, so it should not block.
+   * @return true if the socket was registered with the reactor.
+   */
+  bool start_accepting(Reactor &reactor, const accept_callback_fn &on_accept) {
+    if (!is_valid()) {
+      logger_.error("Socket invalid, cannot accept incoming connections.");
+      return false;
+    }
+    // the socket is readable, so accept does not block
+    return add_to_reactor(reactor, [this, on_accept]() {
+      auto socket = accept();
+      if (socket && on_accept) {
+        on_accept(std::move(socket));
+      }
+    });
+  }
+
+  /**
+   * @brief Register the connected socket with \p reactor, which then receives
+   *        the data coming in on the socket, passes it to \p on_receive and
+   *        transmits the response \p on_receive returns (if any), instead of a
+   *        task blocking in receive.
+   * @note When the remote end closes the connection, the socket is removed
+   *       from the reactor and \p on_receive is called once more with no
+   *       data. The socket may be destroyed from within that call.
+   * @param reactor Reactor which receives the data; it must outlive the socket.
+   * @param max_num_bytes Maximum number of bytes to receive at once.
+   * @param on_receive Function called with the received data and the remote
+   *        endpoint info. It runs on the reactor, so it should not block.
+   * @return true if the socket was registered with the reactor.
+   */
+  bool start_receiving(Reactor &reactor, size_t max_num_bytes,
+                       const receive_callback_fn &on_receive) {
+    if (!is_valid()) {
+      logger_.error("Socket invalid, cannot receive.");
+      return false;
+    }
+    if (!is_connected()) {
+      logger_.error("Socket not connected, cannot receive.");
+      return false;
+    }
+    // NOTE: on_receive is captured rather than stored in the socket, since
+    //       the reactor keeps the callback alive while it runs even if it
+    //       destroys the socket
+    return add_to_reactor(reactor, [this, max_num_bytes, on_receive]() {
+      std::vector<uint8_t> data;
+      // the socket is readable, so receive does not block
+      if (receive(data, max_num_bytes)) {
+        auto response = on_receive(data, remote_info_);
+        if (response.has_value()) {
+          transmit(response.value());
+        }
+      } else if (!is_connected() || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        // the remote closed the connection (or it failed), so stop receiving
+        connected_ = false;
+        remove_from_reactor();
+        auto remote_info = remote_info_;
+        data.clear();
+        on_receive(data, remote_info);
+      }
+    });
+  }
+
 protected:
+  static constexpr size_t MAX_IOVECS = 64; ///< Max number of buffers per sendmsg() call.
+#if defined(MSG_NOSIGNAL)
+  static constexpr int SEND_FLAGS = MSG_NOSIGNAL; ///< Don't raise SIGPIPE if the remote closed.
+#else
+  static constexpr int SEND_FLAGS = 0;
+#endif
+
+  /**
+   * @brief Send the buffers with as few sendmsg() calls as possible,
+   *        retrying partial writes.
+   * @param data Buffers which are sent, in order.
+   * @return true if all of the data was sent, false otherwise.
+   */
+  bool send_buffers(std::span<const struct iovec> data) {
+    std::array<struct iovec, MAX_IOVECS> iovecs;
+    size_t index = 0;  // the first buffer which has not been sent completely
+    size_t offset = 0; // the number of bytes of that buffer which have been sent
+    while (index < data.size()) {
+      size_t num_iovecs = std::min(data.size() - index, MAX_IOVECS);
+      std::copy_n(data.begin() + index, num_iovecs, iovecs.begin());
+      iovecs[0].iov_base = (uint8_t *)iovecs[0].iov_base + offset;
+      iovecs[0].iov_len -= offset;
+      struct msghdr message = {};
+      message.msg_iov = iovecs.data();
+      message.msg_iovlen = num_iovecs;
+      int num_bytes_sent = sendmsg(socket_, &message, SEND_FLAGS);
+      if (num_bytes_sent < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        logger_.error("Error occurred during sending: {} - '{}'", errno, strerror(errno));
+        // update our connection state here since remote end was likely closed...
+        connected_ = false;
+        return false;
+      }
+      logger_.debug("Client sent {} bytes", num_bytes_sent);
+      // skip the buffers which were sent completely
+      size_t remaining = num_bytes_sent;
+      while (index < data.size() && remaining >= data[index].iov_len - offset) {
+        remaining -= data[index].iov_len - offset;
+        offset = 0;
+        index++;
+      }
+      offset += remaining;
+    }
+    return true;
+  }
+
   /**
    * @brief Construct a new TcpSocket object
    * @note This sets connected_ to true, under the assumption that the socket
@@ -412,7 +827,9 @@ protected:
     return true;
   }
 
-  bool connected_{false};
+  std::atomic<bool> connected_{false};
   Socket::Info remote_info_;
+  size_t write_buffer_size_{DEFAULT_WRITE_BUFFER_SIZE};
+  std::vector<uint8_t> write_buffer_;
 };
 } // namespace espp
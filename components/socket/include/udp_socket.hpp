@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <optional>
+#include <span>
 #include <string_view>
 #include <vector>
 
@@ -35,6 +38,15 @@ namespace espp {
  * \section udp_ex6 UDP Multicast Server Example
  * \snippet socket_example.cpp UDP Multicast Server example
  *
+ * \section udp_ex7 UDP Server with Reactor Example
+ * \snippet socket_example.cpp Reactor example
+ *
+ * \section udp_ex8 UDP Receive Benchmark
+ * \snippet socket_example.cpp UDP receive benchmark
+ *
+ * \section udp_ex9 UDP Connected Send Benchmark
+ * \snippet socket_example.cpp UDP connected send benchmark
+ *
  */
 class UdpSocket : public Socket {
 public:
@@ -46,6 +58,9 @@ public:
         ""}; /**< If this is a multicast endpoint, this is the group it belongs to. */
     receive_callback_fn on_receive_callback{
         nullptr}; /**< Function containing business logic to handle data received. */
+    size_t max_batch_size{1}; /**< Max number of datagrams received each time the socket is
+                                 readable (using recvmmsg() on Linux), before the callback is
+                                 called for each of them. */
   };
 
   struct SendConfig {
@@ -67,6 +82,84 @@ public:
         Logger::Verbosity::WARN}; /**< Verbosity level for the UDP socket logger. */
   };
 
+  /**
+   * @brief Config struct for connecting the socket to a fixed remote endpoint.
+   */
+  struct ConnectConfig {
+    std::string ip_address;            /**< Address to send data to. */
+    size_t port;                       /**< Port number to send data to.*/
+    bool is_multicast_endpoint{false}; /**< Whether this should be a multicast endpoint. */
+  };
+
+  /**
+   * @brief Reusable storage for receiving a batch of datagrams with
+   *        receive_batch(), so that receiving does not allocate.
+   */
+  class ReceiveBatch {
+  public:
+    /**
+     * @brief Allocate the storage for a batch of datagrams.
+     * @param max_num_datagrams Max number of datagrams received at once.
+     * @param max_datagram_size Max size of each datagram; longer datagrams
+     *        are truncated.
+     */
+    ReceiveBatch(size_t max_num_datagrams, size_t max_datagram_size)
+        : max_datagram_size_(max_datagram_size),
+          buffer_(std::max<size_t>(max_num_datagrams, 1) * max_datagram_size),
+          sizes_(std::max<size_t>(max_num_datagrams, 1)),
+          senders_(std::max<size_t>(max_num_datagrams, 1)) {
+#if defined(__linux__)
+      iovecs_.resize(sizes_.size());
+      messages_.resize(sizes_.size());
+#endif
+    }
+
+    /**
+     * @brief Get the max number of datagrams received at once.
+     * @return The max number of datagrams.
+     */
+    size_t capacity() const { return sizes_.size(); }
+
+    /**
+     * @brief Get the number of datagrams received by the last receive_batch().
+     * @return The number of datagrams.
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Get a received datagram.
+     * @param index Index of the datagram, < size().
+     * @return View of the datagram, valid until the next receive_batch().
+     */
+    std::span<const uint8_t> data(size_t index) const {
+      return {buffer_.data() + index * max_datagram_size_, sizes_[index]};
+    }
+
+    /**
+     * @brief Get the sender of a received datagram.
+     * @param index Index of the datagram, < size().
+     * @return The sender's information.
+     */
+    const Socket::Info &sender(size_t index) const { return senders_[index]; }
+
+  protected:
+    friend class UdpSocket;
+
+    std::span<uint8_t> slot(size_t index) {
+      return {buffer_.data() + index * max_datagram_size_, max_datagram_size_};
+    }
+
+    size_t max_datagram_size_;
+    std::vector<uint8_t> buffer_; ///< The datagrams, each in a slot of max_datagram_size_
+    std::vector<size_t> sizes_;
+    std::vector<Socket::Info> senders_;
+    size_t size_{0};
+#if defined(__linux__)
+    std::vector<struct iovec> iovecs_;
+    std::vector<struct mmsghdr> messages_;
+#endif
+  };
+
   /**
    * @brief Initialize the socket and associated resources.
    * @param config Config for the socket.
@@ -77,11 +170,7 @@ public:
   /**
    * @brief Tear down any resources associted with the socket.
    */
-  ~UdpSocket() {
-    // we have to explicitly call cleanup here so that the server recvfrom
-    // will return and the task can stop.
-    cleanup();
-  }
+  ~UdpSocket() { stop_receiving(); }
 
   /**
    * @brief Send data to the endpoint specified by the send_config.
@@ -120,6 +209,30 @@ public:
    * @return true if the data was sent, false otherwise.
    */
   bool send(std::string_view data, const SendConfig &send_config) {
+    struct iovec iov = {.iov_base = (void *)data.data(), .iov_len = data.size()};
+    return send(std::span<const struct iovec>(&iov, 1), send_config);
+  }
+
+  /**
+   * @brief Send one datagram, gathered from multiple buffers (e.g. a header
+   *        and a payload which are stored separately), to the endpoint
+   *        specified by the send_config using sendmsg(), so that the buffers
+   *        don't need to be copied into one.
+   *        Can be configured to multicast (within send_config) and can be
+   *        configured to block waiting for a response from the remote.
+   *
+   *        @note in the case of multicast, it will block only until the first
+   *              response.
+   *
+   *        If response is requested, a callback can be provided in
+   *        send_config which will be provided the response data for
+   *        processing.
+   * @param data Buffers which are sent, in order, as one datagram.
+   * @param send_config SendConfig struct indicating where to send and whether
+   *        to wait for a response.
+   * @return true if the data was sent, false otherwise.
+   */
+  bool send(std::span<const struct iovec> data, const SendConfig &send_config) {
     if (!is_valid()) {
       logger_.error("Socket invalid, cannot send");
       return false;
@@ -137,14 +250,18 @@ public:
                     send_config.response_timeout.count(), errno, strerror(errno));
       return false;
     }
-    // sendto
+    // sendmsg
     Socket::Info server_info;
     server_info.init_ipv4(send_config.ip_address, send_config.port);
     auto server_address = server_info.ipv4_ptr();
-    logger_.info("Client sending {} bytes to {}:{}", data.size(), send_config.ip_address,
+    struct msghdr message = {};
+    message.msg_name = server_address;
+    message.msg_namelen = sizeof(*server_address);
+    message.msg_iov = const_cast<struct iovec *>(data.data());
+    message.msg_iovlen = data.size();
+    logger_.info("Client sending {} buffers to {}:{}", data.size(), send_config.ip_address,
                  send_config.port);
-    int num_bytes_sent = sendto(socket_, data.data(), data.size(), 0,
-                                (struct sockaddr *)server_address, sizeof(*server_address));
+    int num_bytes_sent = sendmsg(socket_, &message, 0);
     if (num_bytes_sent < 0) {
       logger_.error("Error occurred during sending: {} - '{}'", errno, strerror(errno));
       return false;
@@ -174,10 +291,152 @@ public:
     return true;
   }
 
+  /**
+   * @brief Send multiple datagrams, each gathered from multiple buffers, to
+   *        the endpoint specified by the send_config. Where available (Linux)
+   *        the datagrams are sent in batches with sendmmsg(), otherwise they
+   *        are sent one at a time with sendmsg().
+   *
+   *        @note This never waits for a response, send_config.wait_for_response
+   *              and the related fields are ignored.
+   * @param datagrams Datagrams to send, each given as the buffers which are
+   *        sent, in order, as that datagram.
+   * @param send_config SendConfig struct indicating where to send.
+   * @return true if all of the datagrams were sent, false otherwise.
+   */
+  bool send_batch(std::span<const std::span<const struct iovec>> datagrams,
+                  const SendConfig &send_config) {
+    if (!is_valid()) {
+      logger_.error("Socket invalid, cannot send");
+      return false;
+    }
+    if (send_config.is_multicast_endpoint) {
+      // configure it for multicast
+      if (!make_multicast()) {
+        logger_.error("Cannot make multicast: {} - '{}'", errno, strerror(errno));
+        return false;
+      }
+    }
+    Socket::Info server_info;
+    server_info.init_ipv4(send_config.ip_address, send_config.port);
+    logger_.debug("Client sending {} datagrams to {}:{}", datagrams.size(),
+                  send_config.ip_address, send_config.port);
+    return send_datagrams(datagrams, server_info.ipv4_ptr());
+  }
+
+  /**
+   * @brief Connect the socket to a fixed remote endpoint, so that data can be
+   *        sent to it with the send() and send_batch() overloads which take
+   *        no SendConfig. The endpoint is resolved (and the socket configured
+   *        for multicast) once, here, rather than for every send.
+   * @note A connected socket only receives datagrams from the remote
+   *       endpoint.
+   * @param connect_config ConnectConfig struct describing the remote endpoint.
+   * @return true if the socket was connected.
+   */
+  bool connect(const ConnectConfig &connect_config) {
+    if (!is_valid()) {
+      logger_.error("Socket invalid, cannot connect");
+      return false;
+    }
+    if (connect_config.is_multicast_endpoint && !make_multicast()) {
+      logger_.error("Cannot make multicast: {} - '{}'", errno, strerror(errno));
+      return false;
+    }
+    Socket::Info remote_info;
+    remote_info.init_ipv4(connect_config.ip_address, connect_config.port);
+    auto remote_address = remote_info.ipv4_ptr();
+    int error = ::connect(socket_, (struct sockaddr *)remote_address, sizeof(*remote_address));
+    if (error != 0) {
+      logger_.error("Could not connect to {}: {} - '{}'", remote_info, errno, strerror(errno));
+      return false;
+    }
+    logger_.info("Connected to {}", remote_info);
+    remote_info_ = remote_info;
+    connected_ = true;
+    return true;
+  }
+
+  /**
+   * @brief Check if the socket is connected to a remote endpoint.
+   * @return true if UdpSocket::connect succeeded.
+   */
+  bool is_connected() const { return connected_; }
+
+  /**
+   * @brief Get the remote endpoint info.
+   * @return The remote endpoint info, if the socket is connected.
+   */
+  const Socket::Info &get_remote_info() const { return remote_info_; }
+
+  /**
+   * @brief Send data to the endpoint the socket is connected to by
+   *        UdpSocket::connect. Does not wait for a response.
+   * @param data vector of bytes to send to the remote endpoint.
+   * @return true if the data was sent, false otherwise.
+   */
+  bool send(const std::vector<uint8_t> &data) {
+    return send(std::string_view{(const char *)data.data(), data.size()});
+  }
+
+  /**
+   * @brief Send data to the endpoint the socket is connected to by
+   *        UdpSocket::connect. Does not wait for a response.
+   * @param data String view of bytes to send to the remote endpoint.
+   * @return true if the data was sent, false otherwise.
+   */
+  bool send(std::string_view data) {
+    struct iovec iov = {.iov_base = (void *)data.data(), .iov_len = data.size()};
+    return send(std::span<const struct iovec>(&iov, 1));
+  }
+
+  /**
+   * @brief Send one datagram, gathered from multiple buffers, to the
+   *        endpoint the socket is connected to by UdpSocket::connect. Does
+   *        not wait for a response.
+   * @param data Buffers which are sent, in order, as one datagram.
+   * @return true if the data was sent, false otherwise.
+   */
+  bool send(std::span<const struct iovec> data) {
+    if (!is_valid() || !connected_) {
+      logger_.error("Socket invalid or not connected, cannot send");
+      return false;
+    }
+    struct msghdr message = {};
+    message.msg_iov = const_cast<struct iovec *>(data.data());
+    message.msg_iovlen = data.size();
+    int num_bytes_sent = sendmsg(socket_, &message, 0);
+    if (num_bytes_sent < 0) {
+      logger_.error("Error occurred during sending: {} - '{}'", errno, strerror(errno));
+      return false;
+    }
+    logger_.debug("Client sent {} bytes", num_bytes_sent);
+    return true;
+  }
+
+  /**
+   * @brief Send multiple datagrams, each gathered from multiple buffers, to
+   *        the endpoint the socket is connected to by UdpSocket::connect.
+   *        Where available (Linux) the datagrams are sent in batches with
+   *        sendmmsg(), otherwise they are sent one at a time with sendmsg().
+   * @param datagrams Datagrams to send, each given as the buffers which are
+   *        sent, in order, as that datagram.
+   * @return true if all of the datagrams were sent, false otherwise.
+   */
+  bool send_batch(std::span<const std::span<const struct iovec>> datagrams) {
+    if (!is_valid() || !connected_) {
+      logger_.error("Socket invalid or not connected, cannot send");
+      return false;
+    }
+    return send_datagrams(datagrams, nullptr);
+  }
+
   /**
    * @brief Call recvfrom on the socket, assuming it has already been
    *        configured appropriately.
    *
+   * @note The data vector is resized to max_num_bytes to receive into, so
+   *       reusing the same vector for each call does not allocate.
    * @param max_num_bytes Maximum number of bytes to receive.
    * @param data Vector of bytes of received data.
    * @param remote_info Socket::Info containing the sender's information. This
@@ -185,29 +444,135 @@ public:
    * @return true if successfully received, false otherwise.
    */
   bool receive(size_t max_num_bytes, std::vector<uint8_t> &data, Socket::Info &remote_info) {
+    data.resize(max_num_bytes);
+    int num_bytes_received = receive(std::span<uint8_t>(data), remote_info);
+    if (num_bytes_received < 0) {
+      data.clear();
+      return false;
+    }
+    data.resize(num_bytes_received);
+    return true;
+  }
+
+  /**
+   * @brief Call recvfrom on the socket, assuming it has already been
+   *        configured appropriately, receiving directly into the caller's
+   *        buffer.
+   *
+   * @param data Buffer to receive into; a longer datagram is truncated to
+   *        its size.
+   * @param remote_info Socket::Info containing the sender's information. This
+   *        will be populated with the information about the sender.
+   * @return Number of bytes received, or -1 if the receive failed.
+   */
+  int receive(std::span<uint8_t> data, Socket::Info &remote_info) {
     if (!is_valid()) {
       logger_.error("Socket invalid, cannot receive.");
-      return false;
+      return -1;
     }
     // recvfrom
     auto remote_address = remote_info.ipv4_ptr();
     socklen_t socklen = sizeof(*remote_address);
-    // put it on the heap so that our stack usage doesn't change depending on
-    // max_num_bytes
-    std::unique_ptr<uint8_t[]> receive_buffer(new uint8_t[max_num_bytes]());
-    // now actually receive
-    logger_.info("Receiving up to {} bytes", max_num_bytes);
-    int num_bytes_received = recvfrom(socket_, receive_buffer.get(), max_num_bytes, 0,
+    logger_.debug("Receiving up to {} bytes", data.size());
+    int num_bytes_received = recvfrom(socket_, data.data(), data.size(), 0,
                                       (struct sockaddr *)remote_address, &socklen);
     // if we didn't receive anything return false and don't do anything else
     if (num_bytes_received < 0) {
       logger_.error("Receive failed: {} - '{}'", errno, strerror(errno));
-      return false;
+      return -1;
     }
-    // we received data, so call the callback function if one was provided.
-    data.assign(receive_buffer.get(), receive_buffer.get() + num_bytes_received);
     remote_info.update();
     logger_.debug("Received {} bytes from {}", num_bytes_received, remote_info);
+    return num_bytes_received;
+  }
+
+  /**
+   * @brief Receive as many datagrams as are waiting on the socket, up to the
+   *        capacity of \p batch, blocking until at least one is received (or
+   *        the receive timeout is reached). On Linux they are received with a
+   *        single recvmmsg() call, otherwise one recvfrom() at a time.
+   *
+   * @param batch Storage for the datagrams, which is reused by each call.
+   * @return Number of datagrams received (also batch.size()), or -1 if the
+   *         receive failed.
+   */
+  int receive_batch(ReceiveBatch &batch) {
+    batch.size_ = 0;
+    if (!is_valid()) {
+      logger_.error("Socket invalid, cannot receive.");
+      return -1;
+    }
+#if defined(__linux__)
+    for (size_t i = 0; i < batch.capacity(); i++) {
+      auto slot = batch.slot(i);
+      batch.iovecs_[i] = {.iov_base = slot.data(), .iov_len = slot.size()};
+      auto &header = batch.messages_[i].msg_hdr;
+      header = {};
+      header.msg_name = batch.senders_[i].ipv4_ptr();
+      header.msg_namelen = sizeof(struct sockaddr_in);
+      header.msg_iov = &batch.iovecs_[i];
+      header.msg_iovlen = 1;
+    }
+    // block until the first datagram, then take what else is waiting
+    int num_received =
+        recvmmsg(socket_, batch.messages_.data(), batch.capacity(), MSG_WAITFORONE, nullptr);
+    if (num_received < 0) {
+      logger_.error("Receive failed: {} - '{}'", errno, strerror(errno));
+      return -1;
+    }
+    for (int i = 0; i < num_received; i++) {
+      batch.sizes_[i] = batch.messages_[i].msg_len;
+      batch.senders_[i].update();
+    }
+    batch.size_ = num_received;
+#else
+    while (batch.size_ < batch.capacity()) {
+      auto slot = batch.slot(batch.size_);
+      auto &sender = batch.senders_[batch.size_];
+      socklen_t socklen = sizeof(struct sockaddr_in);
+      // block until the first datagram, then take what else is waiting
+      int flags = batch.size_ == 0 ? 0 : MSG_DONTWAIT;
+      int num_bytes_received = recvfrom(socket_, slot.data(), slot.size(), flags,
+                                        (struct sockaddr *)sender.ipv4_ptr(), &socklen);
+      if (num_bytes_received < 0) {
+        if (batch.size_ == 0) {
+          logger_.error("Receive failed: {} - '{}'", errno, strerror(errno));
+          return -1;
+        }
+        break;
+      }
+      batch.sizes_[batch.size_] = num_bytes_received;
+      sender.update();
+      batch.size_++;
+    }
+#endif
+    logger_.debug("Received {} datagrams", batch.size_);
+    return batch.size_;
+  }
+
+  /**
+   * @brief Bind the socket to \p port, so that it can receive with receive()
+   *        or receive_batch().
+   * @note start_receiving() binds the socket itself.
+   * @param port The port to which to bind the socket.
+   * @return true if the socket was bound.
+   */
+  bool bind(int port) {
+    if (!is_valid()) {
+      logger_.error("Socket invalid, cannot bind.");
+      return false;
+    }
+    struct sockaddr_in server_addr;
+    // configure the server socket accordingly - assume IPV4 and bind to the
+    // any address "0.0.0.0"
+    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    server_addr.sin_family = address_family_;
+    server_addr.sin_port = htons(port);
+    int err = ::bind(socket_, (struct sockaddr *)&server_addr, sizeof(server_addr));
+    if (err < 0) {
+      logger_.error("Unable to bind: {} - '{}'", errno, strerror(errno));
+      return false;
+    }
     return true;
   }
 
@@ -220,25 +585,126 @@ public:
    * @return true if the socket was created and task was started, false otherwise.
    */
   bool start_receiving(Task::Config &task_config, const ReceiveConfig &receive_config) {
-    if (task_ && task_->is_started()) {
+    if ((task_ && task_->is_started()) || reactor_) {
       logger_.error("Server is alrady receiving");
       return false;
     }
+    if (!bind_receive(receive_config)) {
+      return false;
+    }
+    // set the callback function
+    using namespace std::placeholders;
+    task_config.callback = std::bind(&UdpSocket::server_task_function, this, _1, _2);
+    // start the thread
+    task_ = Task::make_unique(task_config);
+    task_->start();
+    return true;
+  }
+
+  /**
+   * @brief Configure a server socket and register it with \p reactor, which
+   *        then receives and handles the data coming in on the socket, instead
+   *        of starting a task for the socket.
+   *
+   * @param reactor Reactor which calls the receive callback; it must outlive
+   *        the socket.
+   * @param receive_config ReceiveConfig struct with socket and callback info.
+   * @return true if the socket was created and registered, false otherwise.
+   */
+  bool start_receiving(Reactor &reactor, const ReceiveConfig &receive_config) {
+    if ((task_ && task_->is_started()) || reactor_) {
+      logger_.error("Server is alrady receiving");
+      return false;
+    }
+    if (!bind_receive(receive_config)) {
+      return false;
+    }
+    // the socket is readable, so receive does not block
+    return add_to_reactor(reactor, std::bind(&UdpSocket::receive_and_respond, this));
+  }
+
+  /**
+   * @brief Stop receiving: close the socket and stop the receive task (or
+   *        remove the socket from its reactor). Once this returns, the
+   *        receive callback is no longer running and won't be called again,
+   *        so the objects it uses can be destroyed.
+   * @note The socket is closed, so it can't be used afterwards.
+   */
+  void stop_receiving() {
+    // we have to explicitly call cleanup here so that the server recvfrom
+    // will return and the task can stop.
+    cleanup();
+    // stop the task before the receive callback is destroyed
+    if (task_) {
+      task_->stop();
+    }
+  }
+
+protected:
+  static constexpr size_t MAX_BATCH_SIZE = 32; ///< Max number of datagrams per sendmmsg() call.
+
+  /**
+   * @brief Send datagrams with sendmmsg() where available, otherwise with
+   *        sendmsg() one at a time.
+   * @param datagrams Datagrams to send, each given as its buffers.
+   * @param address Address to send to, or nullptr if the socket is connected.
+   * @return true if all of the datagrams were sent, false otherwise.
+   */
+  bool send_datagrams(std::span<const std::span<const struct iovec>> datagrams,
+                      struct sockaddr_in *address) {
+    auto make_message = [&](std::span<const struct iovec> datagram) {
+      struct msghdr message = {};
+      message.msg_name = address;
+      message.msg_namelen = address ? sizeof(*address) : 0;
+      message.msg_iov = const_cast<struct iovec *>(datagram.data());
+      message.msg_iovlen = datagram.size();
+      return message;
+    };
+#if defined(__linux__)
+    std::array<struct mmsghdr, MAX_BATCH_SIZE> messages;
+    size_t num_sent = 0;
+    while (num_sent < datagrams.size()) {
+      size_t batch_size = std::min(datagrams.size() - num_sent, MAX_BATCH_SIZE);
+      for (size_t i = 0; i < batch_size; i++) {
+        messages[i] = {.msg_hdr = make_message(datagrams[num_sent + i]), .msg_len = 0};
+      }
+      int num_messages_sent = sendmmsg(socket_, messages.data(), batch_size, 0);
+      if (num_messages_sent < 0) {
+        logger_.error("Error occurred during sending: {} - '{}'", errno, strerror(errno));
+        return false;
+      }
+      num_sent += num_messages_sent;
+    }
+#else
+    for (const auto &datagram : datagrams) {
+      auto message = make_message(datagram);
+      if (sendmsg(socket_, &message, 0) < 0) {
+        logger_.error("Error occurred during sending: {} - '{}'", errno, strerror(errno));
+        return false;
+      }
+    }
+#endif
+    logger_.debug("Client sent {} datagrams", datagrams.size());
+    return true;
+  }
+
+  /**
+   * @brief Bind the socket to the port (and multicast group) in the
+   *        receive_config, and store its receive callback.
+   * @param receive_config ReceiveConfig struct with socket and callback info.
+   * @return true if the socket was bound.
+   */
+  bool bind_receive(const ReceiveConfig &receive_config) {
     if (!is_valid()) {
       logger_.error("Socket invalid, cannot start receiving.");
       return false;
     }
     server_receive_callback_ = receive_config.on_receive_callback;
+    // allocate the receive buffers once, rather than for each datagram
+    server_batch_ = std::make_unique<ReceiveBatch>(receive_config.max_batch_size,
+                                                   receive_config.buffer_size);
     // bind
-    struct sockaddr_in server_addr;
-    // configure the server socket accordingly - assume IPV4 and bind to the
-    // any address "0.0.0.0"
-    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    server_addr.sin_family = address_family_;
-    server_addr.sin_port = htons(receive_config.port);
-    int err = bind(socket_, (struct sockaddr *)&server_addr, sizeof(server_addr));
-    if (err < 0) {
-      logger_.error("Unable to bind: {} - '{}'", errno, strerror(errno));
+    if (!bind(receive_config.port)) {
       return false;
     }
     if (receive_config.is_multicast_endpoint) {
@@ -254,66 +720,80 @@ public:
         return false;
       }
     }
-    // set the callback function
-    using namespace std::placeholders;
-    task_config.callback =
-        std::bind(&UdpSocket::server_task_function, this, receive_config.buffer_size, _1, _2);
-    // start the thread
-    task_ = Task::make_unique(task_config);
-    task_->start();
     return true;
   }
 
-protected:
   /**
    * @brief Function run in the task_ when start_receiving is called.
    *        Continuously receive data on the socket, pass the received data to
    *        the registered callback function (registered in start_receiving in
    *        the ReceiveConfig struct), and optionally respond to the sender if
    *        the registered callback returns data.
-   * @param buffer_size number of bytes of receive buffer allowed.
    * @param m std::mutex provided from the task for use with the
    *          condition_variable (cv)
    * @param cv std::condition_variable from the task for allowing
    *           interruptible wait / delay.
    * @return Return true if the task should stop; false if it should continue.
    */
-  bool server_task_function(size_t buffer_size, std::mutex &m, std::condition_variable &cv) {
-    // receive data
-    std::vector<uint8_t> received_data;
-    Socket::Info sender_info;
-    if (!receive(buffer_size, received_data, sender_info)) {
+  bool server_task_function(std::mutex &m, std::condition_variable &cv) {
+    if (!receive_and_respond()) {
       // if we failed to receive, then likely we should delay a little bit
       using namespace std::chrono_literals;
       std::unique_lock<std::mutex> lk(m);
       cv.wait_for(lk, 1ms);
+    }
+    // don't want to stop the task
+    return false;
+  }
+
+  /**
+   * @brief Receive the datagrams waiting on the socket (up to
+   *        ReceiveConfig::max_batch_size), pass each of them to the registered
+   *        callback function, and respond to the sender if the callback
+   *        returns data.
+   * @return false if nothing was received, true otherwise.
+   */
+  bool receive_and_respond() {
+    // receive data
+    if (receive_batch(*server_batch_) <= 0) {
       return false;
     }
     if (!server_receive_callback_) {
       logger_.error("Server receive callback is invalid");
-      return false;
-    }
-    // callback
-    auto maybe_response = server_receive_callback_(received_data, sender_info);
-    // send if callback returned data
-    if (!maybe_response.has_value()) {
-      return false;
+      return true;
     }
-    auto response = maybe_response.value();
-    // sendto
-    logger_.info("Server responding to {} with message of length {}", sender_info, response.size());
-    auto sender_address = sender_info.ipv4_ptr();
-    int num_bytes_sent = sendto(socket_, response.data(), response.size(), 0,
-                                (struct sockaddr *)sender_address, sizeof(*sender_address));
-    if (num_bytes_sent < 0) {
-      logger_.error("Error occurred responding: {} - '{}'", errno, strerror(errno));
+    for (size_t i = 0; i < server_batch_->size(); i++) {
+      auto datagram = server_batch_->data(i);
+      auto &sender_info = server_batch_->senders_[i];
+      // the callback takes a vector, which is reused so that it only
+      // allocates if the callback takes its data
+      server_received_data_.assign(datagram.begin(), datagram.end());
+      // callback
+      auto maybe_response = server_receive_callback_(server_received_data_, sender_info);
+      // send if callback returned data
+      if (!maybe_response.has_value()) {
+        continue;
+      }
+      const auto &response = maybe_response.value();
+      // sendto
+      logger_.info("Server responding to {} with message of length {}", sender_info,
+                   response.size());
+      auto sender_address = sender_info.ipv4_ptr();
+      int num_bytes_sent = sendto(socket_, response.data(), response.size(), 0,
+                                  (struct sockaddr *)sender_address, sizeof(*sender_address));
+      if (num_bytes_sent < 0) {
+        logger_.error("Error occurred responding: {} - '{}'", errno, strerror(errno));
+      }
+      logger_.info("Server responded with {} bytes", num_bytes_sent);
     }
-    logger_.info("Server responded with {} bytes", num_bytes_sent);
-    // don't want to stop the task
-    return false;
+    return true;
   }
 
+  bool connected_{false};
+  Socket::Info remote_info_;
   std::unique_ptr<Task> task_;
   receive_callback_fn server_receive_callback_;
+  std::unique_ptr<ReceiveBatch> server_batch_;
+  std::vector<uint8_t> server_received_data_;
 };
 } // namespace espp